@@ -21,6 +21,7 @@ Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA.
 
 #include "AbstractAudioReader.h"
 #include "SFAudioReader.h"
+#include "TMappedAudioReader.h"
 #include "WPAudioReader.h"
 
 #include "Utils.h"
@@ -121,7 +122,10 @@ AbstractAudioReader* AbstractAudioReader::create_audio_reader(const QString& fil
 {
     AbstractAudioReader* newReader = nullptr;
 
-    if (SFAudioReader::can_decode(filename)) {
+    // Uncompressed files are read straight from a memory mapping when possible
+    if (TMappedAudioReader::can_decode(filename)) {
+        newReader = new TMappedAudioReader(filename);
+    } else if (SFAudioReader::can_decode(filename)) {
         newReader = new SFAudioReader(filename);
     } else if (WPAudioReader::can_decode(filename)) {
         newReader = new WPAudioReader(filename);
@@ -145,6 +149,41 @@ DecodeBuffer::DecodeBuffer()
     destination = nullptr;
     readBuffer = nullptr;
     m_channels = destinationBufferSize = readBufferSize = 0;
+    m_ownDestination = nullptr;
+    m_ownDestinationSize = m_ownChannels = 0;
+    m_isExternalDestination = false;
+}
+
+
+void DecodeBuffer::set_external_destination(audio_sample_t** buffers, uint size, uint channels)
+{
+    Q_ASSERT(buffers);
+
+    if (!m_isExternalDestination) {
+        m_ownDestination = destination;
+        m_ownDestinationSize = destinationBufferSize;
+        m_ownChannels = m_channels;
+        m_isExternalDestination = true;
+    }
+
+    destination = buffers;
+    destinationBufferSize = size;
+    m_channels = channels;
+}
+
+
+void DecodeBuffer::reset_destination()
+{
+    if (!m_isExternalDestination) {
+        return;
+    }
+
+    destination = m_ownDestination;
+    destinationBufferSize = m_ownDestinationSize;
+    m_channels = m_ownChannels;
+    m_ownDestination = nullptr;
+    m_ownDestinationSize = m_ownChannels = 0;
+    m_isExternalDestination = false;
 }
 
 
@@ -166,6 +205,12 @@ void DecodeBuffer::check_buffers_capacity(uint size, uint channels)
     }*/
 
 
+    if (destinationBufferSize < size || m_channels < channels) {
+
+        // Never resize memory we don't own, fall back to our own buffers
+        reset_destination();
+    }
+
     if (destinationBufferSize < size || m_channels < channels) {
 
         delete_destination_buffers();
@@ -193,6 +238,8 @@ void DecodeBuffer::check_buffers_capacity(uint size, uint channels)
 
 void DecodeBuffer::delete_destination_buffers()
 {
+    reset_destination();
+
     if (destination) {
         for (uint chan = 0; chan < m_channels; chan++) {
             delete [] destination[chan];
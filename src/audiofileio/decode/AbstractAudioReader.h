@@ -37,6 +37,13 @@ public:
 	}
 	
 	void check_buffers_capacity(uint size, uint channels);
+
+	// Let the decoders write straight into memory owned by someone else,
+	// e.g. QueueBufferSlot buffers. If a read needs more capacity then
+	// available our own buffers are used again, so compare destination
+	// with the external buffers after reading!
+	void set_external_destination(audio_sample_t** buffers, uint size, uint channels);
+	void reset_destination();
 	
 	audio_sample_t** destination;
 	audio_sample_t* readBuffer;
@@ -45,6 +52,11 @@ public:
 
 private:
 	uint m_channels;
+
+	audio_sample_t** m_ownDestination;
+	uint m_ownDestinationSize;
+	uint m_ownChannels;
+	bool m_isExternalDestination;
 	
 	void delete_destination_buffers();
 	void delete_readbuffer();
@@ -71,6 +83,8 @@ public:
 	
     bool is_valid() {return (m_channels > 0 && m_fileFrames > 0);}
 	virtual QString decoder_type() const = 0;
+	// True for formats that need to be decoded, e.g. mp3, vorbis, flac and wavpack
+	virtual bool is_compressed() const {return false;}
 	virtual void clear_buffers() {}
 	
     static AbstractAudioReader* create_audio_reader(const QString& filename);
@@ -28,6 +28,7 @@ Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA.
 #include <QFile>
 #include <QString>
 #include "Utils.h"
+#include "TSampleConverter.h"
 
 #include "FLAC/export.h"
 
@@ -56,6 +57,7 @@ class FlacPrivate
 			bufferSize = 0;
 			bufferUsed = 0;
 			bufferStart = 0;
+			blockFrames = 0;
 			open(filename);
 		}
 		
@@ -166,6 +168,8 @@ class FlacPrivate
 		int		bufferSize;
 		int		bufferUsed;
 		int		bufferStart;
+		// The decoded block is stored planar, channel c starts at c * blockFrames
+		int		blockFrames;
 		
 	protected:
 #ifdef LEGACY_FLAC
@@ -208,7 +212,6 @@ FLAC__StreamDecoderWriteStatus FlacPrivate::write_callback(const FLAC__StreamDec
 	FlacPrivate *fp = (FlacPrivate*)client_data;
 	
 	uint		c;
-	nframes_t	pos = 0;
 	nframes_t	frames = frame->header.blocksize;
 	
 	if (fp->bufferUsed > 0) {
@@ -224,14 +227,14 @@ FLAC__StreamDecoderWriteStatus FlacPrivate::write_callback(const FLAC__StreamDec
 		fp->bufferSize = frames * frame->header.channels;
 	}
 	
-	for (nframes_t i=0; i < frames; i++) {
-		// in FLAC channel 0 is left, 1 is right
-		for (c=0; c < frame->header.channels; c++) {
-			audio_sample_t value = (audio_sample_t)((float)buffer[c][i] / (float)((uint)1<<(frame->header.bits_per_sample-1)));
-			fp->internalBuffer[pos++] = value;
-		}
+	float scale = TSampleConverter::int32_scale(frame->header.bits_per_sample);
+	
+	// in FLAC channel 0 is left, 1 is right
+	for (c=0; c < frame->header.channels; c++) {
+		TSampleConverter::int32_to_float(fp->internalBuffer + c * frames, buffer[c], 1, frames, scale);
 	}
 	
+	fp->blockFrames = frames;
 	fp->bufferUsed = frames * frame->header.channels;
 	
 	return FLAC__STREAM_DECODER_WRITE_STATUS_CONTINUE;
@@ -558,23 +561,9 @@ nframes_t FlacAudioReader::read_private(DecodeBuffer* buffer, nframes_t frameCou
 		
 		framesAvailable = (m_flac->bufferUsed - m_flac->bufferStart) / get_num_channels() ;
 		framesToCopy = (frameCount - framesCoppied < framesAvailable) ? frameCount - framesCoppied : framesAvailable;
-		switch (get_num_channels()) {
-			case 1:
-				memcpy(buffer->destination[0] + framesCoppied, m_flac->internalBuffer + m_flac->bufferStart, framesToCopy * sizeof(audio_sample_t));
-				break;
-			case 2:
-				for (nframes_t i = 0; i < framesToCopy; i++) {
-					buffer->destination[0][framesCoppied + i] = m_flac->internalBuffer[m_flac->bufferStart + i * 2];
-					buffer->destination[1][framesCoppied + i] = m_flac->internalBuffer[m_flac->bufferStart + i * 2 + 1];
-				}
-				break;
-			default:
-				for (nframes_t i = 0; i < framesToCopy; i++) {
-                    for (uint c = 0; c < get_num_channels(); c++) {
-						buffer->destination[c][framesCoppied + i] = m_flac->internalBuffer[m_flac->bufferStart + i * get_num_channels() + c];
-					}
-				}
-				break;
+		nframes_t frameOffset = m_flac->bufferStart / get_num_channels();
+		for (uint c = 0; c < get_num_channels(); c++) {
+			memcpy(buffer->destination[c] + framesCoppied, m_flac->internalBuffer + c * m_flac->blockFrames + frameOffset, framesToCopy * sizeof(audio_sample_t));
 		}
 		
 		if(framesToCopy == framesAvailable) {
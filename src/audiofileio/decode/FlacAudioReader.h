@@ -34,6 +34,7 @@ public:
 	~FlacAudioReader();
 	
 	QString decoder_type() const {return "flac";}
+	bool is_compressed() const {return true;}
 	void clear_buffers();
 
 	static bool can_decode(const QString &filename);
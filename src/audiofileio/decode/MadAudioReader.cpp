@@ -27,6 +27,8 @@ Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA.
 #include <QVector>
 
 #include "Utils.h"
+#include "TSampleConverter.h"
+#include "TSeekIndex.h"
 
 RELAYTOOL_MAD;
 
@@ -276,6 +278,24 @@ bool K3bMad::inputSeek(qint64 pos)
 }
 
 
+bool K3bMad::seekFrame(qint64 pos)
+{
+    if (!m_inputFile.isOpen() || !m_madStructuresInitialized || !m_inputFile.seek(pos)) {
+        return false;
+    }
+
+    // reset the stream to make sure mad really starts decoding at our seek position,
+    // the overlap and synth filter state is restored by decoding the preroll frames
+    mad_stream_finish(madStream);
+    mad_stream_init(madStream);
+    mad_frame_mute(madFrame);
+    mad_synth_mute(madSynth);
+    m_bInputError = false;
+
+    return true;
+}
+
+
 void K3bMad::initMad()
 {
     if (!m_madStructuresInitialized) {
@@ -414,7 +434,7 @@ public:
 
     K3bMad* handle{};
 
-    QVector<unsigned long long> seekPositions;
+    TSeekIndex* seekIndex{};
 
     bool bOutputFinished{};
 
@@ -437,30 +457,46 @@ MadAudioReader::MadAudioReader(const QString& filename)
 {
     d = new MadDecoderPrivate();
     d->handle = new K3bMad();
+    d->seekIndex = new TSeekIndex(filename, "mp3");
 
     initDecoderInternal();
 
-    m_nframes = countFrames();
+    // The seek index holds the stream info too, scanning the file is only
+    // needed when there is no (up to date) index yet
+    if (d->seekIndex->load()) {
+        m_nframes = d->seekIndex->get_frames();
+        m_channels = d->seekIndex->get_channels();
+        m_rate = d->seekIndex->get_rate();
+    } else {
+        m_nframes = countFrames();
+
+        switch( d->firstHeader.mode ) {
+            case MAD_MODE_SINGLE_CHANNEL:
+                m_channels = 1;
+                break;
+            case MAD_MODE_DUAL_CHANNEL:
+            case MAD_MODE_JOINT_STEREO:
+            case MAD_MODE_STEREO:
+                m_channels = 2;
+        }
 
-    switch( d->firstHeader.mode ) {
-        case MAD_MODE_SINGLE_CHANNEL:
-            m_channels = 1;
-            break;
-        case MAD_MODE_DUAL_CHANNEL:
-        case MAD_MODE_JOINT_STEREO:
-        case MAD_MODE_STEREO:
-            m_channels = 2;
+        m_rate = d->firstHeader.samplerate;
+
+        if (m_nframes > 0) {
+            d->seekIndex->set_stream_info(m_channels, m_rate, m_nframes);
+            d->seekIndex->save();
+        }
     }
 
     if (m_nframes <= 0) {
         d->handle->cleanup();
         delete d->handle;
+        delete d->seekIndex;
         delete d;
         d = nullptr;
         return;
     }
 
-    m_rate = d->firstHeader.samplerate;
     m_length = TTimeRef(m_nframes, m_rate);
 
     d->overflowBuffers = nullptr;
@@ -478,6 +514,7 @@ MadAudioReader::~MadAudioReader()
         d->handle->cleanup();
         delete d->handle;
         d->handle = nullptr;
+        delete d->seekIndex;
         MadAudioReader::clear_buffers();
         delete d;
         d = nullptr;
@@ -593,88 +630,89 @@ bool MadAudioReader::seek_private(nframes_t start)
     if (start >= m_nframes) {
         return false;
     }
-    printf("start %d\n", start);
 
-    //
-    // we need to reset the complete mad stuff
-    //
-    if (!initDecoderInternal()) {
+    int frame = d->seekIndex->find(start);
+    if (frame < 0) {
         return false;
     }
 
-    //
-    // search a position
-    // This is all hacking, I don't really know what I am doing here... ;)
-    //
-    double mp3FrameSecs = static_cast<double>(d->firstHeader.duration.seconds) + static_cast<double>(d->firstHeader.duration.fraction) / static_cast<double>(MAD_TIMER_RESOLUTION);
+    const TSeekIndex::Entry& entry = d->seekIndex->at(frame);
+    uint preroll = qMin(entry.preroll, uint(frame));
 
-    double posSecs = static_cast<double>(start) / m_rate;
+    // Only reopen the file if needed, e.g. after countFrames() closed it
+    if (!d->handle->seekFrame(d->seekIndex->at(frame - preroll).offset)) {
+        if (!initDecoderInternal() || !d->handle->seekFrame(d->seekIndex->at(frame - preroll).offset)) {
+            return false;
+        }
+    }
 
-    // seekPosition to seek after frame i
-    unsigned int frame = static_cast<unsigned int>(posSecs / mp3FrameSecs);
-    nframes_t frameOffset = (nframes_t)(start - (frame * mp3FrameSecs * m_rate + 0.5));
+    d->bOutputFinished = false;
 
-    // K3b source: Rob said: 29 frames is the theoretically max frame reservoir limit
-    // (whatever that means...) it seems that mad needs at most 29 frames to get ready
-    //
-    // Ben says: It looks like Rob (the author of MAD) implies here:
-    //    http://www.mars.org/mailman/public/mad-dev/2001-August/000321.html
-    // that 3 frames (1 + 2 extra) is enough... much faster, and seems to work fine...
-    unsigned int frameReservoirProtect = (frame > 3 ? 3 : frame);
+    // Restore the bit reservoir and the overlap and synth filter state
+    if (!decodePrerollFrames(preroll)) {
+        return false;
+    }
+
+    d->overflowStart = 0;
+    d->overflowSize = 0;
+
+    // Seek to exact traverso frame, within this mp3 frame
+    nframes_t frameOffset = nframes_t(start - entry.frame);
+
+    if (frameOffset > 0) {
+        if (!d->handle->decodeNextFrame()) {
+            return false;
+        }
+        mad_synth_frame( d->handle->madSynth, d->handle->madFrame );
+
+        d->outputBuffers = nullptr; // Zeros so that we write to overflow
+        d->outputSize = 0;
+        d->outputPos = 0;
+        createPcmSamples(d->handle->madSynth);
 
-    frame -= frameReservoirProtect;
+        if (d->overflowSize < frameOffset) {
+            d->overflowSize = 0;
+            return false;
+        }
 
-    // seek in the input file behind the already decoded data
-    d->handle->inputSeek( d->seekPositions[frame] );
+        d->overflowStart = frameOffset;
+        d->overflowSize -= frameOffset;
+    }
 
-    // decode some frames ignoring MAD_ERROR_BADDATAPTR errors
-    unsigned int i = 1;
-    while (i <= frameReservoirProtect) {
-        d->handle->fillStreamBuffer();
+    return true;
+}
+
+
+/**
+ * Decodes count frames ignoring MAD_ERROR_BADDATAPTR errors, which are expected
+ * as long as the bit reservoir isn't filled. Only the last frame is synthesized
+ */
+bool MadAudioReader::decodePrerollFrames(uint count)
+{
+    uint i = 1;
+    while (i <= count) {
+        if (!d->handle->fillStreamBuffer()) {
+            return false;
+        }
         if (mad_frame_decode( d->handle->madFrame, d->handle->madStream)) {
             if (MAD_RECOVERABLE( d->handle->madStream->error)) {
-                if (d->handle->madStream->error == MAD_ERROR_BUFLEN) {
+                if (d->handle->madStream->error != MAD_ERROR_BADDATAPTR) {
+                    // MAD_ERROR_BUFLEN or a broken frame, the next try decodes the same or the next frame
                     continue;
                 }
-                else if (d->handle->madStream->error != MAD_ERROR_BADDATAPTR) {
-                    //kdDebug() << "(K3bMadDecoder) Seeking: recoverable mad error ("
-                    //<< mad_stream_errorstr(d->handle->madStream) << ")" << endl;
-                    continue;
-                }
-                else {
-                    //kdDebug() << "(K3bMadDecoder) Seeking: ignoring ("
-                    //<< mad_stream_errorstr(d->handle->madStream) << ")" << endl;
-                }
             }
             else {
                 return false;
             }
         }
 
-        if (i == frameReservoirProtect) {  // synth only the last frame (Rob said so ;)
+        if (i == count) {  // synth only the last frame (Rob said so ;)
             mad_synth_frame( d->handle->madSynth, d->handle->madFrame );
         }
 
         ++i;
     }
 
-    d->overflowStart = 0;
-    d->overflowSize = 0;
-
-    // Seek to exact traverso frame, within this mp3 frame
-    if (frameOffset > 0) {
-        //printf("seekOffset: %lu (start: %lu)\n", frameOffset, start);
-        d->outputBuffers = nullptr; // Zeros so that we write to overflow
-        d->outputSize = 0;
-        d->outputPos = 0;
-        createPcmSamples(d->handle->madSynth);
-        d->overflowStart = frameOffset;
-        if(d->overflowSize < frameOffset) {
-            printf("frameoffset: %d, overflowsize: %d, frame: %d, start %d\n", frameOffset, d->overflowSize, frame, start);
-        }
-        d->overflowSize -= frameOffset;
-    }
-
     return true;
 }
 
@@ -708,30 +746,59 @@ unsigned long MadAudioReader::countFrames()
     d->vbr = false;
     bool bFirstHeaderSaved = false;
 
-    d->seekPositions.clear();
+    d->seekIndex->clear();
+
+    // Size of the main data of each frame, to find out how many frames
+    // the bit reservoir of a frame reaches back
+    QVector<int> mainDataSizes;
+    uint previousReservoirFrames = 0;
 
     while (!error && d->handle->findNextHeader()) {
+        const mad_header& header = d->handle->madFrame->header;
+        const mad_stream* stream = d->handle->madStream;
+
         if (!bFirstHeaderSaved) {
             bFirstHeaderSaved = true;
-            d->firstHeader = d->handle->madFrame->header;
+            d->firstHeader = header;
         }
-        else if (d->handle->madFrame->header.bitrate != d->firstHeader.bitrate) {
+        else if (header.bitrate != d->firstHeader.bitrate) {
             d->vbr = true;
         }
+
         //
         // position in stream: position in file minus the not yet used buffer
         //
-        unsigned long long seekPos = d->handle->inputPos() -
-        (d->handle->madStream->bufend - d->handle->madStream->this_frame + 1);
+        qint64 seekPos = d->handle->inputPos() - (stream->bufend - stream->this_frame);
+
+        // Layer III side info starts with main_data_begin, the amount of bytes
+        // of the previous frames the main data of this frame starts with
+        bool lsf = header.flags & MAD_FLAG_LSF_EXT;
+        bool mono = header.mode == MAD_MODE_SINGLE_CHANNEL;
+        int sideInfoSize = lsf ? (mono ? 9 : 17) : (mono ? 17 : 32);
+        const unsigned char* sideInfo = stream->this_frame + 4 + ((header.flags & MAD_FLAG_PROTECTION) ? 2 : 0);
+        int mainDataBegin = lsf ? sideInfo[0] : ((sideInfo[0] << 1) | (sideInfo[1] >> 7));
+        int frameSize = int(stream->next_frame - stream->this_frame);
+        int headerSize = int(sideInfo - stream->this_frame) + sideInfoSize;
+        mainDataSizes.append(qMax(0, frameSize - headerSize));
+
+        uint frameIndex = uint(mainDataSizes.size() - 1);
+        uint reservoirFrames = 0;
+        for (int available = 0; available < mainDataBegin && reservoirFrames < frameIndex; ++reservoirFrames) {
+            available += mainDataSizes.at(int(frameIndex - reservoirFrames - 1));
+        }
+
+        // The previous frame has to be decoded properly too, it holds the overlap
+        // for this frame, so it's bit reservoir has to be available as well
+        uint preroll = frameIndex ? qMax(reservoirFrames, previousReservoirFrames + 1) : 0;
+        previousReservoirFrames = reservoirFrames;
+
+        d->seekIndex->append(qint64(frames), seekPos, qMin(preroll, frameIndex));
 
-        // save the number of bytes to be read to decode i-1 frames at position i
-        // in other words: when seeking to seekPos the next decoded frame will be i
-        d->seekPositions.append(seekPos);
+        frames += 32 * MAD_NSBSAMPLES(&header);
     }
 
-    if (!d->handle->inputError() && !error) {
-        frames =  d->firstHeader.samplerate * (d->handle->madTimer->seconds + (unsigned long)(
-            (float)d->handle->madTimer->fraction/(float)MAD_TIMER_RESOLUTION));
+    if (d->handle->inputError() || error) {
+        frames = 0;
     }
 
     d->handle->cleanup();
@@ -808,7 +875,6 @@ bool MadAudioReader::createPcmSamples(mad_synth* synth)
     int		offset = d->outputPos;
     nframes_t	nframes = synth->pcm.length;
     bool		overflow = false;
-    nframes_t	i;
 
     if (!d->overflowBuffers) {
         create_buffers();
@@ -830,34 +896,38 @@ bool MadAudioReader::createPcmSamples(mad_synth* synth)
         nframes = m_nframes - (m_readPos + offset);
     }
 
-    // now create the output
-    for (i = 0; i < nframes; i++) {
-        if (overflow == false && d->outputPos + i >= d->outputSize) {
-            writeBuffers = d->overflowBuffers;
-            offset = 0 - i;
-            overflow = true;
-        }
+    // now create the output, what doesn't fit in the output buffers goes to the overflow buffers
+    nframes_t outputFrames = 0;
+    if (!overflow && d->outputPos < d->outputSize) {
+        outputFrames = qMin(nframes, d->outputSize - d->outputPos);
+    }
 
-        /* Left channel */
-        writeBuffers[0][offset + i] = mad_f_todouble(synth->pcm.samples[0][i]);
+    // mad_fixed_t samples have MAD_F_FRACBITS fraction bits, see mad_f_todouble()
+    const float scale = 1.0f / float(1L << MAD_F_FRACBITS);
 
-        /* Right channel. If the decoded stream is monophonic then no right channel
-        */
-        if (synth->pcm.channels == 2) {
-            // FIXME Array access results in undefined pointer dereference according to clang clazy
-            writeBuffers[1][offset + i] = mad_f_todouble(synth->pcm.samples[1][i]);
+    for (int chan = 0; chan < synth->pcm.channels; chan++) {
+        /* Left channel, the right channel only if the decoded stream isn't monophonic */
+        TSampleConverter::int32_to_float(writeBuffers[chan] + offset, synth->pcm.samples[chan], 1, outputFrames, scale);
+        if (outputFrames < nframes) {
+            audio_sample_t* overflowBuffer = d->overflowBuffers[chan] + (overflow ? offset : 0);
+            TSampleConverter::int32_to_float(overflowBuffer, synth->pcm.samples[chan] + outputFrames, 1, nframes - outputFrames, scale);
         }
-    } // pcm conversion
+    }
 
     if (overflow) {
-        d->overflowSize = i + offset;
+        d->overflowSize = nframes + offset;
+        d->overflowStart = 0;
+        d->outputPos -= offset;
+    }
+    else if (outputFrames < nframes) {
+        d->overflowSize = nframes - outputFrames;
         d->overflowStart = 0;
-        d->outputPos -= offset; // i was stored here when we switched to writing to overflow
-        //printf("written: %d (overflow: %u)\n",  nframes - d->overflowSize, d->overflowSize);
+        d->outputPos += outputFrames;
+        //printf("written: %d (overflow: %u)\n",  outputFrames, d->overflowSize);
     }
     else {
-        d->outputPos += i;
-        //printf("written: %d (os=%lu)\n",  i, d->overflowSize);
+        d->outputPos += nframes;
+        //printf("written: %d (os=%lu)\n",  nframes, d->overflowSize);
     }
 
     return true;
@@ -74,6 +74,12 @@ public:
     qint64 streamPos() const;
     bool inputSeek(qint64 pos);
 
+    /**
+     * Seek to the frame starting at byte position pos and reset
+     * the decoder state, returns false if the input isn't open.
+     */
+    bool seekFrame(qint64 pos);
+
     void initMad();
     void cleanup();
 
@@ -109,6 +115,7 @@ public:
         void init();
 	
 	QString decoder_type() const {return "mad";}
+	bool is_compressed() const {return true;}
 	void clear_buffers();
 	
 	static bool can_decode(const QString& filename);
@@ -120,6 +127,7 @@ protected:
 	void create_buffers();
 	bool initDecoderInternal();
 	unsigned long countFrames();
+	bool decodePrerollFrames(uint count);
 	bool createPcmSamples(mad_synth* synth);
 	
 	static int	MaxAllowedRecoverableErrors;
@@ -22,6 +22,7 @@ Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA.
 #include "ResampleAudioReader.h"
 #include <QString>
 #include <cstdio>
+#include <algorithm>
 #include <samplerate.h>
 
 #define OVERFLOW_SIZE 512
@@ -226,11 +227,13 @@ nframes_t ResampleAudioReader::read_private(DecodeBuffer* buffer, nframes_t fram
 	if (!m_resampleDecodeBuffer) {
 		m_resampleDecodeBuffer = new DecodeBuffer;
 		m_resampleDecodeBufferIsMine = true;
-	}
-
-	if (!m_resampleDecodeBuffer->destination) {
 		reset();
 	}
+
+	// DiskIO worker threads may hand us a different resample decode buffer
+	// between reads, make sure it can hold the overflow and the next read so
+	// the overflow copied below isn't lost by a reallocation in m_reader->read()
+	m_resampleDecodeBuffer->check_buffers_capacity(std::max(fileCnt + m_readExtraFrames, nframes_t(OVERFLOW_SIZE)), m_channels);
 	
     bufferUsed = nframes_t(m_overflowUsed);
 	
@@ -351,12 +354,24 @@ void ResampleAudioReader::create_overflow_buffers()
 
 void ResampleAudioReader::set_resample_decode_buffer(DecodeBuffer * buffer)
 {
+	if (buffer == m_resampleDecodeBuffer) {
+		return;
+	}
+
+	// The resample decode buffer is only used as scratch space, overflow
+	// is kept in m_overflowBuffers. So when DiskIO hands us another (worker)
+	// buffer we can swap without resetting the sample rate converter.
+	bool needsReset = (!m_resampleDecodeBuffer || m_resampleDecodeBufferIsMine);
+
 	if (m_resampleDecodeBufferIsMine && m_resampleDecodeBuffer) {
 		delete m_resampleDecodeBuffer;
 		m_resampleDecodeBufferIsMine = false;
 	}
 	m_resampleDecodeBuffer = buffer;
-	reset();
+
+	if (needsReset) {
+		reset();
+	}
 }
 
 int ResampleAudioReader::get_default_resample_quality()
@@ -41,6 +41,7 @@ public:
         return AbstractAudioReader::read_from(buffer, TTimeRef::to_frame(start, m_outputSampleRate), count);
 	}
 	QString decoder_type() const {return (m_reader) ? m_reader->decoder_type() : "";}
+	bool is_compressed() const {return (m_reader) ? m_reader->is_compressed() : false;}
 	void clear_buffers();
 	
 	uint get_output_rate();
@@ -23,6 +23,7 @@ Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA.
 #include <QString>
 
 #include "Utils.h"
+#include "TSampleConverter.h"
 // Always put me below _all_ includes, this is needed
 // in case we run with memory leak detection enabled!
 #include "Debugger.h"
@@ -66,6 +67,18 @@ SFAudioReader::~SFAudioReader()
 }
 
 
+bool SFAudioReader::is_compressed() const
+{
+	switch (m_sfinfo.format & SF_FORMAT_TYPEMASK) {
+		case SF_FORMAT_FLAC:
+		case SF_FORMAT_OGG:
+		case SF_FORMAT_MPEG:
+			return true;
+	}
+	return false;
+}
+
+
 bool SFAudioReader::can_decode(QString filename)
 {
 	SF_INFO infos;
@@ -123,25 +136,8 @@ nframes_t SFAudioReader::read_private(DecodeBuffer* buffer, nframes_t frameCount
 	int framesRead = sf_readf_float(m_sf, buffer->readBuffer, frameCount);
 	
 	// De-interlace
-	switch (m_channels) {
-        case 0:
-            return framesRead;
-		case 1:
-			memcpy(buffer->destination[0], buffer->readBuffer, framesRead * sizeof(audio_sample_t));
-            break;
-        case 2:
-            for (int f = 0; f < framesRead; f++) {
-                int pos = f*2;
-                buffer->destination[0][f] = buffer->readBuffer[pos];
-                buffer->destination[1][f] = buffer->readBuffer[pos + 1];
-            }
-            break;
-        default:
-			for (int f = 0; f < framesRead; f++) {
-                for (uint c = 0; c < m_channels; c++) {
-					buffer->destination[c][f] = buffer->readBuffer[f * m_channels + c];
-				}
-			}
+	if (framesRead > 0) {
+		TSampleConverter::deinterleave_float(buffer->destination, buffer->readBuffer, m_channels, framesRead);
 	}
 	
 	return framesRead;
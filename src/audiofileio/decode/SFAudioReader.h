@@ -34,6 +34,7 @@ public:
 	~SFAudioReader();
 	
 	QString decoder_type() const {return "sndfile";}
+	bool is_compressed() const;
 	
 	static bool can_decode(QString filename);
 
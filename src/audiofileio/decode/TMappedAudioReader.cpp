@@ -0,0 +1,472 @@
+/*
+Copyright (C) 2024 Remon Sijrier
+
+This file is part of Traverso
+
+Traverso is free software; you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation; either version 2 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program; if not, write to the Free Software
+Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA.
+
+*/
+
+
+#include "TMappedAudioReader.h"
+
+#include "TSampleConverter.h"
+#include "Utils.h"
+#include "sndfile.h"
+
+#include <QtEndian>
+
+#include <cstring>
+
+#if defined (Q_OS_UNIX)
+#include <sys/mman.h>
+#include <unistd.h>
+#endif
+
+// Always put me below _all_ includes, this is needed
+// in case we run with memory leak detection enabled!
+#include "Debugger.h"
+
+/** \class TMappedAudioReader
+ *	\brief Reads uncompressed PCM and float WAV, RF64, W64, AIFF and CAF files straight from a memory mapping
+ *
+ *	libsndfile is only used to validate the file and to get the channel count, rate, length
+ *	and sample format, the audio data location is found by walking the file's chunks. Reads
+ *	convert the samples from the mapping into the DecodeBuffer destination buffers with
+ *	TSampleConverter, big endian files are byte swapped into the DecodeBuffer read buffer first.
+ *
+ *	The kernel is told how the file is read: sequential access while reading forward with
+ *	readahead of the next READAHEAD_SIZE bytes, random access with readahead of the previous
+ *	READAHEAD_SIZE bytes while reading backward, and random access otherwise.
+ *
+ *	create_audio_reader() prefers this reader, files it can't handle, e.g. compressed, 8 bit or
+ *	double precision data, or files which can't be mapped, are read with SFAudioReader.
+ */
+
+static bool has_id(const uchar* data, const char* id)
+{
+    return memcmp(data, id, 4) == 0;
+}
+
+
+TMappedAudioReader::TMappedAudioReader(const QString& filename)
+    : AbstractAudioReader(filename)
+{
+    m_map = nullptr;
+    m_mapSize = 0;
+    m_frameSize = 0;
+    m_direction = UNKNOWN_DIRECTION;
+    m_lastReadStart = m_lastReadEnd = 0;
+    m_prefetchStart = m_prefetchEnd = 0;
+
+    m_file.setFileName(m_fileName);
+
+    if (!m_file.open(QIODevice::ReadOnly)) {
+        qWarning("TMappedAudioReader::Could not open soundfile (%s)", QS_C(m_fileName));
+        return;
+    }
+
+    m_mapSize = m_file.size();
+    if (m_mapSize > 0) {
+        m_map = m_file.map(0, m_mapSize);
+    }
+
+    if (!m_map || !probe(m_file, m_map, m_mapSize, &m_format)) {
+        return;
+    }
+
+    m_frameSize = m_format.bytesPerSample * m_format.channels;
+    m_channels = m_format.channels;
+    m_fileFrames = m_format.frames;
+    m_fileSampleRate = m_format.rate;
+    m_length = TTimeRef(m_fileFrames, m_fileSampleRate);
+}
+
+
+TMappedAudioReader::~TMappedAudioReader()
+{
+    if (m_map) {
+        m_file.unmap(const_cast<uchar*>(m_map));
+    }
+}
+
+
+bool TMappedAudioReader::can_decode(const QString& filename)
+{
+    QFile file(filename);
+
+    if (!file.open(QIODevice::ReadOnly) || file.size() <= 0) {
+        return false;
+    }
+
+    qint64 size = file.size();
+    uchar* map = file.map(0, size);
+
+    if (!map) {
+        return false;
+    }
+
+    FileFormat format;
+    bool canDecode = probe(file, map, size, &format);
+
+    file.unmap(map);
+
+    return canDecode;
+}
+
+
+bool TMappedAudioReader::seek_private(nframes_t start)
+{
+    Q_ASSERT(m_map);
+
+    return start < m_fileFrames;
+}
+
+
+nframes_t TMappedAudioReader::read_private(DecodeBuffer* buffer, nframes_t frameCount)
+{
+    Q_ASSERT(m_map);
+
+    nframes_t frames = qMin(frameCount, m_fileFrames - m_readPos);
+
+    if (frames == 0) {
+        return 0;
+    }
+
+    update_access_pattern(m_readPos, frames);
+
+    const uchar* data = m_map + m_format.dataOffset + qint64(m_readPos) * m_frameSize;
+    const char* samples = swap_to(buffer, data, frames);
+
+    for (uint chan = 0; chan < m_channels; ++chan) {
+        const char* channelSamples = samples + chan * m_format.bytesPerSample;
+        audio_sample_t* destination = buffer->destination[chan];
+
+        switch (m_format.sampleFormat) {
+        case FLOAT32:
+            TSampleConverter::float_to_float(destination, 1, reinterpret_cast<const float*>(channelSamples), m_channels, frames);
+            break;
+        case INT16:
+            TSampleConverter::int16_to_float(destination, reinterpret_cast<const int16_t*>(channelSamples), m_channels, frames);
+            break;
+        case INT24:
+            TSampleConverter::int24_to_float(destination, channelSamples, m_channels, frames);
+            break;
+        case INT32:
+            TSampleConverter::int32_to_float(destination, reinterpret_cast<const int32_t*>(channelSamples), m_channels, frames, TSampleConverter::int32_scale(32));
+            break;
+        case INVALID_FORMAT:
+            return 0;
+        }
+    }
+
+    return frames;
+}
+
+
+/**
+ *	Returns \a data if the samples can be converted from the mapping directly,
+ *	otherwise the byte swapped samples are stored in the read buffer of \a buffer.
+ *	TSampleConverter expects host endian 16 and 32 bit samples, and 24 bit samples
+ *	in little endian byte order.
+ */
+const char* TMappedAudioReader::swap_to(DecodeBuffer* buffer, const uchar* data, nframes_t frames)
+{
+    bool needsSwap = (m_format.sampleFormat == INT24) ?
+                m_format.bigEndian : (m_format.bigEndian != (Q_BYTE_ORDER == Q_BIG_ENDIAN));
+
+    if (!needsSwap) {
+        return reinterpret_cast<const char*>(data);
+    }
+
+    // The read buffer holds frames * channels 4 byte samples, large enough for all formats
+    uchar* swapped = reinterpret_cast<uchar*>(buffer->readBuffer);
+    uint bytes = m_format.bytesPerSample;
+    qint64 count = qint64(frames) * m_channels;
+
+    for (qint64 i = 0; i < count; ++i) {
+        const uchar* src = data + i * bytes;
+        uchar* dst = swapped + i * bytes;
+        for (uint b = 0; b < bytes; ++b) {
+            dst[b] = src[bytes - 1 - b];
+        }
+    }
+
+    return reinterpret_cast<const char*>(swapped);
+}
+
+
+/**
+ *	Detects if the file is read forward, backward or at random from the read positions
+ *	and passes the access pattern and readahead requests on to the kernel.
+ */
+void TMappedAudioReader::update_access_pattern(nframes_t start, nframes_t count)
+{
+#if defined (Q_OS_UNIX)
+    ReadDirection direction = UNKNOWN_DIRECTION;
+
+    if (start == m_lastReadEnd) {
+        direction = FORWARD;
+    } else if (start + count == m_lastReadStart) {
+        direction = REVERSE;
+    }
+
+    m_lastReadStart = start;
+    m_lastReadEnd = start + count;
+
+    // A read after a seek has no direction yet, keep the advice of the last established
+    // direction for the map and only restart the readahead window
+    if (direction == UNKNOWN_DIRECTION) {
+        m_prefetchStart = m_prefetchEnd = 0;
+    } else if (direction != m_direction) {
+        m_direction = direction;
+        m_prefetchStart = m_prefetchEnd = 0;
+        advise(0, m_mapSize, direction == FORWARD ? MADV_SEQUENTIAL : MADV_RANDOM);
+    }
+
+    qint64 readStart = m_format.dataOffset + qint64(start) * m_frameSize;
+    qint64 readEnd = readStart + qint64(count) * m_frameSize;
+
+    // Always fault in the range read right now in one go, the first read after a seek
+    // is the latency critical resync refill and must not fault in page by page
+    advise(readStart, readEnd - readStart, MADV_WILLNEED);
+
+    // Request the next readahead window once half of the current one has been read
+    if (direction == FORWARD && readEnd > m_prefetchEnd - READAHEAD_SIZE / 2) {
+        m_prefetchStart = qMax(readStart, m_prefetchEnd);
+        m_prefetchEnd = qMin(readEnd + READAHEAD_SIZE, m_mapSize);
+        advise(m_prefetchStart, m_prefetchEnd - m_prefetchStart, MADV_WILLNEED);
+    } else if (direction == REVERSE && (m_prefetchEnd == 0 || readStart < m_prefetchStart + READAHEAD_SIZE / 2)) {
+        m_prefetchEnd = (m_prefetchEnd == 0) ? readEnd : qMin(readEnd, m_prefetchStart);
+        m_prefetchStart = qMax(readStart - READAHEAD_SIZE, m_format.dataOffset);
+        advise(m_prefetchStart, m_prefetchEnd - m_prefetchStart, MADV_WILLNEED);
+    }
+#else
+    Q_UNUSED(start);
+    Q_UNUSED(count);
+#endif
+}
+
+
+void TMappedAudioReader::advise(qint64 offset, qint64 size, int advice)
+{
+#if defined (Q_OS_UNIX)
+    if (size <= 0) {
+        return;
+    }
+
+    // madvise() needs a page aligned address, the mapping itself starts at a page boundary
+    static const qint64 pageSize = sysconf(_SC_PAGESIZE);
+    qint64 alignedOffset = offset - (offset % pageSize);
+
+    if (madvise(const_cast<uchar*>(m_map) + alignedOffset, size_t(size + offset - alignedOffset), advice) != 0) {
+        PWARN("TMappedAudioReader: madvise failed");
+    }
+#else
+    Q_UNUSED(offset);
+    Q_UNUSED(size);
+    Q_UNUSED(advice);
+#endif
+}
+
+
+bool TMappedAudioReader::probe(QFile& file, const uchar* map, qint64 mapSize, FileFormat* format)
+{
+    SF_INFO info;
+    memset(&info, 0, sizeof(info));
+
+    SNDFILE* sndfile = sf_open_fd(file.handle(), SFM_READ, &info, false);
+
+    if (!sndfile) {
+        return false;
+    }
+
+    sf_close(sndfile);
+
+    switch (info.format & SF_FORMAT_TYPEMASK) {
+    case SF_FORMAT_WAV:
+    case SF_FORMAT_WAVEX:
+    case SF_FORMAT_RF64:
+    case SF_FORMAT_W64:
+    case SF_FORMAT_AIFF:
+    case SF_FORMAT_CAF:
+        break;
+    default:
+        return false;
+    }
+
+    switch (info.format & SF_FORMAT_SUBMASK) {
+    case SF_FORMAT_PCM_16:
+        format->sampleFormat = INT16;
+        format->bytesPerSample = 2;
+        break;
+    case SF_FORMAT_PCM_24:
+        format->sampleFormat = INT24;
+        format->bytesPerSample = 3;
+        break;
+    case SF_FORMAT_PCM_32:
+        format->sampleFormat = INT32;
+        format->bytesPerSample = 4;
+        break;
+    case SF_FORMAT_FLOAT:
+        format->sampleFormat = FLOAT32;
+        format->bytesPerSample = 4;
+        break;
+    default:
+        return false;
+    }
+
+    if (info.channels <= 0 || info.frames <= 0 || info.samplerate <= 0 || info.frames > qint64(0xffffffff)) {
+        return false;
+    }
+
+    format->channels = uint(info.channels);
+    format->rate = uint(info.samplerate);
+    format->frames = nframes_t(info.frames);
+
+    if (!find_data_chunk(map, mapSize, format)) {
+        return false;
+    }
+
+    qint64 dataSize = qint64(format->frames) * format->channels * format->bytesPerSample;
+
+    // The 16 and 32 bit samples are accessed in place
+    if (format->sampleFormat != INT24 && format->dataOffset % format->bytesPerSample != 0) {
+        return false;
+    }
+
+    return format->dataOffset + dataSize <= mapSize;
+}
+
+
+/**
+ *	Walks the chunks of the file to find the start of the audio data, and the
+ *	byte order for the AIFF and CAF formats which can store either.
+ */
+bool TMappedAudioReader::find_data_chunk(const uchar* map, qint64 mapSize, FileFormat* format)
+{
+    if (mapSize < 16) {
+        return false;
+    }
+
+    // WAV and RF64, the ds64 chunk of RF64 has a valid size so the
+    // data chunk can be found the same way
+    if ((has_id(map, "RIFF") || has_id(map, "RF64")) && has_id(map + 8, "WAVE")) {
+        qint64 pos = 12;
+        while (pos + 8 <= mapSize) {
+            quint32 size = qFromLittleEndian<quint32>(map + pos + 4);
+            if (has_id(map + pos, "data")) {
+                format->dataOffset = pos + 8;
+                format->bigEndian = false;
+                return true;
+            }
+            pos += 8 + size + (size & 1);
+        }
+        return false;
+    }
+
+    // Sony Wave64, the chunk ids are GUIDs starting with the 4 character id,
+    // the chunk sizes include the 24 byte chunk header
+    if (mapSize >= 40 && has_id(map, "riff") && has_id(map + 24, "wave")) {
+        qint64 pos = 40;
+        while (pos + 24 <= mapSize) {
+            quint64 size = qFromLittleEndian<quint64>(map + pos + 16);
+            if (has_id(map + pos, "data")) {
+                format->dataOffset = pos + 24;
+                format->bigEndian = false;
+                return true;
+            }
+            if (size < 24 || size > quint64(mapSize)) {
+                return false;
+            }
+            pos += qint64((size + 7) & ~quint64(7));
+        }
+        return false;
+    }
+
+    if (has_id(map, "FORM") && (has_id(map + 8, "AIFF") || has_id(map + 8, "AIFC"))) {
+        bool aifc = has_id(map + 8, "AIFC");
+        bool foundComm = false;
+        bool foundData = false;
+        // Plain AIFF is always big endian
+        format->bigEndian = true;
+
+        qint64 pos = 12;
+        while (pos + 8 <= mapSize && !(foundComm && foundData)) {
+            quint32 size = qFromBigEndian<quint32>(map + pos + 4);
+            const uchar* chunk = map + pos + 8;
+
+            if (has_id(map + pos, "COMM")) {
+                foundComm = true;
+                if (aifc) {
+                    if (size < 22 || pos + 8 + 22 > mapSize) {
+                        return false;
+                    }
+                    const uchar* compression = chunk + 18;
+                    if (has_id(compression, "sowt")) {
+                        format->bigEndian = false;
+                    } else if (!(has_id(compression, "NONE") || has_id(compression, "twos") ||
+                                 has_id(compression, "in24") || has_id(compression, "in32") ||
+                                 has_id(compression, "fl32") || has_id(compression, "FL32"))) {
+                        return false;
+                    }
+                }
+            } else if (has_id(map + pos, "SSND")) {
+                if (pos + 16 > mapSize) {
+                    return false;
+                }
+                foundData = true;
+                format->dataOffset = pos + 16 + qFromBigEndian<quint32>(chunk);
+            }
+
+            pos += 8 + size + (size & 1);
+        }
+        return foundComm && foundData;
+    }
+
+    if (has_id(map, "caff")) {
+        bool foundDesc = false;
+
+        qint64 pos = 8;
+        while (pos + 12 <= mapSize) {
+            qint64 size = qFromBigEndian<qint64>(map + pos + 4);
+            const uchar* chunk = map + pos + 12;
+
+            if (has_id(map + pos, "desc")) {
+                if (size < 32 || pos + 12 + 32 > mapSize || !has_id(chunk + 8, "lpcm")) {
+                    return false;
+                }
+                // kCAFLinearPCMFormatFlagIsLittleEndian
+                format->bigEndian = !(qFromBigEndian<quint32>(chunk + 12) & (1 << 1));
+                foundDesc = true;
+            } else if (has_id(map + pos, "data")) {
+                // The data starts with a 4 byte edit count
+                format->dataOffset = pos + 12 + 4;
+                return foundDesc;
+            }
+
+            // Only the data chunk, which is the last one, can have an unknown (-1) size
+            if (size < 0) {
+                return false;
+            }
+            pos += 12 + size;
+        }
+        return false;
+    }
+
+    return false;
+}
+
+//eof
@@ -0,0 +1,94 @@
+/*
+Copyright (C) 2024 Remon Sijrier
+
+This file is part of Traverso
+
+Traverso is free software; you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation; either version 2 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program; if not, write to the Free Software
+Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA.
+
+*/
+
+
+#ifndef TMAPPEDAUDIOREADER_H
+#define TMAPPEDAUDIOREADER_H
+
+#include "AbstractAudioReader.h"
+
+#include <QFile>
+
+class TMappedAudioReader : public AbstractAudioReader
+{
+public:
+    TMappedAudioReader(const QString& filename);
+    ~TMappedAudioReader();
+
+    QString decoder_type() const {return "mmap";}
+
+    static bool can_decode(const QString& filename);
+
+protected:
+    bool seek_private(nframes_t start);
+    nframes_t read_private(DecodeBuffer* buffer, nframes_t frameCount);
+
+private:
+    enum SampleFormat {
+        INVALID_FORMAT,
+        INT16,
+        INT24,
+        INT32,
+        FLOAT32
+    };
+
+    enum ReadDirection {
+        UNKNOWN_DIRECTION,
+        FORWARD,
+        REVERSE
+    };
+
+    struct FileFormat {
+        SampleFormat    sampleFormat = INVALID_FORMAT;
+        uint            bytesPerSample = 0;
+        uint            channels = 0;
+        uint            rate = 0;
+        nframes_t       frames = 0;
+        qint64          dataOffset = 0;
+        bool            bigEndian = false;
+    };
+
+    // Amount of bytes the kernel is asked to read ahead of the read position
+    static const qint64 READAHEAD_SIZE = 2 * 1024 * 1024;
+
+    QFile           m_file;
+    const uchar*    m_map;
+    qint64          m_mapSize;
+    FileFormat      m_format;
+    uint            m_frameSize;
+
+    ReadDirection   m_direction;
+    nframes_t       m_lastReadStart;
+    nframes_t       m_lastReadEnd;
+    qint64          m_prefetchStart;
+    qint64          m_prefetchEnd;
+
+    void update_access_pattern(nframes_t start, nframes_t count);
+    void advise(qint64 offset, qint64 size, int advice);
+    const char* swap_to(DecodeBuffer* buffer, const uchar* data, nframes_t frames);
+
+    static bool probe(QFile& file, const uchar* map, qint64 mapSize, FileFormat* format);
+    static bool find_data_chunk(const uchar* map, qint64 mapSize, FileFormat* format);
+};
+
+#endif
+
+//eof
@@ -0,0 +1,215 @@
+/*
+Copyright (C) 2024 Remon Sijrier
+
+This file is part of Traverso
+
+Traverso is free software; you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation; either version 2 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program; if not, write to the Free Software
+Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA.
+
+*/
+
+
+#include "TSeekIndex.h"
+
+#include <QDataStream>
+#include <QDateTime>
+#include <QFile>
+#include <QFileInfo>
+#include <QMutex>
+#include <QSaveFile>
+
+#include "Utils.h"
+
+#include <algorithm>
+
+// Always put me below _all_ includes, this is needed
+// in case we run with memory leak detection enabled!
+#include "Debugger.h"
+
+/** \class TSeekIndex
+ *	\brief Maps audio frames to byte offsets in compressed audio files
+ *
+ *	Decoders of formats without a fixed frame to byte relation (mp3, ogg vorbis) build
+ *	the index once, the first time the file is opened, which for imported files is when
+ *	the file is imported. The index is stored in the index dir, the peakfiles dir of the
+ *	current project, and reused as long as the size and modification time of the audio
+ *	file don't change. Without an index dir the index is only kept in memory.
+ *
+ *	find() does a binary search in memory, so seeking no longer needs to scan or bisect the file.
+ */
+
+static const quint32 SEEK_INDEX_MAGIC = 0x54534958; // TSIX
+static const quint32 SEEK_INDEX_VERSION = 1;
+
+static QMutex indexDirMutex;
+static QString indexDir;
+
+
+TSeekIndex::TSeekIndex(const QString& audioFileName, const QByteArray& type)
+    : m_audioFileName(audioFileName)
+    , m_type(type)
+{
+    m_channels = m_rate = 0;
+    m_frames = 0;
+}
+
+/**
+ *	Sets the directory the index files are stored in, an empty \a dir keeps the indices in memory only
+ */
+void TSeekIndex::set_index_dir(const QString& dir)
+{
+    QMutexLocker locker(&indexDirMutex);
+    indexDir = dir;
+}
+
+QString TSeekIndex::index_file_name() const
+{
+    QMutexLocker locker(&indexDirMutex);
+
+    if (indexDir.isEmpty()) {
+        return QString();
+    }
+
+    return indexDir + "/" + QFileInfo(m_audioFileName).fileName() + "-" + m_type + ".seekindex";
+}
+
+/**
+ *	Loads the stored index, returns false if there is none or if it's out of date
+ */
+bool TSeekIndex::load()
+{
+    clear();
+
+    QString fileName = index_file_name();
+    if (fileName.isEmpty()) {
+        return false;
+    }
+
+    QFile file(fileName);
+    if (!file.open(QIODevice::ReadOnly)) {
+        return false;
+    }
+
+    QFileInfo audioFileInfo(m_audioFileName);
+    QDataStream stream(&file);
+
+    quint32 magic, version;
+    QByteArray type;
+    QString audioFileName;
+    qint64 audioFileSize, audioFileModified;
+    qint32 entryCount;
+
+    stream >> magic >> version;
+    if (magic != SEEK_INDEX_MAGIC || version != SEEK_INDEX_VERSION) {
+        return false;
+    }
+
+    stream >> type >> audioFileName >> audioFileSize >> audioFileModified;
+    // Different files with the same name share the index file name
+    if (type != m_type || audioFileName != audioFileInfo.absoluteFilePath() ||
+        audioFileSize != audioFileInfo.size() ||
+        audioFileModified != audioFileInfo.lastModified().toMSecsSinceEpoch()) {
+        return false;
+    }
+
+    stream >> m_channels >> m_rate >> m_frames >> entryCount;
+    if (stream.status() != QDataStream::Ok || entryCount < 0) {
+        clear();
+        return false;
+    }
+
+    m_entries.reserve(entryCount);
+    for (qint32 i = 0; i < entryCount; ++i) {
+        Entry entry;
+        stream >> entry.frame >> entry.offset >> entry.preroll;
+        m_entries.append(entry);
+    }
+
+    if (stream.status() != QDataStream::Ok) {
+        PWARN(QString("TSeekIndex: Corrupt seek index %1").arg(fileName));
+        clear();
+        return false;
+    }
+
+    return true;
+}
+
+bool TSeekIndex::save() const
+{
+    QString fileName = index_file_name();
+    if (fileName.isEmpty()) {
+        return false;
+    }
+
+    QFileInfo audioFileInfo(m_audioFileName);
+    QSaveFile file(fileName);
+
+    if (!file.open(QIODevice::WriteOnly)) {
+        PWARN(QString("TSeekIndex: Could not create seek index %1").arg(fileName));
+        return false;
+    }
+
+    QDataStream stream(&file);
+
+    stream << SEEK_INDEX_MAGIC << SEEK_INDEX_VERSION;
+    stream << m_type << audioFileInfo.absoluteFilePath() << audioFileInfo.size() << audioFileInfo.lastModified().toMSecsSinceEpoch();
+    stream << m_channels << m_rate << m_frames << qint32(m_entries.size());
+
+    for (const Entry& entry : m_entries) {
+        stream << entry.frame << entry.offset << entry.preroll;
+    }
+
+    return file.commit();
+}
+
+void TSeekIndex::clear()
+{
+    m_entries.clear();
+    m_channels = m_rate = 0;
+    m_frames = 0;
+}
+
+/**
+ *	Appends an entry, entries must be appended in increasing \a frame order
+ */
+void TSeekIndex::append(qint64 frame, qint64 offset, quint32 preroll)
+{
+    Q_ASSERT(m_entries.isEmpty() || m_entries.last().frame <= frame);
+
+    Entry entry;
+    entry.frame = frame;
+    entry.offset = offset;
+    entry.preroll = preroll;
+    m_entries.append(entry);
+}
+
+void TSeekIndex::set_stream_info(uint channels, uint rate, qint64 frames)
+{
+    m_channels = channels;
+    m_rate = rate;
+    m_frames = frames;
+}
+
+/**
+ *	Returns the index of the last entry starting at or before \a frame, or -1 if there is none
+ */
+int TSeekIndex::find(qint64 frame) const
+{
+    auto it = std::upper_bound(m_entries.constBegin(), m_entries.constEnd(), frame,
+                               [](qint64 value, const Entry& entry) {return value < entry.frame;});
+
+    return int(it - m_entries.constBegin()) - 1;
+}
+
+//eof
@@ -0,0 +1,75 @@
+/*
+Copyright (C) 2024 Remon Sijrier
+
+This file is part of Traverso
+
+Traverso is free software; you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation; either version 2 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program; if not, write to the Free Software
+Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA.
+
+*/
+
+
+#ifndef TSEEKINDEX_H
+#define TSEEKINDEX_H
+
+#include <QByteArray>
+#include <QString>
+#include <QVector>
+
+class TSeekIndex
+{
+public:
+    struct Entry {
+        // First audio frame decoded when decoding starts at offset
+        qint64      frame;
+        // Byte offset in the audio file
+        qint64      offset;
+        // Amount of entries to decode, and throw away, before this one,
+        // e.g. to restore the mp3 bit reservoir and overlap state
+        quint32     preroll;
+    };
+
+    TSeekIndex(const QString& audioFileName, const QByteArray& type);
+
+    bool load();
+    bool save() const;
+    void clear();
+
+    void append(qint64 frame, qint64 offset, quint32 preroll = 0);
+    int find(qint64 frame) const;
+    const Entry& at(int index) const {return m_entries.at(index);}
+    int size() const {return m_entries.size();}
+    bool is_empty() const {return m_entries.isEmpty();}
+
+    void set_stream_info(uint channels, uint rate, qint64 frames);
+    uint get_channels() const {return m_channels;}
+    uint get_rate() const {return m_rate;}
+    qint64 get_frames() const {return m_frames;}
+
+    static void set_index_dir(const QString& dir);
+
+private:
+    QString         m_audioFileName;
+    QByteArray      m_type;
+    QVector<Entry>  m_entries;
+    uint            m_channels;
+    uint            m_rate;
+    qint64          m_frames;
+
+    QString index_file_name() const;
+};
+
+#endif
+
+//eof
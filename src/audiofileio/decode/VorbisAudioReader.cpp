@@ -22,7 +22,9 @@ Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA.
 #include "VorbisAudioReader.h"
 #include <QFile>
 #include <QString>
+#include <QtEndian>
 #include "Utils.h"
+#include "TSeekIndex.h"
 
 
 #ifdef _WIN32
@@ -40,6 +42,7 @@ RELAYTOOL_VORBISFILE;
 VorbisAudioReader::VorbisAudioReader(const QString& filename)
  : AbstractAudioReader(filename)
 {
+	m_seekIndex = nullptr;
 	m_file = fopen(filename.toUtf8().data(), "rb");
 	if (!m_file) {
 //		PERROR("Couldn't open file %s.", QS_C(filename));
@@ -59,6 +62,14 @@ VorbisAudioReader::VorbisAudioReader(const QString& filename)
 	m_nframes = ov_pcm_total(&m_vf, -1);
 	m_rate = m_vi->rate;
 	m_length = TTimeRef(m_nframes, m_rate);
+	
+	m_seekIndex = new TSeekIndex(filename, "ogg");
+	if (!m_seekIndex->load() || m_seekIndex->get_frames() != qint64(m_nframes)) {
+		if (build_seek_index()) {
+			m_seekIndex->set_stream_info(m_channels, m_rate, m_nframes);
+			m_seekIndex->save();
+		}
+	}
 }
 
 
@@ -67,6 +78,7 @@ VorbisAudioReader::~VorbisAudioReader()
 	if (m_file) {
 		ov_clear(&m_vf);
 	}
+	delete m_seekIndex;
 }
 
 
@@ -103,6 +115,16 @@ bool VorbisAudioReader::seek_private(nframes_t start)
 		return false;
 	}
 	
+	// Jump straight to the page before start and decode up to start
+	int index = m_seekIndex->find(start);
+	if (index >= 0 && ov_raw_seek(&m_vf, m_seekIndex->at(index).offset) == 0) {
+		ogg_int64_t position = ov_pcm_tell(&m_vf);
+		if (position >= 0 && position <= start && skip_frames(start - position)) {
+			return true;
+		}
+	}
+	
+	// No index or the index doesn't match the stream, let vorbisfile search the page
 	if (int result = ov_pcm_seek(&m_vf, start) < 0) {
 //		PERROR("VorbisAudioReader: could not seek to frame %d within %s (%d)", start, QS_C(m_fileName), result);
 		Q_UNUSED(result);
@@ -113,6 +135,82 @@ bool VorbisAudioReader::seek_private(nframes_t start)
 }
 
 
+bool VorbisAudioReader::skip_frames(qint64 frames)
+{
+	while (frames > 0) {
+		audio_sample_t** tmp;
+		int bs;
+		long framesRead = ov_read_float(&m_vf, &tmp, int(qMin(frames, qint64(4096))), &bs);
+		
+		if (framesRead <= 0) {
+			return false;
+		}
+		frames -= framesRead;
+	}
+	
+	return true;
+}
+
+
+/**
+ * Scans the Ogg pages of the file, decoding from a page continues at the granule
+ * position of the page before it. Chained or multiplexed files are not indexed.
+ */
+bool VorbisAudioReader::build_seek_index()
+{
+	m_seekIndex->clear();
+	
+	QFile file(m_fileName);
+	if (!file.open(QIODevice::ReadOnly)) {
+		return false;
+	}
+	
+	uchar header[27 + 255];
+	qint64 pos = 0;
+	qint64 lastGranule = -1;
+	quint32 serial = 0;
+	
+	while (file.seek(pos) && file.read((char*)header, 27) == 27) {
+		if (memcmp(header, "OggS", 4) != 0) {
+			break;
+		}
+		
+		int segments = header[26];
+		if (file.read((char*)header + 27, segments) != segments) {
+			break;
+		}
+		
+		qint64 granule = qFromLittleEndian<qint64>(header + 6);
+		quint32 pageSerial = qFromLittleEndian<quint32>(header + 14);
+		
+		if (pos == 0) {
+			serial = pageSerial;
+		} else if (pageSerial != serial) {
+			m_seekIndex->clear();
+			return false;
+		}
+		
+		// The header pages have granule position 0
+		if (lastGranule > 0) {
+			m_seekIndex->append(lastGranule, pos);
+		}
+		
+		// -1: no packet finishes on this page
+		if (granule != -1) {
+			lastGranule = granule;
+		}
+		
+		qint64 bodySize = 0;
+		for (int i = 0; i < segments; ++i) {
+			bodySize += header[27 + i];
+		}
+		pos += 27 + segments + bodySize;
+	}
+	
+	return !m_seekIndex->is_empty();
+}
+
+
 nframes_t VorbisAudioReader::read_private(DecodeBuffer* buffer, nframes_t frameCount)
 {
 	Q_ASSERT(m_file);
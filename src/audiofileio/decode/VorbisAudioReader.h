@@ -27,6 +27,7 @@ Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA.
 #include "vorbis/vorbisfile.h"
 #include "stdio.h"
 
+class TSeekIndex;
 
 class VorbisAudioReader : public AbstractAudioReader
 {
@@ -35,6 +36,7 @@ public:
 	~VorbisAudioReader();
 	
 	QString decoder_type() const {return "vorbis";}
+	bool is_compressed() const {return true;}
 	
 	static bool can_decode(const QString& filename);
 
@@ -45,6 +47,11 @@ protected:
 	FILE*		m_file;
 	OggVorbis_File	m_vf{};
 	vorbis_info*	m_vi;
+	TSeekIndex*	m_seekIndex;
+
+private:
+	bool build_seek_index();
+	bool skip_frames(qint64 frames);
 };
 
 #endif
@@ -22,6 +22,7 @@ Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA.
 #include "WPAudioReader.h"
 #include <QString>
 #include "Utils.h"
+#include "TSampleConverter.h"
 
 RELAYTOOL_WAVPACK;
 
@@ -107,50 +108,12 @@ nframes_t WPAudioReader::read_private(DecodeBuffer* buffer, nframes_t frameCount
 	
 	nframes_t framesRead = WavpackUnpackSamples(m_wp, readbuffer, frameCount);
 	
-	const uint divider = ((uint)1<<(m_bytesPerSample * 8 - 1));
-	
 	// De-interlace
 	if (m_isFloat) {
-		switch (m_channels) {
-			case 1:
-				memcpy(buffer->destination[0], readbuffer, framesRead * sizeof(audio_sample_t));
-				break;	
-			case 2:
-				for (nframes_t f = 0; f < framesRead; f++) {
-					uint pos = f*2;
-					buffer->destination[0][f] = ((float*)readbuffer)[pos];
-					buffer->destination[1][f] = ((float*)readbuffer)[pos + 1];
-				}
-				break;	
-			default:
-				for (nframes_t f = 0; f < framesRead; f++) {
-                    for (uint c = 0; c < m_channels; c++) {
-						buffer->destination[c][f] = ((float*)readbuffer)[f * m_channels + c];
-					}
-				}
-		}
+		TSampleConverter::deinterleave_float(buffer->destination, (float*)readbuffer, m_channels, framesRead);
 	}
 	else {
-		switch (m_channels) {
-			case 1:
-				for (nframes_t f = 0; f < framesRead; f++) {
-					buffer->destination[0][f] = (float)((float)readbuffer[f]/ divider);
-				}
-				break;	
-			case 2:
-				for (nframes_t f = 0; f < framesRead; f++) {
-					uint pos = f*2;
-					buffer->destination[0][f] = (float)((float)readbuffer[pos]/ divider);
-					buffer->destination[1][f] = (float)((float)readbuffer[pos + 1]/ divider);
-				}
-				break;	
-			default:
-				for (nframes_t f = 0; f < framesRead; f++) {
-                    for (uint c = 0; c < m_channels; c++) {
-						buffer->destination[c][f] = (float)((float)readbuffer[f * m_channels + c]/ divider);
-					}
-				}
-		}
+		TSampleConverter::deinterleave_int32(buffer->destination, readbuffer, m_channels, framesRead, m_bytesPerSample * 8);
 	}
 	
 	return framesRead;
@@ -33,6 +33,7 @@ public:
 	~WPAudioReader();
 	
 	QString decoder_type() const {return "wavpack";}
+	bool is_compressed() const {return true;}
 	
 	static bool can_decode(const QString& filename);
 
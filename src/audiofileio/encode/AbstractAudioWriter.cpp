@@ -22,6 +22,7 @@ Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA.
 #include "AbstractAudioWriter.h"
 #include "SFAudioWriter.h"
 #include "TExportSpecification.h"
+#include "TSpoolAudioWriter.h"
 #include "WPAudioWriter.h"
 
 #include <QString>
@@ -107,6 +108,11 @@ nframes_t AbstractAudioWriter::write(void* buffer, nframes_t count)
 // Static method used by other classes to get an AudioWriter for the correct file type
 AbstractAudioWriter* AbstractAudioWriter::create_audio_writer(TExportSpecification *spec)
 {
+    // Spooled recordings are converted to the writer type's format afterwards
+    if (spec->extraFormat.value("spool") == "true") {
+        return new TSpoolAudioWriter(spec);
+    }
+
     if (spec->get_writer_type() == "sndfile") {
         return new SFAudioWriter(spec);
 	}
@@ -0,0 +1,269 @@
+/*
+Copyright (C) 2024 Remon Sijrier
+
+This file is part of Traverso
+
+Traverso is free software; you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation; either version 2 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program; if not, write to the Free Software
+Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA.
+
+*/
+
+#include "TSpoolAudioWriter.h"
+#include "TExportSpecification.h"
+#include "Utils.h"
+
+#include <QtEndian>
+
+#if defined (Q_OS_UNIX)
+#include <fcntl.h>
+#include <unistd.h>
+#include <cerrno>
+#endif
+
+// Always put me below _all_ includes, this is needed
+// in case we run with memory leak detection enabled!
+#include "Debugger.h"
+
+/** \class TSpoolAudioWriter
+ *	\brief Writes recorded audio as 32 bit float WAV with as little overhead as possible
+ *
+ *	Used when Recording/SpoolRawFloat is enabled. The audio data is collected in a large
+ *	write buffer and written with unbuffered (direct) IO where the file system supports it,
+ *	the file space is preallocated in large steps. The WAV header is written when closing
+ *	the file, a file larger then 4 GB becomes an RF64 file.
+ *
+ *	The resulting file can be played back right away, TRecordingTranscoder converts it
+ *	to the configured recording format afterwards.
+ */
+
+TSpoolAudioWriter::TSpoolAudioWriter(TExportSpecification* spec)
+    : AbstractAudioWriter(spec)
+{
+    m_fd = -1;
+    m_directIO = false;
+    m_writeBuffer = nullptr;
+    m_writeBufferFill = m_fileOffset = m_preallocatedSize = m_dataBytes = 0;
+}
+
+TSpoolAudioWriter::~TSpoolAudioWriter()
+{
+    if (m_isOpen) {
+        TSpoolAudioWriter::close_private();
+    }
+    free(m_writeBuffer);
+}
+
+bool TSpoolAudioWriter::open_private()
+{
+    if (!m_writeBuffer) {
+#if defined (NO_POSIX_MEMALIGN)
+        m_writeBuffer = static_cast<char*>(malloc(WRITE_BUFFER_SIZE));
+#else
+        void* data = nullptr;
+        if (posix_memalign(&data, HEADER_SIZE, WRITE_BUFFER_SIZE) != 0) {
+            return false;
+        }
+        m_writeBuffer = static_cast<char*>(data);
+#endif
+    }
+
+#if defined (Q_OS_UNIX)
+    QByteArray fileName = QFile::encodeName(m_fileName);
+    int flags = O_WRONLY | O_CREAT | O_TRUNC;
+
+#if defined (O_DIRECT)
+    m_fd = ::open(fileName.constData(), flags | O_DIRECT, 0644);
+    m_directIO = (m_fd >= 0);
+#endif
+    // Not all file systems support direct IO
+    if (m_fd < 0) {
+        m_fd = ::open(fileName.constData(), flags, 0644);
+    }
+
+    if (m_fd < 0) {
+        qWarning("TSpoolAudioWriter::open_private: Could not create file (%s)", QS_C(m_fileName));
+        return false;
+    }
+
+#if defined (Q_OS_MAC)
+    fcntl(m_fd, F_NOCACHE, 1);
+#endif
+#else
+    m_file.setFileName(m_fileName);
+
+    if (!m_file.open(QIODevice::WriteOnly | QIODevice::Unbuffered)) {
+        qWarning("TSpoolAudioWriter::open_private: Could not create file (%s)", QS_C(m_fileName));
+        return false;
+    }
+#endif
+
+    m_fileOffset = m_preallocatedSize = m_dataBytes = 0;
+    preallocate(PREALLOCATE_SIZE);
+
+    // The header is written again with the final sizes in close_private()
+    fill_header(m_writeBuffer);
+    m_writeBufferFill = HEADER_SIZE;
+
+    return true;
+}
+
+nframes_t TSpoolAudioWriter::write_private(void* buffer, nframes_t frameCount)
+{
+    const char* data = static_cast<const char*>(buffer);
+    qint64 bytes = qint64(frameCount) * m_exportSpecification->get_channel_count() * sizeof(float);
+    qint64 remaining = bytes;
+
+    while (remaining > 0) {
+        qint64 chunk = qMin(remaining, WRITE_BUFFER_SIZE - m_writeBufferFill);
+        memcpy(m_writeBuffer + m_writeBufferFill, data, size_t(chunk));
+        m_writeBufferFill += chunk;
+        data += chunk;
+        remaining -= chunk;
+
+        if (m_writeBufferFill == WRITE_BUFFER_SIZE && !flush_write_buffer()) {
+            return 0;
+        }
+    }
+
+    m_dataBytes += bytes;
+
+    return frameCount;
+}
+
+bool TSpoolAudioWriter::close_private()
+{
+#if defined (Q_OS_UNIX) && defined (O_DIRECT)
+    // The last write is most likely not a multiple of the block size
+    if (m_directIO) {
+        fcntl(m_fd, F_SETFL, fcntl(m_fd, F_GETFL) & ~O_DIRECT);
+        m_directIO = false;
+    }
+#endif
+
+    bool success = flush_write_buffer();
+    qint64 fileSize = m_fileOffset;
+
+    fill_header(m_writeBuffer);
+    success = success && write_at(0, m_writeBuffer, HEADER_SIZE);
+
+#if defined (Q_OS_UNIX)
+    // Release the space preallocated beyond the end of the file
+    if (ftruncate(m_fd, off_t(fileSize)) != 0) {
+        success = false;
+    }
+    if (::close(m_fd) != 0) {
+        success = false;
+    }
+    m_fd = -1;
+#else
+    Q_UNUSED(fileSize);
+    m_file.close();
+#endif
+
+    return success;
+}
+
+bool TSpoolAudioWriter::flush_write_buffer()
+{
+    if (m_writeBufferFill == 0) {
+        return true;
+    }
+
+    if (m_fileOffset + m_writeBufferFill > m_preallocatedSize) {
+        preallocate(m_fileOffset + m_writeBufferFill + PREALLOCATE_SIZE);
+    }
+
+    if (!write_at(m_fileOffset, m_writeBuffer, m_writeBufferFill)) {
+        PERROR(QString("Could not write to spool file %1").arg(m_fileName));
+        return false;
+    }
+
+    m_fileOffset += m_writeBufferFill;
+    m_writeBufferFill = 0;
+
+    return true;
+}
+
+bool TSpoolAudioWriter::write_at(qint64 offset, const char* data, qint64 size)
+{
+#if defined (Q_OS_UNIX)
+    while (size > 0) {
+        ssize_t written = pwrite(m_fd, data, size_t(size), off_t(offset));
+        if (written < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            return false;
+        }
+        data += written;
+        offset += written;
+        size -= written;
+    }
+    return true;
+#else
+    return m_file.seek(offset) && m_file.write(data, size) == size;
+#endif
+}
+
+void TSpoolAudioWriter::preallocate(qint64 size)
+{
+#if defined (Q_OS_LINUX)
+    // Best effort, keeps the file size as is so a crash doesn't leave a file with trailing garbage
+    fallocate(m_fd, FALLOC_FL_KEEP_SIZE, off_t(m_preallocatedSize), off_t(size - m_preallocatedSize));
+#endif
+    m_preallocatedSize = size;
+}
+
+void TSpoolAudioWriter::fill_header(char* header)
+{
+    const quint16 channels = quint16(m_exportSpecification->get_channel_count());
+    const quint32 rate = quint32(m_exportSpecification->get_sample_rate());
+    const quint16 blockAlign = quint16(channels * sizeof(float));
+    const qint64 riffSize = HEADER_SIZE - 8 + m_dataBytes;
+    const bool rf64 = riffSize > 0xFFFFFFFFLL;
+
+    memset(header, 0, HEADER_SIZE);
+
+    memcpy(header, rf64 ? "RF64" : "RIFF", 4);
+    qToLittleEndian<quint32>(rf64 ? 0xFFFFFFFF : quint32(riffSize), header + 4);
+    memcpy(header + 8, "WAVE", 4);
+
+    // Room for the ds64 chunk in case the file becomes an RF64 file
+    memcpy(header + 12, rf64 ? "ds64" : "JUNK", 4);
+    qToLittleEndian<quint32>(28, header + 16);
+    if (rf64) {
+        qToLittleEndian<quint64>(quint64(riffSize), header + 20);
+        qToLittleEndian<quint64>(quint64(m_dataBytes), header + 28);
+        qToLittleEndian<quint64>(quint64(m_dataBytes / blockAlign), header + 36);
+    }
+
+    // WAVE_FORMAT_IEEE_FLOAT
+    memcpy(header + 48, "fmt ", 4);
+    qToLittleEndian<quint32>(16, header + 52);
+    qToLittleEndian<quint16>(3, header + 56);
+    qToLittleEndian<quint16>(channels, header + 58);
+    qToLittleEndian<quint32>(rate, header + 60);
+    qToLittleEndian<quint32>(rate * blockAlign, header + 64);
+    qToLittleEndian<quint16>(blockAlign, header + 68);
+    qToLittleEndian<quint16>(32, header + 70);
+
+    // Pad the header so the audio data starts at HEADER_SIZE
+    memcpy(header + 72, "JUNK", 4);
+    qToLittleEndian<quint32>(HEADER_SIZE - 88, header + 76);
+
+    memcpy(header + HEADER_SIZE - 8, "data", 4);
+    qToLittleEndian<quint32>(rf64 ? 0xFFFFFFFF : quint32(m_dataBytes), header + HEADER_SIZE - 4);
+}
+
+//eof
@@ -0,0 +1,69 @@
+/*
+Copyright (C) 2024 Remon Sijrier
+
+This file is part of Traverso
+
+Traverso is free software; you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation; either version 2 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program; if not, write to the Free Software
+Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA.
+
+*/
+
+#ifndef TSPOOLAUDIOWRITER_H
+#define TSPOOLAUDIOWRITER_H
+
+#include "AbstractAudioWriter.h"
+
+#include "defines.h"
+
+#include <QFile>
+
+class TExportSpecification;
+
+class TSpoolAudioWriter : public AbstractAudioWriter
+{
+
+public:
+    TSpoolAudioWriter(TExportSpecification* spec);
+    ~TSpoolAudioWriter();
+
+protected:
+    bool open_private();
+    nframes_t write_private(void* buffer, nframes_t frameCount);
+    bool close_private();
+
+private:
+    // The audio data starts at HEADER_SIZE so all writes, except the
+    // last one, are aligned as needed for unbuffered (direct) IO
+    static const int HEADER_SIZE = 4096;
+    static const qint64 WRITE_BUFFER_SIZE = 4 * 1024 * 1024;
+    static const qint64 PREALLOCATE_SIZE = 64 * 1024 * 1024;
+
+    QFile       m_file;
+    int         m_fd;
+    bool        m_directIO;
+    char*       m_writeBuffer;
+    qint64      m_writeBufferFill;
+    qint64      m_fileOffset;
+    qint64      m_preallocatedSize;
+    qint64      m_dataBytes;
+
+    bool flush_write_buffer();
+    bool write_at(qint64 offset, const char* data, qint64 size);
+    void preallocate(qint64 size);
+    void fill_header(char* header);
+};
+
+#endif
+
+//eof
@@ -32,6 +32,8 @@ Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA.
 
 #include <QString>
 
+#include "TSampleConverter.h"
+
 RELAYTOOL_VORBISFILE;
 
 // Always put me below _all_ includes, this is needed
@@ -256,8 +258,6 @@ nframes_t VorbisAudioWriter::write_private(void* buffer, nframes_t frameCount)
 		}
 	}
 	
-	char* data = (char*)buffer;
-	
 	// expose the buffer to submit data
 	float** writeBuffer = vorbis_analysis_buffer(d->vorbisDspState, frameCount);
 	
@@ -265,20 +265,8 @@ nframes_t VorbisAudioWriter::write_private(void* buffer, nframes_t frameCount)
 		return 0;
 	}
 	
-	// uninterleave samples
-	if (m_channels == 1) {
-		for (nframes_t i = 0; i < frameCount; i++) {
-			// Currently assumes 16bit audio
-			writeBuffer[0][i]=( (data[i*2+1]<<8) | (0x00ff&(int)data[i*2]) ) / 32768.f;
-		}
-	}
-	else {
-		for (nframes_t i = 0; i < frameCount; i++) {
-			// Currently assumes 16bit audio
-			writeBuffer[0][i]=( (data[i*4+1]<<8) | (0x00ff&(int)data[i*4]) ) / 32768.f;
-			writeBuffer[1][i]=( (data[i*4+3]<<8) | (0x00ff&(int)data[i*4+2]) ) / 32768.f;
-		}
-	}
+	// uninterleave samples, currently assumes 16bit audio
+	TSampleConverter::deinterleave_int16(writeBuffer, (const int16_t*)buffer, m_channels, frameCount);
 	
 	// tell the library how much we actually submitted
 	vorbis_analysis_wrote(d->vorbisDspState, frameCount);
@@ -0,0 +1,136 @@
+/*
+Copyright (C) 2024 Remon Sijrier
+
+This file is part of Traverso
+
+Traverso is free software; you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation; either version 2 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program; if not, write to the Free Software
+Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA.
+
+*/
+
+#include <cstdio>
+
+#include <QApplication>
+#include <QCommandLineParser>
+#include <QFile>
+#include <QJsonDocument>
+
+#include "AudioDevice.h"
+#include "Mixer.h"
+#include "TSampleConverter.h"
+#include "TBenchmark.h"
+#include "TConfig.h"
+#include "Utils.h"
+
+// Always put me below _all_ includes, this is needed
+// in case we run with memory leak detection enabled!
+#include "Debugger.h"
+
+
+int main( int argc, char **argv )
+{
+    // Traverso core uses a few widgets, e.g. for message boxes, make sure
+    // we don't need a display so the benchmark runs on any build machine
+    if (qEnvironmentVariableIsEmpty("QT_QPA_PLATFORM")) {
+        qputenv("QT_QPA_PLATFORM", "offscreen");
+    }
+
+    QApplication app(argc, argv);
+    QCoreApplication::setOrganizationName("Traverso");
+    QCoreApplication::setApplicationName("Traverso");
+    QCoreApplication::setOrganizationDomain("traverso-daw.org");
+
+    qRegisterMetaType<TTimeRef>("TTimeRef");
+
+    QCommandLineParser parser;
+    parser.setApplicationDescription("Runs the Traverso audio engine on a Project without audio hardware "
+                                      "and writes a JSON report of the processing and disk i/o times");
+    parser.addHelpOption();
+    parser.addPositionalArgument("project", "The project.tpf file of the Project to benchmark");
+
+    QCommandLineOption bufferSizesOption("buffer-sizes", "Comma separated list of buffer sizes (default 128,256,1024)", "sizes", "128,256,1024");
+    QCommandLineOption rateOption("rate", "Sample rate (default 44100)", "rate", "44100");
+    QCommandLineOption cyclesOption("cycles", "Process cycles measured per buffer size (default 2000)", "count", "2000");
+    QCommandLineOption warmupOption("warmup", "Process cycles run before measuring (default 200)", "count", "200");
+    QCommandLineOption seeksOption("seeks", "Amount of seeks in the seek storm, 0 disables it (default 50)", "count", "50");
+    QCommandLineOption noPacingOption("no-pacing", "Run the process cycles back to back instead of at the pace of real hardware");
+    QCommandLineOption noExportOption("no-export", "Don't benchmark exporting the Sheet");
+    QCommandLineOption noPeaksOption("no-peaks", "Don't benchmark rebuilding the peak files");
+    QCommandLineOption outputOption("output", "File to write the report to, - for stdout (default traverso-bench.json)", "file", "traverso-bench.json");
+
+    parser.addOption(bufferSizesOption);
+    parser.addOption(rateOption);
+    parser.addOption(cyclesOption);
+    parser.addOption(warmupOption);
+    parser.addOption(seeksOption);
+    parser.addOption(noPacingOption);
+    parser.addOption(noExportOption);
+    parser.addOption(noPeaksOption);
+    parser.addOption(outputOption);
+
+    parser.process(app);
+
+    if (parser.positionalArguments().size() != 1) {
+        parser.showHelp(1);
+    }
+
+    TBenchmark benchmark;
+
+    const QStringList bufferSizes = parser.value(bufferSizesOption).split(',', Qt::SkipEmptyParts);
+    for (const QString& bufferSize : bufferSizes) {
+        uint size = bufferSize.trimmed().toUInt();
+        if (size > 0) {
+            benchmark.bufferSizes.append(size);
+        }
+    }
+    benchmark.sampleRate = qMax(1u, parser.value(rateOption).toUInt());
+    benchmark.cycles = qMax(1, parser.value(cyclesOption).toInt());
+    benchmark.warmupCycles = qMax(0, parser.value(warmupOption).toInt());
+    benchmark.seeks = qMax(0, parser.value(seeksOption).toInt());
+    benchmark.pacing = !parser.isSet(noPacingOption);
+    benchmark.runExport = !parser.isSet(noExportOption);
+    benchmark.runPeaks = !parser.isSet(noPeaksOption);
+
+    config().check_and_load_configuration();
+
+    Mixer::init_functions();
+    TSampleConverter::init_functions();
+
+    int result = benchmark.run(parser.positionalArguments().first());
+
+    audiodevice().shutdown();
+
+    if (result < 0) {
+        return 1;
+    }
+
+    QByteArray json = QJsonDocument(benchmark.get_report()).toJson();
+    QString output = parser.value(outputOption);
+
+    if (output == "-") {
+        fwrite(json.constData(), 1, size_t(json.size()), stdout);
+    } else {
+        QFile file(output);
+        if (!file.open(QIODevice::WriteOnly | QIODevice::Truncate)) {
+            fprintf(stderr, "traverso-bench: Could not open %s for writing\n", QS_C(output));
+            return 1;
+        }
+        file.write(json);
+        fprintf(stderr, "traverso-bench: Report written to %s\n", QS_C(output));
+    }
+
+    return 0;
+}
+
+//eof
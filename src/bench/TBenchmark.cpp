@@ -0,0 +1,520 @@
+/*
+Copyright (C) 2024 Remon Sijrier
+
+This file is part of Traverso
+
+Traverso is free software; you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation; either version 2 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program; if not, write to the Free Software
+Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA.
+
+*/
+
+#include "TBenchmark.h"
+
+#include <QCoreApplication>
+#include <QDir>
+#include <QElapsedTimer>
+#include <QFile>
+#include <QFileInfo>
+#include <QJsonArray>
+#include <QTemporaryDir>
+#include <QThread>
+
+#include "AudioDevice.h"
+#include "DiskIO.h"
+#include "Peak.h"
+#include "Project.h"
+#include "ProjectManager.h"
+#include "ReadSource.h"
+#include "ResourcesManager.h"
+#include "Sheet.h"
+#include "TConfig.h"
+#include "TExportSpecification.h"
+#include "TFreewheelRenderer.h"
+#include "Utils.h"
+
+#include <algorithm>
+#include <climits>
+#include <random>
+#include <sndfile.h>
+
+#if defined (Q_OS_UNIX) && !defined (Q_OS_LINUX)
+#include <sys/resource.h>
+#endif
+
+// Always put me below _all_ includes, this is needed
+// in case we run with memory leak detection enabled!
+#include "Debugger.h"
+
+/** \class TBenchmark
+ *	\brief Drives the audio engine of a Project without audio hardware and measures it
+ *
+ *	The AudioDevice is set up with the "Benchmark Driver", a Null Driver without an audio
+ *	thread, and every process cycle is run from here with AudioDevice::run_benchmark_cycle().
+ *	By default the cycles are paced to the rate of real hardware so DiskIO works like it
+ *	would while playing back, without pacing the cycles run back to back.
+ *
+ *	For each buffer size the cycle times and the DiskIO refill times are reported as
+ *	percentiles. Then a seek storm measures how long a seek takes until DiskIO has refilled
+ *	the buffers, next to the time DiskIO itself spent in the seeks. The active Sheet is rendered with the TFreewheelRenderer and all peak files
+ *	are rebuilt. The report is a QJsonObject, see get_report().
+ *
+ *	The Project is never saved, but rebuilding the peaks rewrites the peak files of the Project.
+ */
+
+// Seeks give up after this amount of time
+static const trav_time_t SEEK_TIMEOUT = 5000000000LL;
+// Cycles run between the seeks of a seek storm
+static const int CYCLES_BETWEEN_SEEKS = 4;
+// Peak building gives up after this amount of milliseconds
+static const int PEAK_BUILD_TIMEOUT = 600000;
+
+
+TBenchmark::TBenchmark()
+{
+    sampleRate = 44100;
+    cycles = 2000;
+    warmupCycles = 200;
+    seeks = 50;
+    pacing = true;
+    runExport = true;
+    runPeaks = true;
+    m_seekFinished = false;
+    m_finishedPeaks = 0;
+}
+
+/**
+ *	Loads the Project of \a projectFile (the project.tpf file) and runs all benchmarks
+ *
+ * @return 1 on success, -1 if the Project couldn't be loaded or a process cycle failed
+ */
+int TBenchmark::run(const QString& projectFile)
+{
+    QFileInfo fileInfo(projectFile);
+    if (!fileInfo.exists()) {
+        fprintf(stderr, "traverso-bench: %s doesn't exist\n", QS_C(projectFile));
+        return -1;
+    }
+
+    if (bufferSizes.isEmpty()) {
+        fprintf(stderr, "traverso-bench: No buffer sizes given\n");
+        return -1;
+    }
+
+    // Never save the Project when it's closed, the benchmark shouldn't change it
+    config().set_property("Project", "onclose", "none");
+    // Seek storms make sources resync, keep that out of the xrun snapshots
+    config().set_property("Hardware", "FlightRecorderEnabled", false);
+
+    TAudioDeviceSetup ads;
+    ads.driverType = "Benchmark Driver";
+    ads.rate = sampleRate;
+    ads.bufferSize = bufferSizes.first();
+    ads.capture = true;
+    ads.playback = true;
+    ads.ditherShape = "None";
+    audiodevice().set_parameters(ads);
+
+    QDir projectDir(fileInfo.absolutePath());
+    QString projectName = projectDir.dirName();
+    projectDir.cdUp();
+
+    pm().start(projectDir.absolutePath(), projectName);
+
+    Project* project = pm().get_project();
+    if (!project) {
+        fprintf(stderr, "traverso-bench: Unable to load Project %s\n", QS_C(projectName));
+        return -1;
+    }
+
+    Sheet* sheet = project->get_active_sheet();
+    if (!sheet && !project->get_sheets().isEmpty()) {
+        sheet = project->get_sheets().first();
+    }
+    if (!sheet) {
+        fprintf(stderr, "traverso-bench: Project %s has no Sheets\n", QS_C(projectName));
+        return -1;
+    }
+
+    m_report = QJsonObject();
+    m_report["project"] = fileInfo.absoluteFilePath();
+    m_report["sheet"] = sheet->get_name();
+    m_report["sampleRate"] = int(sampleRate);
+    m_report["pacing"] = pacing;
+    m_report["cpuCount"] = QThread::idealThreadCount();
+
+    QJsonArray cycleReports;
+    for (uint bufferSize : bufferSizes) {
+        if (set_buffer_size(bufferSize) < 0) {
+            return -1;
+        }
+        QJsonObject cycleReport = run_cycles(sheet, bufferSize);
+        if (cycleReport.isEmpty()) {
+            return -1;
+        }
+        cycleReports.append(cycleReport);
+    }
+    m_report["cycles"] = cycleReports;
+
+    if (seeks > 0) {
+        m_report["seekStorm"] = run_seek_storm(sheet);
+    }
+
+    if (sheet->is_transport_rolling()) {
+        sheet->start_transport();
+    }
+
+    if (runExport) {
+        m_report["export"] = run_export(sheet);
+    }
+
+    if (runPeaks) {
+        m_report["peakBuilding"] = run_peak_building();
+    }
+
+    m_report["memory"] = memory_usage();
+
+    return 1;
+}
+
+int TBenchmark::set_buffer_size(uint bufferSize)
+{
+    if (audiodevice().get_buffer_size() != bufferSize) {
+        TAudioDeviceSetup ads = audiodevice().get_device_setup();
+        ads.bufferSize = bufferSize;
+        audiodevice().set_parameters(ads);
+    }
+
+    if (audiodevice().get_driver_type() != "Benchmark Driver" || audiodevice().get_buffer_size() != bufferSize) {
+        fprintf(stderr, "traverso-bench: Unable to set up the Benchmark Driver with a buffer size of %u\n", bufferSize);
+        return -1;
+    }
+
+    return 1;
+}
+
+/**
+ *	Runs one process cycle, handles the pending events and waits until \a deadline
+ *	when pacing. Returns the time spent in the process cycle, or -1 on failure.
+ */
+int TBenchmark::run_cycle(trav_time_t deadline)
+{
+    trav_time_t startTime = TTimeRef::get_nanoseconds_since_epoch();
+
+    if (audiodevice().run_benchmark_cycle() < 0) {
+        return -1;
+    }
+
+    trav_time_t cycleTime = TTimeRef::get_nanoseconds_since_epoch() - startTime;
+
+    QCoreApplication::processEvents();
+
+    if (pacing) {
+        trav_time_t now;
+        while ((now = TTimeRef::get_nanoseconds_since_epoch()) < deadline) {
+            QThread::usleep(qMax(trav_time_t(1), (deadline - now) / 1000));
+        }
+    }
+
+    return int(qMin(cycleTime, trav_time_t(INT_MAX)));
+}
+
+QJsonObject TBenchmark::run_cycles(Sheet* sheet, uint bufferSize)
+{
+    trav_time_t cycleBudget = trav_time_t(bufferSize) * 1000000000LL / sampleRate;
+    QVector<trav_time_t> cycleTimes;
+    QVector<trav_time_t> refillTimes;
+    int overruns = 0;
+
+    cycleTimes.reserve(cycles);
+
+    if (!sheet->is_transport_rolling()) {
+        sheet->start_transport();
+    }
+
+    trav_time_t deadline = TTimeRef::get_nanoseconds_since_epoch();
+
+    for (int i = 0; i < warmupCycles + cycles; ++i) {
+        if (i == warmupCycles) {
+            // Drop the refill times of the warmup
+            sheet->get_read_diskio()->take_refill_times(refillTimes);
+            refillTimes.clear();
+        }
+
+        deadline += cycleBudget;
+        int cycleTime = run_cycle(deadline);
+        if (cycleTime < 0) {
+            fprintf(stderr, "traverso-bench: Process cycle failed\n");
+            return QJsonObject();
+        }
+
+        // Don't try to catch up when we fell behind, e.g. when the machine was busy
+        deadline = qMax(deadline, TTimeRef::get_nanoseconds_since_epoch() - cycleBudget);
+
+        if (i >= warmupCycles) {
+            cycleTimes.append(cycleTime);
+            if (cycleTime > cycleBudget) {
+                overruns++;
+            }
+        }
+
+        // DiskIO only keeps a limited amount of refill times
+        sheet->get_read_diskio()->take_refill_times(refillTimes);
+    }
+
+    sheet->get_read_diskio()->take_refill_times(refillTimes);
+
+    QJsonObject report;
+    report["bufferSize"] = int(bufferSize);
+    report["cycleBudgetUs"] = qreal(cycleBudget) / 1000.0;
+    report["overruns"] = overruns;
+    report["cycleTimeUs"] = percentiles(cycleTimes, 0.001);
+    report["diskioRefillTimeUs"] = percentiles(refillTimes, 0.001);
+
+    return report;
+}
+
+/**
+ *	Seeks to random locations while the transport is rolling, and measures the time
+ *	until DiskIO finished each seek. The locations are the same for every run.
+ */
+QJsonObject TBenchmark::run_seek_storm(Sheet* sheet)
+{
+    QJsonObject report;
+    QVector<trav_time_t> seekTimes;
+    QVector<trav_time_t> diskioSeekTimes;
+    int timeouts = 0;
+
+    qint64 lastLocation = sheet->get_last_location().universal_frame();
+    if (lastLocation <= 0) {
+        report["seeks"] = 0;
+        return report;
+    }
+
+    trav_time_t cycleBudget = trav_time_t(audiodevice().get_buffer_size()) * 1000000000LL / sampleRate;
+    std::mt19937 generator(1);
+    std::uniform_int_distribution<qint64> distribution(0, lastLocation);
+
+    connect(sheet->get_read_diskio(), SIGNAL(seekFinished()), this, SLOT(seek_finished()));
+
+    // Only the seeks of the storm
+    sheet->get_read_diskio()->take_seek_times(diskioSeekTimes);
+    diskioSeekTimes.clear();
+
+    if (!sheet->is_transport_rolling()) {
+        sheet->start_transport();
+    }
+
+    trav_time_t deadline = TTimeRef::get_nanoseconds_since_epoch();
+
+    for (int i = 0; i < seeks; ++i) {
+        m_seekFinished = false;
+
+        trav_time_t startTime = TTimeRef::get_nanoseconds_since_epoch();
+        sheet->set_transport_location(TTimeRef(distribution(generator)));
+
+        while (!m_seekFinished && TTimeRef::get_nanoseconds_since_epoch() - startTime < SEEK_TIMEOUT) {
+            deadline = qMax(deadline + cycleBudget, TTimeRef::get_nanoseconds_since_epoch());
+            if (run_cycle(deadline) < 0) {
+                break;
+            }
+        }
+
+        if (m_seekFinished) {
+            seekTimes.append(TTimeRef::get_nanoseconds_since_epoch() - startTime);
+        } else {
+            timeouts++;
+        }
+
+        for (int cycle = 0; cycle < CYCLES_BETWEEN_SEEKS; ++cycle) {
+            deadline = qMax(deadline + cycleBudget, TTimeRef::get_nanoseconds_since_epoch());
+            run_cycle(deadline);
+        }
+    }
+
+    disconnect(sheet->get_read_diskio(), SIGNAL(seekFinished()), this, SLOT(seek_finished()));
+
+    sheet->get_read_diskio()->take_seek_times(diskioSeekTimes);
+
+    report["seeks"] = seeks;
+    report["timeouts"] = timeouts;
+    report["seekTimeMs"] = percentiles(seekTimes, 0.000001);
+    report["diskioSeekTimeMs"] = percentiles(diskioSeekTimes, 0.000001);
+
+    return report;
+}
+
+/**
+ *	Renders the whole Sheet to a 32 bit float wav file in a temporary directory
+ */
+QJsonObject TBenchmark::run_export(Sheet* sheet)
+{
+    QJsonObject report;
+    QTemporaryDir exportDir;
+
+    TTimeRef lastLocation = sheet->get_last_location();
+    qreal audioSeconds = qreal(TTimeRef::to_frame(lastLocation, sampleRate)) / sampleRate;
+
+    if (!exportDir.isValid() || lastLocation == TTimeRef()) {
+        report["result"] = -1;
+        return report;
+    }
+
+    auto spec = new TExportSpecification;
+    spec->set_export_dir(exportDir.path() + "/");
+    spec->set_export_file_name("traverso-bench");
+    spec->set_file_format(SF_FORMAT_WAV);
+    spec->set_data_format(SF_FORMAT_FLOAT);
+    spec->set_channel_count(2);
+    spec->set_sample_rate(sampleRate);
+    spec->set_export_start_location(TTimeRef());
+    spec->set_export_end_location(lastLocation);
+
+    TFreewheelRenderer renderer(sheet, spec);
+
+    QElapsedTimer timer;
+    timer.start();
+    int result = renderer.render();
+    qreal seconds = qreal(timer.nsecsElapsed()) / 1000000000.0;
+
+    delete spec;
+
+    report["result"] = result;
+    report["audioSeconds"] = audioSeconds;
+    report["seconds"] = seconds;
+    report["realtimeFactor"] = seconds > 0 ? audioSeconds / seconds : 0.0;
+
+    return report;
+}
+
+/**
+ *	Rebuilds the peak files of all the audio sources of the Project
+ */
+QJsonObject TBenchmark::run_peak_building()
+{
+    QJsonObject report;
+    QList<Peak*> peaks;
+
+    const QList<ReadSource*> sources = pm().get_project()->get_audiosource_manager()->get_all_audio_sources();
+    for (auto source : sources) {
+        if (source->get_channel_count() == 0) {
+            continue;
+        }
+        auto peak = new Peak(source);
+        connect(peak, SIGNAL(finished()), this, SLOT(peak_finished()));
+        peaks.append(peak);
+    }
+
+    m_finishedPeaks = 0;
+
+    QElapsedTimer timer;
+    timer.start();
+
+    for (auto peak : peaks) {
+        peak->start_peak_loading();
+    }
+
+    while (m_finishedPeaks < peaks.size() && timer.elapsed() < PEAK_BUILD_TIMEOUT) {
+        QCoreApplication::processEvents();
+        QThread::msleep(1);
+    }
+
+    report["sources"] = peaks.size();
+    report["finished"] = m_finishedPeaks;
+    report["seconds"] = qreal(timer.nsecsElapsed()) / 1000000000.0;
+
+    for (auto peak : peaks) {
+        peak->close();
+    }
+
+    return report;
+}
+
+QJsonObject TBenchmark::memory_usage()
+{
+    QJsonObject report;
+
+#if defined (Q_OS_LINUX)
+    QFile status("/proc/self/status");
+    if (status.open(QIODevice::ReadOnly | QIODevice::Text)) {
+        const QList<QByteArray> lines = status.readAll().split('\n');
+        for (const QByteArray& line : lines) {
+            if (line.startsWith("VmRSS:")) {
+                report["residentKB"] = line.mid(6).trimmed().split(' ').first().toLongLong();
+            } else if (line.startsWith("VmHWM:")) {
+                report["peakResidentKB"] = line.mid(6).trimmed().split(' ').first().toLongLong();
+            }
+        }
+    }
+#elif defined (Q_OS_UNIX)
+    struct rusage usage;
+    if (getrusage(RUSAGE_SELF, &usage) == 0) {
+#if defined (Q_OS_MAC)
+        // ru_maxrss is in bytes on Mac OS X
+        report["peakResidentKB"] = qint64(usage.ru_maxrss / 1024);
+#else
+        report["peakResidentKB"] = qint64(usage.ru_maxrss);
+#endif
+    }
+#endif
+
+    return report;
+}
+
+/**
+ *	Returns count, mean, min, max and the usual percentiles of \a values,
+ *	each multiplied by \a scale
+ */
+QJsonObject TBenchmark::percentiles(QVector<trav_time_t> values, qreal scale)
+{
+    QJsonObject report;
+    report["count"] = values.size();
+
+    if (values.isEmpty()) {
+        return report;
+    }
+
+    std::sort(values.begin(), values.end());
+
+    qreal total = 0;
+    for (trav_time_t value : values) {
+        total += value;
+    }
+
+    auto percentile = [&values, scale](qreal fraction) {
+        int index = qMin(values.size() - 1, int(fraction * values.size()));
+        return qreal(values.at(index)) * scale;
+    };
+
+    report["min"] = qreal(values.first()) * scale;
+    report["mean"] = total / values.size() * scale;
+    report["median"] = percentile(0.5);
+    report["p90"] = percentile(0.9);
+    report["p99"] = percentile(0.99);
+    report["p999"] = percentile(0.999);
+    report["max"] = qreal(values.last()) * scale;
+
+    return report;
+}
+
+void TBenchmark::seek_finished()
+{
+    m_seekFinished = true;
+}
+
+void TBenchmark::peak_finished()
+{
+    m_finishedPeaks++;
+}
+
+//eof
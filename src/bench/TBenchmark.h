@@ -0,0 +1,76 @@
+/*
+Copyright (C) 2024 Remon Sijrier
+
+This file is part of Traverso
+
+Traverso is free software; you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation; either version 2 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program; if not, write to the Free Software
+Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA.
+
+*/
+
+#ifndef TBENCHMARK_H
+#define TBENCHMARK_H
+
+#include <QJsonObject>
+#include <QList>
+#include <QObject>
+#include <QString>
+#include <QVector>
+
+#include "defines.h"
+
+class Sheet;
+
+class TBenchmark : public QObject
+{
+    Q_OBJECT
+
+public:
+    TBenchmark();
+
+    QList<uint> bufferSizes;
+    uint        sampleRate;
+    int         cycles;
+    int         warmupCycles;
+    int         seeks;
+    bool        pacing;
+    bool        runExport;
+    bool        runPeaks;
+
+    int run(const QString& projectFile);
+    QJsonObject get_report() const {return m_report;}
+
+private:
+    QJsonObject m_report;
+    bool        m_seekFinished;
+    int         m_finishedPeaks;
+
+    int set_buffer_size(uint bufferSize);
+    int run_cycle(trav_time_t deadline);
+    QJsonObject run_cycles(Sheet* sheet, uint bufferSize);
+    QJsonObject run_seek_storm(Sheet* sheet);
+    QJsonObject run_export(Sheet* sheet);
+    QJsonObject run_peak_building();
+    QJsonObject memory_usage();
+
+    static QJsonObject percentiles(QVector<trav_time_t> values, qreal scale);
+
+private slots:
+    void seek_finished();
+    void peak_finished();
+};
+
+#endif
+
+//eof
@@ -80,8 +80,8 @@ $Id: AddRemove.cpp,v 1.6 2008/11/24 10:12:19 r_sijrier Exp $
         //		thread save via Tsar's thread save logic.
         // tr("Add Track")	The (tranlated) description of this action as it will show up in the HistoryView
         return new AddRemove(this, track, true, this,
-            "private_add_track(Track*)", "trackAdded(Track*)",
-            "private_remove_track(Track*)", "trackRemoved(Track*)",
+            Tsar::call<Sheet, Track, &Sheet::private_add_track>, "trackAdded(Track*)",
+            Tsar::call<Sheet, Track, &Sheet::private_remove_track>, "trackRemoved(Track*)",
             tr("Add Track"));
     }
 
@@ -89,8 +89,8 @@ $Id: AddRemove.cpp,v 1.6 2008/11/24 10:12:19 r_sijrier Exp $
     {
         // Same applies as in add_track(), however, the second and third line are switched :-)
         return new AddRemove(this, track, true, this,
-            "private_remove_track(Track*)", "trackRemoved(Track*)",
-            "private_add_track(Track*)", "trackAdded(Track*)",
+            Tsar::call<Sheet, Track, &Sheet::private_remove_track>, "trackRemoved(Track*)",
+            Tsar::call<Sheet, Track, &Sheet::private_add_track>, "trackAdded(Track*)",
             tr("Remove Track"));
     }
 
@@ -125,6 +125,8 @@ AddRemove::AddRemove(ContextItem* parent, ContextItem* item, const QString& des)
       m_undoActionSlot(""),
       m_doSignal(""),
       m_undoSignal(""),
+      m_doActionFunction(nullptr),
+      m_undoActionFunction(nullptr),
       m_instantanious(false)
 {
     m_parentItem = parent;
@@ -173,6 +175,8 @@ AddRemove::AddRemove(
       m_undoActionSlot(undoActionSlot),
       m_doSignal(doSignal),
       m_undoSignal(undoSignal),
+      m_doActionFunction(nullptr),
+      m_undoActionFunction(nullptr),
       m_instantanious(false)
 {
     if (!historable) {
@@ -198,6 +202,46 @@ AddRemove::AddRemove(
       m_undoActionSlot(undoActionSlot),
       m_doSignal(doSignal),
       m_undoSignal(undoSignal),
+      m_doActionFunction(nullptr),
+      m_undoActionFunction(nullptr),
+      m_instantanious(false)
+{
+    if (!historable) {
+        set_do_not_push_to_historystack();
+    }
+
+    if (item && item->has_active_context()) {
+        cpointer().remove_from_active_context_list(item);
+    }
+}
+
+
+/**
+ * 			Constructor for typed actions, \a doAction and \a undoAction are called directly
+            instead of invoking a slot through the meta object system. Use Tsar::call() to
+            create them for the (private) add and remove slots of \a parent.
+            The other parameters are the same as for the constructor above.
+ */
+AddRemove::AddRemove(
+        ContextItem* parent,
+        ContextItem* item,
+        bool historable,
+        TSession* sheet,
+        TsarFunction doAction,
+        const char * doSignal,
+        TsarFunction undoAction,
+        const char * undoSignal,
+        const QString& des)
+    : TCommand(parent, des),
+      m_parentItem(parent),
+      m_arg(item),
+      m_sheet(sheet),
+      m_doActionSlot(""),
+      m_undoActionSlot(""),
+      m_doSignal(doSignal),
+      m_undoSignal(undoSignal),
+      m_doActionFunction(doAction),
+      m_undoActionFunction(undoAction),
       m_instantanious(false)
 {
     if (!historable) {
@@ -217,6 +261,14 @@ int AddRemove::prepare_actions()
 {
     Q_ASSERT(m_parentItem);
     Q_ASSERT(m_arg);
+
+    if (m_doActionFunction) {
+        Q_ASSERT(m_undoActionFunction);
+        tsar().prepare_event(m_doActionEvent, m_parentItem, m_arg, m_doActionFunction, m_doSignal);
+        tsar().prepare_event(m_undoActionEvent, m_parentItem, m_arg, m_undoActionFunction, m_undoSignal);
+        return 1;
+    }
+
     Q_ASSERT(m_doActionSlot != QString(""));
     Q_ASSERT(m_undoActionSlot != QString(""));
 
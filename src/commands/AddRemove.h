@@ -53,6 +53,15 @@ public :
 			const char* undoActionSlot,
 			const char* undoSignal,
 			const QString& des);
+	AddRemove(ContextItem* parent,
+			ContextItem*  item,
+            bool historable,
+            TSession* sheet,
+			TsarFunction doAction,
+			const char* doSignal,
+			TsarFunction undoAction,
+			const char* undoSignal,
+			const QString& des);
 	~AddRemove();
 
 	bool is_hold_command() const {return false;}
@@ -74,6 +83,8 @@ private :
 	const char*	m_undoActionSlot;
 	const char*	m_doSignal;
 	const char*	m_undoSignal;
+	TsarFunction	m_doActionFunction;
+	TsarFunction	m_undoActionFunction;
 	bool		m_instantanious;
 
     int un_redo_action(TCommand::ActionType actionType);
@@ -129,7 +129,9 @@ int Import::create_readsource()
 	QString dir = m_fileName.left(splitpoint - 1) + "/";
 	m_name = m_fileName.right(length - splitpoint);
 	
-	m_source = resources_manager()->import_source(dir, m_name);
+	// Compressed files can be converted in the background to a format that's cheaper to decode
+	bool transcode = config().get_property("Import", "TranscodeCompressedSources", false).toBool();
+	m_source = resources_manager()->import_source(dir, m_name, transcode);
 	if (! m_source) {
 //		PERROR("Can't import audiofile %s", QS_C(m_fileName));
 		return -1;
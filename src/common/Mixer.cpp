@@ -21,13 +21,30 @@
 */
 
 #include "Mixer.h"
+#include "TDspProfiler.h"
 #include "defines.h"
 #include <cmath> // used for fabs
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
 
-Mixer::compute_peak_t			Mixer::compute_peak 		= nullptr;
-Mixer::apply_gain_to_buffer_t		Mixer::apply_gain_to_buffer 	= nullptr;
-Mixer::mix_buffers_with_gain_t		Mixer::mix_buffers_with_gain 	= nullptr;
-Mixer::mix_buffers_no_gain_t		Mixer::mix_buffers_no_gain 	= nullptr;
+#include "fpu.h"
+#ifdef __SSE__
+#include <xmmintrin.h>
+#endif
+#if defined (__APPLE__)
+#include <Carbon/Carbon.h> // For Gestalt
+#endif
+
+std::atomic<Mixer::compute_peak_t>			Mixer::compute_peak 		{nullptr};
+std::atomic<Mixer::find_peaks_t>			Mixer::find_peaks 		{nullptr};
+std::atomic<Mixer::apply_gain_to_buffer_t>		Mixer::apply_gain_to_buffer 	{nullptr};
+std::atomic<Mixer::mix_buffers_with_gain_t>		Mixer::mix_buffers_with_gain 	{nullptr};
+std::atomic<Mixer::mix_buffers_no_gain_t>		Mixer::mix_buffers_no_gain 	{nullptr};
+std::atomic<Mixer::apply_gain_vector_t>		Mixer::apply_gain_vector 	{nullptr};
+std::atomic<Mixer::apply_gain_ramp_t>		Mixer::apply_gain_ramp 		{nullptr};
+std::atomic<Mixer::mix_with_gain_vector_t>		Mixer::mix_with_gain_vector 	{nullptr};
+std::atomic<Mixer::interleave_stereo_t>		Mixer::interleave_stereo 	{nullptr};
 
 
 
@@ -40,6 +57,21 @@ float default_compute_peak (const audio_sample_t* buf, nframes_t nsamples, float
         return current;
 }
 
+// Updates min and max with the lowest and highest sample value of buf
+void default_find_peaks (const audio_sample_t* buf, nframes_t nsamples, float* min, float* max)
+{
+        float a = *min;
+        float b = *max;
+
+        for (nframes_t i = 0; i < nsamples; ++i) {
+                a = buf[i] < a ? buf[i] : a;
+                b = buf[i] > b ? buf[i] : b;
+        }
+
+        *min = a;
+        *max = b;
+}
+
 void default_apply_gain_to_buffer (audio_sample_t* buf, nframes_t nframes, float gain)
 {
         for (nframes_t i=0; i<nframes; i++)
@@ -60,6 +92,49 @@ void default_mix_buffers_no_gain (audio_sample_t* dst, const audio_sample_t* src
         }
 }
 
+void default_apply_gain_vector (audio_sample_t* buf, const audio_sample_t* gains, nframes_t nframes, float gain)
+{
+        if (gain == 1.0f) {
+                for (nframes_t i = 0; i < nframes; i++) {
+                        buf[i] *= gains[i];
+                }
+                return;
+        }
+
+        for (nframes_t i = 0; i < nframes; i++) {
+                buf[i] *= gains[i] * gain;
+        }
+}
+
+// The gain of the last frame is endGain - step, so the next buffer can start with endGain
+void default_apply_gain_ramp (audio_sample_t* buf, nframes_t nframes, float startGain, float endGain)
+{
+        if (nframes == 0) {
+                return;
+        }
+
+        const float step = (endGain - startGain) / float(nframes);
+
+        for (nframes_t i = 0; i < nframes; i++) {
+                buf[i] *= startGain + float(i) * step;
+        }
+}
+
+void default_mix_with_gain_vector (audio_sample_t* dst, const audio_sample_t* src, const audio_sample_t* gains, nframes_t nframes, float gain)
+{
+        for (nframes_t i = 0; i < nframes; i++) {
+                dst[i] += src[i] * gains[i] * gain;
+        }
+}
+
+void default_interleave_stereo (audio_sample_t* dst, const audio_sample_t* left, const audio_sample_t* right, nframes_t nframes)
+{
+        for (nframes_t i = 0; i < nframes; i++) {
+                dst[2 * i] = left[i];
+                dst[2 * i + 1] = right[i];
+        }
+}
+
 
 #if defined (__APPLE__) && defined (BUILD_VECLIB_OPTIMIZATIONS)
 #include <Accelerate/Accelerate.h>
@@ -73,8 +148,12 @@ float veclib_compute_peak (const audio_sample_t* buf, nframes_t nsamples, float
 
 void veclib_find_peaks (const audio_sample_t* buf, nframes_t nframes, float *min, float *max)
 {
-	vDSP_maxv (const_cast<audio_sample_t*>(buf), 1, max, nframes);
-	vDSP_minv (const_cast<audio_sample_t*>(buf), 1, min, nframes);
+	float tmpmin = 0.0f;
+	float tmpmax = 0.0f;
+	vDSP_maxv (const_cast<audio_sample_t*>(buf), 1, &tmpmax, nframes);
+	vDSP_minv (const_cast<audio_sample_t*>(buf), 1, &tmpmin, nframes);
+	*max = tmpmax > *max ? tmpmax : *max;
+	*min = tmpmin < *min ? tmpmin : *min;
 }
 
 void veclib_apply_gain_to_buffer (audio_sample_t * buf, nframes_t nframes, float gain)
@@ -94,4 +173,406 @@ void veclib_mix_buffers_no_gain (audio_sample_t * dst, const audio_sample_t * sr
 	vDSP_vsma(src, 1, &gain, dst, 1, dst, 1, nframes);
 }
 
+void veclib_apply_gain_vector (audio_sample_t * buf, const audio_sample_t * gains, nframes_t nframes, float gain)
+{
+	vDSP_vmul(buf, 1, gains, 1, buf, 1, nframes);
+	if (gain != 1.0f) {
+		vDSP_vsmul(buf, 1, &gain, buf, 1, nframes);
+	}
+}
+
+void veclib_apply_gain_ramp (audio_sample_t * buf, nframes_t nframes, float startGain, float endGain)
+{
+	if (nframes == 0) {
+		return;
+	}
+	float step = (endGain - startGain) / float(nframes);
+	vDSP_vrampmul(buf, 1, &startGain, &step, buf, 1, nframes);
+}
+
+void veclib_mix_with_gain_vector (audio_sample_t * dst, const audio_sample_t * src, const audio_sample_t * gains, nframes_t nframes, float gain)
+{
+	if (gain != 1.0f) {
+		default_mix_with_gain_vector(dst, src, gains, nframes, gain);
+		return;
+	}
+	// dst = src * gains + dst
+	vDSP_vma(src, 1, gains, 1, dst, 1, dst, 1, nframes);
+}
+
+void veclib_interleave_stereo (audio_sample_t * dst, const audio_sample_t * left, const audio_sample_t * right, nframes_t nframes)
+{
+	// A split complex vector is just a pair of channels
+	DSPSplitComplex split;
+	split.realp = const_cast<audio_sample_t*>(left);
+	split.imagp = const_cast<audio_sample_t*>(right);
+	vDSP_ztoc(&split, 1, reinterpret_cast<DSPComplex*>(dst), 2, nframes);
+}
+
 #endif
+
+
+#if (defined (ARCH_X86) || defined (ARCH_X86_64)) && defined (SSE_OPTIMIZATIONS) && defined (USE_XMMINTRIN)
+#include <xmmintrin.h>
+
+void x86_sse_find_peaks (const audio_sample_t* buf, nframes_t nframes, float *min, float *max)
+{
+        nframes_t i = 0;
+        float a = *min;
+        float b = *max;
+
+        // Process the unaligned head one sample at a time
+        while (i < nframes && (reinterpret_cast<uintptr_t>(buf + i) & 15)) {
+                a = buf[i] < a ? buf[i] : a;
+                b = buf[i] > b ? buf[i] : b;
+                ++i;
+        }
+
+        if (nframes - i >= 4) {
+                __m128 vmin = _mm_set1_ps(a);
+                __m128 vmax = _mm_set1_ps(b);
+
+                for (; i + 4 <= nframes; i += 4) {
+                        __m128 v = _mm_load_ps(buf + i);
+                        vmin = _mm_min_ps(vmin, v);
+                        vmax = _mm_max_ps(vmax, v);
+                }
+
+                float mins[4], maxs[4];
+                _mm_storeu_ps(mins, vmin);
+                _mm_storeu_ps(maxs, vmax);
+
+                for (int j = 0; j < 4; ++j) {
+                        a = mins[j] < a ? mins[j] : a;
+                        b = maxs[j] > b ? maxs[j] : b;
+                }
+        }
+
+        for (; i < nframes; ++i) {
+                a = buf[i] < a ? buf[i] : a;
+                b = buf[i] > b ? buf[i] : b;
+        }
+
+        *min = a;
+        *max = b;
+}
+
+// The buffers of the audio path aren't guaranteed to be 16 byte aligned, hence the unaligned loads/stores
+
+void x86_sse_apply_gain_vector (audio_sample_t* buf, const audio_sample_t* gains, nframes_t nframes, float gain)
+{
+        nframes_t i = 0;
+        const __m128 vgain = _mm_set1_ps(gain);
+
+        for (; i + 4 <= nframes; i += 4) {
+                __m128 g = _mm_mul_ps(_mm_loadu_ps(gains + i), vgain);
+                _mm_storeu_ps(buf + i, _mm_mul_ps(_mm_loadu_ps(buf + i), g));
+        }
+
+        for (; i < nframes; ++i) {
+                buf[i] *= gains[i] * gain;
+        }
+}
+
+void x86_sse_apply_gain_ramp (audio_sample_t* buf, nframes_t nframes, float startGain, float endGain)
+{
+        if (nframes == 0) {
+                return;
+        }
+
+        const float step = (endGain - startGain) / float(nframes);
+        nframes_t i = 0;
+
+        // Compute the gain from the index for every block, adding up the step
+        // would accumulate rounding errors over the buffer
+        const __m128 vstep = _mm_set1_ps(step);
+        const __m128 vstart = _mm_set1_ps(startGain);
+        __m128 vindex = _mm_set_ps(3.0f, 2.0f, 1.0f, 0.0f);
+        const __m128 vfour = _mm_set1_ps(4.0f);
+
+        for (; i + 4 <= nframes; i += 4) {
+                __m128 g = _mm_add_ps(vstart, _mm_mul_ps(vindex, vstep));
+                _mm_storeu_ps(buf + i, _mm_mul_ps(_mm_loadu_ps(buf + i), g));
+                vindex = _mm_add_ps(vindex, vfour);
+        }
+
+        for (; i < nframes; ++i) {
+                buf[i] *= startGain + float(i) * step;
+        }
+}
+
+void x86_sse_mix_with_gain_vector (audio_sample_t* dst, const audio_sample_t* src, const audio_sample_t* gains, nframes_t nframes, float gain)
+{
+        nframes_t i = 0;
+        const __m128 vgain = _mm_set1_ps(gain);
+
+        for (; i + 4 <= nframes; i += 4) {
+                __m128 g = _mm_mul_ps(_mm_loadu_ps(gains + i), vgain);
+                __m128 s = _mm_mul_ps(_mm_loadu_ps(src + i), g);
+                _mm_storeu_ps(dst + i, _mm_add_ps(_mm_loadu_ps(dst + i), s));
+        }
+
+        for (; i < nframes; ++i) {
+                dst[i] += src[i] * gains[i] * gain;
+        }
+}
+
+void x86_sse_interleave_stereo (audio_sample_t* dst, const audio_sample_t* left, const audio_sample_t* right, nframes_t nframes)
+{
+        nframes_t i = 0;
+
+        for (; i + 4 <= nframes; i += 4) {
+                __m128 l = _mm_loadu_ps(left + i);
+                __m128 r = _mm_loadu_ps(right + i);
+                _mm_storeu_ps(dst + 2 * i, _mm_unpacklo_ps(l, r));
+                _mm_storeu_ps(dst + 2 * i + 4, _mm_unpackhi_ps(l, r));
+        }
+
+        for (; i < nframes; ++i) {
+                dst[2 * i] = left[i];
+                dst[2 * i + 1] = right[i];
+        }
+}
+
+#endif
+
+
+/*
+ * Profiling wrappers, they replace the Mixer functions while the TDspProfiler is enabled
+ * and forward to the functions selected at startup. The function name is used as the
+ * profiled object.
+ */
+
+static std::atomic<Mixer::compute_peak_t>		s_compute_peak{nullptr};
+static std::atomic<Mixer::apply_gain_to_buffer_t>	s_apply_gain_to_buffer{nullptr};
+static std::atomic<Mixer::mix_buffers_with_gain_t>	s_mix_buffers_with_gain{nullptr};
+static std::atomic<Mixer::mix_buffers_no_gain_t>	s_mix_buffers_no_gain{nullptr};
+static std::atomic<Mixer::apply_gain_vector_t>	s_apply_gain_vector{nullptr};
+static std::atomic<Mixer::apply_gain_ramp_t>		s_apply_gain_ramp{nullptr};
+static std::atomic<Mixer::mix_with_gain_vector_t>	s_mix_with_gain_vector{nullptr};
+
+static float profiled_compute_peak (const audio_sample_t* buf, nframes_t nsamples, float current)
+{
+        TDspProfileScope scope(TDspProfiler::MIXER, "compute_peak");
+        return s_compute_peak(buf, nsamples, current);
+}
+
+static void profiled_apply_gain_to_buffer (audio_sample_t* buf, nframes_t nframes, float gain)
+{
+        TDspProfileScope scope(TDspProfiler::MIXER, "apply_gain_to_buffer");
+        s_apply_gain_to_buffer(buf, nframes, gain);
+}
+
+static void profiled_mix_buffers_with_gain (audio_sample_t* dst, const audio_sample_t* src, nframes_t nframes, float gain)
+{
+        TDspProfileScope scope(TDspProfiler::MIXER, "mix_buffers_with_gain");
+        s_mix_buffers_with_gain(dst, src, nframes, gain);
+}
+
+static void profiled_mix_buffers_no_gain (audio_sample_t* dst, const audio_sample_t* src, nframes_t nframes)
+{
+        TDspProfileScope scope(TDspProfiler::MIXER, "mix_buffers_no_gain");
+        s_mix_buffers_no_gain(dst, src, nframes);
+}
+
+static void profiled_apply_gain_vector (audio_sample_t* buf, const audio_sample_t* gains, nframes_t nframes, float gain)
+{
+        TDspProfileScope scope(TDspProfiler::MIXER, "apply_gain_vector");
+        s_apply_gain_vector(buf, gains, nframes, gain);
+}
+
+static void profiled_apply_gain_ramp (audio_sample_t* buf, nframes_t nframes, float startGain, float endGain)
+{
+        TDspProfileScope scope(TDspProfiler::MIXER, "apply_gain_ramp");
+        s_apply_gain_ramp(buf, nframes, startGain, endGain);
+}
+
+static void profiled_mix_with_gain_vector (audio_sample_t* dst, const audio_sample_t* src, const audio_sample_t* gains, nframes_t nframes, float gain)
+{
+        TDspProfileScope scope(TDspProfiler::MIXER, "mix_with_gain_vector");
+        s_mix_with_gain_vector(dst, src, gains, nframes, gain);
+}
+
+/**
+ *	Swaps the Mixer functions used in the audio processing path with their profiling
+ *	wrappers, or restores the original ones. Called by TDspProfiler::set_enabled().
+ */
+void Mixer::set_profiling_enabled(bool enabled)
+{
+        bool profiling = (mix_buffers_no_gain == profiled_mix_buffers_no_gain);
+
+        if (enabled == profiling) {
+                return;
+        }
+
+        if (enabled) {
+                s_compute_peak = compute_peak.load();
+                s_apply_gain_to_buffer = apply_gain_to_buffer.load();
+                s_mix_buffers_with_gain = mix_buffers_with_gain.load();
+                s_mix_buffers_no_gain = mix_buffers_no_gain.load();
+                s_apply_gain_vector = apply_gain_vector.load();
+                s_apply_gain_ramp = apply_gain_ramp.load();
+                s_mix_with_gain_vector = mix_with_gain_vector.load();
+
+                compute_peak = profiled_compute_peak;
+                apply_gain_to_buffer = profiled_apply_gain_to_buffer;
+                mix_buffers_with_gain = profiled_mix_buffers_with_gain;
+                mix_buffers_no_gain = profiled_mix_buffers_no_gain;
+                apply_gain_vector = profiled_apply_gain_vector;
+                apply_gain_ramp = profiled_apply_gain_ramp;
+                mix_with_gain_vector = profiled_mix_with_gain_vector;
+        } else {
+                compute_peak = s_compute_peak.load();
+                apply_gain_to_buffer = s_apply_gain_to_buffer.load();
+                mix_buffers_with_gain = s_mix_buffers_with_gain.load();
+                mix_buffers_no_gain = s_mix_buffers_no_gain.load();
+                apply_gain_vector = s_apply_gain_vector.load();
+                apply_gain_ramp = s_apply_gain_ramp.load();
+                mix_with_gain_vector = s_mix_with_gain_vector.load();
+        }
+}
+
+
+static void setup_fpu()
+{
+
+        // export TRAVERSO_RUNNING_UNDER_VALGRIND to disable assembler stuff below!
+        if (getenv("TRAVERSO_RUNNING_UNDER_VALGRIND")) {
+                printf("TRAVERSO_RUNNING_UNDER_VALGRIND=TRUE\n");
+                // valgrind doesn't understand this assembler stuff
+                // September 10th, 2007
+                return;
+        }
+
+#if (defined(ARCH_X86) || defined(ARCH_X86_64)) && defined(USE_XMMINTRIN)
+
+        int MXCSR;
+        FPU fpu;
+
+        /* XXX use real code to determine if the processor supports
+        DenormalsAreZero and FlushToZero
+        */
+
+        if (!fpu.has_flush_to_zero() && !fpu.has_denormals_are_zero()) {
+                return;
+        }
+
+        MXCSR  = _mm_getcsr();
+
+        /*	switch (Config->get_denormal_model()) {
+                case DenormalNone:
+                        MXCSR &= ~(_MM_FLUSH_ZERO_ON|0x8000);
+                        break;
+
+                case DenormalFTZ:
+                        if (fpu.has_flush_to_zero()) {
+                                MXCSR |= _MM_FLUSH_ZERO_ON;
+                        }
+                        break;
+
+                case DenormalDAZ:*/
+        MXCSR &= ~_MM_FLUSH_ZERO_ON;
+        if (fpu.has_denormals_are_zero()) {
+                MXCSR |= 0x8000;
+        }
+        // 			break;
+        //
+        // 		case DenormalFTZDAZ:
+        // 			if (fpu.has_flush_to_zero()) {
+        // 				if (fpu.has_denormals_are_zero()) {
+        // 					MXCSR |= _MM_FLUSH_ZERO_ON | 0x8000;
+        // 				} else {
+        // 					MXCSR |= _MM_FLUSH_ZERO_ON;
+        // 				}
+        // 			}
+        // 			break;
+        // 	}
+
+        _mm_setcsr (MXCSR);
+
+#endif
+}
+
+/**
+ *	Selects the fastest implementation of the Mixer functions for the cpu we run on,
+ *	and enables denormals are zero. Has to be called once at startup, before any
+ *	audio processing takes place.
+ */
+void Mixer::init_functions()
+{
+        bool generic_mix_functions = true;
+
+        FPU fpu;
+
+#if (defined (ARCH_X86) || defined (ARCH_X86_64)) && defined (SSE_OPTIMIZATIONS)
+
+        if (fpu.has_sse()) {
+
+                printf("Using SSE optimized routines\n");
+
+                // SSE SET
+                Mixer::compute_peak		= x86_sse_compute_peak;
+#if defined (USE_XMMINTRIN)
+                Mixer::find_peaks		= x86_sse_find_peaks;
+                Mixer::apply_gain_vector	= x86_sse_apply_gain_vector;
+                Mixer::apply_gain_ramp		= x86_sse_apply_gain_ramp;
+                Mixer::mix_with_gain_vector	= x86_sse_mix_with_gain_vector;
+                Mixer::interleave_stereo	= x86_sse_interleave_stereo;
+#else
+                Mixer::find_peaks		= default_find_peaks;
+                Mixer::apply_gain_vector	= default_apply_gain_vector;
+                Mixer::apply_gain_ramp		= default_apply_gain_ramp;
+                Mixer::mix_with_gain_vector	= default_mix_with_gain_vector;
+                Mixer::interleave_stereo	= default_interleave_stereo;
+#endif
+                Mixer::apply_gain_to_buffer 	= x86_sse_apply_gain_to_buffer;
+                Mixer::mix_buffers_with_gain 	= x86_sse_mix_buffers_with_gain;
+                Mixer::mix_buffers_no_gain 	= x86_sse_mix_buffers_no_gain;
+
+                generic_mix_functions = false;
+
+        }
+
+#elif defined (__APPLE__) && defined (BUILD_VECLIB_OPTIMIZATIONS)
+        long sysVersion = 0;
+
+        if (noErr != Gestalt(gestaltSystemVersion, &sysVersion))
+                sysVersion = 0;
+
+        if (sysVersion >= 0x00001040) { // Tiger at least
+                Mixer::compute_peak           = veclib_compute_peak;
+                Mixer::find_peaks             = veclib_find_peaks;
+                Mixer::apply_gain_to_buffer   = veclib_apply_gain_to_buffer;
+                Mixer::mix_buffers_with_gain  = veclib_mix_buffers_with_gain;
+                Mixer::mix_buffers_no_gain    = veclib_mix_buffers_no_gain;
+                Mixer::apply_gain_vector      = veclib_apply_gain_vector;
+                Mixer::apply_gain_ramp        = veclib_apply_gain_ramp;
+                Mixer::mix_with_gain_vector   = veclib_mix_with_gain_vector;
+                Mixer::interleave_stereo      = veclib_interleave_stereo;
+
+                generic_mix_functions = false;
+
+                printf("Apple VecLib H/W specific optimizations in use\n");
+        }
+#endif
+
+        /* consider FPU denormal handling to be "h/w optimization" */
+
+        setup_fpu ();
+
+
+        if (generic_mix_functions) {
+                Mixer::compute_peak 		= default_compute_peak;
+                Mixer::find_peaks 		= default_find_peaks;
+                Mixer::apply_gain_to_buffer 	= default_apply_gain_to_buffer;
+                Mixer::mix_buffers_with_gain 	= default_mix_buffers_with_gain;
+                Mixer::mix_buffers_no_gain 	= default_mix_buffers_no_gain;
+                Mixer::apply_gain_vector 	= default_apply_gain_vector;
+                Mixer::apply_gain_ramp 		= default_apply_gain_ramp;
+                Mixer::mix_with_gain_vector 	= default_mix_with_gain_vector;
+                Mixer::interleave_stereo 	= default_interleave_stereo;
+
+                printf("No Hardware specific optimizations in use\n");
+        }
+
+}
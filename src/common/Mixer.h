@@ -24,6 +24,7 @@
 #define TRAVERSO_MIXER_H
 
 #include "defines.h"
+#include <atomic>
 #include <cmath>
 
 
@@ -61,9 +62,14 @@ static inline float coefficient_to_dB (float coeff)
 
 
 float default_compute_peak			(const audio_sample_t*  buf, nframes_t nsamples, float current);
+void  default_find_peaks			(const audio_sample_t*  buf, nframes_t nsamples, float* min, float* max);
 void  default_apply_gain_to_buffer		(audio_sample_t*  buf, nframes_t nframes, float gain);
 void  default_mix_buffers_with_gain		(audio_sample_t*  dst, const audio_sample_t*  src, nframes_t nframes, float gain);
 void  default_mix_buffers_no_gain		(audio_sample_t*  dst, const audio_sample_t*  src, nframes_t nframes);
+void  default_apply_gain_vector			(audio_sample_t*  buf, const audio_sample_t*  gains, nframes_t nframes, float gain);
+void  default_apply_gain_ramp			(audio_sample_t*  buf, nframes_t nframes, float startGain, float endGain);
+void  default_mix_with_gain_vector		(audio_sample_t*  dst, const audio_sample_t*  src, const audio_sample_t*  gains, nframes_t nframes, float gain);
+void  default_interleave_stereo			(audio_sample_t*  dst, const audio_sample_t*  left, const audio_sample_t*  right, nframes_t nframes);
 
 
 #if (defined (ARCH_X86) || defined (ARCH_X86_64)) && defined (SSE_OPTIMIZATIONS)
@@ -76,14 +82,27 @@ extern "C"
         void  x86_sse_mix_buffers_with_gain	(audio_sample_t*  dst, const audio_sample_t*  src, nframes_t nframes, float gain);
         void  x86_sse_mix_buffers_no_gain	(audio_sample_t*  dst, const audio_sample_t*  src, nframes_t nframes);
 }
+
+#if defined (USE_XMMINTRIN)
+void  x86_sse_find_peaks			(const audio_sample_t*  buf, nframes_t nsamples, float* min, float* max);
+void  x86_sse_apply_gain_vector			(audio_sample_t*  buf, const audio_sample_t*  gains, nframes_t nframes, float gain);
+void  x86_sse_apply_gain_ramp			(audio_sample_t*  buf, nframes_t nframes, float startGain, float endGain);
+void  x86_sse_mix_with_gain_vector		(audio_sample_t*  dst, const audio_sample_t*  src, const audio_sample_t*  gains, nframes_t nframes, float gain);
+void  x86_sse_interleave_stereo			(audio_sample_t*  dst, const audio_sample_t*  left, const audio_sample_t*  right, nframes_t nframes);
+#endif
 #endif
 
 #if defined (__APPLE__)  && defined (BUILD_VECLIB_OPTIMIZATIONS)
 
 float veclib_compute_peak              (const audio_sample_t* buf, nframes_t nsamples, float current);
+void  veclib_find_peaks                (const audio_sample_t* buf, nframes_t nsamples, float* min, float* max);
 void  veclib_apply_gain_to_buffer      (audio_sample_t* buf, nframes_t nframes, float gain);
 void  veclib_mix_buffers_with_gain     (audio_sample_t* dst, const audio_sample_t* src, nframes_t nframes, float gain);
 void  veclib_mix_buffers_no_gain       (audio_sample_t* dst, const audio_sample_t* src, nframes_t nframes);
+void  veclib_apply_gain_vector         (audio_sample_t* buf, const audio_sample_t* gains, nframes_t nframes, float gain);
+void  veclib_apply_gain_ramp           (audio_sample_t* buf, nframes_t nframes, float startGain, float endGain);
+void  veclib_mix_with_gain_vector      (audio_sample_t* dst, const audio_sample_t* src, const audio_sample_t* gains, nframes_t nframes, float gain);
+void  veclib_interleave_stereo         (audio_sample_t* dst, const audio_sample_t* left, const audio_sample_t* right, nframes_t nframes);
 
 #endif
 
@@ -91,14 +110,33 @@ class Mixer
 {
 public:
         typedef float (*compute_peak_t)			(const audio_sample_t* , nframes_t, float);
+        typedef void  (*find_peaks_t)			(const audio_sample_t* , nframes_t, float*, float*);
         typedef void  (*apply_gain_to_buffer_t)		(audio_sample_t* , nframes_t, float);
         typedef void  (*mix_buffers_with_gain_t)	(audio_sample_t* , const audio_sample_t* , nframes_t, float);
         typedef void  (*mix_buffers_no_gain_t)		(audio_sample_t* , const audio_sample_t* , nframes_t);
-
-        static compute_peak_t		compute_peak;
-        static apply_gain_to_buffer_t	apply_gain_to_buffer;
-        static mix_buffers_with_gain_t	mix_buffers_with_gain;
-        static mix_buffers_no_gain_t	mix_buffers_no_gain;
+        typedef void  (*apply_gain_vector_t)		(audio_sample_t* , const audio_sample_t* , nframes_t, float);
+        typedef void  (*apply_gain_ramp_t)		(audio_sample_t* , nframes_t, float, float);
+        typedef void  (*mix_with_gain_vector_t)		(audio_sample_t* , const audio_sample_t* , const audio_sample_t* , nframes_t, float);
+        typedef void  (*interleave_stereo_t)		(audio_sample_t* , const audio_sample_t* , const audio_sample_t* , nframes_t);
+
+        // The function pointers are atomic, set_profiling_enabled() swaps them
+        // while other threads are calling them
+        static std::atomic<compute_peak_t>		compute_peak;
+        static std::atomic<find_peaks_t>		find_peaks;
+        static std::atomic<apply_gain_to_buffer_t>	apply_gain_to_buffer;
+        static std::atomic<mix_buffers_with_gain_t>	mix_buffers_with_gain;
+        static std::atomic<mix_buffers_no_gain_t>	mix_buffers_no_gain;
+        // buf[i] *= gains[i] * gain
+        static std::atomic<apply_gain_vector_t>	apply_gain_vector;
+        // buf[i] *= gain, with gain going linearly from startGain towards endGain
+        static std::atomic<apply_gain_ramp_t>	apply_gain_ramp;
+        // dst[i] += src[i] * gains[i] * gain
+        static std::atomic<mix_with_gain_vector_t>	mix_with_gain_vector;
+        // dst[2 * i] = left[i], dst[2 * i + 1] = right[i]
+        static std::atomic<interleave_stereo_t>	interleave_stereo;
+
+        static void init_functions();
+        static void set_profiling_enabled(bool enabled);
 };
 
 #endif
@@ -0,0 +1,281 @@
+/*
+Copyright (C) 2024 Remon Sijrier
+
+This file is part of Traverso
+
+Traverso is free software; you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation; either version 2 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program; if not, write to the Free Software
+Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA.
+
+*/
+
+#include "TDspProfiler.h"
+
+#include "Mixer.h"
+
+#include <QMutexLocker>
+
+#include <algorithm>
+#include <climits>
+
+// Always put me below _all_ includes, this is needed
+// in case we run with memory leak detection enabled!
+#include "Debugger.h"
+
+/** \class TDspProfiler
+ *	\brief Collects the time spent per Track, Clip, Plugin, Curve, Fade and Mixer function
+ *
+ *	The audio processing code measures itself with a TDspProfileScope. While profiling
+ *	is enabled each thread writes it's measurements into it's own lock free ringbuffer,
+ *	so the audio thread and the realtime worker threads never wait on each other or on
+ *	the GUI. A thread claims it's ringbuffer with register_thread() when it starts, the
+ *	measurements of threads that didn't register are dropped. The GUI calls collect()
+ *	periodically to move the measurements into the per object statistics returned by
+ *	get_statistics().
+ *
+ *	Objects are only identified by their address, it's up to the caller of get_statistics()
+ *	to map them to something readable. Statistics of deleted objects stay around until reset().
+ */
+
+std::atomic<bool> TDspProfiler::s_enabled{false};
+
+// The ringbuffer index of the calling thread, -1 if it didn't register. Trivially
+// destructible, so using it in record() never registers a thread exit handler
+static thread_local int t_threadBufferIndex = -1;
+
+// Releases the ringbuffer of a thread when the thread exits, so it can be reused.
+// Only touched by register_thread(), outside the audio processing path
+struct TDspProfilerThreadBuffer {
+    bool registered = false;
+
+    ~TDspProfilerThreadBuffer() {
+        if (t_threadBufferIndex >= 0) {
+            dsp_profiler().release_thread_buffer(t_threadBufferIndex);
+            t_threadBufferIndex = -1;
+        }
+    }
+};
+
+static thread_local TDspProfilerThreadBuffer t_threadBuffer;
+
+
+TDspProfiler& dsp_profiler()
+{
+    static TDspProfiler profiler;
+    return profiler;
+}
+
+
+TDspProfiler::TDspProfiler()
+{
+}
+
+TDspProfiler::~TDspProfiler()
+{
+    for (auto& threadBuffer : m_threadBuffers) {
+        delete threadBuffer.samples.load();
+    }
+}
+
+/**
+ *	Enables or disables profiling. The ringbuffers are allocated the first time
+ *	profiling is enabled, so this must not be called from the audio thread.
+ */
+void TDspProfiler::set_enabled(bool enabled)
+{
+    QMutexLocker locker(&m_mutex);
+
+    if (enabled) {
+        for (auto& threadBuffer : m_threadBuffers) {
+            if (!threadBuffer.samples.load()) {
+                threadBuffer.samples.store(new RingBufferNPT<Sample>(SAMPLES_PER_THREAD));
+            }
+        }
+        s_enabled.store(true);
+        Mixer::set_profiling_enabled(true);
+    } else {
+        Mixer::set_profiling_enabled(false);
+        s_enabled.store(false);
+    }
+}
+
+/**
+ *	Claims a ringbuffer for the calling thread, it's released again when the thread exits.
+ *	Call this when an audio processing thread starts, before it processes anything. The
+ *	first use of a thread_local with a destructor may allocate, so this must not happen
+ *	lazily in record().
+ */
+void TDspProfiler::register_thread()
+{
+    if (t_threadBufferIndex >= 0) {
+        return;
+    }
+
+    t_threadBufferIndex = claim_thread_buffer();
+
+    // Registers the thread exit handler which releases the ringbuffer
+    t_threadBuffer.registered = true;
+
+    if (t_threadBufferIndex < 0) {
+        printf("DspProfiler: No free thread buffer, measurements of this thread are dropped\n");
+    }
+}
+
+/**
+ *	Records \a duration in nanoseconds for \a object. Doesn't lock or allocate, measurements
+ *	are dropped when the calling thread's ringbuffer is full or the calling thread didn't
+ *	call register_thread().
+ */
+void TDspProfiler::record(Category category, const void* object, trav_time_t duration)
+{
+    if (t_threadBufferIndex < 0) {
+        return;
+    }
+
+    RingBufferNPT<Sample>* samples = m_threadBuffers[t_threadBufferIndex].samples.load(std::memory_order_acquire);
+    if (!samples) {
+        return;
+    }
+
+    Sample sample;
+    sample.object = object;
+    sample.category = quint32(category);
+    sample.duration = quint32(qBound(trav_time_t(0), duration, trav_time_t(UINT_MAX)));
+
+    samples->write(&sample, 1);
+}
+
+/**
+ *	Moves the measurements of all threads into the statistics. Call this often enough
+ *	to keep the ringbuffers from overflowing, a few times a second is fine.
+ */
+void TDspProfiler::collect()
+{
+    QMutexLocker locker(&m_mutex);
+
+    Sample samples[1024];
+
+    for (auto& threadBuffer : m_threadBuffers) {
+        RingBufferNPT<Sample>* threadSamples = threadBuffer.samples.load();
+        if (!threadSamples) {
+            continue;
+        }
+
+        size_t read;
+        while ((read = threadSamples->read(samples, 1024)) > 0) {
+            for (size_t i = 0; i < read; ++i) {
+                const Sample& sample = samples[i];
+                Accumulator& accumulator = m_accumulators[qMakePair(int(sample.category), sample.object)];
+
+                accumulator.count++;
+                accumulator.total += sample.duration;
+                accumulator.worst = qMax(accumulator.worst, trav_time_t(sample.duration));
+
+                if (accumulator.recent.size() < RECENT_DURATIONS) {
+                    accumulator.recent.append(sample.duration);
+                } else {
+                    accumulator.recent[accumulator.recentIndex] = sample.duration;
+                    accumulator.recentIndex = (accumulator.recentIndex + 1) % RECENT_DURATIONS;
+                }
+            }
+        }
+    }
+}
+
+void TDspProfiler::reset()
+{
+    QMutexLocker locker(&m_mutex);
+
+    Sample samples[1024];
+
+    for (auto& threadBuffer : m_threadBuffers) {
+        RingBufferNPT<Sample>* threadSamples = threadBuffer.samples.load();
+        if (threadSamples) {
+            while (threadSamples->read(samples, 1024) > 0) {
+            }
+        }
+    }
+
+    m_accumulators.clear();
+}
+
+/**
+ *	Returns the statistics of all profiled objects, the median and 99th percentile
+ *	are calculated over the most recent measurements of each object.
+ */
+QList<TDspProfiler::Statistics> TDspProfiler::get_statistics()
+{
+    QMutexLocker locker(&m_mutex);
+
+    QList<Statistics> list;
+
+    for (auto it = m_accumulators.constBegin(); it != m_accumulators.constEnd(); ++it) {
+        const Accumulator& accumulator = it.value();
+
+        Statistics statistics;
+        statistics.category = Category(it.key().first);
+        statistics.object = it.key().second;
+        statistics.count = accumulator.count;
+        statistics.total = accumulator.total;
+        statistics.worst = accumulator.worst;
+        statistics.median = statistics.percentile99 = 0;
+
+        QVector<quint32> recent = accumulator.recent;
+        if (!recent.isEmpty()) {
+            auto median = recent.begin() + recent.size() / 2;
+            std::nth_element(recent.begin(), median, recent.end());
+            statistics.median = *median;
+
+            auto percentile99 = recent.begin() + (recent.size() * 99) / 100;
+            std::nth_element(recent.begin(), percentile99, recent.end());
+            statistics.percentile99 = *percentile99;
+        }
+
+        list.append(statistics);
+    }
+
+    return list;
+}
+
+QString TDspProfiler::category_name(Category category)
+{
+    switch (category) {
+    case CYCLE: return "Cycle";
+    case TRACK: return "Track";
+    case CLIP: return "Clip";
+    case PLUGIN: return "Plugin";
+    case CURVE: return "Curve";
+    case FADE: return "Fade";
+    case MIXER: return "Mixer";
+    default: return "Unknown";
+    }
+}
+
+int TDspProfiler::claim_thread_buffer()
+{
+    for (int i = 0; i < MAX_THREADS; ++i) {
+        bool inUse = false;
+        if (m_threadBuffers[i].inUse.compare_exchange_strong(inUse, true)) {
+            return i;
+        }
+    }
+
+    return -1;
+}
+
+void TDspProfiler::release_thread_buffer(int index)
+{
+    m_threadBuffers[index].inUse.store(false);
+}
+
+//eof
@@ -0,0 +1,149 @@
+/*
+Copyright (C) 2024 Remon Sijrier
+
+This file is part of Traverso
+
+Traverso is free software; you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation; either version 2 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program; if not, write to the Free Software
+Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA.
+
+*/
+
+#ifndef TDSPPROFILER_H
+#define TDSPPROFILER_H
+
+#include <QHash>
+#include <QList>
+#include <QMutex>
+#include <QPair>
+#include <QVector>
+#include <atomic>
+
+#include "RingBufferNPT.h"
+#include "TTimeRef.h"
+#include "defines.h"
+
+class TDspProfiler
+{
+public:
+    enum Category {
+        CYCLE,
+        TRACK,
+        CLIP,
+        PLUGIN,
+        CURVE,
+        FADE,
+        MIXER,
+        CATEGORY_COUNT
+    };
+
+    struct Statistics {
+        Category    category;
+        // The profiled object, for MIXER a static const char* with the function name
+        const void* object;
+        qint64      count;
+        trav_time_t total;
+        trav_time_t worst;
+        trav_time_t median;
+        trav_time_t percentile99;
+    };
+
+    static bool is_enabled() {return s_enabled.load(std::memory_order_relaxed);}
+
+    void set_enabled(bool enabled);
+    void register_thread();
+    void record(Category category, const void* object, trav_time_t duration);
+    void collect();
+    void reset();
+
+    QList<Statistics> get_statistics();
+
+    static QString category_name(Category category);
+
+private:
+    static const int MAX_THREADS = 32;
+    static const int SAMPLES_PER_THREAD = 65536;
+    // Amount of most recent durations kept per object for the percentiles
+    static const int RECENT_DURATIONS = 2048;
+
+    struct Sample {
+        const void* object;
+        quint32     category;
+        quint32     duration;
+    };
+
+    struct ThreadBuffer {
+        std::atomic<RingBufferNPT<Sample>*> samples{nullptr};
+        std::atomic<bool>       inUse{false};
+    };
+
+    struct Accumulator {
+        qint64              count = 0;
+        trav_time_t         total = 0;
+        trav_time_t         worst = 0;
+        QVector<quint32>    recent;
+        int                 recentIndex = 0;
+    };
+
+    static std::atomic<bool>    s_enabled;
+
+    ThreadBuffer                m_threadBuffers[MAX_THREADS];
+    QHash<QPair<int, const void*>, Accumulator> m_accumulators;
+    QMutex                      m_mutex;
+
+    int claim_thread_buffer();
+    void release_thread_buffer(int index);
+
+    TDspProfiler();
+    ~TDspProfiler();
+    TDspProfiler(const TDspProfiler&);
+
+    // allow this function to create one instance
+    friend TDspProfiler& dsp_profiler();
+    friend struct TDspProfilerThreadBuffer;
+};
+
+// use this function to access the DSP load profiler
+TDspProfiler& dsp_profiler();
+
+
+/**
+ *	Measures the time spent in the enclosing scope and records it with the TDspProfiler.
+ *	When profiling is disabled this costs a single atomic load.
+ */
+class TDspProfileScope
+{
+public:
+    TDspProfileScope(TDspProfiler::Category category, const void* object)
+        : m_category(category)
+        , m_object(object)
+        , m_startTime(TDspProfiler::is_enabled() ? TTimeRef::get_nanoseconds_since_epoch() : 0)
+    {
+    }
+
+    ~TDspProfileScope()
+    {
+        if (m_startTime) {
+            dsp_profiler().record(m_category, m_object, TTimeRef::get_nanoseconds_since_epoch() - m_startTime);
+        }
+    }
+
+private:
+    TDspProfiler::Category  m_category;
+    const void*             m_object;
+    trav_time_t             m_startTime;
+};
+
+#endif
+
+//eof
@@ -0,0 +1,421 @@
+/*
+Copyright (C) 2024 Remon Sijrier
+
+This file is part of Traverso
+
+Traverso is free software; you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation; either version 2 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program; if not, write to the Free Software
+Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA.
+
+*/
+
+#include "TFlightRecorder.h"
+
+#include "TConfig.h"
+#include "TTimeRef.h"
+#include "Utils.h"
+
+#include <QDateTime>
+#include <QDir>
+#include <QFile>
+#include <QMutexLocker>
+#include <QTextStream>
+
+#include <algorithm>
+
+// Always put me below _all_ includes, this is needed
+// in case we run with memory leak detection enabled!
+#include "Debugger.h"
+
+/** \class TFlightRecorder
+ *	\brief Keeps the recent history of the audio pipeline and writes it to disk when an xrun happens
+ *
+ *	The audio thread, DiskIO and the ReadSources record cycle times, DiskIO refill and seek
+ *	times, rt queue depths and BufferStatus sync status changes into a fixed size, lock free
+ *	ring of events. Recording an event doesn't lock or allocate, so it's save to do from
+ *	any realtime thread.
+ *
+ *	An underrun, resync or xrun calls trigger(). About a second later, so the events
+ *	following the trigger are captured too, the last few seconds of history are written
+ *	as a snapshot into Hardware/FlightRecorderDirectory, together with a summary that helps
+ *	to tell disk starvation apart from DSP overload.
+ *
+ *	The recorder is enabled with Hardware/FlightRecorderEnabled and has to be created
+ *	in the GUI thread, AudioDevice takes care of that.
+ */
+
+std::atomic<bool> TFlightRecorder::s_enabled{false};
+
+// Keep in sync with BufferStatus::SyncStatus
+static const char* syncStatusNames[] = {
+    "Unknown",
+    "Out of sync",
+    "In sync",
+    "Seeking",
+    "Seeked",
+    "Dequeue failure",
+    "Enqueue failure"
+};
+
+static QString sync_status_name(qint64 status)
+{
+    if (status < 0 || status >= qint64(sizeof(syncStatusNames) / sizeof(syncStatusNames[0]))) {
+        return QString::number(status);
+    }
+    return syncStatusNames[status];
+}
+
+static QString ns_to_ms(qint64 nanoSeconds)
+{
+    return QString::number(double(nanoSeconds) / 1000000.0, 'f', 3);
+}
+
+
+TFlightRecorder& flight_recorder()
+{
+    static TFlightRecorder recorder;
+    return recorder;
+}
+
+
+TFlightRecorder::TFlightRecorder()
+{
+    m_events = nullptr;
+    m_writeIndex = 0;
+    m_triggerPending = false;
+    m_triggerTime = 0;
+    m_triggerType = XRUN;
+
+    m_snapshotDir = config().get_property("Hardware", "FlightRecorderDirectory", QDir::homePath() + "/.traverso/xruns").toString();
+
+    if (config().get_property("Hardware", "FlightRecorderEnabled", true).toBool()) {
+        m_events = new Event[EVENT_COUNT];
+        connect(&m_snapshotTimer, SIGNAL(timeout()), this, SLOT(check_trigger()));
+        m_snapshotTimer.start(250);
+        s_enabled.store(true);
+    }
+}
+
+TFlightRecorder::~TFlightRecorder()
+{
+    s_enabled.store(false);
+    delete [] m_events;
+}
+
+/**
+ *	Adds an event to the ring, the oldest event is overwritten. Doesn't lock or allocate.
+ *	\a object identifies where the event came from, see set_object_name().
+ */
+void TFlightRecorder::record(EventType type, const void* object, qint64 value1, qint64 value2)
+{
+    if (!is_enabled()) {
+        return;
+    }
+
+    quint64 index = m_writeIndex.fetch_add(1, std::memory_order_relaxed);
+    Event& event = m_events[index & (EVENT_COUNT - 1)];
+
+    // Readers skip the event until the new sequence number is stored
+    event.sequence.store(0, std::memory_order_relaxed);
+    std::atomic_thread_fence(std::memory_order_release);
+
+    event.time = TTimeRef::get_nanoseconds_since_epoch();
+    event.object = object;
+    event.value1 = value1;
+    event.value2 = value2;
+    event.type = quint32(type);
+
+    event.sequence.store(index + 1, std::memory_order_release);
+}
+
+/**
+ *	Records the event and schedules a snapshot. Triggers that arrive while a
+ *	snapshot is pending end up in that snapshot.
+ */
+void TFlightRecorder::trigger(EventType type, const void* object, qint64 value1, qint64 value2)
+{
+    if (!is_enabled()) {
+        return;
+    }
+
+    record(type, object, value1, value2);
+
+    bool pending = false;
+    if (m_triggerPending.compare_exchange_strong(pending, true)) {
+        m_triggerType.store(type, std::memory_order_relaxed);
+        m_triggerTime.store(TTimeRef::get_nanoseconds_since_epoch(), std::memory_order_release);
+    }
+}
+
+/**
+ *	Makes \a object show up as \a name instead of it's address in the snapshots.
+ *	Must not be called from a realtime thread.
+ */
+void TFlightRecorder::set_object_name(const void* object, const QString& name)
+{
+    QMutexLocker locker(&m_objectNamesMutex);
+    m_objectNames.insert(object, name);
+}
+
+void TFlightRecorder::check_trigger()
+{
+    if (!m_triggerPending.load()) {
+        return;
+    }
+
+    trav_time_t triggerTime = m_triggerTime.load(std::memory_order_acquire);
+    if (triggerTime == 0 || TTimeRef::get_nanoseconds_since_epoch() - triggerTime < POST_TRIGGER_TIME) {
+        return;
+    }
+
+    write_snapshot(EventType(m_triggerType.load(std::memory_order_relaxed)), triggerTime);
+
+    m_triggerTime.store(0);
+    m_triggerPending.store(false);
+}
+
+QList<TFlightRecorder::EventCopy> TFlightRecorder::copy_events(trav_time_t from, trav_time_t to)
+{
+    QList<EventCopy> events;
+
+    quint64 end = m_writeIndex.load(std::memory_order_acquire);
+    quint64 start = end > quint64(EVENT_COUNT) ? end - EVENT_COUNT : 0;
+
+    for (quint64 index = start; index < end; ++index) {
+        Event& event = m_events[index & (EVENT_COUNT - 1)];
+
+        quint64 sequence = event.sequence.load(std::memory_order_acquire);
+        if (sequence != index + 1) {
+            continue;
+        }
+
+        EventCopy copy;
+        copy.time = event.time;
+        copy.object = event.object;
+        copy.value1 = event.value1;
+        copy.value2 = event.value2;
+        copy.type = EventType(event.type);
+
+        // The event was overwritten while copying it
+        std::atomic_thread_fence(std::memory_order_acquire);
+        if (event.sequence.load(std::memory_order_relaxed) != sequence) {
+            continue;
+        }
+
+        if (copy.time >= from && copy.time <= to && copy.type < EVENT_TYPE_COUNT) {
+            events.append(copy);
+        }
+    }
+
+    // Events of different threads can be stored slightly out of order
+    std::stable_sort(events.begin(), events.end(), [](const EventCopy& a, const EventCopy& b) {
+        return a.time < b.time;
+    });
+
+    return events;
+}
+
+void TFlightRecorder::write_snapshot(EventType reason, trav_time_t triggerTime)
+{
+    QList<EventCopy> events = copy_events(triggerTime - PRE_TRIGGER_TIME, triggerTime + POST_TRIGGER_TIME);
+
+    QDir dir;
+    if (!dir.mkpath(m_snapshotDir)) {
+        PERROR(QString("FlightRecorder: Unable to create directory %1").arg(m_snapshotDir));
+        return;
+    }
+
+    QDateTime now = QDateTime::currentDateTime();
+    QString fileName = m_snapshotDir + "/xrun-" + now.toString("yyyyMMdd-hhmmss-zzz") + ".txt";
+
+    QFile file(fileName);
+    if (!file.open(QIODevice::WriteOnly | QIODevice::Text)) {
+        PERROR(QString("FlightRecorder: Unable to write snapshot %1").arg(fileName));
+        return;
+    }
+
+    QHash<const void*, QString> objectNames;
+    m_objectNamesMutex.lock();
+    objectNames = m_objectNames;
+    m_objectNamesMutex.unlock();
+
+    auto object_name = [&objectNames](const void* object) {
+        if (!object) {
+            return QString("-");
+        }
+        QString name = objectNames.value(object);
+        if (name.isEmpty()) {
+            name = QString("0x%1").arg(quintptr(object), 0, 16);
+        }
+        return name;
+    };
+
+    auto relative_time = [triggerTime](trav_time_t time) {
+        return ns_to_ms(time - triggerTime);
+    };
+
+    int eventCounts[EVENT_TYPE_COUNT] = {};
+    int overBudgetCycles = 0;
+    double worstLoad = 0;
+    trav_time_t worstLoadTime = triggerTime;
+    qint64 worstRefill = 0;
+    trav_time_t worstRefillTime = triggerTime;
+    qint64 lowestDepth = -1;
+    const void* lowestDepthObject = nullptr;
+    trav_time_t lowestDepthTime = triggerTime;
+
+    for (const auto& event : events) {
+        eventCounts[event.type]++;
+
+        switch (event.type) {
+        case CYCLE:
+            if (event.value2 > 0) {
+                double load = (double(event.value1) * 100.0) / double(event.value2);
+                if (load > worstLoad) {
+                    worstLoad = load;
+                    worstLoadTime = event.time;
+                }
+                if (event.value1 > event.value2) {
+                    overBudgetCycles++;
+                }
+            }
+            break;
+        case DISKIO_REFILL:
+            if (event.value1 > worstRefill) {
+                worstRefill = event.value1;
+                worstRefillTime = event.time;
+            }
+            break;
+        case QUEUE_DEPTH:
+        case UNDERRUN:
+            if (lowestDepth < 0 || event.value1 < lowestDepth) {
+                lowestDepth = event.value1;
+                lowestDepthObject = event.object;
+                lowestDepthTime = event.time;
+            }
+            break;
+        default:
+            break;
+        }
+    }
+
+    bool dspOverload = worstLoad >= 90.0;
+    bool diskStarvation = eventCounts[UNDERRUN] > 0 || eventCounts[RESYNC] > 0 || lowestDepth == 0;
+
+    QTextStream out(&file);
+
+    out << "Traverso xrun snapshot\n";
+    out << "Reason: " << event_name(reason) << "\n";
+    out << "Date: " << now.toString(Qt::ISODateWithMs) << "\n";
+    out << "Window: " << ns_to_ms(-PRE_TRIGGER_TIME) << " ms to " << ns_to_ms(POST_TRIGGER_TIME) << " ms around the trigger\n";
+    out << "\n";
+
+    out << "Summary\n";
+    out << "  Cycles: " << eventCounts[CYCLE] << ", over budget: " << overBudgetCycles
+        << ", worst load: " << QString::number(worstLoad, 'f', 1) << " % at " << relative_time(worstLoadTime) << " ms\n";
+    out << "  DiskIO refills: " << eventCounts[DISKIO_REFILL] << ", worst: " << ns_to_ms(worstRefill)
+        << " ms at " << relative_time(worstRefillTime) << " ms\n";
+    if (lowestDepth >= 0) {
+        out << "  Lowest rt queue depth: " << lowestDepth << " slots, " << object_name(lowestDepthObject)
+            << " at " << relative_time(lowestDepthTime) << " ms\n";
+    }
+    out << "  Seeks: " << eventCounts[SEEK_START] << ", underruns: " << eventCounts[UNDERRUN]
+        << ", resyncs: " << eventCounts[RESYNC] << ", xruns: " << eventCounts[XRUN] << "\n";
+
+    out << "  Hint: ";
+    if (dspOverload && diskStarvation) {
+        out << "Audio cycles ran close to their budget and the rt queues ran dry, both DSP overload and disk starvation\n";
+    } else if (dspOverload) {
+        out << "Audio cycles ran close to or over their budget, DSP overload is the likely cause\n";
+    } else if (diskStarvation) {
+        out << "Audio cycles stayed within budget while the rt queues ran dry, disk starvation is the likely cause\n";
+    } else {
+        out << "No DSP overload or disk starvation recorded, the driver or the system might be the cause\n";
+    }
+    out << "\n";
+
+    out << "Events\n";
+    out << "time (ms);event;object;details\n";
+
+    for (const auto& event : events) {
+        QString details;
+
+        switch (event.type) {
+        case CYCLE:
+            details = QString("time %1 ms, budget %2 ms").arg(ns_to_ms(event.value1), ns_to_ms(event.value2));
+            break;
+        case DISKIO_REFILL:
+            details = QString("time %1 ms, sources %2").arg(ns_to_ms(event.value1)).arg(event.value2);
+            break;
+        case DISKIO_SEEK:
+            details = QString("time %1 ms").arg(ns_to_ms(event.value1));
+            break;
+        case SEEK_START:
+        case RESYNC:
+            details = QString("location %1 ms").arg(event.value1);
+            break;
+        case QUEUE_DEPTH:
+            details = QString("slots %1, fill status %2 %").arg(event.value1).arg(event.value2);
+            break;
+        case SYNC_STATUS:
+            details = QString("%1 -> %2").arg(sync_status_name(event.value1), sync_status_name(event.value2));
+            break;
+        case UNDERRUN:
+            details = QString("slots %1").arg(event.value1);
+            break;
+        case XRUN:
+            details = QString("count %1").arg(event.value1);
+            break;
+        default:
+            break;
+        }
+
+        out << relative_time(event.time) << ";" << event_name(event.type) << ";"
+            << object_name(event.object) << ";" << details << "\n";
+    }
+
+    file.close();
+
+    printf("FlightRecorder: %s snapshot written to %s\n", QS_C(event_name(reason)), QS_C(fileName));
+
+    remove_old_snapshots();
+}
+
+void TFlightRecorder::remove_old_snapshots()
+{
+    QDir dir(m_snapshotDir);
+    QStringList snapshots = dir.entryList(QStringList() << "xrun-*.txt", QDir::Files, QDir::Name);
+
+    // The file names sort by date, oldest first
+    for (int i = 0; i < snapshots.size() - MAX_SNAPSHOT_FILES; ++i) {
+        dir.remove(snapshots.at(i));
+    }
+}
+
+QString TFlightRecorder::event_name(EventType type)
+{
+    switch (type) {
+    case CYCLE: return "Cycle";
+    case DISKIO_REFILL: return "DiskIO refill";
+    case DISKIO_SEEK: return "DiskIO seek";
+    case SEEK_START: return "Seek start";
+    case QUEUE_DEPTH: return "Queue depth";
+    case SYNC_STATUS: return "Sync status";
+    case UNDERRUN: return "Underrun";
+    case RESYNC: return "Resync";
+    case XRUN: return "Xrun";
+    default: return "Unknown";
+    }
+}
+
+//eof
@@ -0,0 +1,121 @@
+/*
+Copyright (C) 2024 Remon Sijrier
+
+This file is part of Traverso
+
+Traverso is free software; you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation; either version 2 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program; if not, write to the Free Software
+Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA.
+
+*/
+
+#ifndef TFLIGHTRECORDER_H
+#define TFLIGHTRECORDER_H
+
+#include <QObject>
+#include <QHash>
+#include <QList>
+#include <QMutex>
+#include <QString>
+#include <QTimer>
+#include <atomic>
+
+#include "defines.h"
+
+class TFlightRecorder : public QObject
+{
+    Q_OBJECT
+
+public:
+    enum EventType {
+        CYCLE,              // value1: cycle time, value2: cycle budget, both in ns
+        DISKIO_REFILL,      // value1: do_work() time in ns, value2: amount of refilled sources
+        DISKIO_SEEK,        // value1: seek time in ns
+        SEEK_START,         // value1: seek location in ms
+        QUEUE_DEPTH,        // value1: filled rt queue slots, value2: fill status in percent
+        SYNC_STATUS,        // value1: previous, value2: new BufferStatus::SyncStatus
+        UNDERRUN,           // value1: filled rt queue slots
+        RESYNC,             // value1: requested location in ms
+        XRUN,               // value1: xrun count
+        EVENT_TYPE_COUNT
+    };
+
+    static bool is_enabled() {return s_enabled.load(std::memory_order_relaxed);}
+
+    // RT thread save functions
+    void record(EventType type, const void* object, qint64 value1 = 0, qint64 value2 = 0);
+    void trigger(EventType type, const void* object, qint64 value1 = 0, qint64 value2 = 0);
+
+    void set_object_name(const void* object, const QString& name);
+
+    static QString event_name(EventType type);
+
+private:
+    // Must be a power of 2
+    static const int EVENT_COUNT = 65536;
+    // Amount of history before and after the trigger that goes into the snapshot
+    static const trav_time_t PRE_TRIGGER_TIME = 5000000000;
+    static const trav_time_t POST_TRIGGER_TIME = 1000000000;
+    static const int MAX_SNAPSHOT_FILES = 50;
+
+    struct Event {
+        // 0 while the event is being written, index + 1 afterwards
+        std::atomic<quint64>    sequence{0};
+        trav_time_t             time;
+        const void*             object;
+        qint64                  value1;
+        qint64                  value2;
+        quint32                 type;
+    };
+
+    struct EventCopy {
+        trav_time_t             time;
+        const void*             object;
+        qint64                  value1;
+        qint64                  value2;
+        EventType               type;
+    };
+
+    static std::atomic<bool>    s_enabled;
+
+    Event*                      m_events;
+    std::atomic<quint64>        m_writeIndex;
+    std::atomic<bool>           m_triggerPending;
+    std::atomic<trav_time_t>    m_triggerTime;
+    std::atomic<int>            m_triggerType;
+    QHash<const void*, QString> m_objectNames;
+    QMutex                      m_objectNamesMutex;
+    QTimer                      m_snapshotTimer;
+    QString                     m_snapshotDir;
+
+    QList<EventCopy> copy_events(trav_time_t from, trav_time_t to);
+    void write_snapshot(EventType reason, trav_time_t triggerTime);
+    void remove_old_snapshots();
+
+    TFlightRecorder();
+    ~TFlightRecorder();
+    TFlightRecorder(const TFlightRecorder&);
+
+    // allow this function to create one instance
+    friend TFlightRecorder& flight_recorder();
+
+private slots:
+    void check_trigger();
+};
+
+// use this function to access the xrun flight recorder
+TFlightRecorder& flight_recorder();
+
+#endif
+
+//eof
@@ -0,0 +1,446 @@
+/*
+Copyright (C) 2024 Remon Sijrier
+
+This file is part of Traverso
+
+Traverso is free software; you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation; either version 2 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program; if not, write to the Free Software
+Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA.
+
+*/
+
+
+#include "TSampleConverter.h"
+
+#include "Mixer.h"
+#include "fpu.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cstdio>
+#include <cstring>
+
+#if (defined (ARCH_X86) || defined (ARCH_X86_64)) && defined (SSE_OPTIMIZATIONS) && defined (USE_XMMINTRIN) && defined (__SSE2__)
+#define SAMPLE_CONVERTER_SSE2
+#include <emmintrin.h>
+#endif
+
+/** \class TSampleConverter
+ *	\brief Conversion between the planar float buffers used for processing and the
+ *	interleaved float and integer formats of audio files and audio drivers
+ *
+ *	The conversions are function pointers selected at startup by init_functions(),
+ *	like the Mixer functions. The SSE2 versions vectorize the mono and stereo cases,
+ *	the strides 1 and 2, other strides fall back to plain loops. Packed 24 bit samples
+ *	need byte shuffles SSE2 doesn't have, they're always converted by the plain loops.
+ *
+ *	Integer samples map to [-1, 1) by dividing by 2^(bitDepth - 1), the way back rounds
+ *	to the nearest value and clips. The 16 and 24 bit conversions optionally add triangular
+ *	(TPDF) dither of 1 LSB, generated with a xorshift generator for each of the 4 lanes.
+ */
+
+static const float SCALE_16BIT = 32768.0f;
+static const float SCALE_24BIT = 8388608.0f;
+static const float SCALE_32BIT = 2147483648.0f;
+// The largest float below 2^31, float can't represent INT_MAX
+static const float MAX_INT32_FLOAT = 2147483520.0f;
+
+
+TDitherState::TDitherState()
+{
+    seeds[0] = 22222;
+    seeds[1] = 0x9E3779B9;
+    seeds[2] = 0x7F4A7C15;
+    seeds[3] = 0x2545F491;
+}
+
+static inline float tpdf_noise(uint32_t& seed)
+{
+    seed ^= seed << 13;
+    seed ^= seed >> 17;
+    seed ^= seed << 5;
+    // The difference of two uniform values has a triangular distribution
+    return float(int32_t(seed & 0xffff) - int32_t(seed >> 16)) * (1.0f / 65536.0f);
+}
+
+
+static void default_float_to_float(audio_sample_t* dst, uint dstStride, const float* src, uint srcStride, nframes_t nframes)
+{
+    if (dstStride == 1 && srcStride == 1) {
+        memcpy(dst, src, nframes * sizeof(audio_sample_t));
+        return;
+    }
+
+    for (nframes_t i = 0; i < nframes; ++i) {
+        dst[i * dstStride] = src[i * srcStride];
+    }
+}
+
+static void default_int16_to_float(audio_sample_t* dst, const int16_t* src, uint srcStride, nframes_t nframes)
+{
+    for (nframes_t i = 0; i < nframes; ++i) {
+        dst[i] = float(src[i * srcStride]) * (1.0f / SCALE_16BIT);
+    }
+}
+
+static void default_int24_to_float(audio_sample_t* dst, const char* src, uint srcStride, nframes_t nframes)
+{
+    const unsigned char* bytes = reinterpret_cast<const unsigned char*>(src);
+    const uint byteStride = srcStride * 3;
+
+    for (nframes_t i = 0; i < nframes; ++i) {
+        const unsigned char* sample = bytes + i * byteStride;
+        // Assemble in the upper 24 bits, the arithmetic shift does the sign extension
+        int32_t value = int32_t(uint32_t(sample[0]) << 8 | uint32_t(sample[1]) << 16 | uint32_t(sample[2]) << 24) >> 8;
+        dst[i] = float(value) * (1.0f / SCALE_24BIT);
+    }
+}
+
+static void default_int32_to_float(audio_sample_t* dst, const int32_t* src, uint srcStride, nframes_t nframes, float scale)
+{
+    for (nframes_t i = 0; i < nframes; ++i) {
+        dst[i] = float(src[i * srcStride]) * scale;
+    }
+}
+
+static void default_float_to_int16(int16_t* dst, uint dstStride, const audio_sample_t* src, nframes_t nframes, TDitherState* dither)
+{
+    for (nframes_t i = 0; i < nframes; ++i) {
+        float value = src[i] * SCALE_16BIT;
+        if (dither) {
+            value += tpdf_noise(dither->seeds[0]);
+        }
+        value = std::max(-SCALE_16BIT, std::min(SCALE_16BIT - 1.0f, value));
+        dst[i * dstStride] = int16_t(lrintf(value));
+    }
+}
+
+static void default_float_to_int24(char* dst, uint dstStride, const audio_sample_t* src, nframes_t nframes, TDitherState* dither)
+{
+    const uint byteStride = dstStride * 3;
+
+    for (nframes_t i = 0; i < nframes; ++i) {
+        float value = src[i] * SCALE_24BIT;
+        if (dither) {
+            value += tpdf_noise(dither->seeds[0]);
+        }
+        value = std::max(-SCALE_24BIT, std::min(SCALE_24BIT - 1.0f, value));
+        int32_t sample = int32_t(lrintf(value));
+
+        char* bytes = dst + i * byteStride;
+        bytes[0] = char(sample);
+        bytes[1] = char(sample >> 8);
+        bytes[2] = char(sample >> 16);
+    }
+}
+
+static void default_float_to_int32(int32_t* dst, uint dstStride, const audio_sample_t* src, nframes_t nframes, float scale)
+{
+    for (nframes_t i = 0; i < nframes; ++i) {
+        float value = std::max(-SCALE_32BIT, std::min(MAX_INT32_FLOAT, src[i] * scale));
+        dst[i * dstStride] = int32_t(lrintf(value));
+    }
+}
+
+
+#if defined (SAMPLE_CONVERTER_SSE2)
+
+/*
+ * The stride 2 loops stop one frame early, the vector loads and stores of the last
+ * iteration would otherwise touch the sample after the last one of the channel.
+ * The stride 2 stores keep the samples of the other channel, they're read back
+ * and merged in.
+ */
+
+static inline __m128 sse2_tpdf_noise(__m128i& seeds)
+{
+    seeds = _mm_xor_si128(seeds, _mm_slli_epi32(seeds, 13));
+    seeds = _mm_xor_si128(seeds, _mm_srli_epi32(seeds, 17));
+    seeds = _mm_xor_si128(seeds, _mm_slli_epi32(seeds, 5));
+
+    __m128i low = _mm_and_si128(seeds, _mm_set1_epi32(0xffff));
+    __m128i high = _mm_srli_epi32(seeds, 16);
+
+    return _mm_mul_ps(_mm_cvtepi32_ps(_mm_sub_epi32(low, high)), _mm_set1_ps(1.0f / 65536.0f));
+}
+
+static void x86_sse2_float_to_float(audio_sample_t* dst, uint dstStride, const float* src, uint srcStride, nframes_t nframes)
+{
+    if (dstStride == 1 && srcStride == 1) {
+        memcpy(dst, src, nframes * sizeof(audio_sample_t));
+        return;
+    }
+
+    nframes_t i = 0;
+
+    if (dstStride == 1 && srcStride == 2) {
+        for (; i + 5 <= nframes; i += 4) {
+            __m128 a = _mm_loadu_ps(src + 2 * i);
+            __m128 b = _mm_loadu_ps(src + 2 * i + 4);
+            _mm_storeu_ps(dst + i, _mm_shuffle_ps(a, b, _MM_SHUFFLE(2, 0, 2, 0)));
+        }
+    } else if (dstStride == 2 && srcStride == 1) {
+        for (; i + 5 <= nframes; i += 4) {
+            __m128 samples = _mm_loadu_ps(src + i);
+            __m128 first = _mm_loadu_ps(dst + 2 * i);
+            __m128 second = _mm_loadu_ps(dst + 2 * i + 4);
+            first = _mm_shuffle_ps(first, first, _MM_SHUFFLE(3, 1, 3, 1));
+            second = _mm_shuffle_ps(second, second, _MM_SHUFFLE(3, 1, 3, 1));
+            _mm_storeu_ps(dst + 2 * i, _mm_unpacklo_ps(samples, first));
+            _mm_storeu_ps(dst + 2 * i + 4, _mm_unpackhi_ps(samples, second));
+        }
+    }
+
+    for (; i < nframes; ++i) {
+        dst[i * dstStride] = src[i * srcStride];
+    }
+}
+
+static void x86_sse2_int16_to_float(audio_sample_t* dst, const int16_t* src, uint srcStride, nframes_t nframes)
+{
+    const __m128 scale = _mm_set1_ps(1.0f / SCALE_16BIT);
+    nframes_t i = 0;
+
+    if (srcStride == 1) {
+        for (; i + 8 <= nframes; i += 8) {
+            __m128i samples = _mm_loadu_si128(reinterpret_cast<const __m128i*>(src + i));
+            __m128i low = _mm_srai_epi32(_mm_unpacklo_epi16(samples, samples), 16);
+            __m128i high = _mm_srai_epi32(_mm_unpackhi_epi16(samples, samples), 16);
+            _mm_storeu_ps(dst + i, _mm_mul_ps(_mm_cvtepi32_ps(low), scale));
+            _mm_storeu_ps(dst + i + 4, _mm_mul_ps(_mm_cvtepi32_ps(high), scale));
+        }
+    } else if (srcStride == 2) {
+        for (; i + 5 <= nframes; i += 4) {
+            __m128i samples = _mm_loadu_si128(reinterpret_cast<const __m128i*>(src + 2 * i));
+            __m128i even = _mm_srai_epi32(_mm_slli_epi32(samples, 16), 16);
+            _mm_storeu_ps(dst + i, _mm_mul_ps(_mm_cvtepi32_ps(even), scale));
+        }
+    }
+
+    for (; i < nframes; ++i) {
+        dst[i] = float(src[i * srcStride]) * (1.0f / SCALE_16BIT);
+    }
+}
+
+static void x86_sse2_int32_to_float(audio_sample_t* dst, const int32_t* src, uint srcStride, nframes_t nframes, float scale)
+{
+    const __m128 scaleVector = _mm_set1_ps(scale);
+    nframes_t i = 0;
+
+    if (srcStride == 1) {
+        for (; i + 4 <= nframes; i += 4) {
+            __m128i samples = _mm_loadu_si128(reinterpret_cast<const __m128i*>(src + i));
+            _mm_storeu_ps(dst + i, _mm_mul_ps(_mm_cvtepi32_ps(samples), scaleVector));
+        }
+    } else if (srcStride == 2) {
+        for (; i + 5 <= nframes; i += 4) {
+            __m128 a = _mm_castsi128_ps(_mm_loadu_si128(reinterpret_cast<const __m128i*>(src + 2 * i)));
+            __m128 b = _mm_castsi128_ps(_mm_loadu_si128(reinterpret_cast<const __m128i*>(src + 2 * i + 4)));
+            __m128i even = _mm_castps_si128(_mm_shuffle_ps(a, b, _MM_SHUFFLE(2, 0, 2, 0)));
+            _mm_storeu_ps(dst + i, _mm_mul_ps(_mm_cvtepi32_ps(even), scaleVector));
+        }
+    }
+
+    for (; i < nframes; ++i) {
+        dst[i] = float(src[i * srcStride]) * scale;
+    }
+}
+
+static void x86_sse2_float_to_int16(int16_t* dst, uint dstStride, const audio_sample_t* src, nframes_t nframes, TDitherState* dither)
+{
+    const __m128 scale = _mm_set1_ps(SCALE_16BIT);
+    const __m128 minimum = _mm_set1_ps(-SCALE_16BIT);
+    const __m128 maximum = _mm_set1_ps(SCALE_16BIT - 1.0f);
+    const __m128 silence = _mm_setzero_ps();
+    __m128i seeds = dither ? _mm_loadu_si128(reinterpret_cast<const __m128i*>(dither->seeds)) : _mm_setzero_si128();
+    nframes_t i = 0;
+
+    if (dstStride == 1) {
+        for (; i + 8 <= nframes; i += 8) {
+            __m128 low = _mm_mul_ps(_mm_loadu_ps(src + i), scale);
+            __m128 high = _mm_mul_ps(_mm_loadu_ps(src + i + 4), scale);
+            low = _mm_add_ps(low, dither ? sse2_tpdf_noise(seeds) : silence);
+            high = _mm_add_ps(high, dither ? sse2_tpdf_noise(seeds) : silence);
+            low = _mm_min_ps(_mm_max_ps(low, minimum), maximum);
+            high = _mm_min_ps(_mm_max_ps(high, minimum), maximum);
+            __m128i samples = _mm_packs_epi32(_mm_cvtps_epi32(low), _mm_cvtps_epi32(high));
+            _mm_storeu_si128(reinterpret_cast<__m128i*>(dst + i), samples);
+        }
+    } else if (dstStride == 2) {
+        const __m128i lowMask = _mm_set1_epi32(0x0000ffff);
+        for (; i + 5 <= nframes; i += 4) {
+            __m128 value = _mm_mul_ps(_mm_loadu_ps(src + i), scale);
+            value = _mm_add_ps(value, dither ? sse2_tpdf_noise(seeds) : silence);
+            value = _mm_min_ps(_mm_max_ps(value, minimum), maximum);
+            __m128i samples = _mm_and_si128(_mm_cvtps_epi32(value), lowMask);
+            __m128i other = _mm_andnot_si128(lowMask, _mm_loadu_si128(reinterpret_cast<const __m128i*>(dst + 2 * i)));
+            _mm_storeu_si128(reinterpret_cast<__m128i*>(dst + 2 * i), _mm_or_si128(other, samples));
+        }
+    }
+
+    if (dither) {
+        _mm_storeu_si128(reinterpret_cast<__m128i*>(dither->seeds), seeds);
+    }
+
+    default_float_to_int16(dst + i * dstStride, dstStride, src + i, nframes - i, dither);
+}
+
+static void x86_sse2_float_to_int32(int32_t* dst, uint dstStride, const audio_sample_t* src, nframes_t nframes, float scale)
+{
+    const __m128 scaleVector = _mm_set1_ps(scale);
+    const __m128 minimum = _mm_set1_ps(-SCALE_32BIT);
+    const __m128 maximum = _mm_set1_ps(MAX_INT32_FLOAT);
+    nframes_t i = 0;
+
+    if (dstStride == 1) {
+        for (; i + 4 <= nframes; i += 4) {
+            __m128 value = _mm_mul_ps(_mm_loadu_ps(src + i), scaleVector);
+            value = _mm_min_ps(_mm_max_ps(value, minimum), maximum);
+            _mm_storeu_si128(reinterpret_cast<__m128i*>(dst + i), _mm_cvtps_epi32(value));
+        }
+    } else if (dstStride == 2) {
+        for (; i + 5 <= nframes; i += 4) {
+            __m128 value = _mm_mul_ps(_mm_loadu_ps(src + i), scaleVector);
+            value = _mm_min_ps(_mm_max_ps(value, minimum), maximum);
+            __m128i samples = _mm_cvtps_epi32(value);
+            __m128i first = _mm_loadu_si128(reinterpret_cast<const __m128i*>(dst + 2 * i));
+            __m128i second = _mm_loadu_si128(reinterpret_cast<const __m128i*>(dst + 2 * i + 4));
+            first = _mm_shuffle_epi32(first, _MM_SHUFFLE(3, 1, 3, 1));
+            second = _mm_shuffle_epi32(second, _MM_SHUFFLE(3, 1, 3, 1));
+            _mm_storeu_si128(reinterpret_cast<__m128i*>(dst + 2 * i), _mm_unpacklo_epi32(samples, first));
+            _mm_storeu_si128(reinterpret_cast<__m128i*>(dst + 2 * i + 4), _mm_unpackhi_epi32(samples, second));
+        }
+    }
+
+    default_float_to_int32(dst + i * dstStride, dstStride, src + i, nframes - i, scale);
+}
+
+#endif
+
+
+TSampleConverter::float_to_float_t TSampleConverter::float_to_float = default_float_to_float;
+TSampleConverter::int16_to_float_t TSampleConverter::int16_to_float = default_int16_to_float;
+TSampleConverter::int24_to_float_t TSampleConverter::int24_to_float = default_int24_to_float;
+TSampleConverter::int32_to_float_t TSampleConverter::int32_to_float = default_int32_to_float;
+TSampleConverter::float_to_int16_t TSampleConverter::float_to_int16 = default_float_to_int16;
+TSampleConverter::float_to_int24_t TSampleConverter::float_to_int24 = default_float_to_int24;
+TSampleConverter::float_to_int32_t TSampleConverter::float_to_int32 = default_float_to_int32;
+
+
+/**
+ *	Returns the factor that maps right aligned integer samples of \a bitDepth bits to [-1, 1)
+ */
+float TSampleConverter::int32_scale(uint bitDepth)
+{
+    bitDepth = std::max(1u, std::min(32u, bitDepth));
+    return 1.0f / float(uint64_t(1) << (bitDepth - 1));
+}
+
+void TSampleConverter::deinterleave_float(audio_sample_t** dst, const float* src, uint channels, nframes_t nframes)
+{
+    for (uint chan = 0; chan < channels; ++chan) {
+        float_to_float(dst[chan], 1, src + chan, channels, nframes);
+    }
+}
+
+void TSampleConverter::deinterleave_int16(audio_sample_t** dst, const int16_t* src, uint channels, nframes_t nframes)
+{
+    for (uint chan = 0; chan < channels; ++chan) {
+        int16_to_float(dst[chan], src + chan, channels, nframes);
+    }
+}
+
+void TSampleConverter::deinterleave_int24(audio_sample_t** dst, const char* src, uint channels, nframes_t nframes)
+{
+    for (uint chan = 0; chan < channels; ++chan) {
+        int24_to_float(dst[chan], src + chan * 3, channels, nframes);
+    }
+}
+
+/**
+ *	Deinterleaves right aligned integer samples of \a bitDepth bits, like
+ *	FLAC and WavPack decode them
+ */
+void TSampleConverter::deinterleave_int32(audio_sample_t** dst, const int32_t* src, uint channels, nframes_t nframes, uint bitDepth)
+{
+    float scale = int32_scale(bitDepth);
+
+    for (uint chan = 0; chan < channels; ++chan) {
+        int32_to_float(dst[chan], src + chan, channels, nframes, scale);
+    }
+}
+
+void TSampleConverter::interleave_float(float* dst, const audio_sample_t* const* src, uint channels, nframes_t nframes)
+{
+    if (channels == 2) {
+        Mixer::interleave_stereo(dst, src[0], src[1], nframes);
+        return;
+    }
+
+    for (uint chan = 0; chan < channels; ++chan) {
+        float_to_float(dst + chan, channels, src[chan], 1, nframes);
+    }
+}
+
+void TSampleConverter::interleave_int16(int16_t* dst, const audio_sample_t* const* src, uint channels, nframes_t nframes, TDitherState* dither)
+{
+    for (uint chan = 0; chan < channels; ++chan) {
+        float_to_int16(dst + chan, channels, src[chan], nframes, dither);
+    }
+}
+
+void TSampleConverter::interleave_int24(char* dst, const audio_sample_t* const* src, uint channels, nframes_t nframes, TDitherState* dither)
+{
+    for (uint chan = 0; chan < channels; ++chan) {
+        float_to_int24(dst + chan * 3, channels, src[chan], nframes, dither);
+    }
+}
+
+void TSampleConverter::interleave_int32(int32_t* dst, const audio_sample_t* const* src, uint channels, nframes_t nframes)
+{
+    for (uint chan = 0; chan < channels; ++chan) {
+        float_to_int32(dst + chan, channels, src[chan], nframes, SCALE_32BIT);
+    }
+}
+
+/**
+ *	Selects the fastest implementation of the conversion functions for the cpu we run on.
+ *	Has to be called once at startup, before any audio file or audio device is opened.
+ */
+void TSampleConverter::init_functions()
+{
+#if defined (SAMPLE_CONVERTER_SSE2)
+    FPU fpu;
+
+    if (fpu.has_sse2()) {
+        float_to_float = x86_sse2_float_to_float;
+        int16_to_float = x86_sse2_int16_to_float;
+        int32_to_float = x86_sse2_int32_to_float;
+        float_to_int16 = x86_sse2_float_to_int16;
+        float_to_int32 = x86_sse2_float_to_int32;
+
+        printf("Using SSE2 optimized sample conversion routines\n");
+        return;
+    }
+#endif
+
+    float_to_float	= default_float_to_float;
+    int16_to_float	= default_int16_to_float;
+    int24_to_float	= default_int24_to_float;
+    int32_to_float	= default_int32_to_float;
+    float_to_int16	= default_float_to_int16;
+    float_to_int24	= default_float_to_int24;
+    float_to_int32	= default_float_to_int32;
+}
+
+//eof
@@ -0,0 +1,80 @@
+/*
+Copyright (C) 2024 Remon Sijrier
+
+This file is part of Traverso
+
+Traverso is free software; you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation; either version 2 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program; if not, write to the Free Software
+Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA.
+
+*/
+
+
+#ifndef TSAMPLECONVERTER_H
+#define TSAMPLECONVERTER_H
+
+#include "defines.h"
+#include <cstdint>
+
+// State of the triangular (TPDF) dither of the float to integer conversions,
+// use one per stream so streams don't share their noise
+struct TDitherState {
+    TDitherState();
+    uint32_t seeds[4];
+};
+
+class TSampleConverter
+{
+public:
+    // Strided single channel conversions, the stride is in samples. A stride equal to
+    // the channel count reads or writes one channel of an interleaved buffer.
+    typedef void (*float_to_float_t) (audio_sample_t* dst, uint dstStride, const float* src, uint srcStride, nframes_t nframes);
+    typedef void (*int16_to_float_t) (audio_sample_t* dst, const int16_t* src, uint srcStride, nframes_t nframes);
+    typedef void (*int24_to_float_t) (audio_sample_t* dst, const char* src, uint srcStride, nframes_t nframes);
+    typedef void (*int32_to_float_t) (audio_sample_t* dst, const int32_t* src, uint srcStride, nframes_t nframes, float scale);
+    typedef void (*float_to_int16_t) (int16_t* dst, uint dstStride, const audio_sample_t* src, nframes_t nframes, TDitherState* dither);
+    typedef void (*float_to_int24_t) (char* dst, uint dstStride, const audio_sample_t* src, nframes_t nframes, TDitherState* dither);
+    typedef void (*float_to_int32_t) (int32_t* dst, uint dstStride, const audio_sample_t* src, nframes_t nframes, float scale);
+
+    // dst[i * dstStride] = src[i * srcStride]
+    static float_to_float_t float_to_float;
+    // dst[i] = src[i * srcStride] / 32768
+    static int16_to_float_t int16_to_float;
+    // Packed little endian 24 bit samples, dst[i] = src[i * srcStride] / 8388608
+    static int24_to_float_t int24_to_float;
+    // dst[i] = src[i * srcStride] * scale, e.g. scale = 1 / 2^(bitDepth - 1) for right aligned samples
+    static int32_to_float_t int32_to_float;
+    // Rounds to the nearest value and clips, adds 1 LSB triangular dither if dither != nullptr
+    static float_to_int16_t float_to_int16;
+    static float_to_int24_t float_to_int24;
+    // dst[i * dstStride] = src[i] * scale, clipped to the int32_t range
+    static float_to_int32_t float_to_int32;
+
+    static float int32_scale(uint bitDepth);
+
+    static void deinterleave_float(audio_sample_t** dst, const float* src, uint channels, nframes_t nframes);
+    static void deinterleave_int16(audio_sample_t** dst, const int16_t* src, uint channels, nframes_t nframes);
+    static void deinterleave_int24(audio_sample_t** dst, const char* src, uint channels, nframes_t nframes);
+    static void deinterleave_int32(audio_sample_t** dst, const int32_t* src, uint channels, nframes_t nframes, uint bitDepth);
+
+    static void interleave_float(float* dst, const audio_sample_t* const* src, uint channels, nframes_t nframes);
+    static void interleave_int16(int16_t* dst, const audio_sample_t* const* src, uint channels, nframes_t nframes, TDitherState* dither);
+    static void interleave_int24(char* dst, const audio_sample_t* const* src, uint channels, nframes_t nframes, TDitherState* dither);
+    static void interleave_int32(int32_t* dst, const audio_sample_t* const* src, uint channels, nframes_t nframes);
+
+    static void init_functions();
+};
+
+#endif
+
+//eof
@@ -200,6 +200,12 @@ void Tsar::process_rt_event_signals( )
 */
 void Tsar::process_event_slot(const TsarEvent& event )
 {
+    // Typed events don't need the meta object system
+    if (event.function) {
+        event.function(event.caller, event.argument);
+        return;
+    }
+
     Q_ASSERT(event.slotindex >= 0);
 
     void *_a[] = { nullptr, const_cast<void*>(reinterpret_cast<const void*>(&event.argument)) };
@@ -248,6 +254,7 @@ void Tsar::add_rt_event(QObject *cal, void* arg, const char* signalSignature)
     TsarEvent event;
     event.caller = cal;
     event.argument = arg;
+    event.function = nullptr;
     event.slotindex = -1;
     int retrievedsignalindex = cal->metaObject()->indexOfSignal(signalSignature);
     Q_ASSERT(retrievedsignalindex >= 0);
@@ -271,9 +278,29 @@ void Tsar::prepare_event(TsarEvent &event, QObject* caller, void* argument, cons
     event.caller = caller;
     event.argument = argument;
 
+    event.function = nullptr;
+
     event.slotindex = caller->metaObject()->indexOfMethod(slotSignature);
     event.signalindex = caller->metaObject()->indexOfMethod(signalSignature);
 }
 
+/**
+ *	Prepares a typed event, \a function is called directly in the realtime thread
+ *	instead of invoking a slot through the meta object system.
+ *	Use Tsar::call() to create a \a function calling a (private) slot of \a caller.
+ */
+void Tsar::prepare_event(TsarEvent &event, QObject* caller, void* argument, TsarFunction function, const char* signalSignature )
+{
+    PENTER3;
+    Q_ASSERT(function);
+
+    event.caller = caller;
+    event.argument = argument;
+    event.function = function;
+
+    event.slotindex = -1;
+    event.signalindex = caller->metaObject()->indexOfMethod(signalSignature);
+}
+
 //eof
 
@@ -29,9 +29,13 @@ $Id: Tsar.h,v 1.4 2008/02/11 10:11:52 r_sijrier Exp $
 #include "cameron/readerwritercircularbuffer.h"
 
 
+// Plain function called in the realtime thread instead of a slot, see Tsar::call()
+typedef void (*TsarFunction)(QObject* caller, void* argument);
+
 struct TsarEvent {
     QObject* 	caller;
     void*		argument;
+    TsarFunction    function{};
     int         slotindex;
     int         signalindex;
 };
@@ -52,6 +56,14 @@ class Tsar : public QObject
 
 public:
     void prepare_event(TsarEvent &event, QObject* caller, void* argument, const char* slotSignature, const char* signalSignature);
+    void prepare_event(TsarEvent &event, QObject* caller, void* argument, TsarFunction function, const char* signalSignature);
+
+    // Typed TsarFunction calling \a Method on the caller, e.g.
+    // Tsar::call<Curve, CurveNode, &Curve::private_add_node>
+    template<typename T, typename Arg, void (T::*Method)(Arg*)>
+    static void call(QObject* caller, void* argument) {
+        (static_cast<T*>(caller)->*Method)(static_cast<Arg*>(argument));
+    }
 
     void post_gui_event(const TsarEvent &event);
     void post_rt_event(const TsarEvent& event);
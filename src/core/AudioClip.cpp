@@ -24,6 +24,7 @@ Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA.
 
 #include "ContextItem.h"
 #include "ReadSource.h"
+#include "AbstractAudioReader.h"
 #include "AudioClip.h"
 #include "AudioSource.h"
 #include "WriteSource.h"
@@ -34,6 +35,7 @@ Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA.
 #include <AudioBus.h>
 #include <AudioDevice.h>
 #include "Mixer.h"
+#include "TDspProfiler.h"
 #include "DiskIO.h"
 #include "TExportSpecification.h"
 #include "AudioClipManager.h"
@@ -51,6 +53,7 @@ Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA.
 #include "PluginChain.h"
 #include "GainEnvelope.h"
 #include "TInputEventDispatcher.h"
+#include "TRecordingTranscoder.h"
 
 
 #include <commands.h>
@@ -75,7 +78,10 @@ AudioClip::AudioClip(const QString& name)
     m_sheet = nullptr;
     m_track = nullptr;
     m_readSource = nullptr;
+    m_freewheelReadSource = nullptr;
+    m_freewheelResampleBuffer = nullptr;
     m_writer = nullptr;
+    m_transcodeSpecification = nullptr;
     m_peak = nullptr;
     m_recordingStatus = NO_RECORDING;
     m_isReadSourceValid = m_isMoving = false;
@@ -122,6 +128,8 @@ AudioClip::AudioClip(const QDomNode& node)
 AudioClip::~AudioClip()
 {
     PENTERDES;
+    finish_freewheel();
+
     if (m_readSource) {
         QMetaObject::invokeMethod(m_sheet->get_read_diskio(), "remove_and_delete_audio_source", Qt::QueuedConnection, qobject_cast<AudioSource*>(m_readSource));
     }
@@ -130,6 +138,7 @@ AudioClip::~AudioClip()
         m_peak->close();
     }
 
+    delete m_transcodeSpecification;
     delete m_locationItem;
 }
 
@@ -269,7 +278,10 @@ void AudioClip::set_sources_active_state()
         stopSyncDueMove = false;
     }
 
-    if ( m_track->is_muted() || m_track->is_muted_by_solo() || is_muted() || stopSyncDueMove) {
+    // A frozen track only streams it's frozen clip
+    bool replacedByFreeze = m_track->is_frozen() && m_track->get_frozen_clip() != this;
+
+    if ( m_track->is_muted() || m_track->is_muted_by_solo() || is_muted() || stopSyncDueMove || replacedByFreeze) {
         m_readSource->set_active(false);
     } else {
         m_readSource->set_active(true);
@@ -419,6 +431,8 @@ void AudioClip::set_selected(bool /*selected*/)
 //
 int AudioClip::process(const TTimeRef& startLocation, const TTimeRef& endLocation, nframes_t nframes)
 {
+    TDspProfileScope profileScope(TDspProfiler::CLIP, this);
+
     // Handle silence clips
     if (get_channel_count() == 0) {
         return 0;
@@ -444,15 +458,14 @@ int AudioClip::process(const TTimeRef& startLocation, const TTimeRef& endLocatio
     Q_ASSERT(m_sheet);
     Q_ASSERT(m_readSource);
 
-    AudioBus* bus = m_sheet->get_clip_render_bus();
-
     TTimeRef fileLocation;
-    audio_sample_t* mixdown[2];
+    // FIXME make it future proof so it can deal with any amount of channels?
+    audio_sample_t* mixdown[6];
     nframes_t framesToProcess = nframes;
     nframes_t offset = 0;
     uint outputRate = m_readSource->get_output_rate();
     uint channelcount = get_channel_count();
-    Q_ASSERT(bus->get_channel_count() >= channelcount);
+    Q_ASSERT(channelcount <= 6);
 
     if (startLocation < m_locationItem->get_start()) {
         fileLocation = m_sourceStartLocation;
@@ -469,48 +482,171 @@ int AudioClip::process(const TTimeRef& startLocation, const TTimeRef& endLocatio
         Q_ASSERT(framesToProcess > 0);
     }
 
-    // Read the frames from the ringbuffers
-    // FIXME change when audio thread supports realtime/freewheeling
-    bool realTime = true;
-    nframes_t readFrames = m_readSource->ringbuffer_read(bus, fileLocation, nframes, realTime);
+    QueueBufferSlot* slot = nullptr;
+    audio_sample_t** buffers;
+    nframes_t readFrames;
 
+    if (m_sheet->is_freewheeling()) {
+        // Freewheel rendering isn't bound to the audio device deadline, the
+        // audio is decoded right here instead of taken from the ringbuffers
+        buffers = freewheel_read(fileLocation, offset, framesToProcess, nframes);
 
-    if (readFrames == 0) {
-        bus->silence_buffers(nframes);
-        return 0;
-    }
+        if (!buffers) {
+            return 0;
+        }
 
-    if (readFrames != framesToProcess) {
-        std::cout << QString("AudioClip::process(): readFrames %1, framesToProcess %2").arg(readFrames).arg(framesToProcess).toLatin1().data() << &std::endl;
-    }
+        readFrames = framesToProcess;
+    } else {
+        // Get the slot holding our audio from the ringbuffers, the fades, gain
+        // and mixing are processed directly on the slot buffers so no copies are needed
+        bool realTime = true;
+        slot = m_readSource->ringbuffer_acquire_slot(fileLocation, realTime);
 
-    for(FadeCurve* fade = m_fades.first(); fade != nullptr; fade = fade->next) {
-        fade->process(bus, startLocation, endLocation, nframes);
-    }
+        if (!slot) {
+            return 0;
+        }
+
+        Q_ASSERT(slot->get_buffer_size() >= nframes);
 
-    TTimeRef faderEndLocation = fileLocation + TTimeRef(readFrames, outputRate);    
-    for (uint chan=0; chan<bus->get_channel_count(); ++chan) {
-        audio_sample_t* buf = bus->get_buffer(chan, framesToProcess);
-        mixdown[chan] = buf + offset;
+        readFrames = slot->get_buffer_size();
+        buffers = slot->get_buffers();
+
+        if (readFrames != framesToProcess) {
+            std::cout << QString("AudioClip::process(): readFrames %1, framesToProcess %2").arg(readFrames).arg(framesToProcess).toLatin1().data() << &std::endl;
+        }
     }
 
-    m_fader->process_gain(mixdown, fileLocation, faderEndLocation, readFrames, channelcount);
+    for(FadeCurve* fade = m_fades.first(); fade != nullptr; fade = fade->next) {
+        fade->process(buffers, channelcount, startLocation, endLocation, nframes);
+    }
 
     AudioBus* processBus = m_track->get_process_bus();
 
-    // Mixing should be done on the WHOLE buffer, not just part of it
-    // so use an unmodified nframes variable
+    // A mono clip is mixed into both channels of the process bus
+    audio_sample_t* destination[6];
+    uint mixChannels = 0;
     if (channelcount == 1) {
-        Mixer::mix_buffers_no_gain(processBus->get_buffer(0, nframes), bus->get_buffer(0, nframes), nframes);
-        Mixer::mix_buffers_no_gain(processBus->get_buffer(1, nframes), bus->get_buffer(0, nframes), nframes);
+        mixdown[0] = mixdown[1] = buffers[0];
+        mixChannels = 2;
     } else if (channelcount == 2) {
-        Mixer::mix_buffers_no_gain(processBus->get_buffer(0, nframes), bus->get_buffer(0, nframes), nframes);
-        Mixer::mix_buffers_no_gain(processBus->get_buffer(1, nframes), bus->get_buffer(1, nframes), nframes);
+        mixdown[0] = buffers[0];
+        mixdown[1] = buffers[1];
+        mixChannels = 2;
+    }
+    for (uint chan=0; chan<mixChannels; ++chan) {
+        destination[chan] = processBus->get_buffer(chan, nframes);
+    }
+
+    // Mixing should be done on the WHOLE buffer, not just part of it
+    // so use an unmodified nframes variable. The fader gain only applies
+    // to the clip part, it's applied while mixing so the audio is only
+    // passed once
+    nframes_t faderFrames = qMin(readFrames, nframes - offset);
+    TTimeRef faderEndLocation = fileLocation + TTimeRef(faderFrames, outputRate);
+    nframes_t tail = offset + faderFrames;
+
+    for (uint chan=0; chan<mixChannels; ++chan) {
+        if (offset) {
+            Mixer::mix_buffers_no_gain(destination[chan], mixdown[chan], offset);
+        }
+        if (tail < nframes) {
+            Mixer::mix_buffers_no_gain(destination[chan] + tail, mixdown[chan] + tail, nframes - tail);
+        }
+        destination[chan] += offset;
+        mixdown[chan] += offset;
+    }
+
+    m_fader->process_gain_mix(destination, mixdown, fileLocation, faderEndLocation, faderFrames, mixChannels);
+
+    if (slot) {
+        m_readSource->ringbuffer_release_slot(slot);
     }
 
     return 1;
 }
 
+/**
+ *	Decodes \a framesToProcess frames from \a fileLocation synchronously, used while the
+ *	Sheet is freewheel rendering. The audio is laid out like in the ringbuffer slots,
+ *	starting \a offset frames into the returned buffers which hold \a nframes frames.
+ *
+ * @return The decoded audio of the calling thread, or nullptr if nothing could be read
+ */
+audio_sample_t** AudioClip::freewheel_read(const TTimeRef& fileLocation, nframes_t offset, nframes_t framesToProcess, nframes_t nframes)
+{
+    // Sheets can be rendered by multiple threads, each of them decodes into it's own buffer
+    static thread_local DecodeBuffer decodeBuffer;
+
+    uint channelcount = get_channel_count();
+    decodeBuffer.check_buffers_capacity(nframes, channelcount);
+
+    if (!m_freewheelReadSource) {
+        return nullptr;
+    }
+
+    // The render decodes the file once, straight through, it would only evict the
+    // decoded blocks shared with the realtime readers
+    int read = m_freewheelReadSource->file_read(&decodeBuffer, fileLocation, framesToProcess, false);
+
+    if (read <= 0) {
+        return nullptr;
+    }
+
+    nframes_t readFrames = qMin(nframes_t(read), framesToProcess);
+
+    for (uint chan=0; chan<channelcount; ++chan) {
+        audio_sample_t* buffer = decodeBuffer.destination[chan];
+        if (offset) {
+            memmove(buffer + offset, buffer, readFrames * sizeof(audio_sample_t));
+            memset(buffer, 0, offset * sizeof(audio_sample_t));
+        }
+        memset(buffer + offset + readFrames, 0, (nframes - offset - readFrames) * sizeof(audio_sample_t));
+    }
+
+    return decodeBuffer.destination;
+}
+
+/**
+ *	Creates the private copy of our ReadSource which freewheel_read() decodes from. The
+ *	render then doesn't share the reader and it's decode position with DiskIO.
+ *
+ *	Note: Only call this function while the Sheet is handed over to the render thread,
+ *	see Sheet::start_freewheel()
+ */
+void AudioClip::prepare_freewheel()
+{
+    if (!m_readSource || m_freewheelReadSource || !m_isReadSourceValid) {
+        return;
+    }
+
+    ReadSource* source = m_readSource->deep_copy();
+    source->ref();
+
+    if (source->init() < 0) {
+        PWARN(QString("AudioClip::prepare_freewheel: Couldn't open %1 for rendering").arg(source->get_filename()));
+        delete source;
+        return;
+    }
+
+    m_freewheelResampleBuffer = new DecodeBuffer;
+    source->set_output_rate_and_convertor_type(m_readSource->get_output_rate(), m_sheet->get_read_diskio()->get_resample_quality());
+    source->set_decode_buffers(nullptr, m_freewheelResampleBuffer);
+
+    m_freewheelReadSource = source;
+}
+
+/**
+ *	Deletes the ReadSource copy created by prepare_freewheel()
+ */
+void AudioClip::finish_freewheel()
+{
+    delete m_freewheelReadSource;
+    m_freewheelReadSource = nullptr;
+
+    delete m_freewheelResampleBuffer;
+    m_freewheelResampleBuffer = nullptr;
+}
+
 //
 //  Function called in RealTime AudioThread processing path
 //
@@ -532,6 +668,23 @@ void AudioClip::process_capture(nframes_t nframes)
     }
 }
 
+void AudioClip::set_recording_format(TExportSpecification* spec)
+{
+    QString recordFormat = config().get_property("Recording", "FileFormat", "wav").toString();
+    if (recordFormat == "wavpack") {
+        spec->set_writer_type("wavpack");
+        QString compression = config().get_property("Recording", "WavpackCompressionType", "fast").toString();
+        QString skipwvx = config().get_property("Recording", "WavpackSkipWVX", "false").toString();
+        spec->extraFormat["quality"] = compression;
+        spec->extraFormat["skip_wvx"] = skipwvx;
+    }
+    else if (recordFormat == "w64") {
+        spec->set_file_format(SF_FORMAT_W64);
+    } else {
+        spec->set_file_format(SF_FORMAT_WAV);
+    }
+}
+
 int AudioClip::init_recording()
 {
     Q_ASSERT(m_sheet);
@@ -561,18 +714,15 @@ int AudioClip::init_recording()
 
     spec->set_export_dir(m_sheet->get_audio_sources_dir());
 
-    QString recordFormat = config().get_property("Recording", "FileFormat", "wav").toString();
-    if (recordFormat == "wavpack") {
-        spec->set_writer_type("wavpack");
-        QString compression = config().get_property("Recording", "WavpackCompressionType", "fast").toString();
-        QString skipwvx = config().get_property("Recording", "WavpackSkipWVX", "false").toString();
-        spec->extraFormat["quality"] = compression;
-        spec->extraFormat["skip_wvx"] = skipwvx;
-    }
-    else if (recordFormat == "w64") {
-        spec->set_file_format(SF_FORMAT_W64);
-    } else {
-        spec->set_file_format(SF_FORMAT_WAV);
+    set_recording_format(spec);
+
+    // Record 32 bit float with as little processing as possible, the TRecordingTranscoder
+    // converts the file to the recording format once recording has finished
+    if (config().get_property("Recording", "SpoolRawFloat", false).toBool()) {
+        m_transcodeSpecification = new TExportSpecification;
+        set_recording_format(m_transcodeSpecification);
+        spec->extraFormat["spool"] = "true";
+        spec->set_data_format(SF_FORMAT_FLOAT);
     }
 
     spec->set_recording_state(TExportSpecification::RecordingState::RECORDING);
@@ -590,6 +740,8 @@ int AudioClip::init_recording()
         m_writer = nullptr;
         delete spec;
         spec = nullptr;
+        delete m_transcodeSpecification;
+        m_transcodeSpecification = nullptr;
         return -1;
     }
     m_writer->set_process_peaks( true );
@@ -722,6 +874,11 @@ void AudioClip::finish_write_source()
         QMetaObject::invokeMethod(m_sheet->get_read_diskio(), "add_audio_source", Qt::QueuedConnection, qobject_cast<AudioSource*>(m_readSource));
         // re-inits the lenght from the audiofile due calling rsm->set_source_for_clip()
         m_length = TTimeRef();
+
+        if (m_transcodeSpecification) {
+            recording_transcoder().enqueue(m_writer->get_filename(), m_transcodeSpecification);
+            m_transcodeSpecification = nullptr;
+        }
     }
 
     QMetaObject::invokeMethod(m_sheet->get_write_diskio(), "remove_and_delete_audio_source", Qt::QueuedConnection, qobject_cast<AudioSource*>(m_writer));
@@ -947,7 +1104,9 @@ void AudioClip::create_fade(FadeCurve::FadeType fadeType)
 
     fadeCurve->set_shape("Fast");
     fadeCurve->set_history_stack(get_history_stack());
-    tsar().add_gui_event(this, fadeCurve, "private_add_fade(FadeCurve*)", "fadeAdded(FadeCurve*)");
+    TsarEvent event;
+    tsar().prepare_event(event, this, fadeCurve, Tsar::call<AudioClip, FadeCurve, &AudioClip::private_add_fade>, "fadeAdded(FadeCurve*)");
+    tsar().post_gui_event(event);
 }
 
 QDomNode AudioClip::get_dom_node() const
@@ -965,6 +1124,18 @@ ReadSource * AudioClip::get_readsource() const
     return m_readSource;
 }
 
+/**
+ *	Returns the Peak which builds the peak data of the take while recording,
+ *	or 0 if this AudioClip isn't recording.
+ */
+Peak* AudioClip::get_recording_peak() const
+{
+    if (m_writer) {
+        return m_writer->get_peak();
+    }
+    return nullptr;
+}
+
 void AudioClip::set_as_moving(bool moving)
 {
     m_isMoving = moving;
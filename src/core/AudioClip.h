@@ -39,7 +39,9 @@ class WriteSource;
 class AudioTrack;
 class Peak;
 class AudioBus;
+class DecodeBuffer;
 class PluginChain;
+class TExportSpecification;
 
 class AudioClip : public TAudioProcessingNode
 {
@@ -78,6 +80,7 @@ public:
 	AudioTrack* get_track() const;
 	Sheet* get_sheet() const;
 	Peak* get_peak() const {return m_peak;}
+	Peak* get_recording_peak() const;
 	QDomNode get_state(QDomDocument doc);
 	FadeCurve* get_fade_in() const;
 	FadeCurve* get_fade_out() const;
@@ -115,6 +118,9 @@ public:
 
     void removed_from_track();
 
+    void prepare_freewheel();
+    void finish_freewheel();
+
     AudioClip* next = nullptr;
 
 
@@ -122,7 +128,10 @@ private:
     Sheet*          m_sheet;
     AudioTrack* 	m_track;
     ReadSource*		m_readSource;
+    ReadSource*		m_freewheelReadSource;
+    DecodeBuffer*	m_freewheelResampleBuffer;
     WriteSource*	m_writer;
+    TExportSpecification* m_transcodeSpecification;
     TRealTimeLinkedList<FadeCurve*>	m_fades;
 	Peak* 			m_peak;
     FadeCurve*		m_fadeIn;
@@ -152,6 +161,8 @@ private:
     void set_track_end_location(const TTimeRef& location);
 	void set_sources_active_state();
 	void process_capture(nframes_t nframes);
+    audio_sample_t** freewheel_read(const TTimeRef& fileLocation, nframes_t offset, nframes_t framesToProcess, nframes_t nframes);
+    static void set_recording_format(TExportSpecification* spec);
 		
 	friend class ResourcesManager;
 
@@ -31,14 +31,45 @@ Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA.
 #include "ReadSource.h"
 #include "WriteSource.h"
 #include "Peak.h"
+#include "TSampleConverter.h"
 #include "defines.h"
 
-AudioFileCopyConvert::AudioFileCopyConvert()
+/**	\class AudioFileCopyConvert
+	\brief Copies ReadSources to wav files in a pool of low priority worker threads
+
+	Copy tasks (enqueue_task()) convert the source at it's own sample rate and emit
+	taskFinished() once done. Transcode tasks (enqueue_transcode_task()) convert the
+	source at it's output rate, e.g. the project rate, into the format set in the
+	TExportSpecification and emit transcodeFinished() with the source id and the
+	file name of the converted file.
+
+	Tasks are spread over \a workerCount threads, use 1 when tasks share their
+	TExportSpecification!
+ */
+
+AudioFileCopyConvertThread::AudioFileCopyConvertThread(AudioFileCopyConvert* converter)
+	: m_converter(converter)
+{
+}
+
+void AudioFileCopyConvertThread::run()
+{
+	m_converter->process_tasks();
+}
+
+
+AudioFileCopyConvert::AudioFileCopyConvert(int workerCount)
 {
+	m_workerCount = qMax(1, workerCount);
+	m_busyWorkers = 0;
+	m_stopThreads = false;
 	m_stopProcessing = false;
-	moveToThread(this);
-	start();
-	connect(this, SIGNAL(dequeueTask()), this, SLOT(dequeue_tasks()), Qt::QueuedConnection);
+}
+
+AudioFileCopyConvert::~AudioFileCopyConvert()
+{
+	stop_merging();
+	stop_threads();
 }
 
 /**
@@ -68,24 +99,76 @@ void AudioFileCopyConvert::enqueue_task(ReadSource * source,
 	task.trackname = trackname;
 	task.dir = dir;
 	task.spec = spec;
+	task.transcode = false;
 	
-	m_mutex.lock();
+	queue_task(task);
+}
+
+/**
+ *	Queues the ReadSource \a source to be converted to \a dir / \a outfilename.wav at it's
+	output rate. \a source must be a private copy, not used by anything else, this function
+	takes ownership of both \a source and \a spec.
+
+	On success transcodeFinished() is emitted, if the conversion failed or was stopped the
+	partially written file is removed and no signal is emitted.
+ */
+void AudioFileCopyConvert::enqueue_transcode_task(ReadSource* source,
+	TExportSpecification* spec,
+	const QString& dir,
+	const QString& outfilename)
+{
+	CopyTask task;
+	task.readsource = source;
+	task.outFileName = outfilename;
+	task.extension = "wav";
+	task.tracknumber = -1;
+	task.dir = dir;
+	task.spec = spec;
+	task.transcode = true;
+
+	queue_task(task);
+}
+
+void AudioFileCopyConvert::queue_task(const CopyTask& task)
+{
+	QMutexLocker locker(&m_mutex);
+
 	m_tasks.enqueue(task);
-	m_mutex.unlock();
-	
-	emit dequeueTask();
+
+	if (m_threads.isEmpty()) {
+		start_threads();
+	}
+
+	m_taskAvailable.wakeOne();
 }
 
-void AudioFileCopyConvert::dequeue_tasks()
+void AudioFileCopyConvert::process_tasks()
 {
-	m_mutex.lock();
-	if (m_tasks.size()) {
+	QMutexLocker locker(&m_mutex);
+
+	while (!m_stopThreads) {
+		if (m_tasks.isEmpty() || m_stopProcessing) {
+			m_taskAvailable.wait(&m_mutex);
+			continue;
+		}
+
 		CopyTask task = m_tasks.dequeue();
-		m_mutex.unlock();
+		m_busyWorkers++;
+
+		locker.unlock();
 		process_task(task);
-		return;
+		locker.relock();
+
+		m_busyWorkers--;
+
+		//  The user asked to stop processing, signal we're done
+		// once the last running task has been interrupted.
+		if (m_stopProcessing && m_busyWorkers == 0) {
+			locker.unlock();
+			emit processingStopped();
+			locker.relock();
+		}
 	}
-	m_mutex.unlock();
 }
 
 void AudioFileCopyConvert::process_task(CopyTask task)
@@ -93,14 +176,19 @@ void AudioFileCopyConvert::process_task(CopyTask task)
 	emit taskStarted(task.readsource->get_name());
 
 	DecodeBuffer decodebuffer;
+	// Transcoded files are written at the output rate, e.g. the project rate
+	uint rate = task.transcode ? task.readsource->get_output_rate() : task.readsource->get_sample_rate();
+	uint channelCount = task.readsource->get_channel_count();
+	QString fileName = task.dir + "/" + task.outFileName + ".wav";
+	bool success = false;
 
     task.spec->set_export_start_location(TTimeRef());
     task.spec->set_export_end_location(task.readsource->get_length());
 
     task.spec->set_export_dir(task.dir);
 	task.spec->extraFormat["filetype"] = "wav";
-    task.spec->set_channel_count(task.readsource->get_channel_count());
-    task.spec->set_sample_rate(task.readsource->get_sample_rate());
+    task.spec->set_channel_count(channelCount);
+    task.spec->set_sample_rate(rate);
     task.spec->set_export_file_name(task.outFileName);
 	
 	WriteSource* writesource = new WriteSource(task.spec);
@@ -127,31 +215,26 @@ void AudioFileCopyConvert::process_task(CopyTask task)
 
         task.spec->silence_render_buffer(nframes);
 
-        task.readsource->file_read(&decodebuffer, task.spec->get_export_location(), nframes);
-			
-		for (uint x = 0; x < nframes; ++x) {
-            for (uint y = 0; y < task.spec->get_channel_count(); ++y) {
-                task.spec->get_render_buffer()[y + x*task.spec->get_channel_count()] = decodebuffer.destination[y][x];
-			}
-		}
+        task.readsource->file_read(&decodebuffer, task.spec->get_export_location(), nframes, false);
+
+        TSampleConverter::interleave_float(task.spec->get_render_buffer(), decodebuffer.destination, channelCount, nframes);
 		
 		// due the fact peak generating does _not_ happen in writesource->process
 		// but in a function used by DiskIO, we have to hack the peak processing 
 		// in here.
-        for (uint y = 0; y < task.spec->get_channel_count(); ++y) {
+        for (uint y = 0; y < channelCount; ++y) {
 			writesource->get_peak()->process(y, decodebuffer.destination[y], nframes);
 		}
 		
-		// Process the data, and write to disk
-        // FIXME
-        // Shouldn't we use the actual read frames count instead of block size?
-        // The end of the file will be most likely not a multiple of block size.
-        writesource->process(task.spec->get_block_size());
+		// Process the data, and write to disk, the last block is
+		// most likely not a multiple of the block size
+        writesource->process(nframes);
 		
-        task.spec->add_exported_range(TTimeRef(nframes, task.readsource->get_sample_rate()));
+        task.spec->add_exported_range(TTimeRef(nframes, rate));
 
     } while (task.spec->get_remaining_export_frames() > 0);
 
+	success = true;
 	
 	out:
 	if (!failedToPrepareWritesource) {
@@ -159,23 +242,73 @@ void AudioFileCopyConvert::process_task(CopyTask task)
 	}
 	delete writesource;
     writesource = nullptr;
+
+	if (task.transcode) {
+		qint64 sourceId = task.readsource->get_id();
+		// The copy was created in the GUI thread, let it be deleted there
+		task.readsource->deleteLater();
+		delete task.spec;
+
+		if (!success) {
+			QFile::remove(fileName);
+			return;
+		}
+
+		emit transcodeFinished(sourceId, fileName);
+		return;
+	}
+
 	resources_manager()->remove_source(task.readsource);
 	
-	//  The user asked to stop processing, exit the event loop
-	// and signal we're done.
 	if (m_stopProcessing) {
-		exit(0);
-		wait(1000);
-		m_tasks.clear();
-		emit processingStopped();
 		return;
 	}
 	
-	emit taskFinished(task.dir + "/" + task.outFileName + ".wav", task.tracknumber, task.trackname);
+	emit taskFinished(fileName, task.tracknumber, task.trackname);
 }
 
+void AudioFileCopyConvert::start_threads()
+{
+	for (int i=0; i<m_workerCount; ++i) {
+		auto thread = new AudioFileCopyConvertThread(this);
+		thread->start(QThread::LowPriority);
+		m_threads.append(thread);
+	}
+}
+
+void AudioFileCopyConvert::stop_threads()
+{
+	m_mutex.lock();
+	m_stopThreads = true;
+	m_taskAvailable.wakeAll();
+	m_mutex.unlock();
+
+	foreach(AudioFileCopyConvertThread* thread, m_threads) {
+		thread->wait();
+		delete thread;
+	}
+	m_threads.clear();
+}
+
+/**
+ *	Interrupts the running tasks and drops all queued tasks, processingStopped()
+	is emitted once no task is running anymore.
+ */
 void AudioFileCopyConvert::stop_merging()
 {
+	m_mutex.lock();
 	m_stopProcessing = true;
-}
+	foreach(CopyTask task, m_tasks) {
+		if (task.transcode) {
+			delete task.readsource;
+			delete task.spec;
+		}
+	}
+	m_tasks.clear();
+	bool idle = (m_busyWorkers == 0);
+	m_mutex.unlock();
 
+	if (idle) {
+		emit processingStopped();
+	}
+}
@@ -24,27 +24,40 @@ Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA.
 
 #include <QThread>
 #include <QQueue>
+#include <QList>
 #include <QMutex>
+#include <QWaitCondition>
+
+#include <atomic>
 
 class ReadSource;
 class TExportSpecification;
+class AudioFileCopyConvert;
 
-class AudioFileCopyConvert : public QThread
+class AudioFileCopyConvertThread : public QThread
+{
+public:
+	AudioFileCopyConvertThread(AudioFileCopyConvert* converter);
+
+protected:
+	void run() override;
+
+private:
+	AudioFileCopyConvert* m_converter;
+};
+
+
+class AudioFileCopyConvert : public QObject
 {
 	Q_OBJECT
 public:
-	AudioFileCopyConvert();
-	void run() {
-		exec();
-	}
+	AudioFileCopyConvert(int workerCount = 1);
+	~AudioFileCopyConvert();
 	
 	void enqueue_task(ReadSource* source, TExportSpecification* spec, const QString& dir, const QString& outfilename, int tracknumber, const QString& trackname);
+	void enqueue_transcode_task(ReadSource* source, TExportSpecification* spec, const QString& dir, const QString& outfilename);
 	void stop_merging();
 
-		
-private slots:
-	void dequeue_tasks();
-	
 private:
 	struct CopyTask {
 		QString outFileName;
@@ -54,19 +67,31 @@ private:
 		QString trackname;
 		ReadSource* readsource;
 		TExportSpecification* spec;
+		bool transcode;
 	};
 	
 	QQueue<CopyTask> m_tasks;
+	QList<AudioFileCopyConvertThread*> m_threads;
 	QMutex m_mutex;
-	bool m_stopProcessing;
+	QWaitCondition m_taskAvailable;
+	int m_workerCount;
+	int m_busyWorkers;
+	bool m_stopThreads;
+	std::atomic<bool> m_stopProcessing;
 	
+	void queue_task(const CopyTask& task);
+	void process_tasks();
 	void process_task(CopyTask task);
+	void start_threads();
+	void stop_threads();
+
+	friend class AudioFileCopyConvertThread;
 	
 signals:
-	void dequeueTask();
 	void progress(int);
 	void taskStarted(QString);
 	void taskFinished(QString, int, QString);
+	void transcodeFinished(qint64, QString);
 	void processingStopped();
 };
 
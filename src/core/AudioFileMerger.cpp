@@ -112,8 +112,8 @@ void AudioFileMerger::process_task(MergeTask task)
 
         spec.silence_render_buffer(nframes);
 		
-        task.readsource0->file_read(&decodebuffer0, spec.get_export_location(), nframes);
-        task.readsource1->file_read(&decodebuffer1, spec.get_export_location(), nframes);
+        task.readsource0->file_read(&decodebuffer0, spec.get_export_location(), nframes, false);
+        task.readsource1->file_read(&decodebuffer1, spec.get_export_location(), nframes, false);
 			
 		for (uint x = 0; x < nframes; ++x) {
             spec.get_render_buffer()[x*spec.get_channel_count()] = decodebuffer0.destination[0][x];
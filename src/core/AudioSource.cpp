@@ -25,12 +25,23 @@ Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA.
 #include <utility>
 #include "Sheet.h"
 #include "Peak.h"
+#include "TFlightRecorder.h"
 #include "Utils.h"
 
 // Always put me below _all_ includes, this is needed
 // in case we run with memory leak detection enabled!
 #include "Debugger.h"
 
+void BufferStatus::set_sync_status(int status)
+{
+    int previous = m_syncStatus.exchange(status);
+    // Every seek passes QUEUE_SEEKING_TO_NEW_LOCATION, leave it out so sources
+    // waiting for their clip to come into play don't flood the flight recorder
+    if (previous != status && previous != QUEUE_SEEKING_TO_NEW_LOCATION && status != QUEUE_SEEKING_TO_NEW_LOCATION) {
+        flight_recorder().record(TFlightRecorder::SYNC_STATUS, this, previous, status);
+    }
+}
+
 // This constructor is called at file import or recording
 AudioSource::AudioSource(QString  dir, const QString& name)
 	: m_dir(std::move(dir))
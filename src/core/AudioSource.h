@@ -29,6 +29,9 @@ Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA.
 #include "cameron/readerwritercircularbuffer.h"
 
 #include <QObject>
+#include <atomic>
+#include <cstdlib>
+#include <cstring>
 
 class DecodeBuffer;
 
@@ -46,9 +49,7 @@ struct BufferStatus {
 
     inline bool out_of_sync() const {return m_syncStatus.load() != IN_SYNC;}
 
-    inline void set_sync_status(int status) {
-        m_syncStatus.store(status);
-    }
+    void set_sync_status(int status);
     inline int get_sync_status() {
         return m_syncStatus.load();
     }
@@ -62,19 +63,40 @@ private:
 
 class QueueBufferSlot {
 public:
+    // Slot buffers start on a cache line boundary so decoders
+    // and the Mixer functions can work on them directly
+    static const int CACHE_LINE_SIZE = 64;
+
     QueueBufferSlot(int slotNumber, uint channelCount, nframes_t bufferSize) {
         m_fileLocation = TTimeRef::INVALID;
         m_slotNumber = slotNumber;
         m_bufferSize = bufferSize;
         m_channelCount = channelCount;
+
+        // Round up each channel to a multiple of the cache line size
+        const nframes_t framesPerCacheLine = CACHE_LINE_SIZE / sizeof(audio_sample_t);
+        m_channelStride = ((bufferSize + framesPerCacheLine - 1) / framesPerCacheLine) * framesPerCacheLine;
+
+        size_t size = m_channelStride * channelCount * sizeof(audio_sample_t);
+#if defined (NO_POSIX_MEMALIGN)
+        m_data = static_cast<audio_sample_t*>(malloc(size));
+#else
+        void* data = nullptr;
+        if (posix_memalign(&data, CACHE_LINE_SIZE, size) != 0) {
+            data = malloc(size);
+        }
+        m_data = static_cast<audio_sample_t*>(data);
+#endif
+        memset(m_data, 0, size);
+
+        m_buffers = new audio_sample_t*[channelCount];
         for (uint i=0; i<channelCount; ++i) {
-            m_buffers.append(new audio_sample_t[bufferSize]);
+            m_buffers[i] = m_data + (i * m_channelStride);
         }
     }
     ~QueueBufferSlot() {
-        for (uint i=0; i<m_channelCount; ++i) {
-            delete [] m_buffers.at(i);
-        }
+        delete [] m_buffers;
+        free(m_data);
     }
 
     int get_slot_number() const {return m_slotNumber;}
@@ -83,23 +105,37 @@ public:
 
     audio_sample_t* get_buffer(uint channel) {
         Q_ASSERT(channel < m_channelCount);
-        return m_buffers.at(channel);
+        return m_buffers[channel];
+    }
+
+    // Used to let the decoders write directly into the slot buffers
+    audio_sample_t** get_buffers() {
+        return m_buffers;
     }
 
     void read_buffer(audio_sample_t* dest, uint channel, nframes_t nframes) {
         Q_ASSERT(nframes <= m_bufferSize);
         Q_ASSERT(channel < m_channelCount);
         Q_ASSERT(nframes > 0);
-        memcpy(dest, m_buffers.at(channel), nframes * sizeof(audio_sample_t));
+        memcpy(dest, m_buffers[channel], nframes * sizeof(audio_sample_t));
     }
 
     void write_buffer(const TTimeRef &fileLocation, audio_sample_t* source, uint channel, nframes_t nframes) {
         Q_ASSERT(nframes == m_bufferSize);
         Q_ASSERT(nframes > 0);
-        memcpy(m_buffers.at(channel), source, nframes * sizeof(audio_sample_t));
+        memcpy(m_buffers[channel], source, nframes * sizeof(audio_sample_t));
         m_fileLocation = fileLocation;
     }
 
+    void silence_buffers(nframes_t offset) {
+        if (offset >= m_bufferSize) {
+            return;
+        }
+        for (uint chan=0; chan<m_channelCount; ++chan) {
+            memset(m_buffers[chan] + offset, 0, (m_bufferSize - offset) * sizeof(audio_sample_t));
+        }
+    }
+
     void set_file_location(const TTimeRef& fileLocation) {
         m_fileLocation = fileLocation;
     }
@@ -112,8 +148,10 @@ private:
     TTimeRef            m_fileLocation;
     int                 m_slotNumber;
     nframes_t           m_bufferSize;
+    nframes_t           m_channelStride;
     uint                m_channelCount;
-    QList<audio_sample_t*>   m_buffers;
+    audio_sample_t*     m_data;
+    audio_sample_t**    m_buffers;
 };
 
 
@@ -184,6 +222,16 @@ private:
     virtual void rb_seek_to_transport_location(const TTimeRef &transportLocation) = 0;
     virtual void set_output_rate_and_convertor_type(int outputRate, int converterType) = 0;
     virtual void set_decode_buffers(DecodeBuffer * fileReadBuffer, DecodeBuffer *resampleDecodeBuffer) = 0;
+    // Estimated time left before the rt queue under/overruns, used by
+    // DiskIO to process the most urgent AudioSources first
+    virtual TTimeRef get_time_to_underrun(const TTimeRef& transportLocation) = 0;
+    // Return true if process_realtime_buffers() can run in a DiskIO worker thread
+    virtual bool can_process_in_worker_thread() const {return false;}
+    // Bytes written to disk since the last call, used for the DiskIO write throughput
+    virtual qint64 take_written_bytes() {return 0;}
+    size_t get_rt_queue_depth() const {
+        return m_rtBufferSlotsQueue ? m_rtBufferSlotsQueue->size_approx() : 0;
+    }
     // Used in WriteSource, change to use DecodeBuffers instead
     void set_diskio_frame_buffer(audio_sample_t* frameBuffer) {
         m_diskIOFramebuffer = frameBuffer;
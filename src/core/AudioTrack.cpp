@@ -21,8 +21,11 @@ Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA.
 
 #include "AudioTrack.h"
 
+#include <QCryptographicHash>
 #include <QDomElement>
 #include <QDomNode>
+#include <QFile>
+#include <QUndoStack>
 
 #include "Sheet.h"
 #include "AudioClip.h"
@@ -30,14 +33,23 @@ Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA.
 #include "AudioBus.h"
 #include "AudioDevice.h"
 #include "PluginChain.h"
+#include "Plugin.h"
+#include "GainEnvelope.h"
+#include "FadeCurve.h"
+#include "ReadSource.h"
 #include "Information.h"
 #include "ProjectManager.h"
 #include "ResourcesManager.h"
 #include "Utils.h"
 #include "AddRemove.h"
 #include "PCommand.h"
+#include "TConfig.h"
+#include "TExportSpecification.h"
+#include "TFreewheelRenderer.h"
+#include "Tsar.h"
 
 #include "Mixer.h"
+#include "TDspProfiler.h"
 
 // Always put me below _all_ includes, this is needed
 // in case we run with memory leak detection enabled!
@@ -72,6 +84,7 @@ AudioTrack::AudioTrack( Sheet * sheet, const QDomNode node)
 AudioTrack::~AudioTrack()
 {
     PENTERDES;
+    delete m_processBus;
 }
 
 void AudioTrack::init()
@@ -80,10 +93,23 @@ void AudioTrack::init()
 
     m_type = AUDIOTRACK;
     m_isArmed = false;
-    m_processBus = m_sheet->get_render_bus();
+
+    // Each AudioTrack needs it's own process bus, AudioTracks are processed
+    // in parallel and their post sends are processed afterwards by Sheet
+    TAudioBusConfiguration busConfig;
+    busConfig.name = "Track Process Bus";
+    busConfig.channelcount = 2;
+    busConfig.type = "output";
+    busConfig.isInternalBus = true;
+    m_processBus = new AudioBus(busConfig);
+
+    for (uint chan=0; chan<m_processBus->get_channel_count(); ++chan) {
+        m_processBus->get_channel(chan)->set_buffer_size(audiodevice().get_buffer_size());
+    }
 
     connect(this, SIGNAL(privateAudioClipAdded(AudioClip*)), this, SLOT(private_audioclip_added(AudioClip*)));
     connect(this, SIGNAL(privateAudioClipRemoved(AudioClip*)), this, SLOT(private_audioclip_removed(AudioClip*)));
+    connect(this, SIGNAL(privateFrozenClipRemoved(AudioClip*)), this, SLOT(frozen_clip_removed(AudioClip*)));
 }
 
 QDomNode AudioTrack::get_state( QDomDocument doc, bool istemplate)
@@ -111,6 +137,12 @@ QDomNode AudioTrack::get_state( QDomDocument doc, bool istemplate)
         }
 
         node.appendChild(clips);
+
+        if (m_frozenClip) {
+            node.setAttribute("frozensource", m_frozenClip->get_readsource()->get_name());
+            node.setAttribute("frozenstart", m_frozenClip->get_location()->get_start().universal_frame());
+            node.setAttribute("frozenfingerprint", QString(m_frozenFingerprint));
+        }
     }
 
     return node;
@@ -161,6 +193,21 @@ int AudioTrack::set_state( const QDomNode & node )
         }
     }
 
+    // The frozen render is only valid if the clips and plugins weren't changed
+    // since it was made, e.g. by editing the project file or a failed save
+    QString frozenFileName = e.attribute("frozensource", "");
+    if (!frozenFileName.isEmpty()) {
+        QByteArray fingerprint = e.attribute("frozenfingerprint", "").toLatin1();
+        TTimeRef frozenStartLocation(e.attribute("frozenstart", "0").toLongLong());
+
+        if (fingerprint == frozen_state_fingerprint() && load_frozen_clip(frozenFileName, frozenStartLocation) > 0) {
+            m_frozenFingerprint = fingerprint;
+        } else {
+            PWARN(QString("Track %1: frozen render %2 is out of date, removing it").arg(m_name, frozenFileName));
+            QFile::remove(m_sheet->get_audio_sources_dir() + frozenFileName);
+        }
+    }
+
     return 1;
 }
 
@@ -219,6 +266,11 @@ AudioClip* AudioTrack::init_recording()
 
 void AudioTrack::set_armed( bool armed )
 {
+    // Recording goes to the clips, so the track has to be live
+    if (armed && m_frozenClip) {
+        unfreeze();
+    }
+
     m_isArmed = armed;
     if (m_inputBus) {
         if (m_isArmed) {
@@ -255,21 +307,84 @@ void AudioTrack::add_input_bus(AudioBus *bus)
 //
 //  Function called in RealTime AudioThread processing path
 //
-int AudioTrack::process(const TTimeRef& startLocation, const TTimeRef& endLocation, nframes_t nframes )
+int AudioTrack::process(const TTimeRef& startLocation, const TTimeRef& endLocation, nframes_t nframes, bool processPostSends)
 {
-    int processResult = 0;
+    TDspProfileScope profileScope(TDspProfiler::TRACK, this);
 
     if ( (m_isMuted || m_mutedBySolo) && ( ! m_isArmed) ) {
         return 0;
     }
 
-    // Get the 'render bus' from sheet, a bit hackish solution, but
-    // it avoids to have a dedicated render bus for each Track,
-    // or buffers located on the heap...
+    int processResult;
+
+    if (m_rtFrozenClip) {
+        processResult = process_frozen(startLocation, endLocation, nframes);
+    } else {
+        processResult = process_pre_fader(startLocation, endLocation, nframes, true);
+    }
+
+    processResult |= process_fader(startLocation, endLocation, nframes);
+
+    // TODO: is there a situation where we still want to call process_post_sends
+    // even if processresult == 0?
+    if (processResult) {
+        if (!m_isArmed) {
+            m_processBus->process_monitoring(m_vumonitors);
+        }
+
+        // And finally do the post sends, unless the caller takes care of them
+        if (processPostSends) {
+            process_post_sends(nframes);
+        }
+    }
+
+    return processResult;
+}
+
+/**
+ *	Renders the clips and pre fader plugins of this AudioTrack into it's process bus,
+ *	regardless of the mute and frozen state and without processing the sends.
+ *	Pan, fader and the post fader plugins stay live, see process().
+ *	Used by TFreewheelRenderer to freeze the track.
+ */
+int AudioTrack::render(const TTimeRef& startLocation, const TTimeRef& endLocation, nframes_t nframes)
+{
+    return process_pre_fader(startLocation, endLocation, nframes, false);
+}
+
+/**
+ *	Lets the clips, including the frozen clip, prepare for freewheel rendering,
+ *	see AudioClip::prepare_freewheel()
+ */
+void AudioTrack::prepare_freewheel()
+{
+    for(AudioClip* clip = m_rtAudioClipsLinkedList.first(); clip != nullptr; clip = clip->next) {
+        clip->prepare_freewheel();
+    }
+
+    if (m_frozenClip) {
+        m_frozenClip->prepare_freewheel();
+    }
+}
+
+void AudioTrack::finish_freewheel()
+{
+    for(AudioClip* clip = m_rtAudioClipsLinkedList.first(); clip != nullptr; clip = clip->next) {
+        clip->finish_freewheel();
+    }
+
+    if (m_frozenClip) {
+        m_frozenClip->finish_freewheel();
+    }
+}
+
+int AudioTrack::process_pre_fader(const TTimeRef& startLocation, const TTimeRef& endLocation, nframes_t nframes, bool processPreSends)
+{
+    int processResult = 0;
+
     m_processBus->silence_buffers(nframes);
 
     int result;
-    float panFactor;
 
 
     // Read in clip data into process bus.
@@ -292,12 +407,20 @@ int AudioTrack::process(const TTimeRef& startLocation, const TTimeRef& endLocati
     }
 
     // Then do the pre-send:
-    process_pre_sends(nframes);
+    if (processPreSends) {
+        process_pre_sends(nframes);
+    }
 
 
     // Then apply the pre fader plugins;
     m_pluginChain->process_pre_fader(m_processBus, nframes);
 
+    return processResult;
+}
+
+int AudioTrack::process_fader(const TTimeRef& startLocation, const TTimeRef& endLocation, nframes_t nframes)
+{
+    float panFactor;
 
     // Apply PAN
     if ( (m_processBus->get_channel_count() >= 1) && (m_pan > 0) )  {
@@ -324,20 +447,19 @@ int AudioTrack::process(const TTimeRef& startLocation, const TTimeRef& endLocati
 
 
     // Post fader plugins now
-    processResult |= m_pluginChain->process_post_fader(m_processBus, nframes);
+    return m_pluginChain->process_post_fader(m_processBus, nframes);
+}
 
-    // TODO: is there a situation where we still want to call process_post_sends
-    // even if processresult == 0?
-    if (processResult) {
-        if (!m_isArmed) {
-            m_processBus->process_monitoring(m_vumonitors);
-        }
+// A frozen track streams the render of it's clips and pre fader plugins with a
+// single clip, process_fader() takes it from there. Tracks with pre sends can't
+// be frozen, the pre sends tap the audio before the pre fader plugins.
+int AudioTrack::process_frozen(const TTimeRef& startLocation, const TTimeRef& endLocation, nframes_t nframes)
+{
+    m_processBus->silence_buffers(nframes);
 
-        // And finally do the post sends
-        process_post_sends(nframes);
-    }
+    int result = m_rtFrozenClip->process(startLocation, endLocation, nframes);
 
-    return processResult;
+    return result > 0 ? result : 0;
 }
 
 
@@ -352,6 +474,17 @@ TCommand* AudioTrack::toggle_arm()
 }
 
 
+TCommand* AudioTrack::toggle_freeze()
+{
+    if (m_frozenClip) {
+        unfreeze();
+    } else if (!m_freezeRenderer) {
+        freeze();
+    }
+    return nullptr;
+}
+
+
 TCommand* AudioTrack::silence_others( )
 {
     PCommand* command = new PCommand(this, "solo", tr("Silence Other Tracks"));
@@ -422,8 +555,8 @@ TCommand* AudioTrack::remove_clip(AudioClip* clip, bool historable, bool ismove)
     clip->removed_from_track();
 
     return new AddRemove(this, clip, historable, m_sheet,
-                         "private_remove_clip(AudioClip*)", "privateAudioClipRemoved(AudioClip*)",
-                         "private_add_clip(AudioClip*)", "privateAudioClipAdded(AudioClip*)",
+                         Tsar::call<AudioTrack, AudioClip, &AudioTrack::private_remove_clip>, "privateAudioClipRemoved(AudioClip*)",
+                         Tsar::call<AudioTrack, AudioClip, &AudioTrack::private_add_clip>, "privateAudioClipAdded(AudioClip*)",
                          tr("Remove Clip"));
 }
 
@@ -436,8 +569,8 @@ TCommand* AudioTrack::add_clip(AudioClip* clip, bool historable, bool ismove)
         m_sheet->get_audioclip_manager()->add_clip(clip);
     }
     return new AddRemove(this, clip, historable, m_sheet,
-                         "private_add_clip(AudioClip*)", "privateAudioClipAdded(AudioClip*)",
-                         "private_remove_clip(AudioClip*)", "privateAudioClipRemoved(AudioClip*)",
+                         Tsar::call<AudioTrack, AudioClip, &AudioTrack::private_add_clip>, "privateAudioClipAdded(AudioClip*)",
+                         Tsar::call<AudioTrack, AudioClip, &AudioTrack::private_remove_clip>, "privateAudioClipRemoved(AudioClip*)",
                          tr("Add Clip"));
 }
 
@@ -473,7 +606,9 @@ void AudioTrack::clip_position_changed(AudioClip * clip)
     });
 
     if (m_sheet && m_sheet->is_transport_rolling()) {
-        tsar().add_gui_event(this, clip, "private_clip_position_changed(AudioClip*)", "");
+        TsarEvent event;
+        tsar().prepare_event(event, this, clip, Tsar::call<AudioTrack, AudioClip, &AudioTrack::private_clip_position_changed>, "");
+        tsar().post_gui_event(event);
     } else {
         private_clip_position_changed(clip);
     }
@@ -491,3 +626,345 @@ TCommand* AudioTrack::toggle_show_clip_volume_automation()
 
     return nullptr;
 }
+
+/**
+ *	Renders the clips, fades and pre fader plugins of this AudioTrack into a hidden file in
+ *	the audio sources dir of the Sheet, in the background. Once done the track plays back
+ *	that file with a single stream until it's unfrozen, or until the clips, curves or pre
+ *	fader plugins change, see check_frozen_state(). Pan, fader and the post fader plugins
+ *	stay live.
+ *
+ *	The render covers the unmuted clips plus Freeze/TailLength seconds (default 3) so
+ *	reverb and delay tails aren't cut off.
+ *
+ * @return 1 if the render was started, -1 if the track can't be frozen right now
+ */
+int AudioTrack::freeze()
+{
+    PENTER;
+
+    if (m_frozenClip || m_freezeRenderer) {
+        return -1;
+    }
+
+    if (m_isArmed) {
+        info().information(tr("Disarm Track %1 before freezing it").arg(m_name));
+        return -1;
+    }
+
+    if (m_sheet->is_transport_rolling()) {
+        info().information(tr("Stop the transport before freezing Track %1").arg(m_name));
+        return -1;
+    }
+
+    if (m_sheet->is_render_locked()) {
+        info().information(tr("Sheet %1 is busy rendering, freeze Track %2 when it's done").arg(m_sheet->get_name(), m_name));
+        return -1;
+    }
+
+    if (!get_pre_sends().isEmpty()) {
+        info().information(tr("Track %1 has pre fader sends, remove them before freezing the Track").arg(m_name));
+        return -1;
+    }
+
+    TTimeRef startLocation, endLocation;
+    if (!get_export_range(startLocation, endLocation)) {
+        info().information(tr("Track %1 has no audio to freeze").arg(m_name));
+        return -1;
+    }
+
+    uint rate = audiodevice().get_sample_rate();
+    qreal tailLength = qBound(0.0, config().get_property("Freeze", "TailLength", 3).toDouble(), 60.0);
+    endLocation = endLocation + TTimeRef(nframes_t(tailLength * rate), rate);
+
+    m_freezeSpecification = new TExportSpecification;
+    m_freezeSpecification->set_export_dir(m_sheet->get_audio_sources_dir());
+    m_freezeSpecification->set_export_file_name(QString(".freeze-%1-%2").arg(get_id()).arg(create_id()));
+    m_freezeSpecification->set_file_format(SF_FORMAT_WAV);
+    m_freezeSpecification->set_data_format(SF_FORMAT_FLOAT);
+    m_freezeSpecification->set_channel_count(m_processBus->get_channel_count());
+    m_freezeSpecification->set_sample_rate(rate);
+    m_freezeSpecification->set_export_start_location(startLocation);
+    m_freezeSpecification->set_export_end_location(endLocation);
+
+    // Changes made while rendering make the render useless, see freeze_render_finished()
+    m_frozenFingerprint = frozen_state_fingerprint();
+    m_freezeStartLocation = startLocation;
+
+    // The render thread processes the live Sheet, the transport and editing are
+    // blocked until freeze_render_finished()
+    m_sheet->set_render_locked(true);
+
+    m_freezeRenderer = new TFreewheelRenderer(m_sheet, m_freezeSpecification);
+    m_freezeRenderer->set_track(this);
+    connect(m_freezeRenderer, SIGNAL(renderFinished()), this, SLOT(freeze_render_finished()), Qt::QueuedConnection);
+    m_freezeRenderer->start();
+
+    info().information(tr("Freezing Track %1").arg(m_name));
+
+    return 1;
+}
+
+/**
+ *	Switches back to processing the clips and plugins and removes the frozen render
+ */
+void AudioTrack::unfreeze()
+{
+    PENTER;
+
+    if (!m_frozenClip) {
+        return;
+    }
+
+    for (const auto& connection : std::as_const(m_freezeConnections)) {
+        disconnect(connection);
+    }
+    m_freezeConnections.clear();
+
+    AudioClip* clip = m_frozenClip;
+    m_frozenClip = nullptr;
+    m_frozenFingerprint.clear();
+
+    if (m_sheet->is_transport_rolling()) {
+        TsarEvent event;
+        tsar().prepare_event(event, this, clip, Tsar::call<AudioTrack, AudioClip, &AudioTrack::private_remove_frozen_clip>, "privateFrozenClipRemoved(AudioClip*)");
+        tsar().post_gui_event(event);
+    } else {
+        private_remove_frozen_clip(clip);
+        frozen_clip_removed(clip);
+    }
+
+    // Reactivates the ReadSources of the clips
+    emit audibleStateChanged();
+    emit frozenChanged(false);
+}
+
+/**
+ *	Releases the frozen clip, but keeps the frozen render on disk so it can be loaded
+ *	again with the project. A running freeze is cancelled.
+ *
+ *	Note: Only to be called by Sheet when it's being deleted
+ */
+void AudioTrack::unload_frozen_clip()
+{
+    if (m_freezeRenderer) {
+        m_freezeRenderer->disconnect(this);
+        m_freezeRenderer->cancel();
+        m_freezeRenderer->wait();
+        delete m_freezeRenderer;
+        m_freezeRenderer = nullptr;
+        QFile::remove(m_freezeSpecification->get_export_dir() + m_freezeSpecification->get_export_file_name() + m_freezeSpecification->get_file_extension());
+        delete m_freezeSpecification;
+        m_freezeSpecification = nullptr;
+        m_sheet->set_render_locked(false);
+    }
+
+    if (!m_frozenClip) {
+        return;
+    }
+
+    for (const auto& connection : std::as_const(m_freezeConnections)) {
+        disconnect(connection);
+    }
+    m_freezeConnections.clear();
+
+    m_rtFrozenClip = nullptr;
+    delete m_frozenClip;
+    m_frozenClip = nullptr;
+}
+
+void AudioTrack::freeze_render_finished()
+{
+    PENTER;
+
+    int result = m_freezeRenderer->get_result();
+    m_freezeRenderer->wait();
+    delete m_freezeRenderer;
+    m_freezeRenderer = nullptr;
+
+    m_sheet->set_render_locked(false);
+
+    QString fileName = m_freezeSpecification->get_export_file_name() + m_freezeSpecification->get_file_extension();
+    QString filePath = m_freezeSpecification->get_export_dir() + fileName;
+    delete m_freezeSpecification;
+    m_freezeSpecification = nullptr;
+
+    if (result <= 0) {
+        QFile::remove(filePath);
+        m_frozenFingerprint.clear();
+        if (result < 0) {
+            info().critical(tr("Freezing Track %1 failed").arg(m_name));
+        }
+        return;
+    }
+
+    if (frozen_state_fingerprint() != m_frozenFingerprint) {
+        QFile::remove(filePath);
+        m_frozenFingerprint.clear();
+        info().information(tr("Track %1 was changed while freezing, not frozen").arg(m_name));
+        return;
+    }
+
+    if (load_frozen_clip(fileName, m_freezeStartLocation) < 0) {
+        QFile::remove(filePath);
+        m_frozenFingerprint.clear();
+        info().critical(tr("Freezing Track %1 failed").arg(m_name));
+        return;
+    }
+
+    info().information(tr("Track %1 frozen").arg(m_name));
+}
+
+int AudioTrack::load_frozen_clip(const QString& fileName, const TTimeRef& startLocation)
+{
+    PENTER;
+
+    QString dir = m_sheet->get_audio_sources_dir();
+
+    if (!QFile::exists(dir + fileName)) {
+        return -1;
+    }
+
+    auto source = new ReadSource(dir, fileName);
+    if (source->init() < 0) {
+        PERROR(QString("Couldn't open frozen render %1").arg(dir + fileName));
+        delete source;
+        return -1;
+    }
+
+    // The clip isn't added to the track like the others, it's only processed by process_frozen().
+    // set_sheet() comes last, it adds the ReadSource to the DiskIO of the Sheet
+    auto clip = new AudioClip(tr("%1 (frozen)").arg(m_name));
+    clip->set_track(this);
+    clip->set_location_start(startLocation);
+    clip->set_audio_source(source);
+    clip->set_sheet(m_sheet);
+
+    m_frozenClip = clip;
+
+    if (m_sheet->is_transport_rolling()) {
+        TsarEvent event;
+        tsar().prepare_event(event, this, clip, Tsar::call<AudioTrack, AudioClip, &AudioTrack::private_add_frozen_clip>, "");
+        tsar().post_gui_event(event);
+    } else {
+        private_add_frozen_clip(clip);
+    }
+
+    // Anything that ends up in frozen_state_fingerprint() invalidates the render
+    watch_frozen_state(m_sheet->get_history_stack(), SIGNAL(indexChanged(int)));
+    watch_frozen_state(this, SIGNAL(stateChanged()));
+    watch_frozen_state(this, SIGNAL(routingConfigurationChanged()));
+    watch_frozen_state(this, SIGNAL(audioClipAdded(AudioClip*)));
+    watch_frozen_state(this, SIGNAL(audioClipRemoved(AudioClip*)));
+    watch_frozen_state(m_pluginChain, SIGNAL(pluginAdded(Plugin*)));
+    watch_frozen_state(m_pluginChain, SIGNAL(pluginRemoved(Plugin*)));
+
+    QList<Curve*> curves;
+
+    const QList<Plugin*> plugins = m_pluginChain->get_pre_fader_plugins();
+    for (auto plugin : plugins) {
+        watch_frozen_state(plugin, SIGNAL(bypassChanged()));
+        const QList<PluginControlPort*> ports = plugin->get_control_ports();
+        for (auto port : ports) {
+            watch_frozen_state(port, SIGNAL(controlValueChanged(float)));
+            if (port->get_curve()) {
+                curves.append(port->get_curve());
+            }
+        }
+    }
+
+    for (auto audioClip : std::as_const(m_audioClips)) {
+        watch_frozen_state(audioClip, SIGNAL(stateChanged()));
+        watch_frozen_state(audioClip, SIGNAL(muteChanged()));
+        watch_frozen_state(audioClip, SIGNAL(positionChanged()));
+        watch_frozen_state(audioClip, SIGNAL(fadeAdded(FadeCurve*)));
+        watch_frozen_state(audioClip, SIGNAL(fadeRemoved(FadeCurve*)));
+        curves.append(audioClip->get_plugin_chain()->get_fader()->get_curve());
+
+        for (auto fade : {audioClip->get_fade_in(), audioClip->get_fade_out()}) {
+            if (!fade) {
+                continue;
+            }
+            watch_frozen_state(fade, SIGNAL(modeChanged()));
+            watch_frozen_state(fade, SIGNAL(bendValueChanged()));
+            watch_frozen_state(fade, SIGNAL(strengthValueChanged()));
+            watch_frozen_state(fade, SIGNAL(rangeChanged()));
+            curves.append(fade);
+        }
+    }
+
+    for (auto curve : std::as_const(curves)) {
+        watch_frozen_state(curve, SIGNAL(nodeAdded(CurveNode*)));
+        watch_frozen_state(curve, SIGNAL(nodeRemoved(CurveNode*)));
+        watch_frozen_state(curve, SIGNAL(nodePositionChanged()));
+    }
+
+    // Deactivates the ReadSources of the clips, see AudioClip::set_sources_active_state()
+    emit audibleStateChanged();
+    emit frozenChanged(true);
+
+    return 1;
+}
+
+void AudioTrack::watch_frozen_state(QObject* sender, const char* signal)
+{
+    m_freezeConnections.append(connect(sender, signal, this, SLOT(check_frozen_state())));
+}
+
+/**
+ *	Describes everything that ends up in the frozen render, the render is
+ *	only valid as long as the fingerprint doesn't change
+ */
+QByteArray AudioTrack::frozen_state_fingerprint()
+{
+    QDomDocument doc("Freeze");
+    QDomElement node = doc.createElement("Freeze");
+    doc.appendChild(node);
+
+    // Adding a pre send unfreezes the track, see process_frozen()
+    node.setAttribute("presends", get_pre_sends().size());
+
+    QDomElement pluginsNode = doc.createElement("PreFaderPlugins");
+    node.appendChild(pluginsNode);
+    const QList<Plugin*> plugins = m_pluginChain->get_pre_fader_plugins();
+    for (auto plugin : plugins) {
+        pluginsNode.appendChild(plugin->get_state(doc));
+    }
+
+    for (AudioClip* clip : std::as_const(m_audioClips)) {
+        node.appendChild(clip->get_state(doc));
+    }
+
+    return QCryptographicHash::hash(doc.toByteArray(), QCryptographicHash::Sha1).toHex();
+}
+
+void AudioTrack::check_frozen_state()
+{
+    if (!m_frozenClip || frozen_state_fingerprint() == m_frozenFingerprint) {
+        return;
+    }
+
+    unfreeze();
+
+    info().information(tr("Track %1 changed, it's no longer frozen").arg(m_name));
+}
+
+void AudioTrack::private_add_frozen_clip(AudioClip* clip)
+{
+    m_rtFrozenClip = clip;
+}
+
+void AudioTrack::private_remove_frozen_clip(AudioClip* clip)
+{
+    Q_UNUSED(clip);
+    m_rtFrozenClip = nullptr;
+}
+
+void AudioTrack::frozen_clip_removed(AudioClip* clip)
+{
+    // The AudioClip destructor hands the ReadSource over to DiskIO for deletion
+    QString fileName = clip->get_readsource()->get_filename();
+    delete clip;
+    QFile::remove(fileName);
+}
+
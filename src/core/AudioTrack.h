@@ -26,6 +26,7 @@ Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA.
 #include <QString>
 #include <QDomDocument>
 #include <QList>
+#include <QByteArray>
 
 #include "ContextItem.h"
 #include "TRealTimeLinkedList.h"
@@ -34,6 +35,8 @@ Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA.
 #include "defines.h"
 
 class Sheet;
+class TExportSpecification;
+class TFreewheelRenderer;
 
 
 class AudioTrack : public Track
@@ -65,7 +68,17 @@ public :
         int arm();
         bool armed();
         int disarm();
-        int process(const TTimeRef& startLocation, const TTimeRef& endLocation, nframes_t nframes);
+        int process(const TTimeRef& startLocation, const TTimeRef& endLocation, nframes_t nframes, bool processPostSends=true);
+        int render(const TTimeRef& startLocation, const TTimeRef& endLocation, nframes_t nframes);
+        void prepare_freewheel();
+        void finish_freewheel();
+
+        int freeze();
+        void unfreeze();
+        void unload_frozen_clip();
+        bool is_frozen() const {return m_frozenClip != nullptr;}
+        bool is_freezing() const {return m_freezeRenderer != nullptr;}
+        AudioClip* get_frozen_clip() const {return m_frozenClip;}
 
         bool operator<(const AudioTrack &other) {
             printf("bool operator<(const AudioTrack &other)\n");
@@ -91,8 +104,24 @@ private :
         bool            m_isArmed{};
 	bool		m_showClipVolumeAutomation{};
 
+        // Frozen tracks play back the render of their clips and pre fader plugins
+        // with a single AudioClip that isn't part of m_audioClips
+        AudioClip*      m_frozenClip{};
+        AudioClip*      m_rtFrozenClip{};
+        QByteArray      m_frozenFingerprint;
+        QList<QMetaObject::Connection> m_freezeConnections;
+        TFreewheelRenderer*     m_freezeRenderer{};
+        TExportSpecification*   m_freezeSpecification{};
+        TTimeRef        m_freezeStartLocation;
+
         void set_armed(bool armed);
         void init();
+        int process_pre_fader(const TTimeRef& startLocation, const TTimeRef& endLocation, nframes_t nframes, bool processPreSends);
+        int process_fader(const TTimeRef& startLocation, const TTimeRef& endLocation, nframes_t nframes);
+        int process_frozen(const TTimeRef& startLocation, const TTimeRef& endLocation, nframes_t nframes);
+        QByteArray frozen_state_fingerprint();
+        int load_frozen_clip(const QString& fileName, const TTimeRef& startLocation);
+        void watch_frozen_state(QObject* sender, const char* signal);
 
 signals:
         void audioClipAdded(AudioClip* clip);
@@ -102,11 +131,15 @@ signals:
         void privateAudioClipRemoved(AudioClip* clip);
 
         void armedChanged(bool isArmed);
+        void frozenChanged(bool isFrozen);
+
+        void privateFrozenClipRemoved(AudioClip* clip);
 
 public slots:
         void clip_position_changed(AudioClip* clip);
 
         TCommand* toggle_arm();
+        TCommand* toggle_freeze();
         TCommand* silence_others();
 	TCommand* toggle_show_clip_volume_automation();
 
@@ -117,6 +150,12 @@ private slots:
         void private_audioclip_removed(AudioClip* clip);
 
         void private_clip_position_changed(AudioClip* clip);
+        void private_add_frozen_clip(AudioClip* clip);
+        void private_remove_frozen_clip(AudioClip* clip);
+
+        void frozen_clip_removed(AudioClip* clip);
+        void freeze_render_finished();
+        void check_frozen_state();
 };
 
 #endif
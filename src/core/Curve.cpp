@@ -34,8 +34,12 @@ Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA.
 #include "Utils.h"
 #include <AddRemove.h>
 #include "Mixer.h"
+#include "TDspProfiler.h"
 #include "Information.h"
 #include "TInputEventDispatcher.h"
+#include "Tsar.h"
+
+#include <algorithm>
 
 // Always put me below _all_ includes, this is needed
 // in case we run with memory leak detection enabled!
@@ -65,18 +69,28 @@ Curve::~Curve()
 		node = node->next;
 		delete q;
 	}
+
+    TCompiledCurve* compiled = m_compiled.load();
+    while (compiled) {
+        TCompiledCurve* replaced = compiled->replaced;
+        delete compiled;
+        compiled = replaced;
+    }
 }
 
 void Curve::init( )
 {
 	QObject::tr("Curve");
 	QObject::tr("CurveNode");
-	m_changed = true;
-	m_lookup_cache.left = -1;
     m_defaultValue = 1.0;
     m_session = nullptr;
+    m_compiled = new TCompiledCurve;
 	
 	connect(this, SIGNAL(nodePositionChanged()), this, SLOT(set_changed()));
+    // Node add/remove might be done in the audio thread, the signals arrive in the GUI thread
+    connect(this, SIGNAL(nodeAdded(CurveNode*)), this, SLOT(set_changed()));
+    connect(this, SIGNAL(nodeRemoved(CurveNode*)), this, SLOT(set_changed()));
+    connect(this, SIGNAL(compiledCurveSwapped()), this, SLOT(delete_replaced_compiled_curves()));
 }
 
 
@@ -119,6 +133,10 @@ int Curve::set_state( const QDomNode & node )
 		CurveNode* node = new CurveNode(this, when, value);
 		private_add_node(node);
 	}
+
+	// Compile right away, the loaded project might be processed before
+	// the event loop gets a chance to run a pending compile
+	compile_changes();
 	
 	return 1;
 }
@@ -132,14 +150,18 @@ int Curve::process(
     audio_sample_t makeupgain
 	)
 {
+    TDspProfileScope profileScope(TDspProfiler::CURVE, this);
+
+    const TCompiledCurve* compiled = m_compiled.load(std::memory_order_acquire);
+
 	// Do nothing if there are no nodes!
-	if (m_nodes.isEmpty()) {
+    if (compiled->nodeCount == 0) {
 		return 0;
 	}
 	
 	// Check if we are beyond the last node and only apply gain if != 1.0
-	if (endlocation > qint64(get_range())) {
-        audio_sample_t gain = audio_sample_t((static_cast<CurveNode*>(m_nodes.last()))->get_value()) * makeupgain;
+    if (endlocation > qint64(compiled->lastWhen)) {
+        audio_sample_t gain = audio_sample_t(compiled->lastValue) * makeupgain;
 
 		if (gain == 1.0f) {
 			return 0;
@@ -153,44 +175,121 @@ int Curve::process(
 	}
 	
 	// Calculate the vector, an apply to the buffer including the makeup gain.
-        get_vector(startlocation.universal_frame(), endlocation.universal_frame(), m_session->mixdown, nframes);
+        audio_sample_t* mixdown = m_session->get_mixdown_buffer();
+        get_vector(startlocation.universal_frame(), endlocation.universal_frame(), mixdown, nframes);
 	
 	for (uint chan=0; chan<channels; ++chan) {
-		for (nframes_t n = 0; n < nframes; ++n) {
-                        buffer[chan][n] *= (m_session->mixdown[n] * makeupgain);
-		}
+		Mixer::apply_gain_vector(buffer[chan], mixdown, nframes, makeupgain);
 	}
 	
 	return 1;
 }
 
-
-void Curve::solve ()
+/**
+ *	Like process(), but mixes \a src with the curve applied into \a dst in one pass
+ *	instead of applying the curve in place. \a src is left untouched, so the same
+ *	source buffer can be mixed into multiple channels.
+ */
+void Curve::process_mix(
+	audio_sample_t** dst,
+	audio_sample_t** src,
+	const TTimeRef& startlocation,
+	const TTimeRef& endlocation,
+	nframes_t nframes,
+	uint channels,
+	audio_sample_t makeupgain
+	)
 {
-    int npoints;
+    TDspProfileScope profileScope(TDspProfiler::CURVE, this);
+
+    const TCompiledCurve* compiled = m_compiled.load(std::memory_order_acquire);
 
-	if (!m_changed) {
-		printf("Curve::solve, no data change\n");
+	// No nodes, process() leaves the audio as is
+    if (compiled->nodeCount == 0) {
+		for (uint chan=0; chan<channels; ++chan) {
+			Mixer::mix_buffers_no_gain(dst[chan], src[chan], nframes);
+		}
 		return;
 	}
-	
-	if ((npoints = m_nodes.size()) > 2) {
-		
+
+	// Beyond the last node the gain is constant
+    if (endlocation > qint64(compiled->lastWhen)) {
+        audio_sample_t gain = audio_sample_t(compiled->lastValue) * makeupgain;
+
+		for (uint chan=0; chan<channels; ++chan) {
+			if (gain == 1.0f) {
+				Mixer::mix_buffers_no_gain(dst[chan], src[chan], nframes);
+			} else {
+				Mixer::mix_buffers_with_gain(dst[chan], src[chan], nframes, gain);
+			}
+		}
+		return;
+	}
+
+        audio_sample_t* mixdown = m_session->get_mixdown_buffer();
+        get_vector(startlocation.universal_frame(), endlocation.universal_frame(), mixdown, nframes);
+
+	for (uint chan=0; chan<channels; ++chan) {
+		Mixer::mix_with_gain_vector(dst[chan], src[chan], mixdown, nframes, makeupgain);
+	}
+}
+
+/**
+ *	Creates a TCompiledCurve from the current nodes. The curve segments are stored in
+ *	a flat array sorted by position, each with the polynomial coefficients of the
+ *	constrained spline (or the line for 2 nodes) going through it's nodes.
+ */
+TCompiledCurve* Curve::compile()
+{
+    auto compiled = new TCompiledCurve;
+
+    int npoints = m_nodes.size();
+    compiled->nodeCount = npoints;
+
+    if (npoints == 0) {
+        return compiled;
+    }
+
+    auto x = QVarLengthArray<double>(npoints);
+    auto y = QVarLengthArray<double>(npoints);
+
+    int i = 0;
+    for(CurveNode* node = m_nodes.first(); node!=nullptr; node = node->next, ++i) {
+        x[i] = node->get_when();
+        y[i] = node->get_value();
+    }
+
+    compiled->firstWhen = x[0];
+    compiled->firstValue = y[0];
+    compiled->lastWhen = x[npoints - 1];
+    compiled->lastValue = y[npoints - 1];
+
+    if (npoints == 2) {
+        /* linear interpolation between 2 points */
+        TCompiledCurve::Segment segment;
+        double slope = (y[1] - y[0]) / (x[1] - x[0]);
+        segment.start = x[0];
+        segment.end = x[1];
+        segment.coeff[0] = y[0] - slope * x[0];
+        segment.coeff[1] = slope;
+        segment.coeff[2] = segment.coeff[3] = 0.0;
+        compiled->segments.append(segment);
+    } else if (npoints > 2) {
+        solve(compiled, x.constData(), y.constData(), npoints);
+    }
+
+    return compiled;
+}
+
+
+void Curve::solve (TCompiledCurve* compiled, const double* x, const double* y, int npoints)
+{
 		/* Compute coefficients needed to efficiently compute a constrained spline
 		curve. See "Constrained Cubic Spline Interpolation" by CJC Kruger
 		(www.korf.co.uk/spline.pdf) for more details.
 		*/
 
-        auto x = QVarLengthArray<double>(npoints);
-        auto y = QVarLengthArray<double>(npoints);
-
-        int i;
-
-		i = 0;
-        for(CurveNode* node = m_nodes.first(); node!=nullptr; node = node->next, ++i) {
-            x[i] = node->get_when();
-            y[i] = node->get_value();
-		}
+        compiled->segments.resize(npoints - 1);
 
 		double lp0, lp1, fpone;
 
@@ -205,8 +304,7 @@ void Curve::solve ()
 
 		double fplast = 0;
 
-		i = 0;
-        for(CurveNode* node = m_nodes.first(); node != nullptr; node = node->next, ++i) {
+        for (int i = 0; i < npoints; ++i) {
 
 			double xdelta;   /* gcc is wrong about possible uninitialized use */
 			double xdelta2;  /* ditto */
@@ -246,7 +344,7 @@ void Curve::solve ()
 				double slope_after = (xdelta / ydelta);
 
 				if ((slope_after * slope_before) < 0.0) {
-					/* slope m_changed sign */
+					/* slope changed sign */
 					fpi = 0.0;
 				} else {
 					fpi = 2 / (slope_before + slope_after);
@@ -276,29 +374,81 @@ void Curve::solve ()
 			
 			b = (ydelta - (c * (xi2 - xim12)) - (d * (xi3 - xim13))) / xdelta;
 
-			/* store */
+			/* store, segment i-1 runs from node i-1 to node i */
 
-            node->coeff[0] = y[i-1] - (b * x[i-1]) - (c * xim12) - (d * xim13);
-            node->coeff[1] = b;
-            node->coeff[2] = c;
-            node->coeff[3] = d;
+            TCompiledCurve::Segment& segment = compiled->segments[i-1];
+            segment.start = x[i-1];
+            segment.end = x[i];
+            segment.coeff[0] = y[i-1] - (b * x[i-1]) - (c * xim12) - (d * xim13);
+            segment.coeff[1] = b;
+            segment.coeff[2] = c;
+            segment.coeff[3] = d;
 
             fplast = fpi;
 		}
-	}
+}
+
+// Evaluates the segment polynomial for vec[first] up to vec[first + count], there
+// is no dependency between the iterations so the compiler can vectorize this loop
+static inline void evaluate_segment(const double* coeff, double x0, double dx, nframes_t first, nframes_t count, float* vec)
+{
+    const double c0 = coeff[0];
+    const double c1 = coeff[1];
+    const double c2 = coeff[2];
+    const double c3 = coeff[3];
+    const nframes_t last = first + count;
+
+    for (nframes_t i = first; i < last; ++i) {
+        double x = x0 + double(i) * dx;
+        vec[i] = float(c0 + x * (c1 + x * (c2 + x * c3)));
+    }
+}
 
-	m_changed = false;
+static void evaluate_segments(const TCompiledCurve* compiled, double x0, double dx, float* vec, nframes_t veclen)
+{
+    const TCompiledCurve::Segment* begin = compiled->segments.constData();
+    const TCompiledCurve::Segment* end = begin + compiled->segments.size();
+
+    // The first segment which ends beyond x0
+    const TCompiledCurve::Segment* segment = std::upper_bound(begin, end, x0,
+            [](double x, const TCompiledCurve::Segment& s) {return x < s.end;});
+
+    nframes_t i = 0;
+
+    while (i < veclen) {
+        if (segment == end) {
+            for (; i < veclen; ++i) {
+                vec[i] = float(compiled->lastValue);
+            }
+            break;
+        }
+
+        // Amount of samples that fall within this segment
+        nframes_t count = veclen - i;
+        if (dx > 0.0) {
+            double remaining = std::ceil((segment->end - (x0 + double(i) * dx)) / dx);
+            if (remaining < double(count)) {
+                count = nframes_t(std::max(1.0, remaining));
+            }
+        }
+
+        evaluate_segment(segment->coeff, x0, dx, i, count, vec);
+
+        i += count;
+        ++segment;
+    }
 }
 
 
 void Curve::get_vector (double x0, double x1, float *vec, nframes_t veclen)
 {
-    double rx, dx, lx, hx, max_x, min_x;
+    double dx, lx, hx, max_x, min_x;
     nframes_t i;
     nframes_t original_veclen;
-	int32_t npoints;
+
+    const TCompiledCurve* compiled = m_compiled.load(std::memory_order_acquire);
 	
-	if ((npoints = m_nodes.size()) == 0) {
+    if (compiled->nodeCount == 0) {
 		for (i = 0; i < veclen; ++i) {
             vec[i] = float(m_defaultValue);
 		}
@@ -307,16 +457,13 @@ void Curve::get_vector (double x0, double x1, float *vec, nframes_t veclen)
 
 	/* nodes is now known not to be empty */
 	
-    CurveNode* lastnode = m_nodes.last();
-    CurveNode* firstnode = m_nodes.first();
-
-    max_x = lastnode->get_when();
-    min_x = firstnode->get_when();
+    max_x = compiled->lastWhen;
+    min_x = compiled->firstWhen;
 
 	lx = max (min_x, x0);
 
 	if (x1 < 0) {
-        x1 = lastnode->get_when();
+        x1 = compiled->lastWhen;
 	}
 
 	hx = min (max_x, x1);
@@ -335,10 +482,8 @@ void Curve::get_vector (double x0, double x1, float *vec, nframes_t veclen)
 		
 		subveclen = min (subveclen, veclen);
 
-//                printf("filling first %d samples %f\n", subveclen, firstnode->get_value());
-
 		for (i = 0; i < subveclen; ++i) {
-            vec[i] = float(firstnode->get_value());
+            vec[i] = float(compiled->firstValue);
 		}
 
 		veclen -= subveclen;
@@ -357,9 +502,7 @@ void Curve::get_vector (double x0, double x1, float *vec, nframes_t veclen)
 		
 		subveclen = min (subveclen, veclen);
 
-        val = float(lastnode->get_value());
-
-//                printf("filling last %d samples %f\n", subveclen, firstnode->get_value());
+        val = float(compiled->lastValue);
 
                 for (i = veclen - subveclen; i < veclen; ++i) {
 			vec[i] = val;
@@ -372,16 +515,16 @@ void Curve::get_vector (double x0, double x1, float *vec, nframes_t veclen)
 		return;
 	}
 
-	if (npoints == 1 ) {
+    if (compiled->nodeCount == 1 ) {
 	
 		for (i = 0; i < veclen; ++i) {
-            vec[i] = float(firstnode->get_value());
+            vec[i] = float(compiled->firstValue);
 		}
 		return;
 	}
 
 
-	if (npoints == 2) {
+    if (compiled->nodeCount == 2) {
 
 		/* linear interpolation between 2 points */
 
@@ -395,167 +538,15 @@ void Curve::get_vector (double x0, double x1, float *vec, nframes_t veclen)
 		} else {
 			dx = 0; // not used
 		}
-	
-        double slope = (lastnode->get_value() - firstnode->get_value()) /
-            (lastnode->get_when() - firstnode->get_when() );
-		double yfrac = dx*slope;
-
-        vec[0] = float(firstnode->get_value() + slope * (lx - firstnode->get_when()));
 
-		for (i = 1; i < veclen; ++i) {
-            vec[i] = float(vec[i-1] + float(yfrac));
-		}
+        evaluate_segment(compiled->segments.first().coeff, lx, dx, 0, veclen, vec);
 
 		return;
 	}
 
-    if (m_changed) {
-		solve ();
-	}
-
-    rx = lx;
-
-	if (veclen > 1) {
-
-		dx = (hx - lx) / veclen;
-
-		for (i = 0; i < veclen; ++i, rx += dx) {
-            vec[i] = float(multipoint_eval (rx));
-		}
-	}
-}
-
-double Curve::multipoint_eval(double x)
-{	
-	if ((m_lookup_cache.left < 0) ||
-        ((m_lookup_cache.left > x) || (m_lookup_cache.range.second->get_when() < x))) {
-		
-		CurveNode cn (this, x, 0.0);
-
-        CurveNode* first = m_nodes.first();
-        CurveNode* last = m_nodes.last();
-        CurveNode* middle;
-		bool validrange = false;
-		int len = m_nodes.size() - 1;
-		int half;
-		
-		while (len > 0) {
-			half = len >> 1;
-			middle = first;
-			// advance middle by half
-			int n = half;
-			while (n--) {
-				middle = middle->next;
-			}
-			//start compare
-            if (middle->get_when() < cn.get_when()) {
-				first = middle;
-				first = first->next;
-				len = len - half - 1;
-            } else if (cn.get_when() < middle->get_when()) {
-				len = half;
-			} else {
-				// lower bound (using first/middle)
-                CurveNode* lbfirst = first;
-                CurveNode* lblast = middle;
-                CurveNode* lbmiddle;
-				// start distance.
-				int lblen = 0;
-                CurveNode* temp = lbfirst;
-				while (temp != lblast) {
-					temp = temp->next;
-					++lblen;
-				}
-				
-				int lbhalf;
-				while (lblen > 0) {
-					lbhalf = lblen >> 1;
-					lbmiddle = lbfirst;
-					// advance middle by half
-					n = lbhalf;
-					while (n--) {
-						lbmiddle = lbmiddle->next;
-					}
-                    if (lbmiddle->get_when() < cn.get_when()) {
-						lbfirst = lbmiddle;
-						lbfirst = lbfirst->next;
-						lblen = lblen - lbhalf - 1;
-					} else {
-						lblen = lbhalf;
-					}
-				}
-                m_lookup_cache.range.first = lbfirst;
-				
-
-				// upper bound
-                CurveNode* ubfirst = middle->next;
-                CurveNode* ublast = last;
-                CurveNode* ubmiddle;
-				// start distance.
-				int ublen = 0;
-				temp = ubfirst;
-				while (temp != ublast) {
-					temp = temp->next;
-					++ublen;
-				}
-				
-				int ubhalf;
-				while (ublen > 0) {
-					ubhalf = ublen >> 1;
-					ubmiddle = ubfirst;
-					// advance middle by half
-					n = ubhalf;
-					while (n--) {
-						ubmiddle = ubmiddle->next;
-					}
-
-                    if (cn.get_when() < ubmiddle->get_when()) {
-						ublen = ubhalf;
-					} else {
-						ubfirst = ubmiddle;
-						ubfirst = ubfirst->next;
-						ublen = ublen - ubhalf - 1;
-					}
-				}
-                m_lookup_cache.range.second = ubfirst;
-				
-				validrange = true;
-				break;
-			}
-		}
-		if (!validrange) {
-            m_lookup_cache.range.first = first;
-            m_lookup_cache.range.second = first;
-		}
-	}
-	
-	/* EITHER 
-	
-	a) x is an existing control point, so first == existing point, second == next point
-
-	OR
-
-	b) x is between control points, so range is empty (first == second, points to where
-	to insert x)
-	
-	*/
-
-	if (m_lookup_cache.range.first == m_lookup_cache.range.second) {
-
-		/* x does not exist within the list as a control point */
-		
-		m_lookup_cache.left = x;
-
-		double x2 = x * x;
-		CurveNode* cn = m_lookup_cache.range.second;
-		
-		return cn->coeff[0] + (cn->coeff[1] * x) + (cn->coeff[2] * x2) + (cn->coeff[3] * x2 * x);
-	} 
+    dx = (hx - lx) / veclen;
 
-	/* x is a control point in the data */
-	/* invalidate the cached range because its not usable */
-	m_lookup_cache.left = -1;
-    return m_lookup_cache.range.first->get_value();
+    evaluate_segments(compiled, lx, dx, vec, veclen);
 }
 
 void Curve::set_range(double when)
@@ -600,10 +591,60 @@ void Curve::x_scale(double factor)
 	}
 }
 
+/**
+ *	Schedules compiling the nodes, all changes made in one go, like moving or
+ *	pasting a selection of nodes, are compiled only once.
+ *
+ *	Note: This function should only be called from the GUI thread!
+ */
 void Curve::set_changed( )
 {
-	m_lookup_cache.left = -1;
-	m_changed = true;
+    if (m_compilePending) {
+        return;
+    }
+
+    m_compilePending = true;
+    QMetaObject::invokeMethod(this, "compile_changes", Qt::QueuedConnection);
+}
+
+/**
+ *	Compiles the nodes and hands the result over to the audio processing thread.
+ *
+ *	Note: This function should only be called from the GUI thread!
+ */
+void Curve::compile_changes()
+{
+    m_compilePending = false;
+
+    TCompiledCurve* compiled = compile();
+
+    if (m_session && m_session->is_transport_rolling()) {
+        TsarEvent event;
+        tsar().prepare_event(event, this, compiled, Tsar::call<Curve, TCompiledCurve, &Curve::private_set_compiled_curve>, "compiledCurveSwapped()");
+        tsar().post_gui_event(event);
+    } else {
+        private_set_compiled_curve(compiled);
+        delete_replaced_compiled_curves();
+    }
+}
+
+void Curve::private_set_compiled_curve(TCompiledCurve* compiled)
+{
+    compiled->replaced = m_compiled.load(std::memory_order_relaxed);
+    m_compiled.store(compiled, std::memory_order_release);
+}
+
+void Curve::delete_replaced_compiled_curves()
+{
+    TCompiledCurve* compiled = m_compiled.load(std::memory_order_acquire);
+    TCompiledCurve* replaced = compiled->replaced;
+    compiled->replaced = nullptr;
+
+    while (replaced) {
+        TCompiledCurve* next = replaced->replaced;
+        delete replaced;
+        replaced = next;
+    }
 }
 
 
@@ -638,8 +679,8 @@ TCommand* Curve::add_node(CurveNode* node, bool historable)
 
     AddRemove* cmd;
         cmd = new AddRemove(this, node, historable, m_session,
-			"private_add_node(CurveNode*)", "nodeAdded(CurveNode*)",
-			"private_remove_node(CurveNode*)", "nodeRemoved(CurveNode*)", 
+			Tsar::call<Curve, CurveNode, &Curve::private_add_node>, "nodeAdded(CurveNode*)",
+			Tsar::call<Curve, CurveNode, &Curve::private_remove_node>, "nodeRemoved(CurveNode*)", 
 			tr("Add CurveNode"));
 
 	return cmd;
@@ -666,22 +707,22 @@ TCommand* Curve::remove_node(CurveNode* node, bool historable)
     PENTER2;
 
     return new AddRemove(this, node, historable, m_session,
-                         "private_remove_node(CurveNode*)", "nodeRemoved(CurveNode*)",
-                         "private_add_node(CurveNode*)", "nodeAdded(CurveNode*)",
+                         Tsar::call<Curve, CurveNode, &Curve::private_remove_node>, "nodeRemoved(CurveNode*)",
+                         Tsar::call<Curve, CurveNode, &Curve::private_add_node>, "nodeAdded(CurveNode*)",
                          tr("Remove CurveNode"));
 
 }
 
+// The nodeAdded() signal takes care of compiling the curve in the GUI thread
 void Curve::private_add_node( CurveNode * node )
 {
     m_nodes.add_and_sort(node);
-	set_changed();
 }
 
+// The nodeRemoved() signal takes care of compiling the curve in the GUI thread
 void Curve::private_remove_node( CurveNode * node )
 {
 	m_nodes.remove(node);
-	set_changed();
 }
 
 void Curve::set_sheet(TSession * sheet)
@@ -33,7 +33,9 @@ Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA.
 #include "ContextItem.h"
 #include <QString>
 #include <QList>
+#include <QVector>
 #include <QDomDocument>
+#include <atomic>
 
 #include "CurveNode.h"
 #include "TRealTimeLinkedList.h"
@@ -43,6 +45,26 @@ Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA.
 
 class TSession;
 
+// Flat, read only representation of a Curve's nodes as used by Curve::get_vector()
+// Build in the GUI thread by Curve::compile() and handed over to the audio thread
+struct TCompiledCurve
+{
+	struct Segment {
+		double start;		// when of the left node
+		double end;		// when of the right node
+		double coeff[4];	// y = c0 + c1*x + c2*x^2 + c3*x^3
+	};
+
+	QVector<Segment>	segments;
+	double			firstWhen{};
+	double			lastWhen{};
+	double			firstValue{};
+	double			lastValue{};
+	int			nodeCount{};
+	// The TCompiledCurve this one replaced, deleted once the swap is done
+	TCompiledCurve*		replaced{};
+};
+
 class Curve : public ContextItem
 {
 	Q_OBJECT
@@ -55,6 +77,7 @@ public:
 	QDomNode get_state(QDomDocument doc, const QString& name);
 	virtual int set_state( const QDomNode& node );
 	int process(audio_sample_t** buffer, const TTimeRef& startlocation, const TTimeRef& endlocation, nframes_t nframes, uint channels, float makeupgain=1.0f);
+	void process_mix(audio_sample_t** dst, audio_sample_t** src, const TTimeRef& startlocation, const TTimeRef& endlocation, nframes_t nframes, uint channels, float makeupgain=1.0f);
 	
 	TCommand* add_node(CurveNode* node, bool historable=true);
 	TCommand* remove_node(CurveNode* node, bool historable=true);
@@ -79,20 +102,15 @@ protected:
 
 private :
         TRealTimeLinkedList<CurveNode*> m_nodes;
-	struct LookupCache {
-		double left;  /* leftmost x coordinate used when finding "range" */
-		std::pair<CurveNode*, CurveNode*> range;
-		
-	};
-        LookupCache     m_lookup_cache;
-        bool            m_changed{};
+        std::atomic<TCompiledCurve*> m_compiled;
         double          m_defaultValue{};
         TTimeRef		m_startoffset;
+        bool            m_compilePending{};
 
 	
-	double multipoint_eval (double x);
 	void x_scale(double factor);
-	void solve ();
+	TCompiledCurve* compile();
+	void solve(TCompiledCurve* compiled, const double* x, const double* y, int npoints);
 	void init();
 	
 	friend class CurveNode;
@@ -103,6 +121,9 @@ protected slots:
 private slots:
 	void private_add_node(CurveNode* node);
 	void private_remove_node(CurveNode* node);
+	void private_set_compiled_curve(TCompiledCurve* compiled);
+	void delete_replaced_compiled_curves();
+	void compile_changes();
 	
 
 
@@ -111,6 +132,7 @@ signals :
 	void nodeAdded(CurveNode*);
 	void nodeRemoved(CurveNode*);
 	void nodePositionChanged();
+	void compiledCurveSwapped();
 };
 
 
@@ -33,9 +33,12 @@ $Id: CurveNode.cpp,v 1.8 2007/11/23 14:56:36 r_sijrier Exp $
 CurveNode::CurveNode(Curve *curve, double when, double value)
     : m_curve(curve)
 {
-    coeff[0] = coeff[1] = coeff[2] = coeff[3] = 0.0;
+    Q_ASSERT( ! std::isnan(when));
+    Q_ASSERT( ! std::isnan(value));
 
-    set_when_and_value(when, value);
+    // Not part of the Curve yet, so no need to let it know about our position
+    m_when = when;
+    m_value = value;
 
     next = nullptr;
 }
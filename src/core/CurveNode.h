@@ -52,7 +52,6 @@ public:
     CurveNode* next;
 
 private:
-    double  coeff[4];
     double 	m_when;
     double 	m_value;
 
@@ -25,6 +25,12 @@ Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA.
 #include "AudioDevice.h"
 
 #include "AudioSource.h"
+#include "TConfig.h"
+#include "TFlightRecorder.h"
+
+#include <QVector>
+#include <QPair>
+#include <algorithm>
 
 // Always put me below _all_ includes, this is needed
 // in case we run with memory leak detection enabled!
@@ -82,10 +88,16 @@ const char *to_prio[] = { "none", "realtime", "best-effort", "idle", };
  *	Each Sheet class has it's own DiskIO instance.
  * 	The DiskIO manages all the AudioSources related to a Sheet, and makes sure the RingBuffers
  * 	from the AudioSources are processed in time. (It at least tries very hard)
+ *
+ *	AudioSources are processed in order of their estimated time to underrun, so the
+ *	emptiest buffers get refilled first. When the Hardware/DiskIOThreadCount config
+ *	value is larger then 1, the ReadSources are refilled by a pool of DiskIOThreads,
+ *	each with their own DecodeBuffers, so one slow decoding file no longer starves
+ *	the other ReadSources.
  */
 
 
-void DiskIO::run()
+static void set_io_priority(const char* threadName)
 {
 #if defined (Q_OS_UNIX)
 
@@ -95,26 +107,55 @@ void DiskIO::run()
 
     if (IOPRIO_SUPPORT) {
         // When using the cfq scheduler we are able to set the priority of the io for what it's worth though :-)
+        // A 'who' value of 0 means the calling thread, so each DiskIO (worker) thread gets its own io priority
         int ioprio = 0, ioprio_class = IOPRIO_CLASS_RT;
-        int value = syscall(__NR_ioprio_set, IOPRIO_WHO_PROCESS, getpid(), ioprio | ioprio_class << IOPRIO_CLASS_SHIFT);
+        int value = syscall(__NR_ioprio_set, IOPRIO_WHO_PROCESS, 0, ioprio | ioprio_class << IOPRIO_CLASS_SHIFT);
 
         if (value == -1) {
             ioprio_class = IOPRIO_CLASS_BE;
-            value = syscall(__NR_ioprio_set, IOPRIO_WHO_PROCESS, getpid(), ioprio | ioprio_class << IOPRIO_CLASS_SHIFT);
+            value = syscall(__NR_ioprio_set, IOPRIO_WHO_PROCESS, 0, ioprio | ioprio_class << IOPRIO_CLASS_SHIFT);
         }
 
         if (value == 0) {
-            ioprio = syscall (__NR_ioprio_get, IOPRIO_WHO_PROCESS, getpid());
+            ioprio = syscall (__NR_ioprio_get, IOPRIO_WHO_PROCESS, 0);
             ioprio_class = ioprio >> IOPRIO_CLASS_SHIFT;
             ioprio = ioprio & IOPRIO_PRIO_MASK;
-            printf("DiskIOThread: Using prioritized disk I/O using %s prio %d (Only effective with the cfq scheduler)\n", to_prio[ioprio_class], ioprio);
+            printf("%s: Using prioritized disk I/O using %s prio %d (Only effective with the cfq scheduler)\n", threadName, to_prio[ioprio_class], ioprio);
         }
     }
+#else
+    Q_UNUSED(threadName);
 #endif
+}
+
+
+void DiskIO::run()
+{
+    set_io_priority("DiskIOThread");
     exec();
 }
 
 
+DiskIOThread::DiskIOThread(DiskIO* diskIO)
+    : m_diskIO(diskIO)
+{
+    m_fileDecodeBuffer = new DecodeBuffer;
+    m_resampleDecodeBuffer = new DecodeBuffer;
+}
+
+DiskIOThread::~DiskIOThread()
+{
+    delete m_fileDecodeBuffer;
+    delete m_resampleDecodeBuffer;
+}
+
+void DiskIOThread::run()
+{
+    set_io_priority("DiskIOWorkerThread");
+    m_diskIO->process_due_sources(m_fileDecodeBuffer, m_resampleDecodeBuffer, false);
+}
+
+
 
 DiskIO::DiskIO()
 {
@@ -125,7 +166,12 @@ DiskIO::DiskIO()
     m_resampleQuality = SRC_SINC_FASTEST;
     m_bufferFillStatus = 0;
     m_cpuTime = new RingBufferNPT<trav_time_t>(1024);
+    m_refillTimes = new RingBufferNPT<trav_time_t>(REFILL_TIMES_SIZE);
+    m_seekTimes = new RingBufferNPT<trav_time_t>(REFILL_TIMES_SIZE);
     m_lastCpuReadTime = TTimeRef::get_nanoseconds_since_epoch();
+    m_writtenBytes = 0;
+    m_writeTime = 0;
+    m_lastThroughputReadTime = m_lastCpuReadTime;
 
     // TODO This is a LARGE buffer, any ideas how to make it smaller ??
     // FIXME: this buffer is never resized and an ugly hack so fix it!
@@ -134,6 +180,11 @@ DiskIO::DiskIO()
     m_fileDecodeBuffer = new DecodeBuffer;
     m_resampleDecodeBuffer = new DecodeBuffer;
 
+    m_stopWorkers = false;
+    m_nextDueSource = 0;
+    m_busyWorkers = 0;
+    m_workerCount = qBound(1, config().get_property("Hardware", "DiskIOThreadCount", 1).toInt(), qMax(1, QThread::idealThreadCount()));
+
     // Run in our own event loop so every slot call get's processed there
     moveToThread(this);
     start(QThread::HighPriority);
@@ -146,10 +197,13 @@ DiskIO::~DiskIO()
 {
     PENTERDES;
     stop_disk_thread();
+    stop_workers();
     delete framebuffer;
     delete m_fileDecodeBuffer;
     delete m_resampleDecodeBuffer;
     delete m_cpuTime;
+    delete m_refillTimes;
+    delete m_seekTimes;
 
 }
 
@@ -180,11 +234,14 @@ void DiskIO::seek()
     }
 
     for(auto source : m_audioSources) {
+        source->set_decode_buffers(m_fileDecodeBuffer, m_resampleDecodeBuffer);
         source->rb_seek_to_transport_location(m_seekTransportLocation);
     }
 
     auto totalTime = TTimeRef::get_nanoseconds_since_epoch() - startTime;
     m_cpuTime->write(&totalTime, 1);
+    m_seekTimes->write(&totalTime, 1);
+    flight_recorder().record(TFlightRecorder::DISKIO_SEEK, this, totalTime);
 
     m_waitForSeek.store(false);
     emit seekFinished();
@@ -206,33 +263,169 @@ void DiskIO::do_work( )
         m_resampleQualityChanged = false;
     }
 
+    QVector<QPair<TTimeRef, AudioSource*> > dueSources;
 
     for (auto source : m_audioSources)
     {
-        if (m_waitForSeek.load()) {
-            printf("DiskIO::do_work: waiting for seek\n");
-            return;
-        }
-
         BufferStatus* status = source->get_buffer_status();
 
         if (status->fillStatus < 80 || status->out_of_sync()) {
+            dueSources.append(qMakePair(source->get_time_to_underrun(m_transportLocation), source));
+            flight_recorder().record(TFlightRecorder::QUEUE_DEPTH, status, qint64(source->get_rt_queue_depth()), status->fillStatus);
+        }
+    }
 
-            if (status->out_of_sync()) {
-                source->rb_seek_to_transport_location(m_transportLocation);
-            }
-            else {
-                source->process_realtime_buffers();
+    // The AudioSources closest to an under/overrun are processed first
+    std::stable_sort(dueSources.begin(), dueSources.end(),
+                     [](const QPair<TTimeRef, AudioSource*>& a, const QPair<TTimeRef, AudioSource*>& b) {
+        return a.first < b.first;
+    });
+
+    if (m_workers.isEmpty()) {
+        for (const auto& due : dueSources) {
+            if (m_waitForSeek.load()) {
+                printf("DiskIO::do_work: waiting for seek\n");
+                return;
             }
 
-            if ((status->fillStatus < m_bufferFillStatus.load()) && !status->out_of_sync()) {
-                m_bufferFillStatus.store(status->fillStatus);
+            refill_audio_source(due.second, m_fileDecodeBuffer, m_resampleDecodeBuffer);
+        }
+    } else {
+        QList<AudioSource*> localSources;
+
+        m_workMutex.lock();
+        for (const auto& due : dueSources) {
+            if (due.second->can_process_in_worker_thread()) {
+                m_dueSources.append(due.second);
+            } else {
+                localSources.append(due.second);
             }
         }
+        m_nextDueSource = 0;
+        m_workAvailable.wakeAll();
+        m_workMutex.unlock();
+
+        // Sources that can't be processed by the workers are processed by us
+        for (auto source : localSources) {
+            if (m_waitForSeek.load()) {
+                printf("DiskIO::do_work: waiting for seek\n");
+                break;
+            }
+            refill_audio_source(source, m_fileDecodeBuffer, m_resampleDecodeBuffer);
+        }
+
+        // Help the workers and return when all due sources are processed
+        process_due_sources(m_fileDecodeBuffer, m_resampleDecodeBuffer, true);
+
+        m_workMutex.lock();
+        m_dueSources.clear();
+        m_nextDueSource = 0;
+        m_workMutex.unlock();
     }
 
     auto totalTime = TTimeRef::get_nanoseconds_since_epoch() - startTime;
     m_cpuTime->write(&totalTime, 1);
+    m_refillTimes->write(&totalTime, 1);
+    flight_recorder().record(TFlightRecorder::DISKIO_REFILL, this, totalTime, dueSources.size());
+}
+
+/**
+ *	Takes the next due AudioSource of the list prepared by do_work() until the list is empty.
+ *	The DiskIOThreads wait in here for new work, the DiskIO thread itself returns once all
+ *	the due sources have been processed, including the ones still being processed by the workers.
+ */
+void DiskIO::process_due_sources(DecodeBuffer* fileDecodeBuffer, DecodeBuffer* resampleDecodeBuffer, bool waitForWorkers)
+{
+    QMutexLocker locker(&m_workMutex);
+
+    while (!m_stopWorkers) {
+        if (m_nextDueSource >= m_dueSources.size()) {
+            if (waitForWorkers) {
+                while (m_busyWorkers > 0) {
+                    m_workFinished.wait(&m_workMutex);
+                }
+                return;
+            }
+            m_workAvailable.wait(&m_workMutex);
+            continue;
+        }
+
+        AudioSource* source = m_dueSources.at(m_nextDueSource++);
+        ++m_busyWorkers;
+
+        locker.unlock();
+        if (!m_waitForSeek.load()) {
+            refill_audio_source(source, fileDecodeBuffer, resampleDecodeBuffer);
+        }
+        locker.relock();
+
+        if (--m_busyWorkers == 0) {
+            m_workFinished.wakeAll();
+        }
+    }
+}
+
+void DiskIO::refill_audio_source(AudioSource* source, DecodeBuffer* fileDecodeBuffer, DecodeBuffer* resampleDecodeBuffer)
+{
+    BufferStatus* status = source->get_buffer_status();
+
+    source->set_decode_buffers(fileDecodeBuffer, resampleDecodeBuffer);
+
+    if (status->out_of_sync()) {
+        source->rb_seek_to_transport_location(m_transportLocation);
+    }
+    else {
+        auto startTime = TTimeRef::get_nanoseconds_since_epoch();
+
+        source->process_realtime_buffers();
+
+        qint64 writtenBytes = source->take_written_bytes();
+        if (writtenBytes > 0) {
+            m_writtenBytes.fetch_add(writtenBytes);
+            m_writeTime.fetch_add(qint64(TTimeRef::get_nanoseconds_since_epoch() - startTime));
+        }
+    }
+
+    if (!status->out_of_sync()) {
+        update_buffers_fill_status(status->fillStatus);
+    }
+}
+
+void DiskIO::update_buffers_fill_status(int fillStatus)
+{
+    int current = m_bufferFillStatus.load();
+    while (fillStatus < current && !m_bufferFillStatus.compare_exchange_weak(current, fillStatus)) {
+        // current was updated by compare_exchange_weak, try again
+    }
+}
+
+void DiskIO::start_workers()
+{
+    // The DiskIO thread itself also processes due sources
+    for (int i=1; i<m_workerCount; ++i) {
+        auto worker = new DiskIOThread(this);
+        worker->start(QThread::HighPriority);
+        m_workers.append(worker);
+    }
+
+    printf("DiskIO::start_workers: Using %d threads to refill ReadSources\n", m_workerCount);
+}
+
+void DiskIO::stop_workers()
+{
+    m_workMutex.lock();
+    m_stopWorkers = true;
+    m_workAvailable.wakeAll();
+    m_workMutex.unlock();
+
+    for (auto worker : m_workers) {
+        if ( ! worker->wait(2000) ) {
+            qWarning("DiskIOThread :: Still running after 2 second wait, terminating!");
+            worker->terminate();
+        }
+        delete worker;
+    }
+    m_workers.clear();
 }
 
 
@@ -243,6 +436,10 @@ void DiskIO::add_audio_source(AudioSource* source)
     Q_ASSERT_X(this->thread() == QThread::currentThread(), "DiskIO::addd_audio_source", "Must be called via queued slot connection, not directly by function");
     Q_ASSERT(source->get_channel_count() > 0);
 
+    if (m_workers.isEmpty() && m_workerCount > 1 && source->can_process_in_worker_thread()) {
+        start_workers();
+    }
+
     source->set_output_rate_and_convertor_type(m_outputSampleRate, m_resampleQuality);
     source->set_decode_buffers(m_fileDecodeBuffer, m_resampleDecodeBuffer);
 
@@ -251,6 +448,8 @@ void DiskIO::add_audio_source(AudioSource* source)
     // only for WriteSource change to decodebuffers instead
     source->set_diskio_frame_buffer(framebuffer);
 
+    flight_recorder().set_object_name(source->get_buffer_status(), source->get_name());
+
     m_audioSources.append(source);
 }
 
@@ -293,6 +492,57 @@ bool DiskIO::get_cpu_time(float &time)
     return true;
 }
 
+/**
+ *	Appends the duration in nanoseconds of each refill pass since the last call to \a times.
+ *	At most REFILL_TIMES_SIZE passes are kept, later ones are dropped until this is called.
+ */
+void DiskIO::take_refill_times(QVector<trav_time_t>& times)
+{
+    trav_time_t value = 0;
+
+    while (m_refillTimes->read(&value, 1) == 1) {
+        times.append(value);
+    }
+}
+
+/**
+ *	Like take_refill_times(), for the seeks
+ */
+void DiskIO::take_seek_times(QVector<trav_time_t>& times)
+{
+    trav_time_t value = 0;
+
+    while (m_seekTimes->read(&value, 1) == 1) {
+        times.append(value);
+    }
+}
+
+/**
+ *	Returns the amount of recorded data written to disk per second since the last call in
+ *	\a megaBytesPerSecond, and in \a headroom how many times faster the disk could have
+ *	written it, based on the time spent in the actual writes.
+ *
+ * @return false if nothing was written since the last call
+ */
+bool DiskIO::get_write_throughput(float& megaBytesPerSecond, float& headroom)
+{
+    trav_time_t currentTime = TTimeRef::get_nanoseconds_since_epoch();
+    qint64 writtenBytes = m_writtenBytes.exchange(0);
+    qint64 writeTime = m_writeTime.exchange(0);
+    trav_time_t elapsed = currentTime - m_lastThroughputReadTime;
+
+    m_lastThroughputReadTime = currentTime;
+
+    if (writtenBytes == 0 || elapsed == 0) {
+        return false;
+    }
+
+    megaBytesPerSecond = float((double(writtenBytes) / (1024 * 1024)) / (double(elapsed) / 1000000000));
+    headroom = writeTime > 0 ? float(double(elapsed) / writeTime) : 0.0f;
+
+    return true;
+}
+
 
 /**
  * 	Get the status of the writebuffers.
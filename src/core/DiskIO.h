@@ -23,7 +23,10 @@ Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA.
 #define T_DISKIO_H
 
 #include <QList>
+#include <QMutex>
 #include <QThread>
+#include <QVector>
+#include <QWaitCondition>
 
 #include "RingBufferNPT.h"
 #include "TTimeRef.h"
@@ -31,6 +34,22 @@ Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA.
 
 class AudioSource;
 class DecodeBuffer;
+class DiskIO;
+
+class DiskIOThread : public QThread
+{
+public:
+    DiskIOThread(DiskIO* diskIO);
+    ~DiskIOThread();
+
+protected:
+    void run() override;
+
+private:
+    DiskIO*         m_diskIO;
+    DecodeBuffer*   m_fileDecodeBuffer;
+    DecodeBuffer*   m_resampleDecodeBuffer;
+};
 
 class DiskIO : public QThread
 {
@@ -53,6 +72,9 @@ public:
     }
 
     bool get_cpu_time(float &time);
+    bool get_write_throughput(float& megaBytesPerSecond, float& headroom);
+    void take_refill_times(QVector<trav_time_t>& times);
+    void take_seek_times(QVector<trav_time_t>& times);
     int get_buffers_fill_status();
     uint get_output_rate() {return m_outputSampleRate;}
 	int get_resample_quality() {return m_resampleQuality;}
@@ -68,8 +90,17 @@ private:
     std::atomic<int>    m_bufferFillStatus;
 
     RingBufferNPT<trav_time_t>*	m_cpuTime;
+    // Durations of the refill passes and seeks, see take_refill_times()
+    static const int REFILL_TIMES_SIZE = 4096;
+    RingBufferNPT<trav_time_t>*	m_refillTimes;
+    RingBufferNPT<trav_time_t>*	m_seekTimes;
     trav_time_t         m_lastCpuReadTime;
 
+    // Written bytes and the time spent writing them, see get_write_throughput()
+    std::atomic<qint64> m_writtenBytes;
+    std::atomic<qint64> m_writeTime;
+    trav_time_t         m_lastThroughputReadTime;
+
     int                 m_resampleQuality;
     bool                m_resampleQualityChanged;
     bool                m_sampleRateChanged;
@@ -81,8 +112,26 @@ private:
 
     TTimeRef            m_transportLocation;
     TTimeRef            m_seekTransportLocation;
+
+    // Worker pool, only used when the configured thread count > 1
+    QList<DiskIOThread*> m_workers;
+    int                 m_workerCount;
+    bool                m_stopWorkers;
+    QMutex              m_workMutex;
+    QWaitCondition      m_workAvailable;
+    QWaitCondition      m_workFinished;
+    QList<AudioSource*> m_dueSources;
+    int                 m_nextDueSource;
+    int                 m_busyWorkers;
 	
     void stop_disk_thread();    
+    void start_workers();
+    void stop_workers();
+    void process_due_sources(DecodeBuffer* fileDecodeBuffer, DecodeBuffer* resampleDecodeBuffer, bool waitForWorkers);
+    void refill_audio_source(AudioSource* source, DecodeBuffer* fileDecodeBuffer, DecodeBuffer* resampleDecodeBuffer);
+    void update_buffers_fill_status(int fillStatus);
+
+    friend class DiskIOThread;
 
 public slots:
     void seek();
@@ -32,6 +32,8 @@ $Id: FadeCurve.cpp,v 1.36 2008/11/07 10:43:08 r_sijrier Exp $
 #include <AddRemove.h>
 #include "AudioDevice.h"
 #include "AudioBus.h"
+#include "Mixer.h"
+#include "TDspProfiler.h"
 
 // Always put me below _all_ includes, this is needed
 // in case we run with memory leak detection enabled!
@@ -164,6 +166,21 @@ void FadeCurve::process(AudioBus *bus, const TTimeRef& startLocation, const TTim
 {
     Q_ASSERT(bus->get_channel_count() == 2);
 
+    audio_sample_t* buffers[2];
+    for (uint chan=0; chan<bus->get_channel_count(); ++chan) {
+        buffers[chan] = bus->get_buffer(chan, nframes);
+    }
+
+    process(buffers, bus->get_channel_count(), startLocation, endLocation, nframes);
+}
+
+// Processes the fade on \a buffers in place, e.g. the QueueBufferSlot buffers AudioClip mixes from
+void FadeCurve::process(audio_sample_t** buffers, uint channelCount, const TTimeRef& startLocation, const TTimeRef& endLocation, nframes_t nframes)
+{
+    TDspProfileScope profileScope(TDspProfiler::FADE, this);
+
+    Q_ASSERT(channelCount <= 6);
+
     if (is_bypassed()) {
         return;
     }
@@ -174,7 +191,6 @@ void FadeCurve::process(AudioBus *bus, const TTimeRef& startLocation, const TTim
 
     uint outputRate = audiodevice().get_sample_rate();
     uint framesToProcess = nframes;
-    uint channelCount = bus->get_channel_count();
 
     TTimeRef trackStartLocation, trackEndLocation, mix_pos;
     TTimeRef fadeRange = TTimeRef(get_range());
@@ -201,15 +217,14 @@ void FadeCurve::process(AudioBus *bus, const TTimeRef& startLocation, const TTim
             //                        printf("offset %d\n", offset);
 
             for (uint chan=0; chan<channelCount; ++chan) {
-                audio_sample_t* buf = bus->get_buffer(chan, framesToProcess);
-                mixdown[chan] = buf + offset;
+                mixdown[chan] = buffers[chan] + offset;
             }
             framesToProcess = framesToProcess - offset;
         } else {
             mix_pos = (startLocation - trackStartLocation);
 
             for (uint chan=0; chan<channelCount; ++chan) {
-                mixdown[chan] = bus->get_buffer(chan, framesToProcess);
+                mixdown[chan] = buffers[chan];
             }
         }
         if (endLocation < upperRange) {
@@ -226,13 +241,11 @@ void FadeCurve::process(AudioBus *bus, const TTimeRef& startLocation, const TTim
 
     upperRange = mix_pos + TTimeRef(framesToProcess, outputRate);
 
-    get_vector(mix_pos.universal_frame(), upperRange.universal_frame(), m_session->gainbuffer, framesToProcess);
+    audio_sample_t* gainbuffer = m_session->get_gain_buffer();
+    get_vector(mix_pos.universal_frame(), upperRange.universal_frame(), gainbuffer, framesToProcess);
 
     for (uint chan=0; chan<channelCount; ++chan) {
-        for (nframes_t frame = 0; frame < framesToProcess; ++frame) {
-            // FXME: Array access result in an undefined pointer dereference accorindg to clang tidy
-            mixdown[chan][frame] *= m_session->gainbuffer[frame];
-        }
+        Mixer::apply_gain_vector(mixdown[chan], gainbuffer, framesToProcess, 1.0f);
     }
 }
 
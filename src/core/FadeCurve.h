@@ -54,6 +54,7 @@ public:
 	int set_state( const QDomNode & node );
 
     void process(AudioBus* bus, const TTimeRef &startLocation, const TTimeRef &endLocation, nframes_t nframes);
+    void process(audio_sample_t** buffers, uint channelCount, const TTimeRef &startLocation, const TTimeRef &endLocation, nframes_t nframes);
 	
 	float get_bend_factor() {return m_bendFactor;}
 	float get_strength_factor() {return m_strenghtFactor;}
@@ -30,15 +30,19 @@ Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA.
 #include "defines.h"
 #include "Mixer.h"
 #include "FileHelpers.h"
+#include "TPeakTileCache.h"
+#include "TConfig.h"
 #include <QFileInfo>
 #include <QDateTime>
 #include <QMutexLocker>
+#include <algorithm>
+#include <cstring>
 
 #include "Debugger.h"
 
 #define NORMALIZE_CHUNK_SIZE	10000
-#define PEAKFILE_MAJOR_VERSION	1
-#define PEAKFILE_MINOR_VERSION	4
+#define PEAKFILE_MAJOR_VERSION	2
+#define PEAKFILE_MINOR_VERSION	0
 
 int Peak::zoomStep[] = {
     // non-cached zoomlevels.
@@ -49,13 +53,11 @@ int Peak::zoomStep[] = {
 
 QHash<int, int> Peak::chacheIndexLut;
 
-typedef short peak_data_t;
-
 Peak::Peak(AudioSource* source)
 {
     PENTERCONS;
 
-    m_peaksAvailable = m_permanentFailure = m_interuptPeakBuild = false;
+    m_peaksAvailable = m_permanentFailure = m_interuptPeakBuild = m_building = false;
 
     QString sourcename = source->get_name();
     QString path;
@@ -74,6 +76,7 @@ Peak::Peak(AudioSource* source)
         data->fileName.prepend(path);
         data->pd = nullptr;
         data->peakreader = nullptr;
+        data->mapreader = nullptr;
 
         m_channelData.append(data);
     }
@@ -94,13 +97,14 @@ Peak::~Peak()
 {
     PENTERDES;
 
+    // Wait for, and drop, any tile calculated in the background for us
+    peak_tile_cache().invalidate(this);
+
     delete m_source;
 
     foreach(ChannelData* data, m_channelData) {
-        if (data->normFile.isOpen()) {
-            QFile::remove(data->normFileName);
-        }
-
+        delete data->pd;
+        delete data->mapreader;
         delete data->peakreader;
         delete data;
     }
@@ -111,6 +115,12 @@ void Peak::close()
     pp().free_peak(this);
 }
 
+void Peak::set_building(bool building)
+{
+    QMutexLocker locker(&m_dataMutex);
+    m_building = building;
+}
+
 int Peak::read_header()
 {
     PENTER;
@@ -169,6 +179,8 @@ int Peak::read_header()
         data->file.read((char*)&data->headerdata.headerSize, sizeof(data->headerdata.headerSize));
 
         data->peakreader = new PeakDataReader(data);
+        // Falls back to peakreader if the peak file can't be mapped into memory
+        data->mapreader = new PeakDataMapReader(data);
         data->peakdataDecodeBuffer = new DecodeBuffer;
     }
 
@@ -218,10 +230,17 @@ int Peak::calculate_peaks(
 {
     PENTER3;
 
+    QMutexLocker locker(&m_dataMutex);
+
     if (m_permanentFailure) {
         return PERMANENT_FAILURE;
     }
 
+    // The peak file is being written, it's read once finished() is emitted
+    if (m_building) {
+        return NO_PEAK_FILE;
+    }
+
     if(!m_peaksAvailable) {
         if (read_header() < 0) {
             return NO_PEAK_FILE;
@@ -233,54 +252,25 @@ int Peak::calculate_peaks(
     }
 
     ChannelData* data = m_channelData.at(chan);
-    int produced = 0;
-
-    // 	PROFILE_START;
 
     // Macro view mode
-    if (framesPerPeak >= 64) {
-        int highbit;
-        unsigned long nearestpow2 = nearest_power_of_two(qRound(framesPerPeak), highbit);
-        if (nearestpow2 == 0) {
-            return NO_PEAKDATA_FOUND;
-        }
-
+    if (is_macro_view(framesPerPeak)) {
+        const peak_data_t* peakdata = nullptr;
+        int produced = get_peak_data(chan, &peakdata, startlocation, peakDataCount, framesPerPeak);
 
-        nframes_t startPos = TTimeRef::to_frame(startlocation, 44100);
-
-        int index = cache_index_lut()->value(nearestpow2, -1);
-        if(index >= 0) {
-            // 			printf("index %d\n", index);
-        }
-
-        int offset = qRound(float(startPos) / nearestpow2) * 2;
-        int truncate = 0;
-
-        // Check if this zoom level has as many data as requested.
-        if ( (peakDataCount + offset) > data->headerdata.peakDataSizeForLevel[index]) {
-            truncate = peakDataCount - (data->headerdata.peakDataSizeForLevel[index] - offset);
-            //FIXME: nothing done here?
-                       qDebug("Peak::calculate_peaks truncate: %d", truncate);
-            //            peakDataCount = data->headerdata.peakDataSizeForLevel[index] - offset;
-        }
-
-        nframes_t readposition = data->headerdata.headerSize + (data->headerdata.peakDataOffsets[index] + offset) * sizeof(peak_data_t);
-        produced = data->peakreader->read_from(data->peakdataDecodeBuffer, readposition, peakDataCount);
-
-        if (produced != peakDataCount) {
-            //			PERROR("Could not read in all peak data, peakDataCount is %d, read count is %d", peakDataCount, produced);
+        if (produced < 0) {
+            return produced;
         }
 
-        // 		PROFILE_END("Peak calculate_peaks");
-
-        if (produced == 0) {
-            return NO_PEAKDATA_FOUND;
+        // The PeakDataReader fallback already converted the peak data
+        if (data->mapreader->is_mapped()) {
+            data->peakdataDecodeBuffer->check_buffers_capacity(nframes_t(produced), 1);
+            float* destination = data->peakdataDecodeBuffer->destination[0];
+            for (int i = 0; i < produced; ++i) {
+                destination[i] = float(peakdata[i]);
+            }
         }
 
-        // 		for (int i=(pixelcount-truncate); i<(pixelcount); ++i) {
-        // 			data->peakdataDecodeBuffer->destination[0][i] = 0;
-        // 		}
-        //
         *buffer = data->peakdataDecodeBuffer->destination[0];
 
         return produced;
@@ -358,33 +348,147 @@ int Peak::calculate_peaks(
 }
 
 
+/**
+ *	Gives access to the stored peak data of the zoom level matching \a framesPerPeak
+ *	(macro view only). If the peak file is mapped into memory \a buffer points
+ *	straight into the mapping, no data is copied. Otherwise the data is read with
+ *	PeakDataReader and \a buffer points into the channels DecodeBuffer.
+ *
+ *	\a buffer stays valid until the next call for this channel.
+ *
+ * @return The amount of peak values available in \a buffer or one of the error codes
+ */
+int Peak::get_peak_data(
+        int chan,
+        const peak_data_t** buffer,
+        const TTimeRef &startlocation,
+        int peakDataCount,
+        qreal framesPerPeak)
+{
+    PENTER3;
+
+    QMutexLocker locker(&m_dataMutex);
+
+    if (m_permanentFailure) {
+        return PERMANENT_FAILURE;
+    }
+
+    // The peak file is being written, it's read once finished() is emitted
+    if (m_building) {
+        return NO_PEAK_FILE;
+    }
+
+    if(!m_peaksAvailable) {
+        if (read_header() < 0) {
+            return NO_PEAK_FILE;
+        }
+    }
+
+    if (peakDataCount <= 0 || !is_macro_view(framesPerPeak)) {
+        return NO_PEAKDATA_FOUND;
+    }
+
+    ChannelData* data = m_channelData.at(chan);
+
+    unsigned long nearestpow2;
+    int index = pyramid_level(framesPerPeak, &nearestpow2);
+    if (index < 0) {
+        return NO_PEAKDATA_FOUND;
+    }
+
+    nframes_t startPos = TTimeRef::to_frame(startlocation, 44100);
+    int offset = qRound(float(startPos) / nearestpow2) * 2;
+
+    // Don't read beyond this zoom level, that's the data of the next one
+    int levelSize = data->headerdata.peakDataSizeForLevel[index];
+    if (offset >= levelSize) {
+        return NO_PEAKDATA_FOUND;
+    }
+    peakDataCount = qMin(peakDataCount, levelSize - offset);
+
+    nframes_t readposition = data->headerdata.headerSize + (data->headerdata.peakDataOffsets[index] + offset) * sizeof(peak_data_t);
+    nframes_t produced = 0;
+
+    if (data->mapreader->is_mapped()) {
+        *buffer = data->mapreader->data_at(readposition, peakDataCount, &produced);
+    } else {
+        produced = data->peakreader->read_from(data->peakdataDecodeBuffer, readposition, peakDataCount);
+        *buffer = reinterpret_cast<const peak_data_t*>(data->peakdataDecodeBuffer->readBuffer);
+    }
+
+    if (produced == 0) {
+        return NO_PEAKDATA_FOUND;
+    }
+
+    return int(produced);
+}
+
+
+/**
+ *	Copies the peak data of the zoom level matching \a framesPerPeak from the in memory
+ *	pyramid into \a buffer. This is used to draw a take while it's being recorded,
+ *	the peak file doesn't exist yet at that point.
+ *
+ * @return The amount of peak values copied or NO_PEAKDATA_FOUND
+ */
+int Peak::get_live_peak_data(int chan, float* buffer, const TTimeRef &startlocation, int peakDataCount, qreal framesPerPeak)
+{
+    if (peakDataCount <= 0 || !is_macro_view(framesPerPeak)) {
+        return NO_PEAKDATA_FOUND;
+    }
+
+    unsigned long nearestpow2;
+    int index = pyramid_level(framesPerPeak, &nearestpow2);
+    if (index < 0) {
+        return NO_PEAKDATA_FOUND;
+    }
+
+    nframes_t startPos = TTimeRef::to_frame(startlocation, 44100);
+    int offset = qRound(float(startPos) / nearestpow2) * 2;
+
+    QMutexLocker locker(&m_processDataMutex);
+
+    ChannelData* data = m_channelData.at(chan);
+    if (!data->pd) {
+        return NO_PEAKDATA_FOUND;
+    }
+
+    const QVector<peak_data_t>& levelData = data->pd->levelData[index];
+
+    if (offset >= levelData.size()) {
+        return NO_PEAKDATA_FOUND;
+    }
+
+    int count = qMin(peakDataCount, levelData.size() - offset);
+    const peak_data_t* source = levelData.constData() + offset;
+
+    for (int i = 0; i < count; ++i) {
+        buffer[i] = float(source[i]);
+    }
+
+    return count;
+}
+
+
 int Peak::prepare_processing(uint rate)
 {
     PENTER;
 
-    foreach(ChannelData* data, m_channelData) {
+    // Keeps readers away from the files until finish_processing()
+    QMutexLocker locker(&m_dataMutex);
+    m_building = true;
 
-        data->normFileName = data->fileName;
-        data->normFileName.append(".norm");
+    foreach(ChannelData* data, m_channelData) {
 
-        // Create read/write enabled file
+        // Create write enabled file, the peak data is written in one go by finish_processing()
         data->file.setFileName(data->fileName);
 
-        if (! data->file.open(QIODevice::ReadWrite)) {
+        if (! data->file.open(QIODevice::WriteOnly | QIODevice::Truncate)) {
             PWARN(QString("Couldn't open peak file for writing! (%1)").arg(data->fileName).toLatin1().data());
             m_permanentFailure  = true;
             return -1;
         }
 
-        // Create the temporary normalization data file
-        data->normFile.setFileName(data->normFileName);
-
-        if (! data->normFile.open(QIODevice::ReadWrite)) {
-            PWARN(QString("Couldn't open normalization data file for writing! (%1)").arg(data->normFileName).toLatin1().data());
-            m_permanentFailure  = true;
-            return -1;
-        }
-
         // We need to know the headerSize.
         data->headerdata.headerSize =
                 sizeof(data->headerdata.label) +
@@ -394,12 +498,12 @@ int Peak::prepare_processing(uint rate)
                 sizeof(data->headerdata.normValuesDataOffset) +
                 sizeof(data->headerdata.headerSize);
 
-        // Now seek to the start position, so we can write the peakdata to it in the process function
-        data->file.seek(data->headerdata.headerSize);
-
+        QMutexLocker processDataLocker(&m_processDataMutex);
+        delete data->pd;
         data->pd = new Peak::ProcessData;
         data->pd->stepSize = TTimeRef(nframes_t(1), rate);
-        data->pd->processRange = TTimeRef(nframes_t(64), 44100);
+        data->pd->processRange = TTimeRef(nframes_t(PYRAMID_BASE_FRAMES_PER_PEAK), 44100);
+        data->pd->universalNextDataPoint = data->pd->processRange.universal_frame();
     }
 
 
@@ -413,164 +517,147 @@ int Peak::finish_processing()
 
     foreach(ChannelData* data, m_channelData) {
 
-        if (data->pd->processLocation < data->pd->nextDataPointLocation) {
-            peak_data_t peakvalue = (peak_data_t)(data->pd->peakUpperValue * MAX_DB_VALUE);
-            data->file.write((char*)&peakvalue, sizeof(peak_data_t));
-            peakvalue = (peak_data_t)(-1 * data->pd->peakLowerValue * MAX_DB_VALUE);
-            data->file.write((char*)&peakvalue, sizeof(peak_data_t));
-            data->pd->processBufferSize += 2;
-        }
-
-        int totalBufferSize = 0;
-
-        data->headerdata.peakDataSizeForLevel[0] = data->pd->processBufferSize;
-        totalBufferSize += data->pd->processBufferSize;
-
-        for( int i = SAVING_ZOOM_FACTOR + 1; i < ZOOM_LEVELS+1; ++i) {
-            data->headerdata.peakDataSizeForLevel[i - SAVING_ZOOM_FACTOR] = data->headerdata.peakDataSizeForLevel[i - SAVING_ZOOM_FACTOR - 1] / 2;
-            totalBufferSize += data->headerdata.peakDataSizeForLevel[i - SAVING_ZOOM_FACTOR];
-        }
-
-
-        data->file.seek(data->headerdata.headerSize);
+        ProcessData* pd = data->pd;
 
-        // The routine below uses a different total buffer size calculation
-        // which might end up with a size >= totalbufferSize !!!
-        // Need to look into that, for now + 2 seems to work...
-        peak_data_t* saveBuffer = new peak_data_t[totalBufferSize + 1*sizeof(peak_data_t)];
+        QMutexLocker locker(&m_processDataMutex);
 
-        int read = data->file.read((char*)saveBuffer, sizeof(peak_data_t) * data->pd->processBufferSize) / sizeof(peak_data_t);
-
-        if (read != data->pd->processBufferSize) {
-            //			PERROR("couldn't read in all saved data?? (%d read)", read);
+        // Store the data point of the remaining frames, and merge all
+        // pending data points into their level
+        if (pd->universalLocation > pd->universalNextDataPoint - pd->processRange.universal_frame()) {
+            append_data_point(pd, 0, peak_data_t(pd->peakUpperValue * MAX_DB_VALUE), peak_data_t(-1 * pd->peakLowerValue * MAX_DB_VALUE));
         }
 
-
-        int prevLevelBufferPos = 0;
-        int nextLevelBufferPos;
-        data->headerdata.peakDataSizeForLevel[0] = data->pd->processBufferSize;
-        data->headerdata.peakDataOffsets[0] = 0;
-
-        for (int i = SAVING_ZOOM_FACTOR+1; i < ZOOM_LEVELS+1; ++i) {
-
-            int prevLevelSize = data->headerdata.peakDataSizeForLevel[i - SAVING_ZOOM_FACTOR - 1];
-            data->headerdata.peakDataOffsets[i - SAVING_ZOOM_FACTOR] = data->headerdata.peakDataOffsets[i - SAVING_ZOOM_FACTOR - 1] + prevLevelSize;
-            prevLevelBufferPos = data->headerdata.peakDataOffsets[i - SAVING_ZOOM_FACTOR - 1];
-            nextLevelBufferPos = data->headerdata.peakDataOffsets[i - SAVING_ZOOM_FACTOR];
-
-
-            int count = 0;
-
-            do {
-                Q_ASSERT(nextLevelBufferPos <= totalBufferSize);
-                saveBuffer[nextLevelBufferPos] = (peak_data_t) f_max(saveBuffer[prevLevelBufferPos], saveBuffer[prevLevelBufferPos + 2]);
-                saveBuffer[nextLevelBufferPos + 1] = (peak_data_t) f_max(saveBuffer[prevLevelBufferPos + 1], saveBuffer[prevLevelBufferPos + 3]);
-                nextLevelBufferPos += 2;
-                prevLevelBufferPos += 4;
-                count+=4;
+        for (int level = 1; level < PYRAMID_LEVELS; ++level) {
+            if (pd->hasPendingPair[level]) {
+                pd->hasPendingPair[level] = false;
+                append_data_point(pd, level, pd->pendingPair[level][0], pd->pendingPair[level][1]);
             }
-            while (count < prevLevelSize);
-        }
-
-        data->file.seek(data->headerdata.headerSize);
-
-        int written = data->file.write((char*)saveBuffer, sizeof(peak_data_t) * totalBufferSize) / sizeof(peak_data_t);
-
-        if (written != totalBufferSize) {
-            //			PERROR("could not write complete buffer! (only %d)", written);
-            // 		return -1;
         }
 
-        data->normFile.seek(0);
+        locker.unlock();
 
-        read = data->normFile.read((char*)saveBuffer, sizeof(audio_sample_t) * data->pd->normDataCount) / sizeof(audio_sample_t);
+        int totalBufferSize = 0;
 
-        if (read != data->pd->normDataCount) {
-            //			PERROR("Could not read in all (%d) norm. data, only %d", data->pd->normDataCount, read);
+        for (int level = 0; level < PYRAMID_LEVELS; ++level) {
+            data->headerdata.peakDataOffsets[level] = totalBufferSize;
+            data->headerdata.peakDataSizeForLevel[level] = pd->levelData[level].size();
+            totalBufferSize += pd->levelData[level].size();
         }
 
         data->headerdata.normValuesDataOffset = data->headerdata.headerSize + totalBufferSize * sizeof(peak_data_t);
 
-        data->normFile.close();
+        // Write header, peak data and norm data sequentially
+        write_header(data);
 
-        if (!QFile::remove(data->normFileName)) {
-            //			PERROR("Failed to remove temp. norm. data file! (%s)", data->normFileName.toLatin1().data());
+        for (int level = 0; level < PYRAMID_LEVELS; ++level) {
+            qint64 length = qint64(sizeof(peak_data_t)) * pd->levelData[level].size();
+            if (data->file.write(reinterpret_cast<const char*>(pd->levelData[level].constData()), length) != length) {
+                PWARN(QString("Could not write all peak data to %1").arg(data->fileName).toLatin1().data());
+            }
         }
 
-        written = data->file.write((char*)saveBuffer, sizeof(audio_sample_t) * read) / sizeof(audio_sample_t);
-
-        write_header(data);
+        qint64 length = qint64(sizeof(audio_sample_t)) * pd->normData.size();
+        if (data->file.write(reinterpret_cast<const char*>(pd->normData.constData()), length) != length) {
+            PWARN(QString("Could not write all normalization data to %1").arg(data->fileName).toLatin1().data());
+        }
 
         data->file.close();
 
-        delete [] saveBuffer;
+        locker.relock();
         delete data->pd;
         data->pd = nullptr;
-
     }
 
+    set_building(false);
+
     emit finished();
 
     return 1;
 
 }
 
-
-void Peak::process(uint channel, const audio_sample_t* buffer, nframes_t nframes)
+/**
+ *	Appends a data point to pyramid \a level. Every second data point of a level is
+ *	merged with the previous one into a data point of the next level, so all levels
+ *	are build while streaming through the audio data.
+ */
+void Peak::append_data_point(ProcessData* pd, int level, peak_data_t upper, peak_data_t lower)
 {
-    ChannelData* data = m_channelData.at(channel);
-    ProcessData* pd = data->pd;
+    for (; level < PYRAMID_LEVELS; ++level) {
+        pd->levelData[level].append(upper);
+        pd->levelData[level].append(lower);
 
-    for (uint i=0; i < nframes; i++) {
+        int nextLevel = level + 1;
 
-        pd->processLocation += pd->stepSize;
+        if (nextLevel == PYRAMID_LEVELS) {
+            break;
+        }
 
-        audio_sample_t sample = buffer[i];
+        if (!pd->hasPendingPair[nextLevel]) {
+            pd->pendingPair[nextLevel][0] = upper;
+            pd->pendingPair[nextLevel][1] = lower;
+            pd->hasPendingPair[nextLevel] = true;
+            break;
+        }
 
-        pd->normValue = f_max(pd->normValue, fabsf(sample));
+        upper = qMax(pd->pendingPair[nextLevel][0], upper);
+        lower = qMax(pd->pendingPair[nextLevel][1], lower);
+        pd->hasPendingPair[nextLevel] = false;
+    }
+}
 
-        if (sample > pd->peakUpperValue) {
-            pd->peakUpperValue = sample;
-        }
 
-        if (sample < pd->peakLowerValue) {
-            pd->peakLowerValue = sample;
-        }
+void Peak::process(uint channel, const audio_sample_t* buffer, nframes_t nframes)
+{
+    ChannelData* data = m_channelData.at(channel);
+    ProcessData* pd = data->pd;
 
-        if (pd->processLocation >= pd->nextDataPointLocation) {
+    // Only contended when a recording take is being drawn
+    QMutexLocker locker(&m_processDataMutex);
 
-            peak_data_t peakbuffer[2];
+    const qint64 step = pd->stepSize.universal_frame();
+    const qint64 range = pd->processRange.universal_frame();
+    nframes_t pos = 0;
 
-            peakbuffer[0] = (peak_data_t) (pd->peakUpperValue * MAX_DB_VALUE );
-            peakbuffer[1] = (peak_data_t) (-1 * (pd->peakLowerValue * MAX_DB_VALUE ));
+    // Instead of checking every sample, process spans of samples up to the next
+    // peak data point or normalization chunk boundary, whichever comes first
+    while (pos < nframes) {
+        qint64 distance = pd->universalNextDataPoint - pd->universalLocation;
+        nframes_t toDataPoint = distance > 0 ? nframes_t((distance + step - 1) / step) : 1;
+        nframes_t toNormChunk = NORMALIZE_CHUNK_SIZE - pd->normProcessedFrames;
+        nframes_t span = std::min(std::min(toDataPoint, toNormChunk), nframes - pos);
 
-            int written = data->file.write((char*)peakbuffer, sizeof(peak_data_t) * 2) / sizeof(peak_data_t);
+        float lower = pd->peakLowerValue;
+        float upper = pd->peakUpperValue;
+        Mixer::find_peaks(buffer + pos, span, &lower, &upper);
+        pd->peakLowerValue = lower;
+        pd->peakUpperValue = upper;
 
-            if (written != 2) {
-                PWARN(QString("couldnt write peak data, only (%1)").arg(written).toLatin1().data());
-            }
+        // The norm value has it's own boundaries, it can't reuse lower and upper
+        pd->normValue = Mixer::compute_peak(buffer + pos, span, pd->normValue);
+
+        pd->universalLocation += step * span;
+        pd->normProcessedFrames += span;
+        pos += span;
+
+        if (pd->universalLocation >= pd->universalNextDataPoint) {
+            append_data_point(pd, 0, peak_data_t(pd->peakUpperValue * MAX_DB_VALUE), peak_data_t(-1 * (pd->peakLowerValue * MAX_DB_VALUE)));
 
             pd->peakUpperValue = -10.0;
             pd->peakLowerValue = 10.0;
 
-            pd->processBufferSize+=2;
-            pd->nextDataPointLocation += pd->processRange;
+            pd->universalNextDataPoint += range;
         }
 
         if (pd->normProcessedFrames == NORMALIZE_CHUNK_SIZE) {
-            int written = data->normFile.write((char*)&pd->normValue, sizeof(audio_sample_t)) / sizeof(audio_sample_t);
-
-            if (written != 1) {
-                PWARN(QString("couldnt write norm data, only (%1)").arg(written).toLatin1().data());
-            }
-
+            pd->normData.append(pd->normValue);
             pd->normValue = 0.0;
             pd->normProcessedFrames = 0;
             pd->normDataCount++;
         }
-
-        pd->normProcessedFrames++;
     }
+
+    pd->processBufferSize = pd->levelData[0].size();
 }
 
 
@@ -606,6 +693,15 @@ int Peak::create_from_scratch()
         }
     }
 
+    // Avoid reallocations while accumulating the peak and norm data
+    foreach(ChannelData* data, m_channelData) {
+        qint64 dataPoints = qint64(m_source->get_nframes()) * 44100 / (qint64(m_source->get_file_rate()) * PYRAMID_BASE_FRAMES_PER_PEAK) + 2;
+        for (int level = 0; level < PYRAMID_LEVELS; ++level) {
+            data->pd->levelData[level].reserve(int((dataPoints >> level) + 1) * 2);
+        }
+        data->pd->normData.reserve(int(m_source->get_nframes() / NORMALIZE_CHUNK_SIZE + 1));
+    }
+
     DecodeBuffer decodebuffer;
 
     do {
@@ -614,7 +710,8 @@ int Peak::create_from_scratch()
             goto out;
         }
 
-        readFrames = m_source->file_read(&decodebuffer, totalReadFrames, bufferSize);
+        // Reading the whole file would only flush the decoded block cache
+        readFrames = m_source->file_read(&decodebuffer, totalReadFrames, bufferSize, false);
 
         if (readFrames <= 0) {
             PERROR("readFrames < 0 during peak building");
@@ -654,6 +751,8 @@ out:
 
 audio_sample_t Peak::get_max_amplitude(const TTimeRef &startlocation, const TTimeRef &endlocation)
 {
+    QMutexLocker locker(&m_dataMutex);
+
     foreach(ChannelData* data, m_channelData) {
         if (!data->file.isOpen() || !m_peaksAvailable) {
             printf("either the file is not open, or no peak data available\n");
@@ -734,56 +833,107 @@ PeakProcessor& pp()
 
 PeakProcessor::PeakProcessor()
 {
-    m_ppthread = new PPThread(this);
-    m_taskRunning = false;
-    m_runningPeak = 0;
+    m_stopThreads = false;
 
-    moveToThread(m_ppthread);
+    // Building peak files is mostly decoding, so several sources can be build at once
+    int idealThreadCount = qMax(1, QThread::idealThreadCount());
+    int threadCount = qBound(1, config().get_property("Conversion", "PeakBuildThreadCount", idealThreadCount).toInt(), idealThreadCount);
 
-    m_ppthread->start();
-
-    connect(this, SIGNAL(newTask()), this, SLOT(start_task()), Qt::QueuedConnection);
+    for (int i = 0; i < threadCount; ++i) {
+        auto thread = new PPThread(this);
+        thread->start(QThread::LowPriority);
+        m_threads.append(thread);
+    }
 }
 
 
 PeakProcessor::~ PeakProcessor()
 {
-    m_ppthread->exit(0);
-
-    if (!m_ppthread->wait(1000)) {
-        m_ppthread->terminate();
+    m_mutex.lock();
+    m_stopThreads = true;
+    foreach(Peak* peak, m_runningPeaks) {
+        peak->m_interuptPeakBuild = true;
     }
+    m_taskAvailable.wakeAll();
+    m_mutex.unlock();
 
-    delete m_ppthread;
+    foreach(PPThread* thread, m_threads) {
+        if (!thread->wait(1000)) {
+            thread->terminate();
+        }
+        delete thread;
+    }
 }
 
 
-void PeakProcessor::start_task()
+void PeakProcessor::process_tasks()
 {
-    m_runningPeak->create_from_scratch();
-
     QMutexLocker locker(&m_mutex);
 
-    m_taskRunning = false;
+    while (!m_stopThreads) {
+        Peak* peak = take_task();
 
-    if (m_runningPeak->m_interuptPeakBuild) {
-        PMESG("PeakProcessor:: Deleting interrupted Peak!");
-        delete m_runningPeak;
-        m_runningPeak = nullptr;
-        m_wait.wakeAll();
-        return;
-    }
+        if (!peak) {
+            m_taskAvailable.wait(&m_mutex);
+            continue;
+        }
+
+        m_runningPeaks.append(peak);
+
+        locker.unlock();
+
+        peak->create_from_scratch();
+        // In case building failed before finish_processing()
+        peak->set_building(false);
 
-    foreach(Peak* peak, m_queue) {
-        if (m_runningPeak->m_source->get_filename() == peak->m_source->get_filename()) {
-            m_queue.removeAll(peak);
-            emit peak->finished();
+        locker.relock();
+
+        m_runningPeaks.removeAll(peak);
+
+        if (peak->m_interuptPeakBuild) {
+            PMESG("PeakProcessor:: Deleting interrupted Peak!");
+            delete peak;
+            m_wait.wakeAll();
+            continue;
+        }
+
+        // Other Peaks waiting for the same file are done as well
+        foreach(Peak* queued, m_queue) {
+            if (peak->m_source->get_filename() == queued->m_source->get_filename()) {
+                m_queue.removeAll(queued);
+                emit queued->finished();
+            }
         }
+
+        // A task for the same file might have been put on hold
+        m_taskAvailable.wakeAll();
     }
+}
 
-    m_runningPeak = 0;
+/**
+ *	Returns the first queued Peak which peak file isn't being build
+ *	by another thread, or 0 if there is no such Peak.
+ */
+Peak* PeakProcessor::take_task()
+{
+    for (int i = 0; i < m_queue.size(); ++i) {
+        Peak* peak = m_queue.at(i);
+        bool fileBusy = false;
+
+        foreach(Peak* running, m_runningPeaks) {
+            if (running->m_source->get_filename() == peak->m_source->get_filename()) {
+                fileBusy = true;
+                break;
+            }
+        }
 
-    dequeue_queue();
+        if (!fileBusy) {
+            m_queue.removeAt(i);
+            return peak;
+        }
+    }
+
+    return nullptr;
 }
 
 void PeakProcessor::queue_task(Peak * peak)
@@ -792,18 +942,7 @@ void PeakProcessor::queue_task(Peak * peak)
 
     m_queue.enqueue(peak);
 
-    if (!m_taskRunning) {
-        dequeue_queue();
-    }
-}
-
-void PeakProcessor::dequeue_queue()
-{
-    if (!m_queue.isEmpty()) {
-        m_taskRunning = true;
-        m_runningPeak = m_queue.dequeue();
-        emit newTask();
-    }
+    m_taskAvailable.wakeOne();
 }
 
 void PeakProcessor::free_peak(Peak * peak)
@@ -812,16 +951,17 @@ void PeakProcessor::free_peak(Peak * peak)
 
     m_queue.removeAll(peak);
 
-    if (peak == m_runningPeak) {
+    if (m_runningPeaks.contains(peak)) {
         PMESG("PeakProcessor:: Interrupting running build process!");
         peak->m_interuptPeakBuild =  true;
 
         PMESG("PeakProcessor:: Waiting GUI thread until interrupt finished");
-        m_wait.wait(&m_mutex);
+        // The build thread deletes the interrupted Peak
+        while (m_runningPeaks.contains(peak)) {
+            m_wait.wait(&m_mutex);
+        }
         PMESG("PeakProcessor:: Resuming GUI thread");
 
-        dequeue_queue();
-
         m_mutex.unlock();
 
         return;
@@ -840,7 +980,7 @@ PPThread::PPThread(PeakProcessor * pp)
 
 void PPThread::run()
 {
-    exec();
+    m_pp->process_tasks();
 }
 
 
@@ -914,28 +1054,94 @@ nframes_t PeakDataReader::read(DecodeBuffer* buffer, nframes_t count)
     return nframes_t(framesRead);
 }
 
+
+PeakDataMapReader::PeakDataMapReader(Peak::ChannelData* data)
+{
+    m_d = data;
+    m_size = m_d->file.size();
+    m_data = nullptr;
+
+    Q_ASSERT(m_d->file.isOpen());
+
+    if (m_size > 0) {
+        m_data = m_d->file.map(0, m_size);
+    }
+
+    if (m_data) {
+        m_d->maps.insert(m_data, qMakePair(0, int(m_size)));
+    } else {
+        PWARN(QString("PeakDataMapReader: could not map %1 into memory, using file reads").arg(m_d->fileName).toLatin1().data());
+    }
+}
+
+PeakDataMapReader::~PeakDataMapReader()
+{
+    if (m_data) {
+        m_d->maps.remove(m_data);
+        m_d->file.unmap(m_data);
+    }
+}
+
+/**
+ *	Returns a pointer to the peak data at byte position \a start of the peak file,
+ *	\a available is set to the amount of values, at most \a count, that can be accessed.
+ */
+const peak_data_t* PeakDataMapReader::data_at(nframes_t start, nframes_t count, nframes_t* available) const
+{
+    *available = 0;
+
+    if (!m_data || qint64(start) >= m_size) {
+        return nullptr;
+    }
+
+    qint64 values = (m_size - start) / qint64(sizeof(peak_data_t));
+    *available = nframes_t(qMin(qint64(count), values));
+
+    return reinterpret_cast<const peak_data_t*>(m_data + start);
+}
+
 void Peak::calculate_lut_data()
 {
-    chacheIndexLut.insert(64     , 0);
-    chacheIndexLut.insert(128    , 1);
-    chacheIndexLut.insert(256    , 2);
-    chacheIndexLut.insert(512    , 3);
-    chacheIndexLut.insert(1024   , 4);
-    chacheIndexLut.insert(2048   , 5);
-    chacheIndexLut.insert(4096   , 6);
-    chacheIndexLut.insert(8192   , 7);
-    chacheIndexLut.insert(16384  , 8);
-    chacheIndexLut.insert(32768  , 9);
-    chacheIndexLut.insert(65536  , 10);
-    chacheIndexLut.insert(131072 , 11);
-    chacheIndexLut.insert(262144 , 12);
-    chacheIndexLut.insert(524288 , 13);
-    chacheIndexLut.insert(1048576, 14);
+    for (int level = 0; level < PYRAMID_LEVELS; ++level) {
+        chacheIndexLut.insert(PYRAMID_BASE_FRAMES_PER_PEAK << level, level);
+    }
 }
 
 int Peak::max_zoom_value()
 {
-    return 1048576;
+    return PYRAMID_BASE_FRAMES_PER_PEAK << (PYRAMID_LEVELS - 1);
+}
+
+/**
+ *	Returns the pyramid level used for \a framesPerPeak, or -1 if there is none.
+ *	\a framesPerLevelPeak is set to the frames per peak of that level.
+ */
+int Peak::pyramid_level(qreal framesPerPeak, unsigned long* framesPerLevelPeak)
+{
+    int highbit;
+    *framesPerLevelPeak = nearest_power_of_two(qRound(framesPerPeak), highbit);
+
+    if (*framesPerLevelPeak == 0) {
+        return -1;
+    }
+
+    return cache_index_lut()->value(int(*framesPerLevelPeak), -1);
+}
+
+/**
+ *	Returns true if the peak data for \a framesPerPeak is read from the peak file.
+ *	The fine levels are only used for an exact match, 24 frames per peak would
+ *	otherwise be drawn with the data of 16 or 32 frames per peak.
+ */
+bool Peak::is_macro_view(qreal framesPerPeak)
+{
+    if (framesPerPeak >= 64) {
+        return true;
+    }
+
+    int frames = qRound(framesPerPeak);
+
+    return qreal(frames) == framesPerPeak && cache_index_lut()->contains(frames);
 }
 
 Peak::ChannelData::~ ChannelData()
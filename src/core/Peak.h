@@ -25,11 +25,14 @@ Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA.
 #include <QObject>
 #include <QThread>
 #include <QMutex>
+#include <QRecursiveMutex>
 #include <QQueue>
 #include <QWaitCondition>
 #include <QFile>
 #include <QHash>
 #include <QPair>
+#include <QList>
+#include <QVector>
 
 #include "TTimeRef.h"
 #include "defines.h"
@@ -40,38 +43,35 @@ class Peak;
 class PPThread;
 class DecodeBuffer;
 class PeakDataReader;
+class PeakDataMapReader;
 
-class PeakProcessor : public QObject
+typedef short peak_data_t;
+
+class PeakProcessor
 {
-	Q_OBJECT	
-	
 public:
 	void queue_task(Peak* peak);
 	void free_peak(Peak* peak);
 
 private:
-	PPThread* m_ppthread;
+	QList<PPThread*> m_threads;
 	QMutex m_mutex;
+	QWaitCondition m_taskAvailable;
 	QWaitCondition m_wait;
-	bool m_taskRunning;
-	Peak* m_runningPeak;
-		
+	bool m_stopThreads;
+
+	QList<Peak* > m_runningPeaks;
 	QQueue<Peak* > m_queue;
-	
-	void dequeue_queue();
-	
+
+	void process_tasks();
+	Peak* take_task();
+
 	PeakProcessor();
 	~PeakProcessor();
 	PeakProcessor(const PeakProcessor&);
 	// allow this function to create one instance
 	friend PeakProcessor& pp();
-	
-private slots:
-	void start_task();
-	
-signals:
-	void newTask();
-
+	friend class PPThread;
 };
 
 class PPThread : public QThread
@@ -97,8 +97,10 @@ class Peak : public QObject
 
 public:
 	static const int ZOOM_LEVELS = 22;
-	static const int SAVING_ZOOM_FACTOR = 8;
-	static const int MAX_ZOOM_USING_SOURCEFILE = SAVING_ZOOM_FACTOR - 1;
+	// The peak file stores a min/max pyramid, starting with a level of
+	// PYRAMID_BASE_FRAMES_PER_PEAK (16), up to 16 << 16 (1048576) frames per peak
+	static const int PYRAMID_BASE_FRAMES_PER_PEAK = 16;
+	static const int PYRAMID_LEVELS = 17;
 	// Use ~ 1/4 the range of peak_data_t (== short) so we have headroom
 	// for samples in the range [-4, +4] or + 12 dB
 	static const int MAX_DB_VALUE = 8000;
@@ -117,6 +119,8 @@ public:
     int prepare_processing(uint rate);
 	int finish_processing();
     int calculate_peaks(int chan, float** buffer, const TTimeRef &startlocation, int peakDataCount, qreal framesPerPeak);
+    int get_peak_data(int chan, const peak_data_t** buffer, const TTimeRef &startlocation, int peakDataCount, qreal framesPerPeak);
+    int get_live_peak_data(int chan, float* buffer, const TTimeRef &startlocation, int peakDataCount, qreal framesPerPeak);
 
 	void close();
 	
@@ -126,12 +130,19 @@ public:
 	
 	static QHash<int, int>* cache_index_lut();
 	static int max_zoom_value();
+	static bool is_macro_view(qreal framesPerPeak);
 
 private:
 	ReadSource* 	m_source;
 	bool 		m_peaksAvailable;
 	bool		m_permanentFailure;
 	bool		m_interuptPeakBuild;
+	bool		m_building;
+	// Guards the peak files, readers and decode buffers, which are used by the
+	// peak build, tile and GUI threads. Recursive, calculate_peaks() calls get_peak_data()
+	QRecursiveMutex	m_dataMutex;
+	// Guards the in memory pyramid which is read while recording
+	QMutex		m_processDataMutex;
 	static QHash<int, int> chacheIndexLut;
 	
 	struct ProcessData {
@@ -139,6 +150,7 @@ private:
 			normValue = peakUpperValue = peakLowerValue = 0;
 			processBufferSize = progress = normProcessedFrames = normDataCount = 0;
 			nextDataPointLocation = processRange;
+			universalLocation = universalNextDataPoint = 0;
 		}
 		
 		audio_sample_t		peakUpperValue;
@@ -155,13 +167,23 @@ private:
 		int 			progress;
 		int			processBufferSize;
 		int			normDataCount;
+
+		// Peak building keeps it's location in universal frames and
+		// accumulates all pyramid levels in memory until finish_processing()
+		qint64			universalLocation;
+		qint64			universalNextDataPoint;
+		QVector<peak_data_t>	levelData[PYRAMID_LEVELS];
+		// Data point waiting for a second one to be merged into the level
+		peak_data_t		pendingPair[PYRAMID_LEVELS][2];
+		bool			hasPendingPair[PYRAMID_LEVELS] = {};
+		QVector<audio_sample_t>	normData;
 	};
 	
 	struct PeakHeaderData {
 		int headerSize;
 		int normValuesDataOffset;
-		int peakDataOffsets[ZOOM_LEVELS - SAVING_ZOOM_FACTOR];
-		int peakDataSizeForLevel[ZOOM_LEVELS - SAVING_ZOOM_FACTOR];
+		int peakDataOffsets[PYRAMID_LEVELS];
+		int peakDataSizeForLevel[PYRAMID_LEVELS];
 		char label[6];	//TPFxxx -> Traverso Peak File version x.x.x
 		int version[2];
 	};
@@ -172,11 +194,10 @@ private:
 		}
 		~ChannelData();
 		QString		fileName;
-		QString		normFileName;
 		QFile 		file;
-		QFile		normFile;
 		PeakHeaderData	headerdata;
 		PeakDataReader*	peakreader;
+		PeakDataMapReader* mapreader;
 		ProcessData* 	pd;
 		DecodeBuffer*	peakdataDecodeBuffer;
 		QHash<uchar *, QPair<int /*offset*/, int /*handle|len*/> > maps;
@@ -187,10 +208,15 @@ private:
 	int create_from_scratch();
 	int read_header();
 	int write_header(ChannelData* data);
+	static void append_data_point(ProcessData* pd, int level, peak_data_t upper, peak_data_t lower);
+	static int pyramid_level(qreal framesPerPeak, unsigned long* framesPerLevelPeak);
 	static void calculate_lut_data();
+	void set_building(bool building);
 
 	friend class PeakProcessor;
+	friend class TPeakTileCache;
 	friend class PeakDataReader;
+	friend class PeakDataMapReader;
 
 signals:
 	void finished();
@@ -214,6 +240,21 @@ private:
 	nframes_t read(DecodeBuffer* buffer, nframes_t frameCount);
 };
 
+class PeakDataMapReader
+{
+public:
+	PeakDataMapReader(Peak::ChannelData* data);
+	~PeakDataMapReader();
+
+	bool is_mapped() const {return m_data != nullptr;}
+	const peak_data_t* data_at(nframes_t start, nframes_t count, nframes_t* available) const;
+
+private:
+	Peak::ChannelData* m_d;
+	uchar*		m_data;
+	qint64		m_size;
+};
+
 inline QHash< int, int > * Peak::cache_index_lut()
 {
 	if(chacheIndexLut.isEmpty()) {
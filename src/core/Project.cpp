@@ -36,6 +36,7 @@ Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA.
 #include "ProjectManager.h"
 #include "Information.h"
 #include "TExportThread.h"
+#include "TExportPipeline.h"
 #include "TInputEventDispatcher.h"
 #include "ResourcesManager.h"
 #include "TExportSpecification.h"
@@ -48,6 +49,7 @@ Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA.
 #include "TTimeLineRuler.h"
 #include "TBusTrack.h"
 #include "TSend.h"
+#include "TSeekIndex.h"
 #include "SpectralMeter.h"
 #include "CorrelationMeter.h"
 
@@ -129,6 +131,10 @@ Project::~Project()
 
     cpointer().remove_contextitem(this);
 
+    // Waits for the renders, which use the Sheets
+    delete m_exportPipeline;
+    qDeleteAll(m_sheetExportSpecifications);
+
     delete m_resourcesManager;
 
     foreach(Sheet* sheet, m_sheets) {
@@ -154,6 +160,8 @@ int Project::create(int sheetcount, int numtracks)
         return -1;
     }
 
+    TSeekIndex::set_index_dir(m_rootDir + "/peakfiles");
+
     if (create_audiosources_dir() < 0) {
         return -1;
     }
@@ -243,6 +251,9 @@ int Project::load(const QString& projectfile)
         create_audiosources_dir();
     }
 
+    // Seek indices of compressed audio files are stored with the peak files
+    TSeekIndex::set_index_dir(m_rootDir + "/peakfiles");
+
 
     // Start setting and parsing the content of the xml file
     QString errorMsg;
@@ -652,6 +663,11 @@ QDomNode Project::get_state(QDomDocument doc, bool istemplate)
 
 void Project::prepare_audio_device(QDomDocument doc)
 {
+    // traverso-bench drives the audio device itself, keep it's setup
+    if (audiodevice().get_driver_type() == "Benchmark Driver") {
+        return;
+    }
+
     TAudioDeviceSetup ads;
 
     QDomNode audioDriverConfigurations = doc.documentElement().firstChildElement("AudioDriverConfigurations");
@@ -1059,8 +1075,8 @@ TCommand* Project::add_sheet(Sheet* sheet, bool historable)
 
     AddRemove* cmd;
     cmd = new AddRemove(this, sheet, historable, nullptr,
-                        "private_add_sheet(Sheet*)", "privateSheetAdded(Sheet*)",
-                        "private_remove_sheet(Sheet*)", "privateSheetRemoved(Sheet*)",
+                        Tsar::call<Project, Sheet, &Project::private_add_sheet>, "privateSheetAdded(Sheet*)",
+                        Tsar::call<Project, Sheet, &Project::private_remove_sheet>, "privateSheetRemoved(Sheet*)",
                         tr("Sheet %1 added").arg(sheet->get_name()));
 
     return cmd;
@@ -1071,8 +1087,8 @@ TCommand* Project::remove_sheet(Sheet* sheet, bool historable)
 {
     AddRemove* cmd;
     cmd = new AddRemove(this, sheet, historable, nullptr,
-                        "private_remove_sheet(Sheet*)", "privateSheetRemoved(Sheet*)",
-                        "private_add_sheet(Sheet*)", "privateSheetAdded(Sheet*)",
+                        Tsar::call<Project, Sheet, &Project::private_remove_sheet>, "privateSheetRemoved(Sheet*)",
+                        Tsar::call<Project, Sheet, &Project::private_add_sheet>, "privateSheetAdded(Sheet*)",
                         tr("Remove Sheet %1").arg(sheet->get_name()));
 
 
@@ -1160,6 +1176,84 @@ int Project::export_project()
     return 0;
 }
 
+/**
+ *	Exports each of \a sheets to it's own file in the export dir, with the format
+ *	of get_export_specification(). Independent Sheets are rendered at the same
+ *	time, see TExportPipeline. exportFinished() is emitted when all Sheets are done.
+ */
+int Project::export_sheets(const QList<Sheet*>& sheets)
+{
+    PENTER;
+
+    if (m_exportPipeline || sheets.isEmpty()) {
+        return -1;
+    }
+
+    m_sheetsToExport = sheets;
+
+    return export_project();
+}
+
+void Project::cancel_export()
+{
+    if (m_exportPipeline) {
+        m_exportPipeline->cancel();
+    } else if (m_exportSpecification) {
+        m_exportSpecification->cancel_export();
+    }
+}
+
+void Project::start_export_pipeline()
+{
+    PENTER;
+
+    m_exportPipeline = new TExportPipeline();
+    connect(m_exportPipeline, SIGNAL(progress(int)), m_exportSpecification, SIGNAL(progressChanged(int)));
+    connect(m_exportPipeline, SIGNAL(finished()), this, SLOT(export_pipeline_finished()));
+
+    for (auto sheet : std::as_const(m_sheetsToExport)) {
+        TTimeRef startLocation, endLocation;
+        if (!sheet->get_export_range(startLocation, endLocation)) {
+            info().information(tr("Sheet %1 has no audio to export").arg(sheet->get_name()));
+            continue;
+        }
+
+        auto spec = new TExportSpecification;
+        spec->set_export_dir(m_exportSpecification->get_export_dir());
+        spec->set_export_file_name(sheet->get_name());
+        spec->set_writer_type(m_exportSpecification->get_writer_type());
+        spec->set_file_format(m_exportSpecification->get_file_format());
+        spec->set_data_format(m_exportSpecification->get_data_format());
+        spec->set_channel_count(m_exportSpecification->get_channel_count());
+        spec->set_sample_rate(m_exportSpecification->get_sample_rate());
+        spec->set_sample_rate_conversion_quality(m_exportSpecification->get_sample_rate_conversion_quality());
+        spec->set_dither_type(m_exportSpecification->get_dither_type());
+        spec->extraFormat = m_exportSpecification->extraFormat;
+        spec->set_export_start_location(startLocation);
+        spec->set_export_end_location(endLocation);
+        m_sheetExportSpecifications.append(spec);
+
+        m_exportPipeline->add_sheet(sheet, QList<TExportSpecification*>() << spec);
+    }
+
+    m_sheetsToExport.clear();
+    m_exportPipeline->start();
+}
+
+void Project::export_pipeline_finished()
+{
+    if (m_exportPipeline->get_failed_count()) {
+        info().warning(tr("Exporting %n Sheet(s) failed", "", m_exportPipeline->get_failed_count()));
+    }
+
+    m_exportPipeline->deleteLater();
+    m_exportPipeline = nullptr;
+    qDeleteAll(m_sheetExportSpecifications);
+    m_sheetExportSpecifications.clear();
+
+    emit exportFinished();
+}
+
 void Project::export_finished()
 {
     connect_to_audio_device();
@@ -1174,7 +1268,11 @@ void Project::audio_device_removed_client(TAudioDeviceClient *client)
     }
 
     if (m_disconnectAudioDeviceClientForExport) {
-        m_exportSpecification->start_export(this);
+        if (m_sheetsToExport.isEmpty()) {
+            m_exportSpecification->start_export(this);
+        } else {
+            start_export_pipeline();
+        }
         m_disconnectAudioDeviceClientForExport = false;
     }
 
@@ -38,6 +38,7 @@ class Track;
 class ResourcesManager;
 class TExportSpecification;
 class TExportThread;
+class TExportPipeline;
 class TAudioDeviceClient;
 class TBusTrack;
 class TSend;
@@ -141,6 +142,8 @@ public :
 	int save(bool autosave=false);
 	int load(const QString &projectfile = "");
     int export_project();
+    int export_sheets(const QList<Sheet*>& sheets);
+    void cancel_export();
     TExportSpecification* get_export_specification();
 
 	enum {
@@ -178,6 +181,10 @@ private:
         QHash<qint64, AudioChannel* >   m_softwareAudioChannels;
 
         TExportSpecification*   m_exportSpecification;
+        // Sheets exported by export_sheets(), each with it's own specification
+        TExportPipeline*        m_exportPipeline{};
+        QList<Sheet*>           m_sheetsToExport;
+        QList<TExportSpecification*> m_sheetExportSpecifications;
 
 
 
@@ -214,6 +221,7 @@ private:
 	int create_peakfiles_dir();
 
         void prepare_audio_device(QDomDocument doc);
+        void start_export_pipeline();
     void set_project_closed() {
         m_projectClosed = true;
         disconnect_from_audio_device();
@@ -228,6 +236,7 @@ private slots:
     void sheet_removed(Sheet* sheet);
     void sheet_added(Sheet* sheet);
     void export_finished();
+    void export_pipeline_finished();
     void audio_device_removed_client(TAudioDeviceClient*client);
     
 signals:
@@ -29,7 +29,12 @@ Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA.
 #include "Utils.h"
 #include "AudioDevice.h"
 #include <QFile>
+#include <QReadLocker>
+#include <QWriteLocker>
+#include <algorithm>
 #include "TConfig.h"
+#include "TDecodedBlockCache.h"
+#include "TFlightRecorder.h"
 
 // Always put me below _all_ includes, this is needed
 // in case we run with memory leak detection enabled!
@@ -122,6 +127,7 @@ void ReadSource::private_init()
     m_refcount = 0;
 	m_error = 0;
     m_resampleAudioReader = nullptr;
+    m_resampleDecodeBuffer = nullptr;
 
     // TODO: make this work
     // used to detect if the transport location comes
@@ -264,6 +270,9 @@ int ReadSource::init( )
 void ReadSource::set_output_rate_and_convertor_type(int outputRate, int converterType)
 {
     Q_ASSERT(outputRate > 0);
+
+    QWriteLocker locker(&m_readerLock);
+
     Q_ASSERT_X(m_resampleAudioReader, "ReadSource::set_output_rate_and_convertor_type", "No Resample Audio Reader");
 
 	bool useResampling = config().get_property("Conversion", "DynamicResampling", true).toBool();
@@ -296,17 +305,31 @@ void ReadSource::set_source_start_location(const TTimeRef &sourceStartLocation)
     m_sourceStartLocation = sourceStartLocation;
 }
 
-int ReadSource::file_read(DecodeBuffer* buffer, const TTimeRef& fileLocation, nframes_t cnt) const
+int ReadSource::file_read(DecodeBuffer* buffer, const TTimeRef& fileLocation, nframes_t cnt, bool useCache) const
 {
+    QReadLocker locker(&m_readerLock);
     Q_ASSERT(m_resampleAudioReader);
-    return m_resampleAudioReader->read_from(buffer, fileLocation, cnt);
+    if (!useCache) {
+        return m_resampleAudioReader->read_from(buffer, fileLocation, cnt);
+    }
+    nframes_t location = TTimeRef::to_frame(fileLocation, m_resampleAudioReader->get_output_rate());
+    return decoded_block_cache().read(m_resampleAudioReader, m_fileName, buffer, location, cnt);
 }
 
 
-int ReadSource::file_read(DecodeBuffer * buffer, nframes_t fileLocation, nframes_t cnt)
+/**
+ *	Reads \a cnt frames from \a fileLocation into \a buffer. By default the reads go through
+ *	the process wide TDecodedBlockCache so ReadSources of the same file share their decoded data.
+ *	Use \a useCache = false for reads that touch the whole file only once, like peak building.
+ */
+int ReadSource::file_read(DecodeBuffer * buffer, nframes_t fileLocation, nframes_t cnt, bool useCache)
 {
+    QReadLocker locker(&m_readerLock);
     Q_ASSERT(m_resampleAudioReader);
-    return m_resampleAudioReader->read_from(buffer, fileLocation, cnt);
+    if (!useCache) {
+        return m_resampleAudioReader->read_from(buffer, fileLocation, cnt);
+    }
+    return decoded_block_cache().read(m_resampleAudioReader, m_fileName, buffer, fileLocation, cnt);
 }
 
 
@@ -322,6 +345,7 @@ ReadSource * ReadSource::deep_copy( )
 
 nframes_t ReadSource::get_nframes( ) const
 {
+    QReadLocker locker(&m_readerLock);
     if (!m_resampleAudioReader) {
 		return 0;
 	}
@@ -342,6 +366,9 @@ int ReadSource::set_file(const QString & filename)
 		
 	set_dir(dir);
 	set_name(name);
+
+	// The file might have changed on disk, drop any decoded data of it
+	decoded_block_cache().invalidate(m_fileName);
 	
 	if (init() < 0) {
 		return -1;
@@ -352,6 +379,65 @@ int ReadSource::set_file(const QString & filename)
 	return 1;
 }
 
+/**
+ *	Replaces the file of this ReadSource by \a filename, which must contain the same audio,
+ *	e.g. a transcoded copy of the original file. Unlike set_file() this is safe to call while
+ *	the ReadSource is used by DiskIO, peak building or export, a read in progress finishes
+ *	on the old file and all following reads use the new one.
+ *
+ * @return 1 on success, -1 if \a filename couldn't be opened or has a different channel count
+ */
+int ReadSource::switch_file(const QString& filename)
+{
+	PENTER;
+
+	if (!m_resampleAudioReader) {
+		return set_file(filename);
+	}
+
+	// Opening the file can take a while, don't block readers meanwhile
+	auto reader = new ResampleAudioReader(filename);
+
+	if (!reader->is_valid() || reader->get_num_channels() != m_channelCount) {
+		delete reader;
+		return -1;
+	}
+
+	QString oldFileName = m_fileName;
+	int splitpoint = filename.lastIndexOf("/") + 1;
+
+	m_readerLock.lockForWrite();
+
+	bool useResampling = config().get_property("Conversion", "DynamicResampling", true).toBool();
+	reader->set_output_rate(useResampling ? m_outputRate : reader->get_file_rate());
+	reader->set_converter_type(m_resampleAudioReader->get_convertor_type());
+	if (m_resampleDecodeBuffer) {
+		reader->set_resample_decode_buffer(m_resampleDecodeBuffer);
+	}
+
+	std::swap(reader, m_resampleAudioReader);
+
+	set_dir(filename.left(splitpoint));
+	set_name(filename.mid(splitpoint));
+	m_rate = m_resampleAudioReader->get_file_rate();
+	m_length = m_resampleAudioReader->get_length();
+
+	m_readerLock.unlock();
+
+	delete reader;
+	decoded_block_cache().invalidate(oldFileName);
+
+	emit stateChanged();
+
+	return 1;
+}
+
+bool ReadSource::is_compressed() const
+{
+	QReadLocker locker(&m_readerLock);
+	return m_resampleAudioReader && m_resampleAudioReader->is_compressed();
+}
+
 
 void ReadSource::rb_seek_to_transport_location(const TTimeRef& transportLocation)
 {
@@ -359,6 +445,7 @@ void ReadSource::rb_seek_to_transport_location(const TTimeRef& transportLocation
     Q_ASSERT(m_location);
 
     m_bufferstatus.set_sync_status(BufferStatus::QUEUE_SEEKING_TO_NEW_LOCATION);
+    m_underrunArmed.store(false);
 
     if ((transportLocation + m_aboutOneToFourSecondsTime) < m_location->get_start() ||
         transportLocation > m_location->get_end()) {
@@ -433,25 +520,16 @@ void ReadSource::process_realtime_buffers()
     // except when we are seeking, then the rt queueu actually is empty and we need to
     // read to the m_lastQueuedRTBufferSlot->get_transport_location(); since we set that
     // value to the seek transport location
-    size_t slotsToFill = freeSlots - 1;  // leave one slot in the rt queue so the ringbuffer_read() Queue Buffer Slot cannot be overwritten by us
+    // The slot used by the audio thread is only put back on the free queue by
+    // ringbuffer_release_slot() once it's done with it, so we can fill all free slots
+    size_t slotsToFill = freeSlots;
     if (m_bufferstatus.get_sync_status() == BufferStatus::QUEUE_SEEKED_TO_NEW_LOCATION) {
-        slotsToFill = int(0.7 * slotcount);
+        slotsToFill = std::min(freeSlots, size_t(0.7 * slotcount));
     } else {
         slotFileLocation += m_bufferSlotDuration;
     }
 
     QueueBufferSlot* slot = nullptr;
-    nframes_t totalReadSize = slotsToFill * bufferSize;
-    // file_read can return 0 in which case m_fileDecodeBuffer internal
-    // buffers are the wrong size or not created at all.
-    // since we want to fill the rt buffer even beyond the file length
-    // for now make sure the decode buffers are the correct size
-    m_fileDecodeBuffer->check_buffers_capacity(totalReadSize, m_channelCount);
-    nframes_t read = file_read(m_fileDecodeBuffer, slotFileLocation, totalReadSize);
-    nframes_t offset = 0;
-    if (read != bufferSize) { // likely end of file
-        // printf("ReadSource::fill_realtime_buffers: file_read gave only %d\n", read);
-    }
 
     while (slotsToFill)
     {
@@ -461,13 +539,23 @@ void ReadSource::process_realtime_buffers()
             return;
         }
 
-        for (uint chan=0; chan<m_channelCount; ++chan) {
-            Q_ASSERT(m_fileDecodeBuffer->destinationBufferSize >= offset+bufferSize);
-            // FIXME: use function to get destination buffer that checks if the request is valid
-            slot->write_buffer(slotFileLocation, m_fileDecodeBuffer->destination[chan] + offset, chan, bufferSize);
+        // Decode straight into the slot buffers, no need to copy from m_fileDecodeBuffer
+        m_fileDecodeBuffer->set_external_destination(slot->get_buffers(), bufferSize, m_channelCount);
+        // Clips sharing this file decode it only once, see TDecodedBlockCache
+        nframes_t read = file_read(m_fileDecodeBuffer, slotFileLocation, bufferSize);
+
+        if (read > 0 && m_fileDecodeBuffer->destination != slot->get_buffers()) {
+            // The decoder needed more space then the slot provides and used the
+            // decode buffers own memory, copy it the old fashioned way
+            for (uint chan=0; chan<m_channelCount; ++chan) {
+                slot->write_buffer(slotFileLocation, m_fileDecodeBuffer->destination[chan], chan, bufferSize);
+            }
         }
+        m_fileDecodeBuffer->reset_destination();
 
-        offset += bufferSize;
+        // We fill the rt buffer beyond the file length too, make sure that's silence
+        slot->silence_buffers(read);
+        slot->set_file_location(slotFileLocation);
 
         if (!m_rtBufferSlotsQueue->try_enqueue(slot)) {
             PERROR("ReadSource::fill_realtime_buffers: try enqueue failed");
@@ -488,66 +576,95 @@ void ReadSource::process_realtime_buffers()
 
 
 nframes_t ReadSource::ringbuffer_read(AudioBus *audioBus, const TTimeRef &fileLocation, nframes_t frames, bool realTime)
+{
+    QueueBufferSlot* slot = ringbuffer_acquire_slot(fileLocation, realTime);
+
+    if (!slot) {
+        return 0;
+    }
+
+    for (uint chan=0; chan < m_channelCount; ++chan) {
+        slot->read_buffer(audioBus->get_buffer(chan, frames), chan, frames);
+    }
+
+    nframes_t read = slot->get_buffer_size();
+
+    ringbuffer_release_slot(slot);
+
+    return read;
+}
+
+/**
+ *	Returns the rt queue slot holding the audio data of \a fileLocation so the caller can
+ *	process and mix the audio straight from the slot buffers. The slot buffers may be modified.
+ *	When done the slot \b must be handed back with ringbuffer_release_slot().
+ *
+ * @return The slot for \a fileLocation, or nullptr if it wasn't available
+ */
+QueueBufferSlot* ReadSource::ringbuffer_acquire_slot(const TTimeRef &fileLocation, bool realTime)
 {
     if (m_bufferstatus.out_of_sync()) {
         // printf("ReadSource::ringbuffer_read: Buffer out of sync, skipping file location %s\n",
         //        QS_C(TTimeRef::timeref_to_ms_3(fileLocation)));
-        return 0;
+        return nullptr;
     }
 
     QueueBufferSlot* slot = nullptr;
 
-    // auto startTime = TTimeRef::get_nanoseconds_since_epoch();
-    nframes_t read = 0;
     auto availableSlots = m_rtBufferSlotsQueue->size_approx();
 
     while ((slot = dequeue_from_rt_queue(realTime)))
     {
         Q_ASSERT(m_bufferstatus.get_sync_status() != BufferStatus::QUEUE_SEEKING_TO_NEW_LOCATION);
 
-        Q_ASSERT(slot);
-
-        m_freeBufferSlotsQueue->try_enqueue(slot); // always put the dequeued slot on the free slots queue so we don't lose slots
-
-        // check if this slot or any available is a candidate slot, if not, no need to process the
-        // whole queue, instead start a resync
-
-
         TTimeRef slotFileLocation = slot->get_file_location();
 
         Q_ASSERT(slotFileLocation != TTimeRef::INVALID);
 
         if (slotFileLocation == fileLocation)
         {
-            for (uint chan=0; chan < m_channelCount; ++chan) {
-                slot->read_buffer(audioBus->get_buffer(chan, frames), chan, frames);
+            if (realTime) {
+                m_underrunArmed.store(true);
             }
-
-            read = slot->get_buffer_size();
-            break;
+            return slot;
         }
 
+        // this slot is not the one we're looking for, always put it on the free
+        // slots queue so we don't lose slots
+        m_freeBufferSlotsQueue->try_enqueue(slot);
+
         TTimeRef lastAvailableSlotFileLocation = slotFileLocation + (availableSlots * m_bufferSlotDuration);
 
-        // Check transport location in queue range
+        // Check transport location in queue range, if not, no need to process the
+        // whole queue, instead start a resync
         if ((fileLocation < slotFileLocation) || (fileLocation > lastAvailableSlotFileLocation)) {
             printf("ReadSource::ringbuffer_read: FileLocation not in queue range: %s (%s - %s)\n",
                    QS_C(TTimeRef::timeref_to_ms_3(fileLocation)),
                    QS_C(TTimeRef::timeref_to_ms_3(slotFileLocation)),
                    QS_C(TTimeRef::timeref_to_ms_3(lastAvailableSlotFileLocation)));
             m_bufferstatus.set_sync_status(BufferStatus::SyncStatus::OUT_OF_SYNC);
-            read = 0;
-            break;
+            flight_recorder().trigger(TFlightRecorder::RESYNC, &m_bufferstatus,
+                                      (fileLocation.universal_frame() * 1000) / TTimeRef::UNIVERSAL_SAMPLE_RATE);
+            return nullptr;
         }
 
         printf("ReadSource::rb_read: Skipping slot %d, location %s\n",
                slot->get_slot_number(), QS_C(TTimeRef::timeref_to_ms_3(slotFileLocation)));
     }
 
-    // auto totalTime = TTimeRef::get_nanoseconds_since_epoch() - startTime;
-    // printf("ReadSource::rb_read: took nanosecs: %ld\n", totalTime);
+    // The rt queue ran dry while playing back, DiskIO didn't refill it in time.
+    // Transport start and the first fill after a seek don't count
+    if (realTime && m_underrunArmed.exchange(false)) {
+        flight_recorder().trigger(TFlightRecorder::UNDERRUN, &m_bufferstatus, qint64(availableSlots));
+    }
 
-    return read;
+    return nullptr;
+}
+
+void ReadSource::ringbuffer_release_slot(QueueBufferSlot* slot)
+{
+    Q_ASSERT(slot);
+    m_freeBufferSlotsQueue->try_enqueue(slot);
 }
 
 QueueBufferSlot* ReadSource::dequeue_from_rt_queue(bool realTime)
@@ -584,6 +701,30 @@ BufferStatus* ReadSource::get_buffer_status()
     return &m_bufferstatus;
 }
 
+/**
+ *	Estimates how long the audio thread can keep reading from the rt queue before
+ *	it runs dry. If the clip only starts after \a transportLocation the time until
+ *	the clip comes into play is added, so DiskIO can postpone refilling this source.
+ */
+TTimeRef ReadSource::get_time_to_underrun(const TTimeRef& transportLocation)
+{
+    if (!m_active.load()) {
+        return TTimeRef::max_length();
+    }
+
+    if (m_bufferstatus.out_of_sync() || !m_rtBufferSlotsQueue) {
+        return TTimeRef();
+    }
+
+    TTimeRef timeToUnderrun = m_rtBufferSlotsQueue->size_approx() * m_bufferSlotDuration;
+
+    if (m_location && m_location->get_start() > transportLocation) {
+        timeToUnderrun += m_location->get_start() - transportLocation;
+    }
+
+    return timeToUnderrun;
+}
+
 void ReadSource::set_active(bool active)
 {
     m_active.store(active);
@@ -591,6 +732,7 @@ void ReadSource::set_active(bool active)
 
 uint ReadSource::get_file_rate() const
 {
+    QReadLocker locker(&m_readerLock);
     if (m_resampleAudioReader) {
         return m_resampleAudioReader->get_file_rate();
 	} else {
@@ -602,7 +744,10 @@ uint ReadSource::get_file_rate() const
 
 void ReadSource::set_decode_buffers(DecodeBuffer* fileDecodeBuffer, DecodeBuffer *resampleDecodeBuffer)
 {
+    QWriteLocker locker(&m_readerLock);
+
     m_fileDecodeBuffer = fileDecodeBuffer;
+    m_resampleDecodeBuffer = resampleDecodeBuffer;
 
     if (m_resampleAudioReader) {
         m_resampleAudioReader->set_resample_decode_buffer(resampleDecodeBuffer);
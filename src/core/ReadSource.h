@@ -25,6 +25,7 @@ Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA.
 #include "AudioSource.h"
 
 #include <QDomDocument>
+#include <QReadWriteLock>
 
 
 class ResampleAudioReader;
@@ -56,14 +57,18 @@ public :
 	QDomNode get_state(QDomDocument doc);
 
     nframes_t ringbuffer_read(AudioBus *audioBus, const TTimeRef &fileLocation, nframes_t frames, bool realTime);
+    QueueBufferSlot* ringbuffer_acquire_slot(const TTimeRef &fileLocation, bool realTime);
+    void ringbuffer_release_slot(QueueBufferSlot* slot);
 
-    int file_read(DecodeBuffer* buffer, const TTimeRef& fileLocation, nframes_t cnt) const;
-    int file_read(DecodeBuffer* buffer, nframes_t fileLocation, nframes_t cnt);
+    int file_read(DecodeBuffer* buffer, const TTimeRef& fileLocation, nframes_t cnt, bool useCache=true) const;
+    int file_read(DecodeBuffer* buffer, nframes_t fileLocation, nframes_t cnt, bool useCache=true);
 
 	int init();
 	int get_error() const {return m_error;}
 	QString get_error_string() const;
 	int set_file(const QString& filename);
+	int switch_file(const QString& filename);
+	bool is_compressed() const;
 	void set_active(bool active);
 	
 	nframes_t get_nframes() const;
@@ -81,10 +86,16 @@ private:
     ResampleAudioReader*	m_resampleAudioReader;
 
     DecodeBuffer*       m_fileDecodeBuffer;
+    DecodeBuffer*       m_resampleDecodeBuffer;
+    // Guards m_resampleAudioReader and m_fileName against switch_file()
+    mutable QReadWriteLock m_readerLock;
     int                 m_refcount;
     int                 m_error;
     bool                m_silent;
     std::atomic<bool>   m_active;
+    // Set once the audio thread got a slot after the last seek, an empty rt queue
+    // before that is the initial fill and not an underrun
+    std::atomic<bool>   m_underrunArmed{};
 
     TLocation*          m_location;
     TTimeRef            m_length;
@@ -106,6 +117,8 @@ private:
     void rb_seek_to_transport_location(const TTimeRef &transportLocation) final;
     void set_output_rate_and_convertor_type(int outputRate, int converterType) final;
     void set_decode_buffers(DecodeBuffer * fileReadBuffer, DecodeBuffer *resampleDecodeBuffer);
+    TTimeRef get_time_to_underrun(const TTimeRef& transportLocation) final;
+    bool can_process_in_worker_thread() const final {return true;}
 
 signals:
 	void stateChanged();
@@ -28,6 +28,13 @@ Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA.
 #include "Sheet.h"
 #include "Utils.h"
 #include "AudioDevice.h"
+#include "AudioFileCopyConvert.h"
+#include "TConfig.h"
+#include "TExportSpecification.h"
+
+#include <QFile>
+#include <QFileInfo>
+#include <QThread>
 
 // Always put me below _all_ includes, this is needed
 // in case we run with memory leak detection enabled!
@@ -44,12 +51,16 @@ ResourcesManager::ResourcesManager(Project* project)
 {
 	PENTERCONS;
     m_silentReadSource = nullptr;
+    m_transcoder = nullptr;
 }
 
 
 ResourcesManager::~ResourcesManager()
 {
 	PENTERDES;
+	// Interrupts running conversions, they use copies of our sources
+	delete m_transcoder;
+	
 	foreach(SourceData* data, m_sources) {
 		if (! data->source->ref()) {
 			delete data->source;
@@ -140,7 +151,14 @@ int ResourcesManager::set_state( const QDomNode & node )
 }
 
 
-ReadSource* ResourcesManager::import_source(const QString& dir, const QString& name)
+/**
+ *	Creates a ReadSource for the file \a dir + \a name, or returns the ReadSource if the file
+	was imported before.
+	
+	If \a transcode is true and the file is compressed (mp3, ogg, flac, wavpack) it's converted
+	in the background to a wav file in the project's audiosources dir, see transcode_source().
+ */
+ReadSource* ResourcesManager::import_source(const QString& dir, const QString& name, bool transcode)
 {
 	QString fileName = dir + name;
 	foreach(SourceData* data, m_sources) {
@@ -166,11 +184,111 @@ ReadSource* ResourcesManager::import_source(const QString& dir, const QString& n
 	}
 	
 	emit sourceAdded(source);
+	
+	if (transcode && source->is_compressed()) {
+		transcode_source(source);
+	}
 
 	return source;
 }
 
 
+/**
+ *	Queues a conversion of \a source to a wav file in the project's audiosources dir,
+	at the project rate in the Import/TranscodeFormat format ("float" or "24bit").
+	
+	The conversion reads from it's own copy of \a source, so \a source and AudioClips using
+	it keep working on the original file until the conversion is finished, see transcode_finished()
+ */
+void ResourcesManager::transcode_source(ReadSource* source)
+{
+	PENTER;
+	
+	if (!m_transcoder) {
+		int threadCount = config().get_property("Import", "TranscodeThreadCount", qMax(1, QThread::idealThreadCount() / 2)).toInt();
+		m_transcoder = new AudioFileCopyConvert(threadCount);
+		connect(m_transcoder, SIGNAL(transcodeFinished(qint64,QString)), this, SLOT(transcode_finished(qint64,QString)));
+	}
+	
+	ReadSource* copy = get_readsource(source->get_id());
+	if (!copy || copy->get_error() < 0) {
+		delete copy;
+		return;
+	}
+	
+	// Without dynamic resampling, the file is played back at it's own rate
+	uint rate = m_project->get_rate();
+	if (!config().get_property("Conversion", "DynamicResampling", true).toBool()) {
+		rate = copy->get_file_rate();
+	}
+	int converterType = config().get_property("Conversion", "ExportResamplingConverterType", 1).toInt();
+	copy->set_output_rate_and_convertor_type(rate, converterType);
+	
+	auto spec = new TExportSpecification;
+	spec->set_file_format(SF_FORMAT_WAV);
+	if (config().get_property("Import", "TranscodeFormat", "float").toString() == "24bit") {
+		spec->set_data_format(SF_FORMAT_PCM_24);
+	} else {
+		spec->set_data_format(SF_FORMAT_FLOAT);
+	}
+	
+	QString dir = m_project->get_root_dir() + "/audiosources";
+	QString name = QFileInfo(source->get_name()).completeBaseName();
+	if (QFile::exists(dir + "/" + name + ".wav")) {
+		name += "-" + QString::number(source->get_id());
+	}
+	
+	m_transcoder->enqueue_transcode_task(copy, spec, dir, name);
+}
+
+
+/**
+ *	Switches the ReadSource with id \a sourceId and all it's copies used by AudioClips
+	to the converted file \a fileName.
+ */
+void ResourcesManager::transcode_finished(qint64 sourceId, const QString& fileName)
+{
+	PENTER;
+	
+	SourceData* data = m_sources.value(sourceId);
+	
+	// The source was removed while it was being converted
+	if (!data) {
+		QFile::remove(fileName);
+		return;
+	}
+	
+	// Copies of the source created from now on use the converted file too
+	if (data->source->switch_file(fileName) < 0) {
+		info().warning(tr("ResourcesManager:: Failed to use converted file %1 for %2")
+				.arg(fileName).arg(data->source->get_name()));
+		QFile::remove(fileName);
+		return;
+	}
+	
+	QList<AudioClip*> clips;
+	
+	foreach(ClipData* clipdata, m_clips) {
+		AudioClip* clip = clipdata->clip;
+		ReadSource* source = clip->get_readsource();
+		if (!clipdata->inUse || clip->get_readsource_id() != sourceId || !source) {
+			continue;
+		}
+		if (source != data->source && source->switch_file(fileName) < 0) {
+			info().warning(tr("ResourcesManager:: Failed to use converted file %1 for %2")
+					.arg(fileName).arg(source->get_name()));
+			continue;
+		}
+		clips.append(clip);
+	}
+	
+	// Reloads the peak data, it was written for the converted file while converting
+	foreach(AudioClip* clip, clips) {
+		set_source_for_clip(clip, clip->get_readsource());
+	}
+}
+
+
 ReadSource* ResourcesManager::create_recording_source(
 	const QString& dir,
 	const QString& name,
@@ -30,6 +30,7 @@ Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA.
 
 
 class AudioSource;
+class AudioFileCopyConvert;
 class ReadSource;
 class AudioClip;
 class Project;
@@ -50,7 +51,7 @@ public:
 				uint channelCount,
 				qint64 sheetId);
 	
-	ReadSource* import_source(const QString& dir, const QString& name);
+	ReadSource* import_source(const QString& dir, const QString& name, bool transcode=false);
 	ReadSource* get_silent_readsource();
 	AudioClip* new_audio_clip(const QString& name);
 	AudioClip* get_clip(qint64 id);
@@ -90,6 +91,12 @@ private:
 	QHash<qint64, SourceData* >	m_sources;
 	QHash<qint64, ClipData* >	m_clips;
 	ReadSource*			m_silentReadSource;
+	AudioFileCopyConvert*		m_transcoder;
+	
+	void transcode_source(ReadSource* source);
+	
+private slots:
+	void transcode_finished(qint64 sourceId, const QString& fileName);
 	
 	
 signals:
@@ -46,6 +46,7 @@ Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA.
 #include "WriteSource.h"
 #include "AudioClipManager.h"
 #include "Tsar.h"
+#include "TFlightRecorder.h"
 #include "SnapList.h"
 #include "TBusTrack.h"
 #include "TConfig.h"
@@ -55,6 +56,7 @@ Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA.
 #include "Marker.h"
 #include "TInputEventDispatcher.h"                       
 #include "TSend.h"
+#include "TRealTimeThreadPool.h"
 #include <Plugin.h>
 #include <PluginChain.h>
 
@@ -111,6 +113,15 @@ Sheet::~Sheet()
 
     delete [] mixdown;
     delete [] gainbuffer;
+    for (int i=0; i<m_workerMixdownBuffers.size(); ++i) {
+        delete [] m_workerMixdownBuffers.at(i);
+        delete [] m_workerGainBuffers.at(i);
+    }
+
+    // The AudioClips of frozen tracks hand their ReadSource back to the read DiskIO
+    for (auto track : m_audioTracks) {
+        track->unload_frozen_clip();
+    }
 
     delete m_readDiskIO;
     delete m_writeDiskIO;
@@ -132,6 +143,8 @@ void Sheet::init()
     tsar().prepare_event(m_transportStoppedTsarEvent, this, nullptr, "", "transportStopped()");
     tsar().prepare_event(m_seekStartTsarEvent, this, nullptr, "", "seekStart()");
     tsar().prepare_event(m_transportLocationChangedTsarEvent, this, nullptr, "", "transportLocationChanged()");
+    m_transportLocationNotifyPending.store(false);
+    connect(this, SIGNAL(transportLocationChanged()), this, SLOT(transport_location_notified()));
 
     set_seeking(false);
     set_start_seek(false);
@@ -502,6 +515,11 @@ void Sheet::solo_track(Track *track)
 //
 int Sheet::process( nframes_t nframes )
 {
+    // The freewheel render thread owns the process buffers now
+    if (is_freewheeling()) {
+        return 0;
+    }
+
     if (start_seek()) {
         printf("Sheet::process: starting seek\n");
         inititate_seek();
@@ -526,20 +544,22 @@ int Sheet::process( nframes_t nframes )
 		return 0;
     }
 
-	int processResult = 0;
-
     TTimeRef startLocation = get_transport_location();
     TTimeRef endLocation = startLocation + TTimeRef(nframes, audiodevice().get_sample_rate());
 
 	// Process all Tracks.
-    for(AudioTrack* track = m_rtAudioTracks.first(); track != nullptr; track = track->next) {
-        processResult |= track->process(startLocation, endLocation, nframes);
-	}
+    int processResult = process_audio_tracks(startLocation, endLocation, nframes);
 
 	// update the transport location
     m_transportLocation.add_frames(nframes, audiodevice().get_sample_rate());
+    publish_transport_location();
     m_readDiskIO->set_transport_location(m_transportLocation);
-    tsar().post_rt_event(m_transportLocationChangedTsarEvent);
+
+    // The GUI reads the location snapshot, so only notify it again when
+    // it handled the previous notification instead of every cycle
+    if (!m_transportLocationNotifyPending.exchange(true)) {
+        tsar().post_rt_event(m_transportLocationChangedTsarEvent);
+    }
 
 	if (!processResult) {
 		return 0;
@@ -557,6 +577,212 @@ int Sheet::process( nframes_t nframes )
 	return 1;
 }
 
+/**
+ *	Processes the AudioTracks, spread over the realtime thread pool if it has workers.
+ *
+ *	AudioTracks only touch their own buffers up to their post sends, so these are
+ *	processed in parallel. The post sends mix into the shared bus buffers, they're
+ *	processed afterwards in track order. Tracks with pre sends are processed completely
+ *	in that same serial pass. This way the busses are summed in the exact same order
+ *	as when processing all tracks serially, and renders stay bit exact.
+ */
+int Sheet::process_audio_tracks(const TTimeRef& startLocation, const TTimeRef& endLocation, nframes_t nframes)
+{
+    int processResult = 0;
+
+    if (rt_thread_pool().get_worker_count() == 0) {
+        for(AudioTrack* track = m_rtAudioTracks.first(); track != nullptr; track = track->next) {
+            processResult |= track->process(startLocation, endLocation, nframes);
+        }
+        return processResult;
+    }
+
+    int jobCount = 0;
+    for(AudioTrack* track = m_rtAudioTracks.first(); track != nullptr; track = track->next) {
+        if (jobCount < MAX_PARALLEL_TRACKS && !track->has_pre_sends()) {
+            m_parallelTracks[jobCount++] = track;
+        }
+    }
+
+    m_cycleStartLocation = startLocation;
+    m_cycleEndLocation = endLocation;
+    m_cycleFrames = nframes;
+
+    rt_thread_pool().run_jobs(process_track_job, this, jobCount);
+
+    int job = 0;
+    for(AudioTrack* track = m_rtAudioTracks.first(); track != nullptr; track = track->next) {
+        if (job < jobCount && m_parallelTracks[job] == track) {
+            int result = m_parallelResults[job++];
+            if (result) {
+                track->process_post_sends(nframes);
+            }
+            processResult |= result;
+        } else {
+            processResult |= track->process(startLocation, endLocation, nframes);
+        }
+    }
+
+    return processResult;
+}
+
+/**
+ *	Prepares the Sheet for freewheel rendering with blocks up to \a blockSize frames,
+ *	starting at \a startLocation. While freewheeling the audio device no longer processes
+ *	the Sheet, process_freewheel() has to be called from the render thread instead.
+ *
+ *	The audio thread hands over the Sheet first: once the freewheel flag is set, this
+ *	function waits for a full process cycle, so no Sheet::process() call still uses the
+ *	process buffers when they are resized.
+ *
+ * @return 1 on success, -1 if the transport is rolling or seeking
+ */
+int Sheet::start_freewheel(nframes_t blockSize, const TTimeRef& startLocation)
+{
+    PENTER;
+
+    if (is_freewheeling()) {
+        return -1;
+    }
+
+    // transport_control() refuses to start the transport once the flag is set,
+    // so either it sees the flag or we see the transport rolling
+    m_freewheeling.store(true);
+
+    if (is_transport_rolling() || is_seeking()) {
+        m_freewheeling.store(false);
+        return -1;
+    }
+
+    audiodevice().wait_for_process_cycle();
+
+    resize_buffer(qMax(blockSize, audiodevice().get_buffer_size()));
+
+    for(AudioTrack* track = m_rtAudioTracks.first(); track != nullptr; track = track->next) {
+        track->prepare_freewheel();
+    }
+
+    m_freewheelResumeLocation = m_transportLocation;
+    m_transportLocation = startLocation;
+    publish_transport_location();
+
+    return 1;
+}
+
+/**
+ *	Renders the next \a nframes frames of the Sheet into the render bus, as fast as
+ *	the cpu allows. The AudioClips decode their audio synchronously and the Sheet
+ *	Master captures it's output in the render bus instead of sending it to the
+ *	(hardware) busses.
+ *
+ *	The tracks are processed in the calling thread, the realtime thread pool is reserved
+ *	for the audio thread and its workers shouldn't wait for disk reads.
+ *
+ * @return 0 if none of the AudioTracks produced audio
+ */
+int Sheet::process_freewheel(nframes_t nframes)
+{
+    Q_ASSERT(is_freewheeling());
+
+    TTimeRef startLocation = m_transportLocation;
+    TTimeRef endLocation = startLocation + TTimeRef(nframes, audiodevice().get_sample_rate());
+
+    m_renderBus->silence_buffers(nframes);
+
+    int processResult = 0;
+    for(AudioTrack* track = m_rtAudioTracks.first(); track != nullptr; track = track->next) {
+        processResult |= track->process(startLocation, endLocation, nframes);
+    }
+
+    m_transportLocation.add_frames(nframes, audiodevice().get_sample_rate());
+    publish_transport_location();
+
+    // Unlike realtime processing the busses are always processed, so
+    // plugin tails end up in the render too
+    for(TBusTrack* busTrack = m_rtBusTracks.first(); busTrack != nullptr; busTrack = busTrack->next) {
+        busTrack->process(startLocation, endLocation, nframes);
+    }
+
+    m_masterOutBusTrack->process(startLocation, endLocation, nframes, m_renderBus);
+
+    return processResult;
+}
+
+/**
+ *	Renders the next \a nframes frames of \a track only into it's process bus, see
+ *	AudioTrack::render(). The busses and the Sheet Master are not processed.
+ *
+ * @return 0 if \a track didn't produce audio
+ */
+int Sheet::process_freewheel_track(AudioTrack* track, nframes_t nframes)
+{
+    Q_ASSERT(is_freewheeling());
+
+    TTimeRef startLocation = m_transportLocation;
+    TTimeRef endLocation = startLocation + TTimeRef(nframes, audiodevice().get_sample_rate());
+
+    int processResult = track->render(startLocation, endLocation, nframes);
+
+    m_transportLocation.add_frames(nframes, audiodevice().get_sample_rate());
+    publish_transport_location();
+
+    return processResult;
+}
+
+/**
+ *	Hands the Sheet back to the audio thread. The process buffers are resized and
+ *	the transport location restored while the Sheet is still owned by the render
+ *	thread, this function returns once the audio thread processed the Sheet again.
+ */
+void Sheet::stop_freewheel()
+{
+    PENTER;
+
+    if (!is_freewheeling()) {
+        return;
+    }
+
+    for(AudioTrack* track = m_rtAudioTracks.first(); track != nullptr; track = track->next) {
+        track->finish_freewheel();
+    }
+
+    resize_buffer(audiodevice().get_buffer_size());
+
+    // The ringbuffers still hold the audio for the old transport location
+    m_transportLocation = m_freewheelResumeLocation;
+    publish_transport_location();
+
+    m_freewheeling.store(false);
+
+    audiodevice().wait_for_process_cycle();
+
+    emit transportLocationChanged();
+}
+
+/**
+ *	Locks the Sheet while a render uses it from another thread, see AudioTrack::freeze().
+ *	Starting the transport and dispatching edits are refused while the Sheet is locked.
+ *
+ *	Note: This function should only be called from the GUI thread!
+ */
+void Sheet::set_render_locked(bool locked)
+{
+    if (m_renderLocked == locked) {
+        return;
+    }
+
+    m_renderLocked = locked;
+
+    emit renderLockChanged(m_renderLocked);
+}
+
+void Sheet::process_track_job(void* data, int jobIndex)
+{
+    auto sheet = static_cast<Sheet*>(data);
+    AudioTrack* track = sheet->m_parallelTracks[jobIndex];
+    sheet->m_parallelResults[jobIndex] = track->process(sheet->m_cycleStartLocation, sheet->m_cycleEndLocation, sheet->m_cycleFrames, false);
+}
+
 void Sheet::resize_buffer(nframes_t size)
 {
     if (mixdown) {
@@ -569,10 +795,29 @@ void Sheet::resize_buffer(nframes_t size)
 	mixdown = new audio_sample_t[size];
 	gainbuffer = new audio_sample_t[size];
 
+    // Each realtime worker thread processing tracks needs it's own scratch buffers
+    for (int i=0; i<m_workerMixdownBuffers.size(); ++i) {
+        delete [] m_workerMixdownBuffers.at(i);
+        delete [] m_workerGainBuffers.at(i);
+    }
+    m_workerMixdownBuffers.clear();
+    m_workerGainBuffers.clear();
+
+    for (int i=0; i<rt_thread_pool().get_worker_count(); ++i) {
+        m_workerMixdownBuffers.append(new audio_sample_t[size]);
+        m_workerGainBuffers.append(new audio_sample_t[size]);
+    }
+
     QList<AudioChannel*> audioChannels;
     audioChannels.append(m_masterOutBusTrack->get_process_bus()->get_channels());
     audioChannels.append(m_renderBus->get_channels());
     audioChannels.append(m_clipRenderBus->get_channels());
+    foreach(AudioTrack* track, m_audioTracks) {
+        audioChannels.append(track->get_process_bus()->get_channels());
+    }
+    foreach(TBusTrack* busTrack, m_busTracks) {
+        audioChannels.append(busTrack->get_process_bus()->get_channels());
+    }
 
     for(auto chan : audioChannels) {
         chan->set_buffer_size(size);
@@ -708,6 +953,11 @@ TCommand* Sheet::start_transport()
     // FIXME: is this really true, currently not so for the export thread
     // Q_ASSERT(QThread::currentThread() == m_threadPointer);
 
+    if (m_renderLocked) {
+        info().information(tr("Sheet %1 is busy rendering, the transport can't be started").arg(m_name));
+        return ied().failure();
+    }
+
     // Delegate the transport start (or if we are rolling stop)
 	// request to the audiodevice. Depending on the driver in use
 	// this call will return directly to us (by a call to transport_control),
@@ -725,6 +975,11 @@ TCommand* Sheet::start_transport()
 // So ALL functions called here need to be RT thread save!!
 int Sheet::transport_control(TTransportControl *transportControl)
 {
+    // The freewheel render owns the Sheet, see start_freewheel()
+    if (is_freewheeling()) {
+        return false;
+    }
+
     switch(transportControl->get_state()) {
     case TTransportControl::Stopped:
         if (transportControl->get_location() != m_transportLocation) {
@@ -915,17 +1170,26 @@ void Sheet::inititate_seek()
     m_transportRolling.store(false);
     set_start_seek(false);
 	
+    flight_recorder().record(TFlightRecorder::SEEK_START, this,
+                             (m_seekTransportLocation.universal_frame() * 1000) / TTimeRef::UNIVERSAL_SAMPLE_RATE);
+
     // only sets a boolean flag and the new seek location, save to call
     m_readDiskIO->set_seek_transport_location(m_seekTransportLocation);
     tsar().post_rt_event(m_seekStartTsarEvent);
 }
 
+void Sheet::transport_location_notified()
+{
+    m_transportLocationNotifyPending.store(false);
+}
+
 void Sheet::seek_finished()
 {
     Q_ASSERT_X(this->thread() == QThread::currentThread(), "Sheet::seek_finished", "Called from other Thread!");
 
     PMESG2("Sheet :: entering seek_finished");
     m_transportLocation  = m_seekTransportLocation;
+    publish_transport_location();
     printf("Sheet::seek_finished: Transport Location is now %s\n", QS_C(TTimeRef::timeref_to_ms_3(m_transportLocation)));
 	m_seeking = 0;
 
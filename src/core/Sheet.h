@@ -101,6 +101,14 @@ public:
 
     int process(nframes_t nframes);
 
+    int start_freewheel(nframes_t blockSize, const TTimeRef& startLocation);
+    int process_freewheel(nframes_t nframes);
+    int process_freewheel_track(AudioTrack* track, nframes_t nframes);
+    void stop_freewheel();
+
+    void set_render_locked(bool locked);
+    bool is_render_locked() const {return m_renderLocked;}
+
     // jackd only feature
     int transport_control(TTransportControl* state);
 
@@ -137,9 +145,21 @@ private:
     TsarEvent           m_seekStartTsarEvent;
     TsarEvent           m_transportLocationChangedTsarEvent;
 
+    // AudioTracks processed by the realtime thread pool, see process_audio_tracks()
+    static const int    MAX_PARALLEL_TRACKS = 256;
+    AudioTrack*         m_parallelTracks[MAX_PARALLEL_TRACKS];
+    int                 m_parallelResults[MAX_PARALLEL_TRACKS];
+    TTimeRef            m_cycleStartLocation;
+    TTimeRef            m_cycleEndLocation;
+    nframes_t           m_cycleFrames{};
+
+    // Transport location to return to after freewheel rendering
+    TTimeRef            m_freewheelResumeLocation;
+
     std::atomic<bool>   m_seeking;
     std::atomic<bool>   m_startSeek;
     std::atomic<bool>   m_stopTransport;
+    std::atomic<bool>   m_transportLocationNotifyPending;
 
     inline void set_start_seek(bool startSeek) {
         m_startSeek.store(startSeek);
@@ -160,6 +180,7 @@ private:
     bool		m_recording;
     bool		m_prepareRecording{};
     bool		m_readyToRecord{};
+    bool		m_renderLocked{};
 
     void init();
 
@@ -170,6 +191,8 @@ private:
     void update_skip_positions();
 
     void resize_buffer(nframes_t size);
+    int process_audio_tracks(const TTimeRef& startLocation, const TTimeRef& endLocation, nframes_t nframes);
+    static void process_track_job(void* data, int jobIndex);
 
     friend class AudioClipManager;
 
@@ -194,6 +217,7 @@ signals:
     void recordingStateChanged();
     void prepareRecording();
     void stateChanged();
+    void renderLockChanged(bool locked);
 
 private slots:
     void handle_diskio_writebuffer_overrun();
@@ -201,6 +225,7 @@ private slots:
     void prepare_recording();
     void clip_finished_recording(AudioClip* clip);
     void config_changed();
+    void transport_location_notified();
 };
 
 #endif
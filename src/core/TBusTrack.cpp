@@ -28,6 +28,7 @@ Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA.
 #include "AudioDevice.h"
 
 #include "Mixer.h"
+#include "TDspProfiler.h"
 
 
 TBusTrack::TBusTrack(TSession* session, const QString& name, int channelCount)
@@ -106,8 +107,10 @@ void TBusTrack::set_name( const QString & name )
         Track::set_name(name);
 }
 
-int TBusTrack::process(const TTimeRef& startLocation, const TTimeRef& endLocation, nframes_t nframes)
+int TBusTrack::process(const TTimeRef& startLocation, const TTimeRef& endLocation, nframes_t nframes, AudioBus* renderBus)
 {
+    TDspProfileScope profileScope(TDspProfiler::TRACK, this);
+
     if (m_isMuted || (get_gain() == 0.0f) ) {
         return 0;
     }
@@ -142,7 +145,14 @@ int TBusTrack::process(const TTimeRef& startLocation, const TTimeRef& endLocatio
 
     m_processBus->process_monitoring(m_vumonitors);
 
-    process_post_sends(nframes);
+    // A render bus captures the result instead of the post sends, see Sheet::process_freewheel()
+    if (renderBus) {
+        for(uint chan=0; chan<m_processBus->get_channel_count() && chan<renderBus->get_channel_count(); chan++) {
+            Mixer::mix_buffers_no_gain(renderBus->get_buffer(chan, nframes), m_processBus->get_buffer(chan, nframes), nframes);
+        }
+    } else {
+        process_post_sends(nframes);
+    }
 
     m_processBus->silence_buffers(nframes);
 
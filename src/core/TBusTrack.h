@@ -37,7 +37,7 @@ public:
     QDomNode get_state(QDomDocument doc, bool istemplate=false);
     virtual int set_state( const QDomNode & node );
     void set_name(const QString& name);
-    int process(const TTimeRef &startLocation, const TTimeRef &endLocation, nframes_t nframes);
+    int process(const TTimeRef &startLocation, const TTimeRef &endLocation, nframes_t nframes, AudioBus* renderBus=nullptr);
 
     bool operator<(const TBusTrack& other) {
         return this->get_sort_index() < other.get_sort_index();
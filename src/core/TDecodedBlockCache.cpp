@@ -0,0 +1,224 @@
+/*
+Copyright (C) 2024 Remon Sijrier
+
+This file is part of Traverso
+
+Traverso is free software; you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation; either version 2 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program; if not, write to the Free Software
+Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA.
+
+*/
+
+#include "TDecodedBlockCache.h"
+
+#include "ResampleAudioReader.h"
+#include "TConfig.h"
+
+#include <QHash>
+#include <QVarLengthArray>
+#include <cstring>
+#include <algorithm>
+
+// Always put me below _all_ includes, this is needed
+// in case we run with memory leak detection enabled!
+#include "Debugger.h"
+
+/** \class TDecodedBlockCache
+ *	\brief A process wide, size bounded cache of decoded (and resampled) audio blocks
+ *
+ *	Every AudioClip has it's own ReadSource with it's own ResampleAudioReader, so clips
+ *	referring to the same audio file would decode the same file regions over and over again.
+ *	ReadSource::file_read() goes through this cache instead, blocks of BLOCK_SIZE frames are
+ *	stored keyed by file name, output rate, converter type and block index. The least recently
+ *	used blocks are dropped once the memory budget, Conversion/DecodedBlockCacheSize in MB,
+ *	is exceeded. A size of 0 disables the cache.
+ */
+
+uint qHash(const TDecodedBlockCache::BlockKey& key, uint seed)
+{
+    return qHash(key.fileName, seed) ^ qHash(key.blockIndex) ^ (key.outputRate << 8) ^ uint(key.converterType);
+}
+
+
+TDecodedBlockCache& decoded_block_cache()
+{
+    static TDecodedBlockCache cache;
+    return cache;
+}
+
+
+TDecodedBlockCache::DecodedBlock::DecodedBlock(uint channelCount, nframes_t frameCount)
+    : m_channelCount(channelCount)
+    , m_frameCount(frameCount)
+{
+    m_data = new audio_sample_t[channelCount * BLOCK_SIZE];
+}
+
+TDecodedBlockCache::DecodedBlock::~DecodedBlock()
+{
+    delete [] m_data;
+}
+
+
+TDecodedBlockCache::TDecodedBlockCache()
+{
+    set_max_size(config().get_property("Conversion", "DecodedBlockCacheSize", 128).toInt());
+}
+
+void TDecodedBlockCache::set_max_size(int megaBytes)
+{
+    QMutexLocker locker(&m_mutex);
+    // cost is in KiloBytes to stay well within the int range of QCache
+    m_blocks.setMaxCost(qMax(0, megaBytes) * 1024);
+    m_enabled.store(m_blocks.maxCost() > 0);
+}
+
+/**
+ *	Drops all cached blocks of \a fileName, call this when the file changed on disk.
+ */
+void TDecodedBlockCache::invalidate(const QString& fileName)
+{
+    QMutexLocker locker(&m_mutex);
+
+    const auto keys = m_blocks.keys();
+    for (const auto& key : keys) {
+        if (key.fileName == fileName) {
+            m_blocks.remove(key);
+        }
+    }
+}
+
+/**
+ *	Reads \a count frames starting at \a start into \a buffer, decoding the missing
+ *	blocks with \a reader. The frames are copied straight into the destination of
+ *	\a buffer, e.g. the external destination set by ReadSource for it's ringbuffer slots.
+ *
+ *	The reader is only accessed by the calling thread, the cache itself can be used
+ *	from any thread. The mutex is only held to look up and insert blocks, decoding
+ *	and copying is done outside of it.
+ *
+ * @return The number of frames read
+ */
+nframes_t TDecodedBlockCache::read(ResampleAudioReader* reader, const QString& fileName, DecodeBuffer* buffer, nframes_t start, nframes_t count)
+{
+    if (!m_enabled.load()) {
+        return reader->read_from(buffer, start, count);
+    }
+
+    nframes_t fileFrames = reader->get_nframes();
+    if (count == 0 || start >= fileFrames) {
+        return 0;
+    }
+
+    count = std::min(count, fileFrames - start);
+    buffer->check_buffers_capacity(count, reader->get_num_channels());
+
+    BlockKey key;
+    key.fileName = fileName;
+    key.outputRate = reader->get_output_rate();
+    key.converterType = reader->get_convertor_type();
+
+    nframes_t read = 0;
+
+    while (read < count) {
+        nframes_t location = start + read;
+        key.blockIndex = location / BLOCK_SIZE;
+        nframes_t offset = location % BLOCK_SIZE;
+
+        std::shared_ptr<const DecodedBlock> block = lookup(key);
+
+        if (!block) {
+            block = decode_block(reader, key.blockIndex);
+            if (!block) {
+                break;
+            }
+            // QCache may evict the block right away, we keep our reference
+            // to it until the copy is done
+            insert(key, block);
+        }
+
+        if (offset >= block->m_frameCount) {
+            // end of file
+            break;
+        }
+
+        nframes_t toCopy = std::min(count - read, block->m_frameCount - offset);
+
+        for (uint chan = 0; chan < block->m_channelCount; ++chan) {
+            memcpy(buffer->destination[chan] + read, block->get_buffer(chan) + offset, toCopy * sizeof(audio_sample_t));
+        }
+
+        read += toCopy;
+    }
+
+    return read;
+}
+
+std::shared_ptr<const TDecodedBlockCache::DecodedBlock> TDecodedBlockCache::lookup(const BlockKey& key)
+{
+    QMutexLocker locker(&m_mutex);
+
+    CacheEntry* entry = m_blocks.object(key);
+
+    if (!entry) {
+        return nullptr;
+    }
+
+    return entry->block;
+}
+
+void TDecodedBlockCache::insert(const BlockKey& key, const std::shared_ptr<const DecodedBlock>& block)
+{
+    auto entry = new CacheEntry;
+    entry->block = block;
+
+    QMutexLocker locker(&m_mutex);
+    // QCache takes ownership of the entry
+    m_blocks.insert(key, entry, int(block->m_channelCount * BLOCK_SIZE * sizeof(audio_sample_t) / 1024));
+}
+
+std::shared_ptr<const TDecodedBlockCache::DecodedBlock> TDecodedBlockCache::decode_block(ResampleAudioReader* reader, nframes_t blockIndex)
+{
+    // Each thread has it's own DecodeBuffer, the decoder writes straight into the block
+    static thread_local DecodeBuffer decodeBuffer;
+
+    uint channelCount = reader->get_num_channels();
+    auto block = std::make_shared<DecodedBlock>(channelCount, BLOCK_SIZE);
+
+    QVarLengthArray<audio_sample_t*, 8> destination(channelCount);
+    for (uint chan = 0; chan < channelCount; ++chan) {
+        destination[chan] = block->get_buffer(chan);
+    }
+
+    decodeBuffer.set_external_destination(destination.data(), BLOCK_SIZE, channelCount);
+    nframes_t decoded = reader->read_from(&decodeBuffer, blockIndex * BLOCK_SIZE, BLOCK_SIZE);
+
+    if (decoded > 0 && decodeBuffer.destination != destination.data()) {
+        // The decoder needed more space then the block provides and used the
+        // decode buffers own memory
+        for (uint chan = 0; chan < channelCount; ++chan) {
+            memcpy(block->get_buffer(chan), decodeBuffer.destination[chan], decoded * sizeof(audio_sample_t));
+        }
+    }
+    decodeBuffer.reset_destination();
+
+    if (decoded == 0) {
+        return nullptr;
+    }
+
+    block->m_frameCount = decoded;
+
+    return block;
+}
+
+//eof
@@ -0,0 +1,100 @@
+/*
+Copyright (C) 2024 Remon Sijrier
+
+This file is part of Traverso
+
+Traverso is free software; you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation; either version 2 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program; if not, write to the Free Software
+Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA.
+
+*/
+
+#ifndef TDECODEDBLOCKCACHE_H
+#define TDECODEDBLOCKCACHE_H
+
+#include <QCache>
+#include <QMutex>
+#include <QString>
+
+#include <atomic>
+#include <memory>
+
+#include "defines.h"
+
+class DecodeBuffer;
+class ResampleAudioReader;
+
+class TDecodedBlockCache
+{
+public:
+    static const nframes_t BLOCK_SIZE = 16384;
+
+    nframes_t read(ResampleAudioReader* reader, const QString& fileName, DecodeBuffer* buffer, nframes_t start, nframes_t count);
+
+    void invalidate(const QString& fileName);
+    void set_max_size(int megaBytes);
+
+private:
+    struct BlockKey {
+        QString     fileName;
+        uint        outputRate;
+        int         converterType;
+        nframes_t   blockIndex;
+
+        bool operator==(const BlockKey& other) const {
+            return blockIndex == other.blockIndex &&
+                    outputRate == other.outputRate &&
+                    converterType == other.converterType &&
+                    fileName == other.fileName;
+        }
+    };
+
+    struct DecodedBlock {
+        DecodedBlock(uint channelCount, nframes_t frameCount);
+        ~DecodedBlock();
+
+        audio_sample_t* get_buffer(uint channel) const {return m_data + channel * BLOCK_SIZE;}
+
+        audio_sample_t* m_data;
+        uint            m_channelCount;
+        nframes_t       m_frameCount;
+    };
+
+    // QCache deletes it's objects on eviction, the entries share the block with
+    // the readers still copying from it outside of the mutex
+    struct CacheEntry {
+        std::shared_ptr<const DecodedBlock> block;
+    };
+
+    QCache<BlockKey, CacheEntry>    m_blocks;
+    QMutex                          m_mutex;
+    std::atomic<bool>               m_enabled{};
+
+    std::shared_ptr<const DecodedBlock> lookup(const BlockKey& key);
+    void insert(const BlockKey& key, const std::shared_ptr<const DecodedBlock>& block);
+    std::shared_ptr<const DecodedBlock> decode_block(ResampleAudioReader* reader, nframes_t blockIndex);
+
+    TDecodedBlockCache();
+    TDecodedBlockCache(const TDecodedBlockCache&);
+
+    // allow this function to create one instance
+    friend TDecodedBlockCache& decoded_block_cache();
+    friend uint qHash(const BlockKey& key, uint seed);
+};
+
+// use this function to access the process wide decoded block cache
+TDecodedBlockCache& decoded_block_cache();
+
+#endif
+
+//eof
@@ -0,0 +1,206 @@
+/*
+Copyright (C) 2024 Remon Sijrier
+
+This file is part of Traverso
+
+Traverso is free software; you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation; either version 2 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program; if not, write to the Free Software
+Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA.
+
+*/
+
+#include "TExportPipeline.h"
+
+#include <QThread>
+
+#include "Information.h"
+#include "Sheet.h"
+#include "TConfig.h"
+#include "TFreewheelRenderer.h"
+#include "Utils.h"
+
+// Always put me below _all_ includes, this is needed
+// in case we run with memory leak detection enabled!
+#include "Debugger.h"
+
+/** \class TExportPipeline
+ *	\brief Exports a set of Sheets, rendering independent Sheets at the same time
+ *
+ *	Each Sheet is rendered once by a TFreewheelRenderer, which fans the rendered audio
+ *	out to one encoder thread per export specification, e.g. one per file format.
+ *	Up to Project/ConcurrentSheetRenders Sheets are rendered at the same time, by
+ *	default half the amount of cores so the encoders have room to run too.
+ *
+ *	The Sheets are render locked while they're rendered, see Sheet::set_render_locked().
+ *	A Sheet that is already locked, e.g. by a track freeze, fails to export.
+ *
+ *	The pipeline lives in the GUI thread, the progress() and finished() signals
+ *	are emitted from there.
+ */
+
+TExportPipeline::TExportPipeline(QObject* parent)
+    : QObject(parent)
+{
+    m_nextJob = m_runningJobs = m_failedJobs = 0;
+    m_cancelled = false;
+    m_normalize = false;
+    m_normalizeTargetdB = 0.0f;
+
+    int defaultRenders = qMax(1, QThread::idealThreadCount() / 2);
+    m_maxRunningJobs = qMax(1, config().get_property("Project", "ConcurrentSheetRenders", defaultRenders).toInt());
+}
+
+TExportPipeline::~TExportPipeline()
+{
+    cancel();
+
+    for (const Job& job : m_jobs) {
+        if (job.renderer) {
+            job.renderer->wait();
+            delete job.renderer;
+            job.sheet->set_render_locked(false);
+        }
+    }
+}
+
+/**
+ *	Adds \a sheet to the pipeline, to be exported with each of \a specs. All of
+ *	\a specs must have the same export range.
+ */
+void TExportPipeline::add_sheet(Sheet* sheet, const QList<TExportSpecification*>& specs)
+{
+    Q_ASSERT(!is_running());
+
+    Job job;
+    job.sheet = sheet;
+    job.specs = specs;
+    job.renderer = nullptr;
+    job.progress = 0;
+    m_jobs.append(job);
+}
+
+void TExportPipeline::start()
+{
+    PENTER;
+
+    m_cancelled = false;
+    m_failedJobs = 0;
+
+    start_next_jobs();
+
+    if (m_runningJobs == 0) {
+        emit finished();
+    }
+}
+
+void TExportPipeline::cancel()
+{
+    m_cancelled = true;
+
+    for (const Job& job : m_jobs) {
+        if (job.renderer) {
+            job.renderer->cancel();
+        }
+    }
+}
+
+/**
+ *	Normalizes each Sheet to \a targetdB, see TFreewheelRenderer::set_normalize()
+ */
+void TExportPipeline::set_normalize(bool normalize, float targetdB)
+{
+    m_normalize = normalize;
+    m_normalizeTargetdB = targetdB;
+}
+
+void TExportPipeline::start_next_jobs()
+{
+    while (!m_cancelled && m_runningJobs < m_maxRunningJobs && m_nextJob < m_jobs.size()) {
+        Job& job = m_jobs[m_nextJob++];
+
+        if (job.sheet->is_render_locked()) {
+            info().warning(tr("Sheet %1 is busy rendering, it's not exported").arg(job.sheet->get_name()));
+            job.progress = 100;
+            m_failedJobs++;
+            continue;
+        }
+
+        job.sheet->set_render_locked(true);
+
+        job.renderer = new TFreewheelRenderer(job.sheet, job.specs);
+        job.renderer->set_normalize(m_normalize, m_normalizeTargetdB);
+        connect(job.renderer, SIGNAL(progress(int)), this, SLOT(renderer_progress(int)), Qt::QueuedConnection);
+        connect(job.renderer, SIGNAL(renderFinished()), this, SLOT(renderer_finished()), Qt::QueuedConnection);
+
+        m_runningJobs++;
+        job.renderer->start();
+    }
+}
+
+int TExportPipeline::job_index(TFreewheelRenderer* renderer) const
+{
+    for (int i=0; i<m_jobs.size(); ++i) {
+        if (m_jobs.at(i).renderer == renderer) {
+            return i;
+        }
+    }
+    return -1;
+}
+
+void TExportPipeline::renderer_progress(int jobProgress)
+{
+    int index = job_index(qobject_cast<TFreewheelRenderer*>(sender()));
+    if (index < 0) {
+        return;
+    }
+
+    m_jobs[index].progress = jobProgress;
+
+    int totalProgress = 0;
+    for (const Job& job : m_jobs) {
+        totalProgress += job.progress;
+    }
+
+    emit progress(totalProgress / qMax(1, m_jobs.size()));
+}
+
+void TExportPipeline::renderer_finished()
+{
+    auto renderer = qobject_cast<TFreewheelRenderer*>(sender());
+    int index = job_index(renderer);
+    if (index < 0) {
+        return;
+    }
+
+    renderer->wait();
+
+    if (renderer->get_result() < 0) {
+        m_failedJobs++;
+        printf("TExportPipeline: exporting Sheet %s failed\n", QS_C(m_jobs.at(index).sheet->get_name()));
+    }
+
+    m_jobs[index].renderer = nullptr;
+    m_jobs[index].progress = 100;
+    m_jobs[index].sheet->set_render_locked(false);
+    renderer->deleteLater();
+
+    m_runningJobs--;
+
+    start_next_jobs();
+
+    if (m_runningJobs == 0) {
+        emit finished();
+    }
+}
+
+//eof
@@ -0,0 +1,79 @@
+/*
+Copyright (C) 2024 Remon Sijrier
+
+This file is part of Traverso
+
+Traverso is free software; you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation; either version 2 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program; if not, write to the Free Software
+Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA.
+
+*/
+
+#ifndef TEXPORTPIPELINE_H
+#define TEXPORTPIPELINE_H
+
+#include <QObject>
+#include <QList>
+
+class Sheet;
+class TExportSpecification;
+class TFreewheelRenderer;
+
+class TExportPipeline : public QObject
+{
+    Q_OBJECT
+
+public:
+    TExportPipeline(QObject* parent = nullptr);
+    ~TExportPipeline();
+
+    void add_sheet(Sheet* sheet, const QList<TExportSpecification*>& specs);
+    void start();
+    void cancel();
+    void set_normalize(bool normalize, float targetdB = 0.0f);
+
+    bool is_running() const {return m_runningJobs > 0;}
+    int get_failed_count() const {return m_failedJobs;}
+
+private:
+    struct Job {
+        Sheet*                          sheet;
+        QList<TExportSpecification*>    specs;
+        TFreewheelRenderer*             renderer;
+        int                             progress;
+    };
+
+    QList<Job>  m_jobs;
+    int         m_nextJob;
+    int         m_runningJobs;
+    int         m_failedJobs;
+    int         m_maxRunningJobs;
+    bool        m_cancelled;
+    bool        m_normalize;
+    float       m_normalizeTargetdB;
+
+    void start_next_jobs();
+    int job_index(TFreewheelRenderer* renderer) const;
+
+private slots:
+    void renderer_progress(int jobProgress);
+    void renderer_finished();
+
+signals:
+    void progress(int);
+    void finished();
+};
+
+#endif
+
+//eof
@@ -0,0 +1,256 @@
+/*
+Copyright (C) 2024 Remon Sijrier
+
+This file is part of Traverso
+
+Traverso is free software; you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation; either version 2 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program; if not, write to the Free Software
+Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA.
+
+*/
+
+#include "TExportStream.h"
+
+#include "AudioDevice.h"
+#include "TExportSpecification.h"
+#include "TSampleConverter.h"
+#include "WriteSource.h"
+
+// Always put me below _all_ includes, this is needed
+// in case we run with memory leak detection enabled!
+#include "Debugger.h"
+
+/** \class TExportStream
+ *	\brief A stream of interleaved audio blocks, rendered once and read by several encoders
+ *
+ *	The render thread fills the blocks with begin_write() / end_write(), every reader gets
+ *	each block with begin_read() / end_read(). A block is only written again once all readers
+ *	are done with it, so a slow encoder throttles the render instead of the memory usage growing.
+ */
+
+TExportStream::TExportStream(nframes_t blockSize, uint channelCount, int blockCount)
+    : m_blockSize(blockSize)
+    , m_channelCount(channelCount)
+{
+    m_writePosition = 0;
+    m_finished = false;
+    m_cancelled = false;
+
+    m_blocks.resize(qMax(2, blockCount));
+    for (int i=0; i<m_blocks.size(); ++i) {
+        m_blocks[i].data = new audio_sample_t[m_blockSize * m_channelCount];
+        m_blocks[i].nframes = 0;
+    }
+}
+
+TExportStream::~TExportStream()
+{
+    for (int i=0; i<m_blocks.size(); ++i) {
+        delete [] m_blocks.at(i).data;
+    }
+}
+
+/**
+ *	Adds a reader to the stream, this has to be done before the first block is written
+ *
+ * @return The reader index to be used with begin_read() and end_read()
+ */
+int TExportStream::add_reader()
+{
+    QMutexLocker locker(&m_mutex);
+
+    Q_ASSERT(m_writePosition == 0);
+
+    m_readPositions.append(0);
+    return m_readPositions.size() - 1;
+}
+
+/**
+ *	Removes \a reader from the stream, e.g. when it's encoder failed, so the
+ *	writer no longer waits for it
+ */
+void TExportStream::remove_reader(int reader)
+{
+    QMutexLocker locker(&m_mutex);
+
+    m_readPositions[reader] = -1;
+    m_blockRead.wakeAll();
+}
+
+/**
+ *	Waits until the next block is no longer in use by any of the readers
+ *
+ * @return The interleaved block buffer to write into, or nullptr if the stream was cancelled
+ */
+audio_sample_t* TExportStream::begin_write()
+{
+    QMutexLocker locker(&m_mutex);
+
+    while (!m_cancelled && (m_writePosition - slowest_read_position()) >= m_blocks.size()) {
+        m_blockRead.wait(&m_mutex);
+    }
+
+    if (m_cancelled) {
+        return nullptr;
+    }
+
+    // The readers don't touch this block until end_write() is called
+    return m_blocks.at(int(m_writePosition % m_blocks.size())).data;
+}
+
+void TExportStream::end_write(nframes_t nframes)
+{
+    QMutexLocker locker(&m_mutex);
+
+    m_blocks[int(m_writePosition % m_blocks.size())].nframes = nframes;
+    m_writePosition++;
+    m_blockWritten.wakeAll();
+}
+
+/**
+ *	Marks the end of the stream, begin_read() returns nullptr once all blocks have been read
+ */
+void TExportStream::finish()
+{
+    QMutexLocker locker(&m_mutex);
+
+    m_finished = true;
+    m_blockWritten.wakeAll();
+}
+
+void TExportStream::cancel()
+{
+    QMutexLocker locker(&m_mutex);
+
+    m_cancelled = true;
+    m_blockWritten.wakeAll();
+    m_blockRead.wakeAll();
+}
+
+bool TExportStream::is_cancelled()
+{
+    QMutexLocker locker(&m_mutex);
+
+    return m_cancelled;
+}
+
+/**
+ *	Waits for the next block of \a reader
+ *
+ * @return The interleaved block and it's frame count in \a nframes, or nullptr at the
+ *	end of the stream or if the stream was cancelled
+ */
+const audio_sample_t* TExportStream::begin_read(int reader, nframes_t* nframes)
+{
+    QMutexLocker locker(&m_mutex);
+
+    qint64 position = m_readPositions.at(reader);
+
+    while (!m_cancelled && !m_finished && position >= m_writePosition) {
+        m_blockWritten.wait(&m_mutex);
+    }
+
+    if (m_cancelled || position >= m_writePosition) {
+        return nullptr;
+    }
+
+    const Block& block = m_blocks.at(int(position % m_blocks.size()));
+    *nframes = block.nframes;
+    return block.data;
+}
+
+void TExportStream::end_read(int reader)
+{
+    QMutexLocker locker(&m_mutex);
+
+    m_readPositions[reader]++;
+    m_blockRead.wakeAll();
+}
+
+qint64 TExportStream::slowest_read_position() const
+{
+    qint64 slowest = m_writePosition;
+
+    for (qint64 position : m_readPositions) {
+        if (position >= 0 && position < slowest) {
+            slowest = position;
+        }
+    }
+
+    return slowest;
+}
+
+
+/** \class TExportEncoder
+ *	\brief Encodes a TExportStream into a file, in it's own thread
+ *
+ *	Each encoder writes the stream with a WriteSource using the AbstractAudioWriter, sample
+ *	format and sample rate of \a spec. The block size and render buffer of \a spec are owned
+ *	by the encoder, the export range has to be set by the caller.
+ */
+
+TExportEncoder::TExportEncoder(TExportStream* stream, TExportSpecification* spec)
+    : m_stream(stream)
+    , m_spec(spec)
+{
+    m_reader = m_stream->add_reader();
+    m_result = 0;
+}
+
+void TExportEncoder::run()
+{
+    const nframes_t blockSize = m_stream->get_block_size();
+    const uint streamChannelCount = m_stream->get_channel_count();
+    const uint channelCount = m_spec->get_channel_count();
+    const uint sampleRate = audiodevice().get_sample_rate();
+
+    m_renderBuffer.resize(int(blockSize * channelCount));
+    m_spec->set_block_size(blockSize);
+    m_spec->set_render_buffer(m_renderBuffer.data());
+
+    WriteSource writesource(m_spec);
+
+    if (writesource.prepare_export() == -1) {
+        m_stream->remove_reader(m_reader);
+        m_result = -1;
+        return;
+    }
+
+    nframes_t nframes;
+    while (const audio_sample_t* block = m_stream->begin_read(m_reader, &nframes)) {
+        audio_sample_t* renderBuffer = m_spec->get_render_buffer();
+
+        // WriteSource converts the render buffer in place, so each encoder uses it's own copy
+        for (uint chan = 0; chan < channelCount; ++chan) {
+            if (chan < streamChannelCount) {
+                TSampleConverter::float_to_float(renderBuffer + chan, channelCount, block + chan, streamChannelCount, nframes);
+            } else {
+                for (nframes_t frame = 0; frame < nframes; ++frame) {
+                    renderBuffer[frame * channelCount + chan] = 0.0f;
+                }
+            }
+        }
+
+        m_stream->end_read(m_reader);
+
+        writesource.process(nframes);
+
+        m_spec->add_exported_range(TTimeRef(nframes, sampleRate));
+    }
+
+    writesource.finish_export();
+
+    m_result = m_stream->is_cancelled() ? 0 : 1;
+}
+
+//eof
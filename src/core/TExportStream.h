@@ -0,0 +1,97 @@
+/*
+Copyright (C) 2024 Remon Sijrier
+
+This file is part of Traverso
+
+Traverso is free software; you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation; either version 2 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program; if not, write to the Free Software
+Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA.
+
+*/
+
+#ifndef TEXPORTSTREAM_H
+#define TEXPORTSTREAM_H
+
+#include <QMutex>
+#include <QThread>
+#include <QVector>
+#include <QWaitCondition>
+
+#include "defines.h"
+
+class TExportSpecification;
+
+class TExportStream
+{
+public:
+    TExportStream(nframes_t blockSize, uint channelCount, int blockCount = 8);
+    ~TExportStream();
+
+    int add_reader();
+    void remove_reader(int reader);
+
+    audio_sample_t* begin_write();
+    void end_write(nframes_t nframes);
+    void finish();
+    void cancel();
+
+    const audio_sample_t* begin_read(int reader, nframes_t* nframes);
+    void end_read(int reader);
+
+    nframes_t get_block_size() const {return m_blockSize;}
+    uint get_channel_count() const {return m_channelCount;}
+    bool is_cancelled();
+
+private:
+    struct Block {
+        audio_sample_t* data;
+        nframes_t       nframes;
+    };
+
+    QVector<Block>  m_blocks;
+    // Amount of blocks read by each reader, -1 for removed readers
+    QVector<qint64> m_readPositions;
+    qint64          m_writePosition;
+    nframes_t       m_blockSize;
+    uint            m_channelCount;
+    bool            m_finished;
+    bool            m_cancelled;
+    QMutex          m_mutex;
+    QWaitCondition  m_blockWritten;
+    QWaitCondition  m_blockRead;
+
+    qint64 slowest_read_position() const;
+};
+
+
+class TExportEncoder : public QThread
+{
+public:
+    TExportEncoder(TExportStream* stream, TExportSpecification* spec);
+
+    int get_result() const {return m_result;}
+
+protected:
+    void run() override;
+
+private:
+    TExportStream*          m_stream;
+    TExportSpecification*   m_spec;
+    QVector<audio_sample_t> m_renderBuffer;
+    int                     m_reader;
+    int                     m_result;
+};
+
+#endif
+
+//eof
@@ -0,0 +1,343 @@
+/*
+Copyright (C) 2024 Remon Sijrier
+
+This file is part of Traverso
+
+Traverso is free software; you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation; either version 2 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program; if not, write to the Free Software
+Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA.
+
+*/
+
+#include "TFreewheelRenderer.h"
+
+#include <QTemporaryFile>
+#include <QVarLengthArray>
+#include <QVector>
+#include <cfloat>
+
+#include "AudioBus.h"
+#include "AudioDevice.h"
+#include "AudioTrack.h"
+#include "Mixer.h"
+#include "Sheet.h"
+#include "TExportSpecification.h"
+#include "TExportStream.h"
+#include "TSampleConverter.h"
+
+// Always put me below _all_ includes, this is needed
+// in case we run with memory leak detection enabled!
+#include "Debugger.h"
+
+/** \class TFreewheelRenderer
+ *	\brief Renders a Sheet into one or more files as fast as the cpu allows
+ *
+ *	The renderer drives Sheet::process_freewheel() with blocks of FREEWHEEL_BLOCK_SIZE
+ *	frames, independent of the audio device. The AudioClips decode their audio with
+ *	ReadSource::file_read() instead of waiting for DiskIO to fill the ringbuffers.
+ *
+ *	The Sheet is rendered only once, into a TExportStream. Each of the export specifications
+ *	gets a TExportEncoder thread reading that stream, which writes it with the
+ *	AbstractAudioWriter of it's specification. So rendering to e.g. wav and flac at
+ *	the same time costs one render and two encoders running in parallel.
+ *
+ *	The caller sets up the specifications like for a realtime export, except for the block
+ *	size and render buffer which are owned by the encoders. All specifications must have
+ *	the same export range. The Sheet must not be processed by the audio device while
+ *	rendering, Sheet::process() is a no-op while freewheeling.
+ *
+ *	A normalized export doesn't need a separate render pass to find the peak value. The
+ *	render is written to a float intermediate file while tracking the peak, a streaming
+ *	second stage reads it back, applies the normalization gain and feeds the encoders.
+ *	Reading and scaling is cheap compared to the render, so a normalized export costs
+ *	close to one render.
+ *
+ *	With set_track() only that AudioTrack is rendered, up to but not including it's post
+ *	sends, this is used to freeze a track.
+ */
+
+TFreewheelRenderer::TFreewheelRenderer(Sheet* sheet, TExportSpecification* spec)
+    : TFreewheelRenderer(sheet, QList<TExportSpecification*>() << spec)
+{
+}
+
+TFreewheelRenderer::TFreewheelRenderer(Sheet* sheet, const QList<TExportSpecification*>& specs)
+    : m_sheet(sheet)
+    , m_track(nullptr)
+    , m_specs(specs)
+{
+    m_cancelRender = false;
+    m_result = 0;
+    m_lastProgress = -1;
+    m_normalize = false;
+    m_normalizeTargetdB = 0.0f;
+}
+
+/**
+ *	Normalizes the render so it's peak value equals \a targetdB
+ */
+void TFreewheelRenderer::set_normalize(bool normalize, float targetdB)
+{
+    m_normalize = normalize;
+    m_normalizeTargetdB = targetdB;
+}
+
+void TFreewheelRenderer::run()
+{
+    m_result = render();
+
+    emit renderFinished();
+}
+
+/**
+ *	Renders the export range of the specifications in the calling thread, the
+ *	encoders run in their own threads
+ *
+ * @return 1 on success, 0 if the render was cancelled, -1 if the render or one
+ *	of the encoders failed
+ */
+int TFreewheelRenderer::render()
+{
+    PENTER;
+
+    if (m_specs.isEmpty()) {
+        return -1;
+    }
+
+    // The encoders advance the export location of their specification,
+    // the render keeps track of it's own location
+    TExportSpecification* spec = m_specs.first();
+    TTimeRef startLocation = spec->get_export_location();
+    nframes_t totalFrames = spec->get_remaining_export_frames();
+
+    if (m_sheet->start_freewheel(FREEWHEEL_BLOCK_SIZE, startLocation) < 0) {
+        return -1;
+    }
+
+    m_lastProgress = -1;
+
+    TExportStream stream(FREEWHEEL_BLOCK_SIZE, get_render_bus()->get_channel_count());
+    QList<TExportEncoder*> encoders;
+    int result;
+
+    if (m_normalize) {
+        result = render_normalized(&stream, encoders, totalFrames);
+    } else {
+        start_encoders(&stream, encoders);
+        result = render_to_stream(&stream, totalFrames);
+    }
+
+    if (result > 0) {
+        stream.finish();
+    } else {
+        stream.cancel();
+    }
+
+    m_sheet->stop_freewheel();
+
+    for (auto encoder : encoders) {
+        encoder->wait();
+        if (encoder->get_result() < 0) {
+            result = -1;
+        }
+        delete encoder;
+    }
+
+    return result;
+}
+
+int TFreewheelRenderer::render_to_stream(TExportStream* stream, nframes_t totalFrames)
+{
+    nframes_t remainingFrames = totalFrames;
+
+    while (remainingFrames > 0) {
+        if (m_cancelRender.load()) {
+            return 0;
+        }
+
+        nframes_t nframes = qMin(remainingFrames, FREEWHEEL_BLOCK_SIZE);
+
+        process_block(nframes);
+
+        audio_sample_t* block = stream->begin_write();
+        if (!block) {
+            return 0;
+        }
+
+        interleave_render_bus(block, nframes);
+
+        stream->end_write(nframes);
+
+        remainingFrames -= nframes;
+
+        update_progress(int(100 - (qint64(remainingFrames) * 100) / qMax(nframes_t(1), totalFrames)));
+    }
+
+    return 1;
+}
+
+/**
+ *	Renders into a float intermediate file while tracking the peak value, then streams
+ *	the intermediate file to the encoders with the normalization gain applied.
+ *	The render takes 90% of the progress, the second stage the remaining 10%.
+ */
+int TFreewheelRenderer::render_normalized(TExportStream* stream, QList<TExportEncoder*>& encoders, nframes_t totalFrames)
+{
+    const uint channelCount = stream->get_channel_count();
+
+    QTemporaryFile intermediate(m_specs.first()->get_export_dir() + "/.traverso-render-XXXXXX");
+    if (!intermediate.open()) {
+        PERROR(QString("Couldn't create intermediate render file in %1").arg(m_specs.first()->get_export_dir()));
+        return -1;
+    }
+
+    QVector<audio_sample_t> block(int(FREEWHEEL_BLOCK_SIZE * channelCount));
+    audio_sample_t peak = 0.0f;
+    nframes_t remainingFrames = totalFrames;
+
+    while (remainingFrames > 0) {
+        if (m_cancelRender.load()) {
+            return 0;
+        }
+
+        nframes_t nframes = qMin(remainingFrames, FREEWHEEL_BLOCK_SIZE);
+        qint64 bytes = qint64(nframes * channelCount * sizeof(audio_sample_t));
+
+        process_block(nframes);
+
+        interleave_render_bus(block.data(), nframes);
+
+        peak = Mixer::compute_peak(block.data(), nframes * channelCount, peak);
+
+        if (intermediate.write(reinterpret_cast<const char*>(block.data()), bytes) != bytes) {
+            PERROR(QString("Couldn't write to intermediate render file %1").arg(intermediate.fileName()));
+            return -1;
+        }
+
+        remainingFrames -= nframes;
+
+        update_progress(int(90 - (qint64(remainingFrames) * 90) / qMax(nframes_t(1), totalFrames)));
+    }
+
+    // Done with the Sheet, the second stage only reads the intermediate file
+    m_sheet->stop_freewheel();
+
+    float gain = normalization_factor(peak);
+
+    if (!intermediate.seek(0)) {
+        return -1;
+    }
+
+    start_encoders(stream, encoders);
+
+    remainingFrames = totalFrames;
+
+    while (remainingFrames > 0) {
+        if (m_cancelRender.load()) {
+            return 0;
+        }
+
+        nframes_t nframes = qMin(remainingFrames, FREEWHEEL_BLOCK_SIZE);
+        qint64 bytes = qint64(nframes * channelCount * sizeof(audio_sample_t));
+
+        audio_sample_t* streamBlock = stream->begin_write();
+        if (!streamBlock) {
+            return 0;
+        }
+
+        if (intermediate.read(reinterpret_cast<char*>(streamBlock), bytes) != bytes) {
+            PERROR(QString("Couldn't read from intermediate render file %1").arg(intermediate.fileName()));
+            return -1;
+        }
+
+        if (gain != 1.0f) {
+            Mixer::apply_gain_to_buffer(streamBlock, nframes * channelCount, gain);
+        }
+
+        stream->end_write(nframes);
+
+        remainingFrames -= nframes;
+
+        update_progress(int(100 - (qint64(remainingFrames) * 10) / qMax(nframes_t(1), totalFrames)));
+    }
+
+    return 1;
+}
+
+void TFreewheelRenderer::start_encoders(TExportStream* stream, QList<TExportEncoder*>& encoders)
+{
+    for (auto spec : m_specs) {
+        encoders.append(new TExportEncoder(stream, spec));
+    }
+    for (auto encoder : encoders) {
+        encoder->start();
+    }
+}
+
+void TFreewheelRenderer::process_block(nframes_t nframes)
+{
+    if (m_track) {
+        m_sheet->process_freewheel_track(m_track, nframes);
+    } else {
+        m_sheet->process_freewheel(nframes);
+    }
+}
+
+AudioBus* TFreewheelRenderer::get_render_bus() const
+{
+    if (m_track) {
+        return m_track->get_process_bus();
+    }
+    return m_sheet->get_render_bus();
+}
+
+void TFreewheelRenderer::interleave_render_bus(audio_sample_t* block, nframes_t nframes)
+{
+    AudioBus* renderBus = get_render_bus();
+    const uint channelCount = renderBus->get_channel_count();
+
+    QVarLengthArray<const audio_sample_t*, 8> buffers;
+    for (uint chan = 0; chan < channelCount; ++chan) {
+        buffers.append(renderBus->get_buffer(chan, nframes));
+    }
+
+    TSampleConverter::interleave_float(block, buffers.constData(), channelCount, nframes);
+}
+
+float TFreewheelRenderer::normalization_factor(audio_sample_t peak) const
+{
+    float target = dB_to_scale_factor(m_normalizeTargetdB);
+
+    if (target == 1.0f) {
+        // do not normalize to precisely 1.0 (0 dBFS), to avoid making it appear
+        // that we may have clipped.
+        target -= FLT_EPSILON;
+    }
+
+    if (qFuzzyCompare(peak, 0.0f)) {
+        PWARN("TFreewheelRenderer::normalization: peak value == 0");
+        return 1.0f;
+    }
+
+    return target / peak;
+}
+
+void TFreewheelRenderer::update_progress(int renderProgress)
+{
+    if (renderProgress != m_lastProgress) {
+        m_lastProgress = renderProgress;
+        emit progress(renderProgress);
+    }
+}
+
+//eof
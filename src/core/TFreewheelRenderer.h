@@ -0,0 +1,85 @@
+/*
+Copyright (C) 2024 Remon Sijrier
+
+This file is part of Traverso
+
+Traverso is free software; you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation; either version 2 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program; if not, write to the Free Software
+Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA.
+
+*/
+
+#ifndef TFREEWHEELRENDERER_H
+#define TFREEWHEELRENDERER_H
+
+#include <QList>
+#include <QThread>
+#include <atomic>
+
+#include "defines.h"
+
+class AudioBus;
+class AudioTrack;
+class Sheet;
+class TExportSpecification;
+class TExportStream;
+class TExportEncoder;
+
+class TFreewheelRenderer : public QThread
+{
+    Q_OBJECT
+
+public:
+    // Frames rendered per Sheet::process_freewheel() call
+    static const nframes_t FREEWHEEL_BLOCK_SIZE = 8192;
+
+    TFreewheelRenderer(Sheet* sheet, TExportSpecification* spec);
+    TFreewheelRenderer(Sheet* sheet, const QList<TExportSpecification*>& specs);
+
+    int render();
+    void cancel() {m_cancelRender.store(true);}
+    void set_normalize(bool normalize, float targetdB = 0.0f);
+    void set_track(AudioTrack* track) {m_track = track;}
+    int get_result() const {return m_result;}
+    Sheet* get_sheet() const {return m_sheet;}
+
+protected:
+    void run() override;
+
+private:
+    Sheet*                          m_sheet;
+    AudioTrack*                     m_track;
+    QList<TExportSpecification*>    m_specs;
+    std::atomic<bool>               m_cancelRender;
+    int                             m_result;
+    int                             m_lastProgress;
+    bool                            m_normalize;
+    float                           m_normalizeTargetdB;
+
+    int render_to_stream(TExportStream* stream, nframes_t totalFrames);
+    int render_normalized(TExportStream* stream, QList<TExportEncoder*>& encoders, nframes_t totalFrames);
+    void start_encoders(TExportStream* stream, QList<TExportEncoder*>& encoders);
+    void process_block(nframes_t nframes);
+    AudioBus* get_render_bus() const;
+    void interleave_render_bus(audio_sample_t* block, nframes_t nframes);
+    float normalization_factor(audio_sample_t peak) const;
+    void update_progress(int renderProgress);
+
+signals:
+    void progress(int);
+    void renderFinished();
+};
+
+#endif
+
+//eof
@@ -23,6 +23,9 @@ Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA.
 
 #include "ContextPointer.h"
 #include "Information.h"
+#include "Project.h"
+#include "ProjectManager.h"
+#include "Sheet.h"
 #include "TCommand.h"
 #include "TMoveCommand.h"
 #include "TCommandPlugin.h"
@@ -148,6 +151,13 @@ int TInputEventDispatcher::dispatch_shortcut_from_contextmenu(TShortCutFunction*
 int TInputEventDispatcher::dispatch_shortcut(TShortCut* shortCut, bool fromContextMenu)
 {
     PENTER2;
+
+    // A render is reading the Sheet from another thread, see Sheet::set_render_locked()
+    Project* project = pm().get_project();
+    if (!m_holdingCommand && project && project->get_active_sheet() && project->get_active_sheet()->is_render_locked()) {
+        info().information(tr("Sheet %1 is busy rendering, try again when it's done").arg(project->get_active_sheet()->get_name()));
+        return 0;
+    }
     PMESG("Dispatching key %d", shortCut->getKeyValue());
 
     TCommand* command = nullptr;
@@ -0,0 +1,276 @@
+/*
+Copyright (C) 2024 Remon Sijrier
+
+This file is part of Traverso
+
+Traverso is free software; you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation; either version 2 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program; if not, write to the Free Software
+Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA.
+
+*/
+
+#include "TPeakTileCache.h"
+
+#include "Peak.h"
+#include "TConfig.h"
+
+#include <cstring>
+
+// Always put me below _all_ includes, this is needed
+// in case we run with memory leak detection enabled!
+#include "Debugger.h"
+
+/** \class TPeakTileCache
+ *	\brief In memory cache of waveform peak data, split up in tiles of TILE_SIZE pixels
+ *
+ *	Painting an AudioClipView no longer calls Peak::calculate_peaks() from the GUI thread.
+ *	Instead the view asks for the tiles it needs with get_tile(). Resident tiles are copied
+ *	right away, missing tiles are calculated by a couple of TPeakTileThreads and the
+ *	tileLoaded() signal is emitted once they arrive so the view can repaint.
+ *
+ *	Tiles are dropped least recently used first when the memory budget,
+ *	Interface/PeakTileCacheSize in MB, is exceeded.
+ */
+
+static const int PEAK_TILE_THREAD_COUNT = 2;
+// Don't let pending tiles pile up when scrolling fast, the oldest requests are dropped
+static const int MAX_PENDING_TILES = 512;
+
+uint qHash(const TPeakTileCache::TileKey& key, uint seed)
+{
+    return qHash(quintptr(key.peak), seed) ^ qHash(key.tileIndex) ^ qHash(key.timeRefPerPixel) ^ uint(key.channel << 24);
+}
+
+
+TPeakTileCache& peak_tile_cache()
+{
+    static TPeakTileCache cache;
+    return cache;
+}
+
+
+TPeakTileThread::TPeakTileThread(TPeakTileCache* cache)
+    : m_cache(cache)
+{
+}
+
+void TPeakTileThread::run()
+{
+    m_cache->process_jobs();
+}
+
+
+TPeakTileCache::TPeakTileCache()
+{
+    m_stopThreads = false;
+    set_max_size(config().get_property("Interface", "PeakTileCacheSize", 32).toInt());
+}
+
+TPeakTileCache::~TPeakTileCache()
+{
+    stop_threads();
+}
+
+void TPeakTileCache::set_max_size(int megaBytes)
+{
+    QMutexLocker locker(&m_mutex);
+    // cost is in bytes, a tile is only a few KB
+    m_tiles.setMaxCost(qBound(1, megaBytes, 1024) * 1024 * 1024);
+}
+
+/**
+ *	Copies the peak data of tile \a tileIndex into \a data if the tile is resident, otherwise
+ *	the tile is scheduled for loading. \a data must be able to hold TILE_SIZE * 2 values.
+ *
+ * @return The amount of peak values copied, TILE_PENDING if the tile is not available yet,
+ *	or one of the Peak error codes if the last tile calculation for \a peak failed.
+ */
+int TPeakTileCache::get_tile(Peak* peak, int channel, qreal framesPerPeak, qint64 timeRefPerPixel, qint64 tileIndex, float* data)
+{
+    Q_ASSERT(peak);
+
+    QMutexLocker locker(&m_mutex);
+
+    if (m_errors.contains(peak)) {
+        return m_errors.take(peak);
+    }
+
+    TileKey key;
+    key.peak = peak;
+    key.channel = channel;
+    key.framesPerPeak = framesPerPeak;
+    key.timeRefPerPixel = timeRefPerPixel;
+    key.tileIndex = tileIndex;
+
+    Tile* tile = m_tiles.object(key);
+
+    if (tile) {
+        memcpy(data, tile->data.constData(), size_t(tile->data.size()) * sizeof(float));
+        return tile->data.size();
+    }
+
+    // Most recently requested tiles are processed first, they're most likely visible
+    m_jobs.removeAll(key);
+    m_jobs.append(key);
+    while (m_jobs.size() > MAX_PENDING_TILES) {
+        m_jobs.removeFirst();
+    }
+
+    if (m_threads.isEmpty()) {
+        start_threads();
+    }
+
+    m_jobAvailable.wakeOne();
+
+    return TILE_PENDING;
+}
+
+/**
+ *	Removes all tiles and pending requests for \a peak. Waits until a running calculation
+ *	for \a peak has finished, so it's safe to delete \a peak after calling this function.
+ */
+void TPeakTileCache::invalidate(Peak* peak)
+{
+    QMutexLocker locker(&m_mutex);
+
+    for (int i = m_jobs.size() - 1; i >= 0; --i) {
+        if (m_jobs.at(i).peak == peak) {
+            m_jobs.removeAt(i);
+        }
+    }
+
+    const auto keys = m_tiles.keys();
+    for (const auto& key : keys) {
+        if (key.peak == peak) {
+            m_tiles.remove(key);
+        }
+    }
+
+    while (m_busyPeaks.contains(peak)) {
+        m_jobFinished.wait(&m_mutex);
+    }
+
+    m_errors.remove(peak);
+}
+
+void TPeakTileCache::process_jobs()
+{
+    QMutexLocker locker(&m_mutex);
+
+    while (!m_stopThreads) {
+        // Peak isn't thread save, find the most recent job of a Peak
+        // that's not being processed by another thread
+        int jobIndex = -1;
+        for (int i = m_jobs.size() - 1; i >= 0; --i) {
+            if (!m_busyPeaks.contains(m_jobs.at(i).peak)) {
+                jobIndex = i;
+                break;
+            }
+        }
+
+        if (jobIndex < 0) {
+            m_jobAvailable.wait(&m_mutex);
+            continue;
+        }
+
+        TileKey key = m_jobs.takeAt(jobIndex);
+        m_busyPeaks.insert(key.peak);
+
+        locker.unlock();
+
+        bool microView = !Peak::is_macro_view(key.framesPerPeak);
+        int peakDataCount = microView ? TILE_SIZE : TILE_SIZE * 2;
+        TTimeRef startLocation(qint64(key.tileIndex * TILE_SIZE * key.timeRefPerPixel));
+
+        // The peak data is shared with the peak build and GUI threads, keep it
+        // locked until it's copied into the tile. Deleting the Peak waits for
+        // this job in invalidate(), see Peak::~Peak()
+        QMutexLocker peakLocker(&key.peak->m_dataMutex);
+        float* peakData = nullptr;
+        const peak_data_t* storedPeakData = nullptr;
+        int produced;
+
+        // Macro view data is converted straight from the (memory mapped) peak file
+        if (microView) {
+            produced = key.peak->calculate_peaks(key.channel, &peakData, startLocation, peakDataCount, key.framesPerPeak);
+        } else {
+            produced = key.peak->get_peak_data(key.channel, &storedPeakData, startLocation, peakDataCount, key.framesPerPeak);
+        }
+
+        Tile* tile = nullptr;
+        // A tile beyond the available peak data is just silence
+        if (produced > 0 || produced == Peak::NO_PEAKDATA_FOUND) {
+            tile = new Tile;
+            tile->data.resize(peakDataCount);
+            tile->data.fill(0.0f);
+            int count = qMin(produced, peakDataCount);
+            if (peakData) {
+                memcpy(tile->data.data(), peakData, size_t(count) * sizeof(float));
+            } else if (storedPeakData) {
+                for (int i = 0; i < count; ++i) {
+                    tile->data[i] = float(storedPeakData[i]);
+                }
+            }
+        }
+
+        peakLocker.unlock();
+
+        locker.relock();
+
+        if (tile) {
+            m_tiles.insert(key, tile, int(tile->data.size() * sizeof(float)));
+        } else {
+            m_errors.insert(key.peak, produced);
+            // No use in trying the other tiles of this Peak, the view will
+            // request them again when the peak data is available
+            for (int i = m_jobs.size() - 1; i >= 0; --i) {
+                if (m_jobs.at(i).peak == key.peak) {
+                    m_jobs.removeAt(i);
+                }
+            }
+        }
+
+        m_busyPeaks.remove(key.peak);
+        m_jobFinished.wakeAll();
+        m_jobAvailable.wakeOne();
+
+        locker.unlock();
+        emit tileLoaded(key.peak);
+        locker.relock();
+    }
+}
+
+void TPeakTileCache::start_threads()
+{
+    for (int i=0; i<PEAK_TILE_THREAD_COUNT; ++i) {
+        auto thread = new TPeakTileThread(this);
+        thread->start(QThread::LowPriority);
+        m_threads.append(thread);
+    }
+}
+
+void TPeakTileCache::stop_threads()
+{
+    m_mutex.lock();
+    m_stopThreads = true;
+    m_jobAvailable.wakeAll();
+    m_mutex.unlock();
+
+    for (auto thread : m_threads) {
+        thread->wait();
+        delete thread;
+    }
+    m_threads.clear();
+}
+
+//eof
@@ -0,0 +1,122 @@
+/*
+Copyright (C) 2024 Remon Sijrier
+
+This file is part of Traverso
+
+Traverso is free software; you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation; either version 2 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program; if not, write to the Free Software
+Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA.
+
+*/
+
+#ifndef TPEAKTILECACHE_H
+#define TPEAKTILECACHE_H
+
+#include <QObject>
+#include <QCache>
+#include <QHash>
+#include <QList>
+#include <QMutex>
+#include <QSet>
+#include <QThread>
+#include <QVector>
+#include <QWaitCondition>
+
+#include "Peak.h"
+#include "TTimeRef.h"
+
+class TPeakTileCache;
+
+class TPeakTileThread : public QThread
+{
+public:
+    TPeakTileThread(TPeakTileCache* cache);
+
+protected:
+    void run() override;
+
+private:
+    TPeakTileCache* m_cache;
+};
+
+
+class TPeakTileCache : public QObject
+{
+    Q_OBJECT
+
+public:
+    // Amount of pixels covered by one tile
+    static const int TILE_SIZE = 256;
+
+    enum {
+        TILE_PENDING = 0
+    };
+
+    int get_tile(Peak* peak, int channel, qreal framesPerPeak, qint64 timeRefPerPixel, qint64 tileIndex, float* data);
+    void invalidate(Peak* peak);
+    void set_max_size(int megaBytes);
+
+private:
+    struct TileKey {
+        Peak*   peak;
+        int     channel;
+        qreal   framesPerPeak;
+        qint64  timeRefPerPixel;
+        qint64  tileIndex;
+
+        bool operator==(const TileKey& other) const {
+            return peak == other.peak &&
+                    channel == other.channel &&
+                    framesPerPeak == other.framesPerPeak &&
+                    timeRefPerPixel == other.timeRefPerPixel &&
+                    tileIndex == other.tileIndex;
+        }
+    };
+
+    struct Tile {
+        QVector<float> data;
+    };
+
+    QCache<TileKey, Tile>   m_tiles;
+    QList<TileKey>          m_jobs;
+    QSet<Peak*>             m_busyPeaks;
+    QHash<Peak*, int>       m_errors;
+    QList<TPeakTileThread*> m_threads;
+    QMutex                  m_mutex;
+    QWaitCondition          m_jobAvailable;
+    QWaitCondition          m_jobFinished;
+    bool                    m_stopThreads;
+
+    void process_jobs();
+    void start_threads();
+    void stop_threads();
+
+    TPeakTileCache();
+    ~TPeakTileCache();
+    TPeakTileCache(const TPeakTileCache&);
+
+    // allow this function to create one instance
+    friend TPeakTileCache& peak_tile_cache();
+    friend class TPeakTileThread;
+    friend uint qHash(const TileKey& key, uint seed);
+
+signals:
+    void tileLoaded(Peak* peak);
+};
+
+// use this function to access the waveform tile cache
+TPeakTileCache& peak_tile_cache();
+
+#endif
+
+//eof
@@ -0,0 +1,242 @@
+/*
+Copyright (C) 2024 Remon Sijrier
+
+This file is part of Traverso
+
+Traverso is free software; you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation; either version 2 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program; if not, write to the Free Software
+Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA.
+
+*/
+
+#include "TRecordingTranscoder.h"
+
+#include "AbstractAudioReader.h"
+#include "TDecodedBlockCache.h"
+#include "TExportSpecification.h"
+#include "TSampleConverter.h"
+#include "WriteSource.h"
+
+#include <QFile>
+#include <QFileInfo>
+#include <QVector>
+
+#include <cstdio>
+
+// Always put me below _all_ includes, this is needed
+// in case we run with memory leak detection enabled!
+#include "Debugger.h"
+
+/** \class TRecordingTranscoder
+ *	\brief Converts spooled recordings to the configured recording format in the background
+ *
+ *	With Recording/SpoolRawFloat enabled recordings are written as 32 bit float WAV files
+ *	by TSpoolAudioWriter, keeping the disk thread load low while recording many tracks.
+ *	Once a recording has finished it's file is queued here and converted in a low priority
+ *	thread. The converted file replaces the spooled file under the same name, so the
+ *	ReadSource and the project don't have to know about it.
+ *
+ *	If the conversion fails or is interrupted by quitting Traverso the spooled file is kept,
+ *	it's a valid recording in it's own right.
+ */
+
+
+TRecordingTranscoder& recording_transcoder()
+{
+    static TRecordingTranscoder transcoder;
+    return transcoder;
+}
+
+
+TRecordingTranscodeThread::TRecordingTranscodeThread(TRecordingTranscoder* transcoder)
+    : m_transcoder(transcoder)
+{
+}
+
+void TRecordingTranscodeThread::run()
+{
+    m_transcoder->process_jobs();
+}
+
+
+TRecordingTranscoder::TRecordingTranscoder()
+{
+    m_thread = nullptr;
+    m_stopThread = false;
+    m_busy = false;
+}
+
+TRecordingTranscoder::~TRecordingTranscoder()
+{
+    m_mutex.lock();
+    m_stopThread = true;
+    m_jobAvailable.wakeAll();
+    m_mutex.unlock();
+
+    if (m_thread) {
+        m_thread->wait();
+        delete m_thread;
+    }
+
+    for (const auto& job : m_jobs) {
+        delete job.spec;
+    }
+}
+
+/**
+ *	Queues the spooled recording \a fileName to be converted to the format described by \a spec.
+ *	Takes ownership of \a spec.
+ */
+void TRecordingTranscoder::enqueue(const QString& fileName, TExportSpecification* spec)
+{
+    Q_ASSERT(spec);
+
+    QMutexLocker locker(&m_mutex);
+
+    TranscodeJob job;
+    job.fileName = fileName;
+    job.spec = spec;
+    m_jobs.enqueue(job);
+
+    if (!m_thread) {
+        m_thread = new TRecordingTranscodeThread(this);
+        m_thread->start(QThread::LowPriority);
+    }
+
+    m_jobAvailable.wakeOne();
+}
+
+/**
+ *	Returns the amount of recordings waiting for or being converted
+ */
+int TRecordingTranscoder::get_pending_count()
+{
+    QMutexLocker locker(&m_mutex);
+    return m_jobs.size() + (m_busy ? 1 : 0);
+}
+
+void TRecordingTranscoder::process_jobs()
+{
+    QMutexLocker locker(&m_mutex);
+
+    while (!m_stopThread) {
+        if (m_jobs.isEmpty()) {
+            m_jobAvailable.wait(&m_mutex);
+            continue;
+        }
+
+        TranscodeJob job = m_jobs.dequeue();
+        m_busy = true;
+
+        locker.unlock();
+
+        emit transcodeStarted(job.fileName);
+
+        if (transcode(job)) {
+            emit transcodeFinished(job.fileName);
+        } else {
+            emit transcodeFailed(job.fileName);
+        }
+
+        delete job.spec;
+
+        locker.relock();
+        m_busy = false;
+    }
+}
+
+bool TRecordingTranscoder::transcode(const TranscodeJob& job)
+{
+    AbstractAudioReader* reader = AbstractAudioReader::create_audio_reader(job.fileName);
+
+    if (!reader) {
+        PERROR(QString("TRecordingTranscoder: Could not open %1").arg(job.fileName));
+        return false;
+    }
+
+    QFileInfo fileInfo(job.fileName);
+    uint channelCount = reader->get_num_channels();
+    nframes_t totalFrames = reader->get_nframes();
+    uint rate = reader->get_file_rate();
+
+    QVector<audio_sample_t> renderBuffer(int(TRANSCODE_BLOCK_SIZE * channelCount));
+
+    TExportSpecification* spec = job.spec;
+    spec->set_export_dir(fileInfo.absolutePath() + "/");
+    // WriteSource adds the extension, which is the same as the one of the spooled file
+    spec->set_export_file_name(fileInfo.completeBaseName() + "-transcode");
+    spec->set_channel_count(channelCount);
+    spec->set_sample_rate(rate);
+    spec->set_block_size(TRANSCODE_BLOCK_SIZE);
+    spec->set_render_buffer(renderBuffer.data());
+    spec->set_export_start_location(TTimeRef());
+    spec->set_export_end_location(reader->get_length());
+
+    auto writer = new WriteSource(spec);
+    bool success = (writer->prepare_export() != -1);
+
+    DecodeBuffer decodeBuffer;
+    nframes_t location = 0;
+
+    while (success && location < totalFrames) {
+        if (m_stopThread) {
+            success = false;
+            break;
+        }
+
+        nframes_t nframes = totalFrames - location;
+        if (nframes > TRANSCODE_BLOCK_SIZE) {
+            nframes = TRANSCODE_BLOCK_SIZE;
+        }
+        nframes_t read = reader->read_from(&decodeBuffer, location, nframes);
+
+        if (read == 0) {
+            success = false;
+            break;
+        }
+
+        TSampleConverter::interleave_float(renderBuffer.data(), decodeBuffer.destination, channelCount, read);
+
+        success = (writer->process(read) == read);
+
+        spec->add_exported_range(TTimeRef(read, rate));
+        location += read;
+    }
+
+    writer->finish_export();
+    QString transcodedFileName = writer->get_filename();
+    delete writer;
+    delete reader;
+
+    if (success) {
+#if defined (Q_OS_UNIX)
+        // Atomically replaces the spooled file, ReadSources still reading it keep
+        // reading the spooled data until they open the file again
+        success = (std::rename(QFile::encodeName(transcodedFileName).constData(),
+                               QFile::encodeName(job.fileName).constData()) == 0);
+#else
+        success = QFile::remove(job.fileName) && QFile::rename(transcodedFileName, job.fileName);
+#endif
+    }
+
+    if (!success) {
+        QFile::remove(transcodedFileName);
+        return false;
+    }
+
+    decoded_block_cache().invalidate(job.fileName);
+
+    return true;
+}
+
+//eof
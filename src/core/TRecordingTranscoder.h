@@ -0,0 +1,97 @@
+/*
+Copyright (C) 2024 Remon Sijrier
+
+This file is part of Traverso
+
+Traverso is free software; you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation; either version 2 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program; if not, write to the Free Software
+Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA.
+
+*/
+
+#ifndef TRECORDINGTRANSCODER_H
+#define TRECORDINGTRANSCODER_H
+
+#include <QObject>
+#include <QList>
+#include <QMutex>
+#include <QQueue>
+#include <QThread>
+#include <QWaitCondition>
+
+#include <atomic>
+
+#include "defines.h"
+
+class TExportSpecification;
+class TRecordingTranscoder;
+
+class TRecordingTranscodeThread : public QThread
+{
+public:
+    TRecordingTranscodeThread(TRecordingTranscoder* transcoder);
+
+protected:
+    void run() override;
+
+private:
+    TRecordingTranscoder* m_transcoder;
+};
+
+
+class TRecordingTranscoder : public QObject
+{
+    Q_OBJECT
+
+public:
+    void enqueue(const QString& fileName, TExportSpecification* spec);
+    int get_pending_count();
+
+private:
+    static const nframes_t TRANSCODE_BLOCK_SIZE = 16384;
+
+    struct TranscodeJob {
+        QString                 fileName;
+        TExportSpecification*   spec;
+    };
+
+    QQueue<TranscodeJob>        m_jobs;
+    TRecordingTranscodeThread*  m_thread;
+    QMutex                      m_mutex;
+    QWaitCondition              m_jobAvailable;
+    std::atomic<bool>           m_stopThread;
+    bool                        m_busy;
+
+    void process_jobs();
+    bool transcode(const TranscodeJob& job);
+
+    TRecordingTranscoder();
+    ~TRecordingTranscoder();
+    TRecordingTranscoder(const TRecordingTranscoder&);
+
+    // allow this function to create one instance
+    friend TRecordingTranscoder& recording_transcoder();
+    friend class TRecordingTranscodeThread;
+
+signals:
+    void transcodeStarted(QString fileName);
+    void transcodeFinished(QString fileName);
+    void transcodeFailed(QString fileName);
+};
+
+// use this function to access the background transcoder of spooled recordings
+TRecordingTranscoder& recording_transcoder();
+
+#endif
+
+//eof
@@ -32,6 +32,7 @@ Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA.
 #include "SnapList.h"
 #include "TLocation.h"
 #include "TTimeLineRuler.h"
+#include "TRealTimeThreadPool.h"
 
 #include "Debugger.h"
 
@@ -57,6 +58,7 @@ void TSession::init()
 	// TODO seek to old position on project exit ?
 	m_workLocation = TTimeRef();
 	m_transportLocation = TTimeRef();
+	publish_transport_location();
     m_scrollBarXValue = m_scrollBarYValue = 0;
 	m_hzoom = config().get_property("Sheet", "hzoomLevel", 8192).toInt();
     m_transportRolling.store(false);
@@ -158,6 +160,26 @@ QDomNode TSession::get_state(QDomDocument doc)
 
 
 
+audio_sample_t* TSession::get_mixdown_buffer() const
+{
+	int worker = TRealTimeThreadPool::current_worker_index();
+	if (worker < 0) {
+		return mixdown;
+	}
+	Q_ASSERT(worker < m_workerMixdownBuffers.size());
+	return m_workerMixdownBuffers.at(worker);
+}
+
+audio_sample_t* TSession::get_gain_buffer() const
+{
+	int worker = TRealTimeThreadPool::current_worker_index();
+	if (worker < 0) {
+		return gainbuffer;
+	}
+	Q_ASSERT(worker < m_workerGainBuffers.size());
+	return m_workerGainBuffers.at(worker);
+}
+
 TBusTrack* TSession::get_master_out_bus_track() const
 {
 	if (is_project_session()) {
@@ -198,6 +220,28 @@ QList<TBusTrack*> TSession::get_bus_tracks() const
 	return m_busTracks;
 }
 
+/**
+ *	Checks if \a bus is the process bus of one of the TBusTracks of this session,
+ *	the Project busses (e.g. the hardware busses) are not part of the session.
+ *
+ *	Note: Walks the realtime bus track list, safe to call from the thread processing
+ *	the session
+ */
+bool TSession::is_session_bus(AudioBus* bus) const
+{
+	if (m_masterOutBusTrack && m_masterOutBusTrack->get_process_bus() == bus) {
+		return true;
+	}
+
+	for(TBusTrack* busTrack = m_rtBusTracks.first(); busTrack != nullptr; busTrack = busTrack->next) {
+		if (busTrack->get_process_bus() == bus) {
+			return true;
+		}
+	}
+
+	return false;
+}
+
 SnapList* TSession::get_snap_list() const
 {
 	if (m_parentSession) {
@@ -249,7 +293,7 @@ TTimeRef TSession::get_transport_location() const
 		return m_parentSession->get_transport_location();
 	}
 
-	return m_transportLocation;
+	return TTimeRef(m_transportLocationSnapshot.load(std::memory_order_acquire));
 }
 
 qreal TSession::get_hzoom() const
@@ -464,8 +508,8 @@ TCommand* TSession::add_track(Track* track, bool historable)
 	}
 
 	return new AddRemove(this, track, historable, this,
-		"private_add_track(Track*)", "privateTrackAdded(Track*)",
-		"private_remove_track(Track*)", "privateTrackRemoved(Track*)",
+		Tsar::call<TSession, Track, &TSession::private_add_track>, "privateTrackAdded(Track*)",
+		Tsar::call<TSession, Track, &TSession::private_remove_track>, "privateTrackRemoved(Track*)",
         tr("Added %1: %2").arg(track->metaObject()->className(), track->get_name()));
 }
 
@@ -478,8 +522,8 @@ TCommand* TSession::remove_track(Track* track, bool historable)
 	}
 
 	return new AddRemove(this, track, historable, this,
-		"private_remove_track(Track*)", "privateTrackRemoved(Track*)",
-		"private_add_track(Track*)", "privateTrackAdded(Track*)",
+		Tsar::call<TSession, Track, &TSession::private_remove_track>, "privateTrackRemoved(Track*)",
+		Tsar::call<TSession, Track, &TSession::private_add_track>, "privateTrackAdded(Track*)",
         tr("Removed %1: %2").arg(track->metaObject()->className(), track->get_name()));
 }
 
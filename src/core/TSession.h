@@ -26,11 +26,13 @@ Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA.
 
 #include <QDomNode>
 #include <QHash>
+#include <QVector>
 
 #include "TRealTimeLinkedList.h"
 #include "defines.h"
 #include "TTimeRef.h"
 
+class AudioBus;
 class AudioTrack;
 class SnapList;
 class TLocation;
@@ -52,6 +54,7 @@ public:
 	qreal get_hzoom() const;
 	QPoint get_scrollbar_xy();
     bool is_transport_rolling() const;
+    bool is_freewheeling() const {return m_freewheeling.load();}
 	TTimeRef get_work_location() const;
 	virtual TTimeRef get_last_location() const;
     TTimeRef get_seek_transport_location() const {return m_seekTransportLocation;}
@@ -66,6 +69,7 @@ public:
 	TBusTrack* get_master_out_bus_track() const;
 	virtual QList<Track*> get_tracks() const;
 	QList<TBusTrack*> get_bus_tracks() const;
+	bool is_session_bus(AudioBus* bus) const;
 	QList<TSession*> get_child_sessions() const {return m_childSessions;}
 	TLocation* get_work_snap() const;
 	virtual bool is_snap_on() const	{return m_isSnapOn;}
@@ -92,6 +96,10 @@ public:
 	audio_sample_t* 	mixdown{};
 	audio_sample_t*		gainbuffer{};
 
+	// Scratch buffers of the calling thread, the realtime worker threads have their own
+	audio_sample_t* get_mixdown_buffer() const;
+	audio_sample_t* get_gain_buffer() const;
+
 protected:
 	TSession*               m_parentSession;
 	QList<TSession*>        m_childSessions;
@@ -102,6 +110,8 @@ protected:
 	QHash<qint64, Track* >	m_tracks;
 	TBusTrack*              m_masterOutBusTrack{};
 	QHash<qint64, int>      m_trackHeights;
+	QVector<audio_sample_t*> m_workerMixdownBuffers;
+	QVector<audio_sample_t*> m_workerGainBuffers;
 
     SnapList*           m_snaplist;
     TLocation*       m_workSnap;
@@ -115,9 +125,16 @@ protected:
     bool                m_isProjectSession{};
 
     std::atomic<bool>   m_transportRolling;
+    std::atomic<bool>   m_freewheeling{};
     TTimeRef            m_transportLocation;
     TTimeRef            m_workLocation;
     TTimeRef            m_seekTransportLocation;
+    // m_transportLocation as seen by the non realtime threads
+    std::atomic<qint64> m_transportLocationSnapshot{};
+
+    void publish_transport_location() {
+        m_transportLocationSnapshot.store(m_transportLocation.universal_frame(), std::memory_order_release);
+    }
 
 private:
 	friend class TTimeLineRuler;
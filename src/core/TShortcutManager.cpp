@@ -462,6 +462,13 @@ void TShortcutManager::loadFunctions()
 	function->commandName = "AudioTrackSilenceOthers";
     registerFunction(function);
 
+	function = new TFunction();
+	function->object = "AudioTrack";
+	function->slotsignature = "toggle_freeze";
+	function->m_description = tr("Freeze: On/Off");
+	function->commandName = "AudioTrackToggleFreeze";
+    registerFunction(function);
+
 	function = new TFunction();
 	function->object = "FadeCurve";
 	function->slotsignature = "set_mode";
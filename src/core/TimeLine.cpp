@@ -80,8 +80,8 @@ TCommand * TimeLine::add_marker(Marker* marker, bool historable)
 	
 	AddRemove* cmd;
 	cmd = new AddRemove(this, marker, historable, m_sheet,
-		"private_add_marker(Marker*)", "markerAdded(Marker*)",
-		"private_remove_marker(Marker*)", "markerRemoved(Marker*)",
+		Tsar::call<TimeLine, Marker, &TimeLine::private_add_marker>, "markerAdded(Marker*)",
+		Tsar::call<TimeLine, Marker, &TimeLine::private_remove_marker>, "markerRemoved(Marker*)",
   		tr("Add Marker"));
 	
 	// Bypass the real time thread save logic in tsar, since a Marker doesn't have YET
@@ -97,8 +97,8 @@ TCommand* TimeLine::remove_marker(Marker* marker, bool historable)
 {
 	AddRemove* cmd;
 	cmd = new AddRemove(this, marker, historable, m_sheet,
-		"private_remove_marker(Marker*)", "markerRemoved(Marker*)",
-		"private_add_marker(Marker*)", "markerAdded(Marker*)",
+		Tsar::call<TimeLine, Marker, &TimeLine::private_remove_marker>, "markerRemoved(Marker*)",
+		Tsar::call<TimeLine, Marker, &TimeLine::private_add_marker>, "markerAdded(Marker*)",
   		tr("Remove Marker"));
 	
 	// Bypass the real time thread save logic in tsar, since a Marker doesn't have YET
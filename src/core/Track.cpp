@@ -250,7 +250,9 @@ int Track::get_sort_index( ) const
 void Track::add_input_bus(AudioBus *bus)
 {
         if (m_session && m_session->is_transport_rolling()) {
-        tsar().add_gui_event(this, bus, "private_add_input_bus(AudioBus*)", "routingConfigurationChanged()");
+        TsarEvent event;
+        tsar().prepare_event(event, this, bus, Tsar::call<Track, AudioBus, &Track::private_add_input_bus>, "routingConfigurationChanged()");
+        tsar().post_gui_event(event);
         } else {
                 private_add_input_bus(bus);
                 emit routingConfigurationChanged();
@@ -260,7 +262,9 @@ void Track::add_input_bus(AudioBus *bus)
 void Track::remove_input_bus(AudioBus *bus)
 {
         if (m_session && m_session->is_transport_rolling()) {
-        tsar().add_gui_event(this, bus, "private_remove_input_bus(AudioBus*)", "routingConfigurationChanged()");
+        TsarEvent event;
+        tsar().prepare_event(event, this, bus, Tsar::call<Track, AudioBus, &Track::private_remove_input_bus>, "routingConfigurationChanged()");
+        tsar().post_gui_event(event);
         } else {
                 private_remove_input_bus(bus);
                 emit routingConfigurationChanged();
@@ -301,7 +305,9 @@ void Track::add_post_send(AudioBus *bus)
     postSend->set_type(TSend::POSTSEND);
 
     if (!m_session || (m_session && m_session->is_transport_rolling())) {
-        tsar().add_gui_event(this, postSend, "private_add_post_send(TSend*)", "routingConfigurationChanged()");
+        TsarEvent event;
+        tsar().prepare_event(event, this, postSend, Tsar::call<Track, TSend, &Track::private_add_post_send>, "routingConfigurationChanged()");
+        tsar().post_gui_event(event);
     } else {
         private_add_post_send(postSend);
         emit routingConfigurationChanged();
@@ -330,7 +336,9 @@ void Track::add_pre_send(qint64 busId)
     preSend->set_type(TSend::PRESEND);
 
     if (!m_session || (m_session && m_session->is_transport_rolling())) {
-        tsar().add_gui_event(this, preSend, "private_add_pre_send(TSend*)", "routingConfigurationChanged()");
+        TsarEvent event;
+        tsar().prepare_event(event, this, preSend, Tsar::call<Track, TSend, &Track::private_add_pre_send>, "routingConfigurationChanged()");
+        tsar().post_gui_event(event);
     } else {
         private_add_pre_send(preSend);
         emit routingConfigurationChanged();
@@ -358,7 +366,9 @@ void Track::remove_post_sends(QList<qint64> sendIds)
 void Track::remove_post_send(TSend *send)
 {
     if (!m_session || (m_session && m_session->is_transport_rolling())) {
-        tsar().add_gui_event(this, send, "private_remove_post_send(TSend*)", "routingConfigurationChanged()");
+        TsarEvent event;
+        tsar().prepare_event(event, this, send, Tsar::call<Track, TSend, &Track::private_remove_post_send>, "routingConfigurationChanged()");
+        tsar().post_gui_event(event);
     } else {
         private_remove_post_send(send);
         emit routingConfigurationChanged();
@@ -386,7 +396,9 @@ void Track::remove_pre_sends(QList<qint64> sendIds)
 
     for(TSend* send : sendsToBeRemoved) {
         if (!m_session || (m_session && m_session->is_transport_rolling())) {
-            tsar().add_gui_event(this, send, "private_remove_pre_send(TSend*)", "routingConfigurationChanged()");
+            TsarEvent event;
+            tsar().prepare_event(event, this, send, Tsar::call<Track, TSend, &Track::private_remove_pre_send>, "routingConfigurationChanged()");
+            tsar().post_gui_event(event);
         } else {
             private_remove_pre_send(send);
             emit routingConfigurationChanged();
@@ -459,6 +471,13 @@ void Track::process_send(TSend *send, nframes_t nframes)
     float panFactor;
 
     AudioBus* receiverBus = send->get_bus();
+
+    // Busses outside the Sheet, like the hardware busses, are processed by the
+    // audio thread and are not part of the render while freewheeling
+    if (m_session && m_session->is_freewheeling() && !m_session->is_session_bus(receiverBus)) {
+        return;
+    }
+
     for (uint i=0; i<m_processBus->get_channel_count(); i++) {
         sender = m_processBus->get_channel(i);
         receiver = receiverBus->get_channel(i);
@@ -89,6 +89,9 @@ public:
     TSend* get_send(qint64 sendId);
     virtual void add_input_bus(AudioBus* bus);
 
+    bool has_pre_sends() {return !m_preSends.isEmpty();}
+    void process_post_sends(nframes_t nframes);
+
 
 protected:
     QList<TVUMonitor*>  m_vumonitors;
@@ -106,7 +109,6 @@ protected:
     AudioBus*       m_inputBus;
     QString         m_busInName;
 
-    void process_post_sends(nframes_t nframes);
     void process_pre_sends(nframes_t nframes);
     void remove_input_bus(AudioBus* bus);
 
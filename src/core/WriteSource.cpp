@@ -27,7 +27,9 @@ Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA.
 #include "AudioBus.h"
 #include <AudioDevice.h>
 #include "AbstractAudioWriter.h"
+#include "Mixer.h"
 #include "Peak.h"
+#include "TSampleConverter.h"
 #include "Utils.h"
 
 #include "gdither.h"
@@ -45,6 +47,9 @@ WriteSource::WriteSource( TExportSpecification* specification )
     m_peak = nullptr;
     m_channelCount = 0;
     m_isRecording = false;
+    m_recordingBuffer = nullptr;
+    m_recordingBufferFrames = m_recordingBatchFrames = 0;
+    m_writtenBytes = 0;
 }
 
 WriteSource::~WriteSource()
@@ -62,6 +67,7 @@ WriteSource::~WriteSource()
 	if (m_writer) {
 		delete m_writer;
 	}
+    free(m_recordingBuffer);
 }
 
 nframes_t WriteSource::process (nframes_t nframes)
@@ -153,8 +159,16 @@ nframes_t WriteSource::process (nframes_t nframes)
         }
 
         switch (m_exportSpecification->get_data_format()) {
-        case SF_FORMAT_PCM_S8:
         case SF_FORMAT_PCM_16:
+            // No and triangular dither are handled by the vectorized conversion
+            if (m_exportSpecification->get_dither_type() == GDitherNone || m_exportSpecification->get_dither_type() == GDitherTri) {
+                TDitherState* dither = m_exportSpecification->get_dither_type() == GDitherTri ? &m_ditherState : nullptr;
+                TSampleConverter::float_to_int16(static_cast<int16_t*>(m_outputData), 1, writeBuffer, toWrite * m_channelCount, dither);
+                written += m_writer->write(m_outputData, toWrite);
+                break;
+            }
+            [[fallthrough]];
+        case SF_FORMAT_PCM_S8:
         case SF_FORMAT_PCM_24:
             for (uint chn = 0; chn < m_channelCount; ++chn) {
                 gdither_runf (m_dither, chn, toWrite, writeBuffer, m_outputData);
@@ -164,28 +178,8 @@ nframes_t WriteSource::process (nframes_t nframes)
             break;
 
         case SF_FORMAT_PCM_32:
-            for (uint chn = 0; chn < m_channelCount; ++chn) {
-                Q_ASSERT(m_outputData);
-                int *ob = static_cast<int *>(m_outputData);
-                const double int_max = double(INT_MAX);
-                const double int_min = double(INT_MIN);
-
-                for (nframes_t x = 0; x < toWrite; ++x) {
-                    uint i = chn + (x * m_channelCount);
-
-                    if (writeBuffer[i] > 1.0f) {
-                        ob[i] = INT_MAX;
-                    } else if (writeBuffer[i] < -1.0f) {
-                        ob[i] = INT_MIN;
-                    } else {
-                        if (writeBuffer[i] >= 0.0f) {
-                            ob[i] = lrintf (int_max * writeBuffer[i]);
-                        } else {
-                            ob[i] = - lrintf (int_min * writeBuffer[i]);
-                        }
-                    }
-                }
-            }
+            Q_ASSERT(m_outputData);
+            TSampleConverter::float_to_int32(static_cast<int32_t*>(m_outputData), 1, writeBuffer, toWrite * m_channelCount, 2147483648.0f);
             /* and export to disk */
             written += m_writer->write(m_outputData, toWrite);
             break;
@@ -223,6 +217,26 @@ int WriteSource::prepare_export()
     m_channelCount = m_exportSpecification->get_channel_count();
     m_sampleBytes = m_exportSpecification->get_sample_bytes();
 
+    // Recording collects many small ringbuffer slots into one large write,
+    // the conversion buffers below have to be able to hold such a batch
+    if (m_exportSpecification->get_recording_state() == TExportSpecification::RecordingState::RECORDING) {
+        m_exportSpecification->set_block_size(RECORDING_BATCH_FRAMES);
+
+        free(m_recordingBuffer);
+        size_t size = RECORDING_BATCH_FRAMES * m_channelCount * sizeof(audio_sample_t);
+#if defined (NO_POSIX_MEMALIGN)
+        m_recordingBuffer = static_cast<audio_sample_t*>(malloc(size));
+#else
+        void* data = nullptr;
+        if (posix_memalign(&data, QueueBufferSlot::CACHE_LINE_SIZE, size) != 0) {
+            data = malloc(size);
+        }
+        m_recordingBuffer = static_cast<audio_sample_t*>(data);
+#endif
+        m_recordingBufferFrames = RECORDING_BATCH_FRAMES;
+        m_recordingBatchFrames = 0;
+    }
+
     m_processPeaks = false;
     m_dataBuffer = m_leftOverBuffer = nullptr;
     m_leftOverBufferSize = 0;
@@ -391,74 +405,89 @@ void WriteSource::set_process_peaks( bool process )
 	}
 }
 
-int WriteSource::rb_file_write(QueueBufferSlot* slot)
+void WriteSource::set_recording(bool rec )
 {
-    nframes_t written = 0;
-    uint chan;
+	m_isRecording = rec;
+}
 
-    nframes_t nframes = slot->get_buffer_size();
-	
-    // FIXME make it support any channel count, not just some high enough number?
-    audio_sample_t* readbuffer[6];
-    for (int index = 0; index < 6; ++index) {
-        readbuffer[index] = nullptr;
-    }
+// Called from DiskIO::do_work in DiskAudioThread or one of the DiskIO worker threads
+void WriteSource::process_realtime_buffers()
+{
+    QueueBufferSlot* slot = nullptr;
 
-	for (chan=0; chan<m_channelCount; ++chan) {
-		
-        readbuffer[chan] = new audio_sample_t[nframes * m_channelCount];
+    // Drain all queued slots, so recording at small buffer sizes still
+    // results in a few large writes instead of one write per slot
+    while (m_rtBufferSlotsQueue->try_dequeue(slot)) {
+        if (m_recordingBatchFrames + slot->get_buffer_size() > m_recordingBufferFrames) {
+            flush_recording_batch();
+        }
+
+        add_to_recording_batch(slot);
 
-        slot->read_buffer(readbuffer[chan], chan, nframes);
+        m_freeBufferSlotsQueue->try_enqueue(slot);
+    }
 
-        m_peak->process(chan, readbuffer[chan], nframes);
+    flush_recording_batch();
+
+	if (! m_isRecording ) {
+		finish_export();
 	}
+}
+
+void WriteSource::add_to_recording_batch(QueueBufferSlot* slot)
+{
+    nframes_t nframes = slot->get_buffer_size();
+    Q_ASSERT(nframes <= m_recordingBufferFrames);
+
+    if (m_peak) {
+        for (uint chan=0; chan<m_channelCount; ++chan) {
+            m_peak->process(chan, slot->get_buffer(chan), nframes);
+        }
+    }
+
+    audio_sample_t* dest = m_recordingBuffer + (m_recordingBatchFrames * m_channelCount);
 
     if (m_channelCount == 1) {
-        m_exportSpecification->set_render_buffer(readbuffer[0]);
+        memcpy(dest, slot->get_buffer(0), nframes * sizeof(audio_sample_t));
+    } else if (m_channelCount == 2) {
+        Mixer::interleave_stereo(dest, slot->get_buffer(0), slot->get_buffer(1), nframes);
     } else {
-        // Interlace data into dataF buffer!
-        for (uint f=0; f<nframes; f++) {
-            for (chan = 0; chan < m_channelCount; chan++) {
-                m_exportSpecification->get_render_buffer()[f * m_channelCount + chan] = readbuffer[chan][f];
-            }
+        for (uint chan=0; chan<m_channelCount; ++chan) {
+            TSampleConverter::float_to_float(dest + chan, m_channelCount, slot->get_buffer(chan), 1, nframes);
         }
     }
 
-    written = process(nframes);
+    m_recordingBatchFrames += nframes;
+}
 
-    if (written != nframes) {
-        // Say something
-        PERROR(QString("Different read / write count: read = %1, write = %2").arg(nframes, written))
+void WriteSource::flush_recording_batch()
+{
+    if (m_recordingBatchFrames == 0) {
+        return;
     }
 
-    for (chan=0; chan<m_channelCount; ++chan) {
-        delete [] readbuffer[chan];
+    m_exportSpecification->set_render_buffer(m_recordingBuffer);
+
+    nframes_t written = process(m_recordingBatchFrames);
+
+    if (written != m_recordingBatchFrames) {
+        PERROR(QString("Different read / write count: read = %1, write = %2").arg(m_recordingBatchFrames).arg(written));
     }
-	
-    return written;
-}
 
-void WriteSource::set_recording(bool rec )
-{
-	m_isRecording = rec;
+    uint sampleBytes = m_sampleBytes ? m_sampleBytes : sizeof(audio_sample_t);
+    m_writtenBytes.fetch_add(qint64(written) * m_channelCount * sampleBytes);
+
+    m_recordingBatchFrames = 0;
 }
 
-// Called from DiskIO::do_work in DiskAudioThread
-// TODO: make sure this function is thread save
-void WriteSource::process_realtime_buffers()
+// For a WriteSource the deadline is the moment the audio thread runs out of free slots
+TTimeRef WriteSource::get_time_to_underrun(const TTimeRef& /*transportLocation*/)
 {
-    m_exportSpecification->set_render_buffer(m_diskIOFramebuffer);
-
-    QueueBufferSlot* slot = nullptr;
-
-    while (m_rtBufferSlotsQueue->try_dequeue(slot)) {
-        rb_file_write(slot);
-        m_freeBufferSlotsQueue->try_enqueue(slot);
+    if (!m_freeBufferSlotsQueue) {
+        return TTimeRef();
     }
 
-	if (! m_isRecording ) {
-		finish_export();
-	}
+    return m_freeBufferSlotsQueue->size_approx() * m_bufferSlotDuration;
 }
 
 BufferStatus* WriteSource::get_buffer_status()
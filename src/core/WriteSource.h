@@ -25,7 +25,9 @@ Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA.
 #include "AudioSource.h"
 
 #include <samplerate.h>
+#include <atomic>
 #include "gdither_types.h"
+#include "TSampleConverter.h"
 
 class TExportSpecification;
 class Peak;
@@ -41,8 +43,10 @@ public :
 	WriteSource(TExportSpecification* spec);
 	~WriteSource();
 
+    // Recorded audio is written to disk in batches of up to this many frames
+    static const nframes_t RECORDING_BATCH_FRAMES = 16384;
+
     nframes_t ringbuffer_write(AudioBus* bus, nframes_t nframes, bool realTime);
-    int rb_file_write(QueueBufferSlot* slot);
 	void process_ringbuffer(audio_sample_t* buffer);
 
     BufferStatus* get_buffer_status() final;
@@ -59,12 +63,16 @@ public :
 
     bool is_recording() const;
 
+    bool can_process_in_worker_thread() const final {return true;}
+    qint64 take_written_bytes() final {return m_writtenBytes.exchange(0);}
+
 private:
 	AbstractAudioWriter*	m_writer;
 	TExportSpecification*	m_exportSpecification;
     Peak*                   m_peak;
 	
     GDither         m_dither;
+    TDitherState    m_ditherState;
     bool            m_processPeaks;
     bool            m_isRecording;
     nframes_t       m_sampleRate;
@@ -80,6 +88,15 @@ private:
     float*          m_dataBuffer;
     void*           m_outputData;
 
+    // Interleaved recording data waiting to be written, see process_realtime_buffers()
+    audio_sample_t* m_recordingBuffer;
+    nframes_t       m_recordingBufferFrames;
+    nframes_t       m_recordingBatchFrames;
+    std::atomic<qint64> m_writtenBytes;
+
+    void add_to_recording_batch(QueueBufferSlot* slot);
+    void flush_recording_batch();
+
     QueueBufferSlot* dequeue_from_free_queue(bool realTime);
 
     friend class DiskIO;
@@ -93,6 +110,7 @@ private:
     void set_decode_buffers(DecodeBuffer * /*fileReadBuffer*/, DecodeBuffer */*resampleDecodeBuffer*/) final {
         // Writesource does not support DecodeBuffers yet
     }
+    TTimeRef get_time_to_underrun(const TTimeRef& transportLocation) final;
 
 
 
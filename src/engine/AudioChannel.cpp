@@ -140,12 +140,16 @@ void AudioChannel::private_remove_monitor(TVUMonitor *monitor)
 
 void AudioChannel::add_monitor(TVUMonitor *monitor)
 {
-    tsar().add_gui_event(this, monitor, "private_add_monitor(TVUMonitor*)", "vuMonitorAdded(TVUMonitor*)");
+    TsarEvent event;
+    tsar().prepare_event(event, this, monitor, Tsar::call<AudioChannel, TVUMonitor, &AudioChannel::private_add_monitor>, "vuMonitorAdded(TVUMonitor*)");
+    tsar().post_gui_event(event);
 }
 
 void AudioChannel::remove_monitor(TVUMonitor *monitor)
 {
-    tsar().add_gui_event(this, monitor, "private_remove_monitor(TVUMonitor*)", "vuMonitorAdded(TVUMonitor*)");
+    TsarEvent event;
+    tsar().prepare_event(event, this, monitor, Tsar::call<AudioChannel, TVUMonitor, &AudioChannel::private_remove_monitor>, "vuMonitorAdded(TVUMonitor*)");
+    tsar().post_gui_event(event);
 }
 
 void AudioChannel::read_from_hardware_port(audio_sample_t *buf, nframes_t nframes)
@@ -53,6 +53,7 @@ RELAYTOOL_JACK
 
 //#include <sys/mman.h>
 #include <QDebug>
+#include <QThread>
 
 // Always put me below _all_ includes, this is needed
 // in case we run with memory leak detection enabled!
@@ -198,6 +199,9 @@ AudioDevice::AudioDevice()
     // sure no events will get lost
     tsar();
 
+    // The flight recorder's snapshot timer has to live in the GUI thread
+    flight_recorder();
+
     connect(this, SIGNAL(xrunStormDetected()), this, SLOT(switch_to_null_driver()));
     connect(&m_xrunResetTimer, SIGNAL(timeout()), this, SLOT(reset_xrun_counter()));
 
@@ -266,9 +270,30 @@ int AudioDevice::run_cycle( nframes_t nframes, float delayed_usecs )
     tsar().process_rt_event_slots();
     tsar().post_rt_event(finishedOneProcessCycleEvent);
 
+    m_processCycleCount.fetch_add(1, std::memory_order_release);
+
     return 1;
 }
 
+/**
+ *	Blocks until the audio thread completed a full process cycle that started after
+ *	this function was called. Any state change made before calling this function is
+ *	then seen by the clients, and no client is still processing with the old state.
+ *	Returns directly if the audio thread isn't running.
+ *
+ *	Note: Don't call this function from the audio thread!
+ */
+void AudioDevice::wait_for_process_cycle()
+{
+    // The cycle counted next might have started before we were called,
+    // the one after it certainly didn't
+    quint64 cycle = m_processCycleCount.load(std::memory_order_acquire) + 2;
+
+    while (m_runAudioThread && m_processCycleCount.load(std::memory_order_acquire) < cycle) {
+        QThread::usleep(500);
+    }
+}
+
 int AudioDevice::run_one_cycle( nframes_t nframes, float  )
 {
 
@@ -294,6 +319,28 @@ void AudioDevice::delay( float  )
 {
 }
 
+/**
+ * Runs one process cycle in the calling thread. Only works with the "Benchmark Driver",
+ * which is a Null Driver without an audio thread, so traverso-bench can drive the
+ * audio processing as fast as possible and time each cycle.
+ *
+ * @return 0 on success, -1 if the Benchmark Driver isn't loaded or the cycle failed
+ */
+int AudioDevice::run_benchmark_cycle()
+{
+    if (!m_driver || m_driverType != "Benchmark Driver") {
+        return -1;
+    }
+
+    set_transport_cycle_start_time(TTimeRef::get_nanoseconds_since_epoch());
+
+    int result = run_cycle(m_bufferSize, 0);
+
+    set_transport_cycle_end_time(TTimeRef::get_nanoseconds_since_epoch());
+
+    return result < 0 ? -1 : 0;
+}
+
 
 /**
  * This function is used to initialize the AudioDevice's audioThread with the supplied
@@ -481,6 +528,14 @@ int AudioDevice::create_driver(const QString& driverType, bool capture, bool pla
         return 1;
     }
 
+    // Not in m_availableDrivers, only used by traverso-bench, see run_benchmark_cycle()
+    if (driverType == "Benchmark Driver") {
+        printf("AudioDevice: Creating Benchmark Driver...\n");
+        m_driver = new TAudioDriver(this);
+        m_driverType = driverType;
+        return 1;
+    }
+
     return -1;
 }
 
@@ -776,7 +831,9 @@ void AudioDevice::private_remove_client(TAudioDeviceClient* client)
  */
 void AudioDevice::add_client( TAudioDeviceClient * client )
 {
-    tsar().add_gui_event(this, client, "private_add_client(TAudioDeviceClient*)", "audioDeviceClientAdded(TAudioDeviceClient*)");
+    TsarEvent event;
+    tsar().prepare_event(event, this, client, Tsar::call<AudioDevice, TAudioDeviceClient, &AudioDevice::private_add_client>, "audioDeviceClientAdded(TAudioDeviceClient*)");
+    tsar().post_gui_event(event);
 }
 
 /**
@@ -787,7 +844,9 @@ void AudioDevice::add_client( TAudioDeviceClient * client )
  */
 void AudioDevice::remove_client( TAudioDeviceClient * client )
 {
-    tsar().add_gui_event(this, client, "private_remove_client(TAudioDeviceClient*)", "audioDeviceClientRemoved(TAudioDeviceClient*)");
+    TsarEvent event;
+    tsar().prepare_event(event, this, client, Tsar::call<AudioDevice, TAudioDeviceClient, &AudioDevice::private_remove_client>, "audioDeviceClientRemoved(TAudioDeviceClient*)");
+    tsar().post_gui_event(event);
 }
 
 void AudioDevice::audiothread_finished() 
@@ -806,6 +865,8 @@ void AudioDevice::xrun( )
     tsar().add_rt_event(this, nullptr, "bufferUnderRun()");
 
     m_xrunCount++;
+    flight_recorder().trigger(TFlightRecorder::XRUN, this, m_xrunCount);
+
     if (m_xrunCount > 30) {
         tsar().add_rt_event(this, nullptr, "xrunStormDetected()");
     }
@@ -30,12 +30,15 @@ Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA.
 #include <QByteArray>
 #include <QTimer>
 #include <QVariant>
+#include <atomic>
 
 
 #include "RingBufferNPT.h"
 #include "TRealTimeLinkedList.h"
 #include "TAudioBusConfiguration.h"
 #include "TAudioDeviceSetup.h"
+#include "TDspProfiler.h"
+#include "TFlightRecorder.h"
 #include "TTimeRef.h"
 #include "TTransportControl.h"
 #include "defines.h"
@@ -86,6 +89,9 @@ public:
         void transport_stop(TAudioDeviceClient* client, const TTimeRef& location);
         int transport_seek_to(TAudioDeviceClient* client, const TTimeRef &location);
 
+        int run_benchmark_cycle();
+        void wait_for_process_cycle();
+
         TAudioDeviceSetup get_device_setup() {return m_setup;}
 
         AudioChannel* create_channel(const QString& name, uint channelNumber, int type);
@@ -169,6 +175,7 @@ private:
 
 	RingBufferNPT<trav_time_t>*	m_cpuTime;
 	volatile size_t		m_runAudioThread;
+	std::atomic<quint64>	m_processCycleCount{};
 	trav_time_t		m_cycleStartTime;
 	trav_time_t		m_lastCpuReadTime;
 	uint 			m_bufferSize;
@@ -199,6 +206,12 @@ private:
 	{
 		trav_time_t runcycleTime = time - m_cycleStartTime;
 		m_cpuTime->write(&runcycleTime, 1);
+		if (TDspProfiler::is_enabled()) {
+			dsp_profiler().record(TDspProfiler::CYCLE, this, runcycleTime);
+		}
+		if (TFlightRecorder::is_enabled() && m_rate > 0) {
+			flight_recorder().record(TFlightRecorder::CYCLE, this, runcycleTime, (qint64(m_bufferSize) * 1000000000) / m_rate);
+		}
 	}
 
         TAudioDriver* get_driver() const {return m_driver;}
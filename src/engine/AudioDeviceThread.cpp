@@ -97,6 +97,8 @@ void AudioDeviceThread::run()
     if (m_realTime) {
         become_realtime();
     }
+
+    dsp_profiler().register_thread();
 	
 	if (m_device->m_driver->start() < 0) {
 		watchdog.terminate();
@@ -151,7 +151,9 @@ void JackDriver::add_channel(AudioChannel* channel)
 
 
         if (is_running()) {
-            tsar().add_gui_event(this, pcpair, "private_add_port_channel_pair(PortChannelPair*)", "");
+            TsarEvent event;
+            tsar().prepare_event(event, this, pcpair, Tsar::call<JackDriver, PortChannelPair, &JackDriver::private_add_port_channel_pair>, "");
+            tsar().post_gui_event(event);
         } else {
             private_add_port_channel_pair(pcpair);
         }
@@ -194,6 +196,7 @@ int JackDriver::attach( )
         m_device->set_buffer_size( jack_get_buffer_size(m_jack_client) );
         m_device->set_sample_rate (jack_get_sample_rate(m_jack_client));
 
+        jack_set_thread_init_callback (m_jack_client, _thread_init_callback, this);
         jack_set_process_callback (m_jack_client, _process_callback, this);
         jack_set_xrun_callback (m_jack_client, _xrun_callback, this);
         jack_set_buffer_size_callback (m_jack_client, _bufsize_callback, this);
@@ -286,6 +289,12 @@ int JackDriver::_xrun_callback( void * arg )
         return 0;
 }
 
+// Called by jack in it's process thread, before the first process callback
+void JackDriver::_thread_init_callback(void* )
+{
+        dsp_profiler().register_thread();
+}
+
 int JackDriver::_process_callback (nframes_t nframes, void *arg)
 {
 	JackDriver* driver  = static_cast<JackDriver *> (arg);
@@ -83,6 +83,7 @@ private:
 	int  jack_sync_callback (jack_transport_state_t, jack_position_t*);
 
         static int _xrun_callback(void *arg);
+        static void _thread_init_callback(void* arg);
         static int  _process_callback (nframes_t nframes, void *arg);
         static int _bufsize_callback(jack_nframes_t nframes, void *arg);
 	static void _on_jack_shutdown_callback(void* arg);
@@ -23,6 +23,7 @@
 
 #include "AudioDevice.h"
 #include "AudioChannel.h"
+#include "TSampleConverter.h"
 
 #include <Utils.h>
 
@@ -57,13 +58,10 @@ int PADriver::_read(nframes_t nframes)
 		return 0;
 	}
 
-        int index = 0;
-        for(nframes_t i=0; i<nframes; i++) {
-                for (int chan=0; chan<m_captureChannels.size(); chan++) {
-                        AudioChannel* channel = m_captureChannels.at(chan);
-                        audio_sample_t* buf = channel->get_buffer(nframes);
-                        buf[i] = in[index++];
-                }
+        uint channelCount = uint(m_captureChannels.size());
+        for (uint chan=0; chan<channelCount; chan++) {
+                audio_sample_t* buf = m_captureChannels.at(chan)->get_buffer(nframes);
+                TSampleConverter::float_to_float(buf, 1, in + chan, channelCount, nframes);
         }
 
 	return 1;
@@ -78,11 +76,9 @@ int PADriver::_write(nframes_t nframes)
         float* out = (float*) m_paOutputBuffer;
 
 
-        int index = 0;
-        for(nframes_t i=0; i<nframes; i++) {
-                for (int chan=0; chan<m_playbackChannels.size(); chan++) {
-                        out[index++] = m_playbackChannels.at(chan)->get_buffer(nframes)[i];
-                }
+        uint channelCount = uint(m_playbackChannels.size());
+        for (uint chan=0; chan<channelCount; chan++) {
+                TSampleConverter::float_to_float(out + chan, channelCount, m_playbackChannels.at(chan)->get_buffer(nframes), 1, nframes);
         }
 	
         for (int chan=0; chan<m_playbackChannels.size(); chan++) {
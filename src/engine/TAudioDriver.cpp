@@ -94,6 +94,12 @@ int TAudioDriver::attach( )
     m_frameRate = 44100;
     m_framesPerCycle = 1024;
 
+    // The Benchmark Driver runs with the requested rate and buffer size
+    if (m_device->get_driver_type() == "Benchmark Driver") {
+        m_frameRate = m_device->get_sample_rate();
+        m_framesPerCycle = m_device->get_buffer_size();
+    }
+
     m_device->set_buffer_size (m_framesPerCycle);
     m_device->set_sample_rate (m_frameRate);
 
@@ -0,0 +1,252 @@
+/*
+Copyright (C) 2024 Remon Sijrier
+
+This file is part of Traverso
+
+Traverso is free software; you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation; either version 2 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program; if not, write to the Free Software
+Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA.
+
+*/
+
+#include "TRealTimeThreadPool.h"
+
+#include "TConfig.h"
+#include "TDspProfiler.h"
+
+#if defined (Q_OS_UNIX)
+#include <pthread.h>
+#include <sched.h>
+#endif
+
+#include <cerrno>
+
+// Always put me below _all_ includes, this is needed
+// in case we run with memory leak detection enabled!
+#include "Debugger.h"
+
+/** \class TRealTimeThreadPool
+ *	\brief A pool of realtime worker threads to spread the audio processing over multiple cores
+ *
+ *	The audio thread hands out a set of independent jobs with run_jobs(), processes jobs
+ *	itself too and returns once all of them are done. Handing out jobs doesn't allocate
+ *	and doesn't take locks, the workers are woken up with a semaphore and claim jobs
+ *	with a compare and swap on the job state. The job state holds the generation of the
+ *	run_jobs() call next to the job index, a worker preempted between reading and claiming
+ *	a job therefore can't claim a job of the next run_jobs() call.
+ *
+ *	The workers run with realtime priority, each pinned to it's own cpu, the audio
+ *	thread itself runs on cpu 0. The amount of workers is Hardware/AudioProcessingThreadCount,
+ *	0 disables the pool and run_jobs() then processes all jobs in the calling thread.
+ */
+
+// -1 for all threads not owned by the pool, e.g. the audio thread
+static thread_local int t_workerIndex = -1;
+
+
+TRealTimeThreadPool& rt_thread_pool()
+{
+    static TRealTimeThreadPool pool;
+    return pool;
+}
+
+
+TRealTimeWorkerThread::TRealTimeWorkerThread(TRealTimeThreadPool* pool, int index)
+    : m_pool(pool)
+    , m_index(index)
+{
+}
+
+void TRealTimeWorkerThread::run()
+{
+    t_workerIndex = m_index;
+
+    dsp_profiler().register_thread();
+
+#if defined (Q_OS_LINUX)
+    cpu_set_t mask;
+    CPU_ZERO(&mask);
+    // cpu 0 is used by the audio thread
+    CPU_SET((m_index + 1) % qMax(1, QThread::idealThreadCount()), &mask);
+    if (pthread_setaffinity_np(pthread_self(), sizeof(mask), &mask) != 0) {
+        printf("RealTimeWorkerThread %d: Unable to set CPU affinity\n", m_index);
+    }
+#endif
+
+#if defined (Q_OS_UNIX)
+    // Just below the audio thread
+    struct sched_param param;
+    param.sched_priority = 69;
+    if (pthread_setschedparam(pthread_self(), SCHED_FIFO, &param) != 0) {
+        printf("RealTimeWorkerThread %d: Unable to set realtime priority\n", m_index);
+    }
+#endif
+
+    m_pool->worker_loop();
+}
+
+
+TRealTimeThreadPool::TRealTimeThreadPool()
+{
+    m_function = nullptr;
+    m_data = nullptr;
+    m_generation = 0;
+    m_jobState = 0;
+    m_finishedJobs = 0;
+    m_stopThreads = false;
+
+#if defined (Q_OS_LINUX)
+    sem_init(&m_jobsAvailable, 0, 0);
+#endif
+
+    // The audio thread processes jobs too, so by default one worker less then there are cores
+    int maxWorkers = qMax(0, QThread::idealThreadCount() - 1);
+    int workerCount = qBound(0, config().get_property("Hardware", "AudioProcessingThreadCount", maxWorkers).toInt(), maxWorkers);
+
+    for (int i=0; i<workerCount; ++i) {
+        auto thread = new TRealTimeWorkerThread(this, i);
+        thread->start(QThread::TimeCriticalPriority);
+        m_threads.append(thread);
+    }
+
+    printf("RealTimeThreadPool: Using %d audio processing worker threads\n", workerCount);
+}
+
+TRealTimeThreadPool::~TRealTimeThreadPool()
+{
+    m_stopThreads = true;
+    wake_workers(m_threads.size());
+
+    for (auto thread : m_threads) {
+        thread->wait();
+        delete thread;
+    }
+
+#if defined (Q_OS_LINUX)
+    sem_destroy(&m_jobsAvailable);
+#endif
+}
+
+/**
+ *	Calls \a function for each job index in the range [0, \a jobCount), spread over the
+ *	audio thread and the worker threads. Returns when all jobs have been processed.
+ *
+ *	Note: This function should only be called from the audio thread!
+ */
+void TRealTimeThreadPool::run_jobs(job_function_t function, void* data, int jobCount)
+{
+    if (jobCount <= 0) {
+        return;
+    }
+
+    if (m_threads.isEmpty() || jobCount == 1) {
+        for (int i=0; i<jobCount; ++i) {
+            function(data, i);
+        }
+        return;
+    }
+
+    Q_ASSERT(jobCount <= int(JOB_INDEX_MASK));
+
+    m_function = function;
+    m_data = data;
+    m_finishedJobs.store(0, std::memory_order_relaxed);
+    ++m_generation;
+    // Publishes the job to the workers, starting at job index 0
+    m_jobState.store((quint64(m_generation) << GENERATION_SHIFT) | (quint64(jobCount) << JOB_COUNT_SHIFT), std::memory_order_release);
+
+    wake_workers(qMin(jobCount - 1, m_threads.size()));
+
+    process_jobs();
+
+    // The remaining jobs are being processed by the workers, they run on
+    // their own cpu so busy waiting is the fastest way to continue
+    while (m_finishedJobs.load(std::memory_order_acquire) < jobCount) {
+    }
+}
+
+/**
+ *	Returns the index of the worker thread calling this function, or -1 if the
+ *	calling thread isn't one of the pool's workers
+ */
+int TRealTimeThreadPool::current_worker_index()
+{
+    return t_workerIndex;
+}
+
+void TRealTimeThreadPool::process_jobs()
+{
+    quint64 state = m_jobState.load(std::memory_order_acquire);
+
+    while (true) {
+        int jobIndex = int(state & JOB_INDEX_MASK);
+        int jobCount = int((state >> JOB_COUNT_SHIFT) & JOB_INDEX_MASK);
+
+        // All jobs are claimed, this includes a worker woken up too late for the
+        // previous run_jobs() call, which finds the job state exhausted
+        if (jobIndex >= jobCount) {
+            return;
+        }
+
+        // Fails if another thread claimed this job or if a new run_jobs() call
+        // replaced the job state in the mean time, state is reloaded in that case
+        if (!m_jobState.compare_exchange_weak(state, state + 1, std::memory_order_acq_rel, std::memory_order_acquire)) {
+            continue;
+        }
+
+        // The claimed job isn't finished yet, so run_jobs() can't return and
+        // m_function and m_data still belong to the generation we claimed from
+        m_function(m_data, jobIndex);
+
+        m_finishedJobs.fetch_add(1, std::memory_order_release);
+
+        state = m_jobState.load(std::memory_order_acquire);
+    }
+}
+
+void TRealTimeThreadPool::worker_loop()
+{
+    while (true) {
+        wait_for_jobs();
+
+        if (m_stopThreads) {
+            return;
+        }
+
+        process_jobs();
+    }
+}
+
+void TRealTimeThreadPool::wake_workers(int count)
+{
+#if defined (Q_OS_LINUX)
+    // sem_post() doesn't block, it's safe to use in the audio thread
+    for (int i=0; i<count; ++i) {
+        sem_post(&m_jobsAvailable);
+    }
+#else
+    m_jobsAvailable.release(count);
+#endif
+}
+
+void TRealTimeThreadPool::wait_for_jobs()
+{
+#if defined (Q_OS_LINUX)
+    while (sem_wait(&m_jobsAvailable) != 0 && errno == EINTR) {
+    }
+#else
+    m_jobsAvailable.acquire();
+#endif
+}
+
+//eof
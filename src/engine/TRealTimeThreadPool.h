@@ -0,0 +1,103 @@
+/*
+Copyright (C) 2024 Remon Sijrier
+
+This file is part of Traverso
+
+Traverso is free software; you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation; either version 2 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program; if not, write to the Free Software
+Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA.
+
+*/
+
+#ifndef TREALTIMETHREADPOOL_H
+#define TREALTIMETHREADPOOL_H
+
+#include <QList>
+#include <QThread>
+#include <atomic>
+
+#if defined (Q_OS_LINUX)
+#include <semaphore.h>
+#else
+#include <QSemaphore>
+#endif
+
+class TRealTimeThreadPool;
+
+class TRealTimeWorkerThread : public QThread
+{
+public:
+    TRealTimeWorkerThread(TRealTimeThreadPool* pool, int index);
+
+protected:
+    void run() override;
+
+private:
+    TRealTimeThreadPool* m_pool;
+    int m_index;
+};
+
+
+class TRealTimeThreadPool
+{
+public:
+    typedef void (*job_function_t)(void* data, int jobIndex);
+
+    void run_jobs(job_function_t function, void* data, int jobCount);
+
+    int get_worker_count() const {return m_threads.size();}
+
+    static int current_worker_index();
+
+private:
+    // The job state packs the run generation, the job count and the next job index
+    // into one atomic, so a job can only be claimed for the run it belongs to
+    static const quint64 JOB_INDEX_MASK = 0xffff;
+    static const int JOB_COUNT_SHIFT = 16;
+    static const int GENERATION_SHIFT = 32;
+
+    QList<TRealTimeWorkerThread*> m_threads;
+
+    job_function_t      m_function;
+    void*               m_data;
+    quint32             m_generation;
+    std::atomic<quint64> m_jobState;
+    std::atomic<int>    m_finishedJobs;
+    std::atomic<bool>   m_stopThreads;
+
+#if defined (Q_OS_LINUX)
+    sem_t               m_jobsAvailable;
+#else
+    QSemaphore          m_jobsAvailable;
+#endif
+
+    void wake_workers(int count);
+    void wait_for_jobs();
+    void process_jobs();
+    void worker_loop();
+
+    TRealTimeThreadPool();
+    ~TRealTimeThreadPool();
+    TRealTimeThreadPool(const TRealTimeThreadPool&);
+
+    // allow this function to create one instance
+    friend TRealTimeThreadPool& rt_thread_pool();
+    friend class TRealTimeWorkerThread;
+};
+
+// use this function to access the realtime audio processing thread pool
+TRealTimeThreadPool& rt_thread_pool();
+
+#endif
+
+//eof
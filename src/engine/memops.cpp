@@ -32,6 +32,7 @@
 #include <climits>
 
 #include <memops.h> 
+#include "TSampleConverter.h"
 
 #define SAMPLE_MAX_24BIT  8388608.0f
 #define SAMPLE_MAX_16BIT  32768.0f
@@ -81,31 +82,13 @@ void sample_move_d32u24_sSs (char *dst, audio_sample_t *src, unsigned long nsamp
 void sample_move_d32u24_sS (char *dst, audio_sample_t *src, unsigned long nsamples, unsigned long dst_skip, dither_state_t*)
 
 {
-        long long y;
-
-	while (nsamples--) {
-		y = (long long)(*src * SAMPLE_MAX_24BIT) << 8;
-		if (y > INT_MAX) {
-			*((int *) dst) = INT_MAX;
-		} else if (y < INT_MIN) {
-			*((int *) dst) = INT_MIN;
-		} else {
-			*((int *) dst) = (int)y;
-		}
-		dst += dst_skip;
-		src++;
-	}
+	// float_to_int32() clips to the int32 range, the lower 8 bits are ignored by the hardware
+	TSampleConverter::float_to_int32((int32_t*) dst, dst_skip / sizeof(int32_t), src, nsamples, SAMPLE_MAX_24BIT * 256.0f);
 }	
 
 void sample_move_dS_s32u24 (audio_sample_t *dst, const char *src, unsigned long nsamples, unsigned long src_skip)
 {
-	/* ALERT: signed sign-extension portability !!! */
-
-	while (nsamples--) {
-		*dst = (*((int *) src) >> 8) / SAMPLE_MAX_24BIT;
-		dst++;
-		src += src_skip;
-	}
+	TSampleConverter::int32_to_float(dst, (const int32_t*) src, src_skip / sizeof(int32_t), nsamples, 1.0f / (SAMPLE_MAX_24BIT * 256.0f));
 }	
 
 void sample_move_dither_rect_d32u24_sS (char *dst, audio_sample_t *src, unsigned long nsamples, unsigned long dst_skip, dither_state_t *)
@@ -381,6 +364,10 @@ void sample_move_dither_shaped_d32u24_sSs (char *dst,  audio_sample_t *src, unsi
 void sample_move_d24_sS (char *dst, audio_sample_t *src, unsigned long nsamples, unsigned long dst_skip, dither_state_t *)
 
 {
+#if __BYTE_ORDER == __LITTLE_ENDIAN
+	// TSampleConverter uses packed little endian 24 bit samples
+	TSampleConverter::float_to_int24(dst, dst_skip / 3, src, nsamples, nullptr);
+#else
         long long y;
 
 	while (nsamples--) {
@@ -399,6 +386,7 @@ void sample_move_d24_sS (char *dst, audio_sample_t *src, unsigned long nsamples,
 		dst += dst_skip;
 		src++;
 	}
+#endif
 }	
 
 void sample_move_d24_sSs (char *dst, audio_sample_t *src, unsigned long nsamples, unsigned long dst_skip, dither_state_t * /*state*/)
@@ -433,6 +421,9 @@ void sample_move_d24_sSs (char *dst, audio_sample_t *src, unsigned long nsamples
 
 void sample_move_dS_s24 (audio_sample_t *dst, const char *src, unsigned long nsamples, unsigned long src_skip)
 {
+#if __BYTE_ORDER == __LITTLE_ENDIAN
+	TSampleConverter::int24_to_float(dst, src, src_skip / 3, nsamples);
+#else
 	/* ALERT: signed sign-extension portability !!! */
 
 	while (nsamples--) {
@@ -447,6 +438,7 @@ void sample_move_dS_s24 (audio_sample_t *dst, const char *src, unsigned long nsa
 		dst++;
 		src += src_skip;
 	}
+#endif
 }	
 
 void sample_move_dither_rect_d24_sS (char *dst, audio_sample_t *src, unsigned long nsamples, unsigned long dst_skip, dither_state_t *)
@@ -737,22 +729,7 @@ void sample_move_dither_shaped_d24_sSs (char *dst,  audio_sample_t *src, unsigne
 void sample_move_d16_sS (char *dst,  audio_sample_t *src, unsigned long nsamples, unsigned long dst_skip, dither_state_t* )
 	
 {
-	int tmp;
-
-	/* ALERT: signed sign-extension portability !!! */
-
-	while (nsamples--) {
-		tmp = f_round(*src * SAMPLE_MAX_16BIT);
-		if (tmp > SHRT_MAX) {
-			*((short *)dst) = SHRT_MAX;
-		} else if (tmp < SHRT_MIN) {
-			*((short *)dst) = SHRT_MIN;
-		} else {
-			*((short *) dst) = (short) tmp;
-		}
-		dst += dst_skip;
-		src++;
-	}
+	TSampleConverter::float_to_int16((int16_t*) dst, dst_skip / sizeof(int16_t), src, nsamples, nullptr);
 }
 
 void sample_move_dither_rect_d16_sSs (char *dst,  audio_sample_t *src, unsigned long nsamples, unsigned long dst_skip, dither_state_t * /*state*/)
@@ -1014,12 +991,7 @@ void sample_move_dither_shaped_d16_sS (char *dst,  audio_sample_t *src, unsigned
 void sample_move_dS_s16 (audio_sample_t *dst, const char *src, unsigned long nsamples, unsigned long src_skip) 
 	
 {
-	/* ALERT: signed sign-extension portability !!! */
-	while (nsamples--) {
-		*dst = (*((short *) src)) / SAMPLE_MAX_16BIT;
-		dst++;
-		src += src_skip;
-	}
+	TSampleConverter::int16_to_float(dst, (const int16_t*) src, src_skip / sizeof(int16_t), nsamples);
 }	
 
 void sample_merge_d16_sS (char *dst,  audio_sample_t *src, unsigned long nsamples, unsigned long dst_skip, dither_state_t *)
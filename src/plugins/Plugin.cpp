@@ -221,6 +221,7 @@ QString PluginControlPort::get_symbol()
 void PluginControlPort::set_control_value(float value)
 {
 	m_value = value;
+	emit controlValueChanged(m_value);
 }
 
 void PluginControlPort::set_use_automation(bool automation)
@@ -165,6 +165,9 @@ protected:
 
 public slots:
     void set_control_value(float value);
+
+signals:
+    void controlValueChanged(float value);
 };
 
 
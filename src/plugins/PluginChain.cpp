@@ -24,6 +24,7 @@ Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA.
 #include "Plugin.h"
 #include "PluginManager.h"
 #include "TInputEventDispatcher.h"
+#include "TDspProfiler.h"
 #include "TSession.h"
 #include "AddRemove.h"
 #include "GainEnvelope.h"
@@ -102,8 +103,8 @@ TCommand* PluginChain::add_plugin(Plugin * plugin, bool historable)
     plugin->set_history_stack(get_history_stack());
 
     return new AddRemove( this, plugin, historable, m_session,
-                          "private_add_plugin(Plugin*)", "privatePluginAdded(Plugin*)",
-                          "private_remove_plugin(Plugin*)", "privatePluginRemoved(Plugin*)",
+                          Tsar::call<PluginChain, Plugin, &PluginChain::private_add_plugin>, "privatePluginAdded(Plugin*)",
+                          Tsar::call<PluginChain, Plugin, &PluginChain::private_remove_plugin>, "privatePluginRemoved(Plugin*)",
                           tr("Add Plugin (%1)").arg(plugin->get_name()));
 }
 
@@ -117,8 +118,8 @@ TCommand* PluginChain::remove_plugin(Plugin* plugin, bool historable)
     }
 
     return new AddRemove( this, plugin, historable, m_session,
-                          "private_remove_plugin(Plugin*)", "privatePluginRemoved(Plugin*)",
-                          "private_add_plugin(Plugin*)", "privatePluginAdded(Plugin*)",
+                          Tsar::call<PluginChain, Plugin, &PluginChain::private_remove_plugin>, "privatePluginRemoved(Plugin*)",
+                          Tsar::call<PluginChain, Plugin, &PluginChain::private_add_plugin>, "privatePluginAdded(Plugin*)",
                           tr("Remove Plugin (%1)").arg(plugin->get_name()));
 }
 
@@ -196,6 +197,7 @@ void PluginChain::process_pre_fader(AudioBus *bus, nframes_t nframes)
         if (plugin == m_fader) {
             return;
         }
+        TDspProfileScope profileScope(TDspProfiler::PLUGIN, plugin);
         plugin->process(bus, nframes);
     }
 }
@@ -210,6 +212,7 @@ int PluginChain::process_post_fader(AudioBus *bus, nframes_t nframes)
 
     for(Plugin* plugin = m_rtPlugins.first(); plugin != nullptr; plugin = plugin->next) {
         if (faderWasReached) {
+            TDspProfileScope profileScope(TDspProfiler::PLUGIN, plugin);
             plugin->process(bus, nframes);
         } else if (plugin == m_fader) {
             faderWasReached = true;
@@ -28,7 +28,7 @@ Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA.
 GainEnvelope::GainEnvelope(TSession* session)
         : Plugin(session)
 {
-    m_gain = 1.0f;
+    m_gain = m_appliedGain = 1.0f;
 	PluginControlPort* port = new PluginControlPort(this, 0, 1.0);
 	port->set_index(0);
 	m_controlPorts.append(port);
@@ -70,6 +70,7 @@ int GainEnvelope::set_state(const QDomNode & node)
 	
 	QDomElement e = node.toElement();
 	m_gain = e.attribute("gain", "1.0").toFloat();
+	m_appliedGain = m_gain;
 	
 	return 1;
 }
@@ -109,13 +110,54 @@ Curve * GainEnvelope::get_curve()
 void GainEnvelope::process_gain(audio_sample_t** buffer, const TTimeRef& startlocation, const TTimeRef& endlocation, nframes_t nframes, uint channels)
 {
         PluginControlPort* port = m_controlPorts.at(0);
+        float gain = m_gain;
 
         if (port->use_automation()) {
-                port->get_curve()->process(buffer, startlocation, endlocation, nframes, channels, m_gain);
-        } else {
+                port->get_curve()->process(buffer, startlocation, endlocation, nframes, channels, gain);
+        } else if (gain != m_appliedGain) {
+                // Ramp towards the new fader value to avoid zipper noise
+                for (uint chan=0; chan<channels; ++chan) {
+                        Mixer::apply_gain_ramp(buffer[chan], nframes, m_appliedGain, gain);
+                }
+        } else if (gain != 1.0f) {
                 for (uint chan=0; chan<channels; ++chan) {
-                        Mixer::apply_gain_to_buffer(buffer[chan], nframes, m_gain);
+                        Mixer::apply_gain_to_buffer(buffer[chan], nframes, gain);
                 }
         }
+
+        m_appliedGain = gain;
 }
 
+/**
+ *	Mixes \a src with the gain (envelope) applied into \a dst in a single pass, see
+ *	process_gain(). \a src is left untouched.
+ */
+void GainEnvelope::process_gain_mix(audio_sample_t** dst, audio_sample_t** src, const TTimeRef& startlocation, const TTimeRef& endlocation, nframes_t nframes, uint channels)
+{
+        PluginControlPort* port = m_controlPorts.at(0);
+        float gain = m_gain;
+
+        if (port->use_automation()) {
+                port->get_curve()->process_mix(dst, src, startlocation, endlocation, nframes, channels, gain);
+        } else if (gain != m_appliedGain) {
+                // Ramp towards the new fader value to avoid zipper noise
+                audio_sample_t* gainbuffer = m_session->get_gain_buffer();
+                float step = (gain - m_appliedGain) / nframes;
+                for (nframes_t i=0; i<nframes; ++i) {
+                        gainbuffer[i] = m_appliedGain + step * float(i);
+                }
+                for (uint chan=0; chan<channels; ++chan) {
+                        Mixer::mix_with_gain_vector(dst[chan], src[chan], gainbuffer, nframes, 1.0f);
+                }
+        } else if (gain != 1.0f) {
+                for (uint chan=0; chan<channels; ++chan) {
+                        Mixer::mix_buffers_with_gain(dst[chan], src[chan], nframes, gain);
+                }
+        } else {
+                for (uint chan=0; chan<channels; ++chan) {
+                        Mixer::mix_buffers_no_gain(dst[chan], src[chan], nframes);
+                }
+        }
+
+        m_appliedGain = gain;
+}
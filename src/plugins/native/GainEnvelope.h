@@ -41,6 +41,7 @@ public:
 	int set_state(const QDomNode & node );
     void process(AudioBus* bus, nframes_t nframes);
 	void process_gain(audio_sample_t** buffer, const TTimeRef& startlocation, const TTimeRef& endlocation, nframes_t nframes, uint channels);
+	void process_gain_mix(audio_sample_t** dst, audio_sample_t** src, const TTimeRef& startlocation, const TTimeRef& endlocation, nframes_t nframes, uint channels);
 	
         void set_session(TSession* session);
 	void set_gain(float gain) {m_gain = gain;}
@@ -51,6 +52,8 @@ public:
 	
 private:
 	float m_gain;
+	// The gain used in the previous process cycle, only accessed by the audio thread
+	float m_appliedGain;
 };
 
 #endif
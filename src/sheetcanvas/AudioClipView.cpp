@@ -37,6 +37,7 @@ Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA.
 #include "ResourcesManager.h"
 #include "ProjectManager.h"
 #include "Peak.h"
+#include "TPeakTileCache.h"
 #include "Information.h"
 #include "Themer.h"
 #include "TConfig.h"
@@ -48,6 +49,7 @@ Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA.
 
 #include <QFileDialog>
 #include <QLinearGradient>
+#include <QVarLengthArray>
 #include <cmath>
 #include "dialogs/AudioClipEditDialog.h"
 #include "Fade.h"
@@ -98,6 +100,7 @@ AudioClipView::AudioClipView(SheetView* sv, AudioTrackView* parent, AudioClip* c
     connect(m_clip, SIGNAL(fadeAdded(FadeCurve*)), this, SLOT(add_new_fade_curve_view(FadeCurve*)));
     connect(m_clip, SIGNAL(fadeRemoved(FadeCurve*)), this, SLOT(remove_fade_curve_view(FadeCurve*)));
     connect(m_clip, SIGNAL(positionChanged()), this, SLOT(position_changed()));
+    connect(&peak_tile_cache(), SIGNAL(tileLoaded(Peak*)), this, SLOT(peak_tile_loaded(Peak*)));
 
     if (m_clip->recording_state() == AudioClip::RECORDING) {
         start_recording();
@@ -184,7 +187,7 @@ void AudioClipView::paint(QPainter* painter, const QStyleOptionGraphicsItem *opt
             QString buildProcess = "Building Peaks: " + si + "%";
             painter->drawText(r, Qt::AlignVCenter, buildProcess);
 
-        } else if (m_clip->recording_state() == AudioClip::NO_RECORDING) {
+        } else {
             //                        PROFILE_START;
             draw_peaks(painter, option->exposedRect.x(), pixelcount);
             //                        PROFILE_END("draw peaks");
@@ -215,7 +218,9 @@ void AudioClipView::draw_peaks(QPainter* p, qreal xstart, int pixelcount)
 {
     PENTER4;
 
-    Peak* peak = m_clip->get_peak();
+    // While recording the peak data comes from the take's WriteSource
+    bool recording = m_clip->recording_state() == AudioClip::RECORDING;
+    Peak* peak = recording ? m_clip->get_recording_peak() : m_clip->get_peak();
 
     // clip away the outline which are painted again vertically
     // in Qt 4.6.x, it doesn't happen in Qt 4.5.x
@@ -230,7 +235,7 @@ void AudioClipView::draw_peaks(QPainter* p, qreal xstart, int pixelcount)
         return;
     }
 
-    bool microView = m_sheet->get_hzoom() < 64 ? true : false;
+    bool microView = !Peak::is_macro_view(m_sheet->get_hzoom());
     TTimeRef clipstartoffset = m_clip->get_source_start_location();
     uint channels = m_clip->get_channel_count();
     int peakdatacount = microView ? pixelcount : pixelcount * 2;
@@ -294,33 +299,58 @@ void AudioClipView::draw_peaks(QPainter* p, qreal xstart, int pixelcount)
         mixCurveData |= fademix;
     }
 
-    // Load peak data, mix curvedata and start painting it
+    // Load peak data from the tile cache. Tiles that aren't resident yet are calculated
+    // in the background, peak_tile_loaded() takes care of repainting once they arrive.
     // if no peakdata is returned for a certain Peak object, schedule it for loading.
+    const int valuesPerPixel = microView ? 1 : 2;
+    const qint64 firstPixel = qint64(std::floor(xstart + offset));
+    QVarLengthArray<float> peakBuffer(int(channels) * peakdatacount);
+    QVarLengthArray<float> tileData(TPeakTileCache::TILE_SIZE * 2);
+
     for (uint chan=0; chan < channels; ++chan) {
+        pixeldata[chan] = peakBuffer.data() + chan * peakdatacount;
+        memset(pixeldata[chan], 0, size_t(peakdatacount) * sizeof(float));
 
-        int availpeaks = peak->calculate_peaks(
-                    chan,
-                    &pixeldata[chan],
-            TTimeRef(xstart * m_sv->timeref_scalefactor) + clipstartoffset,
-                    peakdatacount,
-                    m_sheet->get_hzoom());
+        if (recording) {
+            peak->get_live_peak_data(chan, pixeldata[chan], TTimeRef(firstPixel * m_sv->timeref_scalefactor), peakdatacount, m_sheet->get_hzoom());
+            continue;
+        }
 
+        qint64 pixel = firstPixel;
+        int filled = 0;
 
-        if (peakdatacount != availpeaks) {
-            // 			PWARN("peakdatacount != availpeaks (%d, %d)", peakdatacount, availpeaks);
-        }
+        while (filled < pixelcount) {
+            qint64 tileIndex = pixel / TPeakTileCache::TILE_SIZE;
+            int tileOffset = int(pixel % TPeakTileCache::TILE_SIZE);
+            int count = qMin(TPeakTileCache::TILE_SIZE - tileOffset, pixelcount - filled);
 
-        if (availpeaks == Peak::NO_PEAK_FILE) {
-            connect(peak, SIGNAL(progress(int)), this, SLOT(update_progress_info(int)));
-            connect(peak, SIGNAL(finished()), this, SLOT (peak_creation_finished()));
-            m_waitingForPeaks = true;
-            peak->start_peak_loading();
-            return;
-        }
+            int availpeaks = peak_tile_cache().get_tile(peak, chan, m_sheet->get_hzoom(), m_sv->timeref_scalefactor, tileIndex, tileData.data());
 
-        if (availpeaks == Peak::PERMANENT_FAILURE || availpeaks == Peak::NO_PEAKDATA_FOUND) {
-            return;
+            if (availpeaks == Peak::NO_PEAK_FILE) {
+                connect(peak, SIGNAL(progress(int)), this, SLOT(update_progress_info(int)));
+                connect(peak, SIGNAL(finished()), this, SLOT (peak_creation_finished()));
+                m_waitingForPeaks = true;
+                peak->start_peak_loading();
+                return;
+            }
+
+            if (availpeaks == Peak::PERMANENT_FAILURE) {
+                return;
+            }
+
+            if (availpeaks > 0) {
+                memcpy(pixeldata[chan] + filled * valuesPerPixel,
+                       tileData.data() + tileOffset * valuesPerPixel,
+                       size_t(count * valuesPerPixel) * sizeof(float));
+            }
+
+            filled += count;
+            pixel += count;
         }
+    }
+
+    // Mix curvedata and start painting it
+    for (uint chan=0; chan < channels; ++chan) {
 
         if (m_mergedView && channels == 2 && chan == 0) continue;
 
@@ -536,7 +566,7 @@ void AudioClipView::draw_db_lines(QPainter* p, qreal xstart, int pixelcount)
     p->save();
 
     int channels = m_clip->get_channel_count();
-    bool microView = m_sheet->get_hzoom() < 64 ? true : false;
+    bool microView = !Peak::is_macro_view(m_sheet->get_hzoom());
     int linestartpos = xstart;
     if (xstart < m_lineOffset) linestartpos = m_lineOffset;
 
@@ -607,7 +637,7 @@ void AudioClipView::draw_db_lines(QPainter* p, qreal xstart, int pixelcount)
 void AudioClipView::create_brushes()
 {
     /** TODO: The following part is identical to calculations in draw_db_lines(). Move to a central place. **/
-    bool microView = m_sheet->get_hzoom() < 64 ? true : false;
+    bool microView = !Peak::is_macro_view(m_sheet->get_hzoom());
     int channels = m_clip->get_channel_count();
 
     if ((m_mergedView) || (channels == 0)) {
@@ -671,9 +701,20 @@ void AudioClipView::update_progress_info( int progress )
 void AudioClipView::peak_creation_finished()
 {
     m_waitingForPeaks = false;
+    // Drop tiles and errors of the Peak from before it was (re)build
+    if (Peak* peak = m_clip->get_peak()) {
+        peak_tile_cache().invalidate(peak);
+    }
     update();
 }
 
+void AudioClipView::peak_tile_loaded(Peak* peak)
+{
+    if (peak == m_clip->get_peak()) {
+        update();
+    }
+}
+
 void AudioClipView::add_new_fade_curve_view( FadeCurve * fade )
 {
     PENTER;
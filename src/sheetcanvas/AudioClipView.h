@@ -133,6 +133,7 @@ public slots:
 private slots:
 	void update_progress_info(int progress);
 	void peak_creation_finished();
+	void peak_tile_loaded(Peak* peak);
 	void start_recording();
 	void finish_recording();
 	void update_recording();
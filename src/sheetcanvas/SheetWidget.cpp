@@ -134,6 +134,15 @@ SheetWidget::SheetWidget(TSession* sheet, QWidget* parent)
         connect(m_zoomSlider, SIGNAL(sliderMoved(int)), this, SLOT(zoom_slider_value_changed(int)));
         connect(m_session, SIGNAL(hzoomChanged()), this, SLOT(sheet_zoom_level_changed()));
 
+        // No edits (e.g. dropping files) while a render reads the Sheet, child
+        // sessions show the tracks of their parent Sheet
+        TSession* lockSession = m_session->get_parent_session() ? m_session->get_parent_session() : m_session;
+        if (auto renderSheet = qobject_cast<Sheet*>(lockSession)) {
+                connect(renderSheet, &Sheet::renderLockChanged, this, [this](bool locked) {
+                        setEnabled(!locked);
+                });
+        }
+
         zoomLayout->addWidget(zoomLabel);
         zoomLayout->addWidget(m_zoomSlider);
 
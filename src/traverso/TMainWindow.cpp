@@ -84,6 +84,7 @@ Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA.
 #include "widgets/InfoWidgets.h"
 #include "widgets/ResourcesWidget.h"
 #include "widgets/CorrelationMeterWidget.h"
+#include "widgets/TDspProfilerWidget.h"
 #include "widgets/SpectralMeterWidget.h"
 #include "widgets/TransportConsoleWidget.h"
 #include "widgets/WelcomeWidget.h"
@@ -224,6 +225,13 @@ TMainWindow::TMainWindow()
 	addDockWidget(Qt::TopDockWidgetArea, m_spectralMeterDW);
 	m_spectralMeterDW->hide();
 
+	m_dspProfilerDW = new QDockWidget(tr("DSP Load"), this);
+	m_dspProfilerDW->setObjectName("DspProfilerDockWidget");
+	m_dspProfiler = new TDspProfilerWidget(m_dspProfilerDW);
+	m_dspProfilerDW->setWidget(m_dspProfiler);
+	addDockWidget(Qt::BottomDockWidgetArea, m_dspProfilerDW);
+	m_dspProfilerDW->hide();
+
 	// BusMonitor
 	m_busMonitorDW = new QDockWidget(tr("VU Meters"), this);
 	m_busMonitorDW->setObjectName(tr("VU Meters"));
@@ -486,6 +494,7 @@ void TMainWindow::add_session(TSession *session)
 		connect(session, SIGNAL(snapChanged()), this, SLOT(update_snap_state()));
 		connect(session, SIGNAL(sessionAdded(TSession*)), this, SLOT(add_session(TSession*)));
 		connect(session, SIGNAL(sessionRemoved(TSession*)), this, SLOT(remove_session(TSession*)));
+		connect(session, SIGNAL(renderLockChanged(bool)), this, SLOT(update_history_state()));
 	}
 }
 
@@ -547,6 +556,7 @@ void TMainWindow::show_session(TSession* session)
 
 	if (session) {
         ContextItem::get_undogroup()->setActiveStack(session->get_history_stack());
+        update_history_state();
         // Update scrollbars in order to reset the snapList's range
         m_currentSheetWidget->get_sheetview()->update_scrollbars();
 //                setWindowTitle(m_project->get_title() + ": Sheet " + session->get_name() + " - Traverso");
@@ -891,6 +901,7 @@ void TMainWindow::create_menus( )
 
 	menu->addAction(m_correlationMeterDW->toggleViewAction());
 	menu->addAction(m_spectralMeterDW->toggleViewAction());
+	menu->addAction(m_dspProfilerDW->toggleViewAction());
 
 	menu->addSeparator();
 	action = menu->addAction(tr("ToolBars"));
@@ -1896,13 +1907,47 @@ void TMainWindow::reset_vu_levels_peak_hold_value()
 
 TCommand* TMainWindow::undo()
 {
+    if (history_is_render_locked()) {
+        info().information(tr("The Sheet is busy rendering, try again when it's done"));
+        return 0;
+    }
     ContextItem::get_undogroup()->undo();
     return 0;
 }
 
 TCommand* TMainWindow::redo()
 {
+    if (history_is_render_locked()) {
+        info().information(tr("The Sheet is busy rendering, try again when it's done"));
+        return 0;
+    }
     ContextItem::get_undogroup()->redo();
     return 0;
 }
 
+/**
+ *	The active history stack belongs to the current Sheet, child sessions share the
+ *	stack of their parent. Undo and redo run the commands synchronously when the
+ *	transport isn't rolling, which isn't allowed while a render reads the Sheet,
+ *	see Sheet::set_render_locked()
+ */
+bool TMainWindow::history_is_render_locked() const
+{
+    if (!m_currentSheetWidget) {
+        return false;
+    }
+
+    TSession* session = m_currentSheetWidget->get_session();
+    if (session->get_parent_session()) {
+        session = session->get_parent_session();
+    }
+
+    Sheet* sheet = qobject_cast<Sheet*>(session);
+    return sheet && sheet->is_render_locked();
+}
+
+void TMainWindow::update_history_state()
+{
+    m_historyWidget->setEnabled(!history_is_render_locked());
+}
+
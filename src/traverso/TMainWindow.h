@@ -60,6 +60,7 @@ class ResourcesInfoWidget;
 class SheetWidget;
 class CorrelationMeterWidget;
 class SpectralMeterWidget;
+class TDspProfilerWidget;
 class TransportConsoleWidget;
 class SettingsDialog;
 class ProjectManagerDialog;
@@ -143,6 +144,8 @@ private:
         TransportConsoleWidget*	m_transportConsole;
         QDockWidget*		m_spectralMeterDW;
         SpectralMeterWidget*	m_spectralMeter;
+        QDockWidget*		m_dspProfilerDW;
+        TDspProfilerWidget*	m_dspProfiler;
 	SettingsDialog*		m_settingsdialog;
 	ProjectManagerDialog*	m_projectManagerDialog;
 	OpenProjectDialog*	m_openProjectDialog;
@@ -186,6 +189,7 @@ private:
         void set_project_actions_enabled(bool enable);
 	void save_config_and_emit_message(const QString& message);
         void track_finder_show_initial_text();
+        bool history_is_render_locked() const;
 
         static TMainWindow* m_instance;
 	
@@ -249,6 +253,7 @@ private slots:
 	void follow_state_changed(bool state);
 	void update_follow_state();
 	void update_temp_follow_state(bool state);
+	void update_history_state();
         void track_finder_model_index_changed(const QModelIndex& index);
         void track_finder_return_pressed();
 
@@ -98,7 +98,7 @@ void ExportDialog::on_startButton_clicked( )
         progressBar->setValue(progress);
     });
     connect(cancelExportButton, &QPushButton::clicked, this, [=]() {
-        exportSpecification->cancel_export();
+        m_project->cancel_export();
     });
 
 	// clear extraformats, it might be different now from previous runs!
@@ -106,12 +106,12 @@ void ExportDialog::on_startButton_clicked( )
 	
     m_formatOptionsWidget->get_format_options(exportSpecification);
 	
+    // Each Sheet is exported to it's own file, see Project::export_sheets()
+    QList<Sheet*> sheets;
 	if (allSheetsButton->isChecked()) {
-        for (auto sheet : m_project->get_sheets()) {
-            exportSpecification->add_sheet_to_export(sheet);
-        }
+        sheets = m_project->get_sheets();
 	} else {
-        exportSpecification->add_sheet_to_export(m_project->get_active_sheet());
+        sheets.append(m_project->get_active_sheet());
     }
 
     QString exportDir = exportDirName->text();
@@ -126,7 +126,10 @@ void ExportDialog::on_startButton_clicked( )
 	name += fi.completeBaseName() + ".toc";
     exportSpecification->tocFileName = name;
 
-    m_project->export_project();
+    if (m_project->export_sheets(sheets) < 0) {
+        render_finished();
+        return;
+    }
 	
 	startButton->hide();
 	closeButton->hide();
@@ -952,6 +952,9 @@ void RecordingConfigPage::load_config()
         wavpackCompressionComboBox->setCurrentIndex(2);
     }
 
+    spoolRawFloatCheckBox->setChecked(config().get_property("Recording", "SpoolRawFloat", false).toBool());
+    transcodeOnImportCheckBox->setChecked(config().get_property("Import", "TranscodeCompressedSources", false).toBool());
+
     int index = config().get_property("Conversion", "RTResamplingConverterType", ResampleAudioReader::get_default_resample_quality()).toInt();
     ontheflyResampleComboBox->setCurrentIndex(index);
 
@@ -968,6 +971,8 @@ void RecordingConfigPage::save_config()
     config().set_property("Recording", "WavpackCompressionType", wavpackCompressionComboBox->itemData(wavpackCompressionComboBox->currentIndex()).toString());
     QString skipwvx = wavpackUseAlmostLosslessCheckBox->isChecked() ? "true" : "false";
     config().set_property("Recording", "WavpackSkipWVX", skipwvx);
+    config().set_property("Recording", "SpoolRawFloat", spoolRawFloatCheckBox->isChecked());
+    config().set_property("Import", "TranscodeCompressedSources", transcodeOnImportCheckBox->isChecked());
 }
 
 void RecordingConfigPage::reset_default_config()
@@ -978,6 +983,8 @@ void RecordingConfigPage::reset_default_config()
     config().set_property("Recording", "FileFormat", "wav");
     config().set_property("Recording", "WavpackCompressionType", "fast");
     config().set_property("Recording", "WavpackSkipWVX", "false");
+    config().set_property("Recording", "SpoolRawFloat", false);
+    config().set_property("Import", "TranscodeCompressedSources", false);
 
     load_config();
 }
@@ -79,6 +79,9 @@ SystemResources::SystemResources(QWidget * parent)
     m_dspCpuUsage = new SystemValueBar(this);
     m_diskReadCpuUsage = new SystemValueBar(this);
     m_diskWriteCpuUsage = new SystemValueBar(this);
+    m_writeThroughput = new QLabel(this);
+    m_writeThroughput->setToolTip(tr("Recording write speed and disk headroom"));
+    m_writeThroughput->setFocusPolicy(Qt::NoFocus);
     m_icon = new QPushButton();
 	m_icon->setIcon(find_pixmap(":/memorysmall"));
 	m_icon->setFlat(true);
@@ -137,6 +140,7 @@ SystemResources::SystemResources(QWidget * parent)
 
     lay->addWidget(m_writeBufferStatus);
     lay->addWidget(m_diskWriteCpuUsage);
+    lay->addWidget(m_writeThroughput);
 
     lay->addSpacing(12);
 
@@ -182,6 +186,12 @@ void SystemResources::update_status( )
         if (sheet->get_write_diskio()->get_cpu_time(time)) {
             m_diskWriteCpuUsage->set_value(time);
         }
+        float megaBytesPerSecond, headroom;
+        if (sheet->get_write_diskio()->get_write_throughput(megaBytesPerSecond, headroom)) {
+            m_writeThroughput->setText(QString("%1 MB/s (%2x)").arg(megaBytesPerSecond, 0, 'f', 1).arg(headroom, 0, 'f', 0));
+        } else {
+            m_writeThroughput->clear();
+        }
 	}
 
     m_readBufferStatus->set_value(bufReadStatus);
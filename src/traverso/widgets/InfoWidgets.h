@@ -75,6 +75,7 @@ private:
     SystemValueBar*	m_dspCpuUsage;
     SystemValueBar*	m_diskReadCpuUsage;
     SystemValueBar*	m_diskWriteCpuUsage;
+    QLabel*         m_writeThroughput;
     QPushButton*	m_icon;
     QLabel*         m_collectedNumber;
 
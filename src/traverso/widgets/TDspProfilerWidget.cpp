@@ -0,0 +1,296 @@
+/*
+Copyright (C) 2024 Remon Sijrier
+
+This file is part of Traverso
+
+Traverso is free software; you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation; either version 2 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program; if not, write to the Free Software
+Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA.
+
+*/
+
+#include "TDspProfilerWidget.h"
+
+#include "AudioClip.h"
+#include "AudioDevice.h"
+#include "AudioTrack.h"
+#include "FadeCurve.h"
+#include "Plugin.h"
+#include "PluginChain.h"
+#include "Project.h"
+#include "ProjectManager.h"
+#include "Sheet.h"
+#include "TBusTrack.h"
+
+#include <QDir>
+#include <QFile>
+#include <QFileDialog>
+#include <QHBoxLayout>
+#include <QHeaderView>
+#include <QPushButton>
+#include <QTextStream>
+#include <QTreeWidget>
+#include <QVBoxLayout>
+
+#include <algorithm>
+
+// Always put me below _all_ includes, this is needed
+// in case we run with memory leak detection enabled!
+#include "Debugger.h"
+
+/** \class TDspProfilerWidget
+ *	\brief Shows the TDspProfiler statistics, worst offenders first
+ *
+ *	The profiler only knows objects by their address, the names are looked up by
+ *	walking the Tracks, Clips and Plugins of the current Project. Objects that can't
+ *	be found anymore are shown as deleted. The worst case is also shown as a percentage
+ *	of the time available per audio cycle, anything near 100% will cause xruns.
+ */
+
+enum {
+    NAME_COLUMN,
+    TYPE_COLUMN,
+    CALLS_COLUMN,
+    AVERAGE_COLUMN,
+    MEDIAN_COLUMN,
+    PERCENTILE99_COLUMN,
+    WORST_COLUMN,
+    BUDGET_COLUMN,
+    COLUMN_COUNT
+};
+
+static qreal to_microseconds(trav_time_t nanoseconds)
+{
+    return qreal(nanoseconds) / 1000.0;
+}
+
+
+TDspProfilerWidget::TDspProfilerWidget(QWidget* parent)
+    : QWidget(parent)
+{
+    m_enableButton = new QPushButton(tr("Enable"), this);
+    m_enableButton->setCheckable(true);
+    m_enableButton->setChecked(TDspProfiler::is_enabled());
+    m_resetButton = new QPushButton(tr("Reset"), this);
+    m_saveButton = new QPushButton(tr("Save..."), this);
+
+    m_tree = new QTreeWidget(this);
+    m_tree->setRootIsDecorated(false);
+    m_tree->setColumnCount(COLUMN_COUNT);
+    m_tree->setHeaderLabels(QStringList() << tr("Name") << tr("Type") << tr("Calls")
+                            << tr("Average (µs)") << tr("Median (µs)") << tr("99% (µs)")
+                            << tr("Worst (µs)") << tr("Worst (% of cycle)"));
+    m_tree->header()->setSectionResizeMode(NAME_COLUMN, QHeaderView::Stretch);
+
+    auto buttonLayout = new QHBoxLayout;
+    buttonLayout->addWidget(m_enableButton);
+    buttonLayout->addWidget(m_resetButton);
+    buttonLayout->addStretch(1);
+    buttonLayout->addWidget(m_saveButton);
+
+    auto layout = new QVBoxLayout(this);
+    layout->setContentsMargins(0, 0, 0, 0);
+    layout->addLayout(buttonLayout);
+    layout->addWidget(m_tree);
+
+    connect(m_enableButton, SIGNAL(toggled(bool)), this, SLOT(set_profiling_enabled(bool)));
+    connect(m_resetButton, SIGNAL(clicked()), this, SLOT(reset()));
+    connect(m_saveButton, SIGNAL(clicked()), this, SLOT(save_to_file()));
+    connect(&m_updateTimer, SIGNAL(timeout()), this, SLOT(update_statistics()));
+
+    if (TDspProfiler::is_enabled()) {
+        m_updateTimer.start(1000);
+    }
+}
+
+TDspProfilerWidget::~TDspProfilerWidget()
+{
+    if (TDspProfiler::is_enabled()) {
+        dsp_profiler().set_enabled(false);
+    }
+}
+
+void TDspProfilerWidget::set_profiling_enabled(bool enabled)
+{
+    dsp_profiler().set_enabled(enabled);
+
+    if (enabled) {
+        m_updateTimer.start(1000);
+    } else {
+        m_updateTimer.stop();
+        update_statistics();
+    }
+}
+
+void TDspProfilerWidget::reset()
+{
+    dsp_profiler().reset();
+    m_statistics.clear();
+    m_tree->clear();
+}
+
+void TDspProfilerWidget::update_statistics()
+{
+    dsp_profiler().collect();
+
+    m_statistics = dsp_profiler().get_statistics();
+
+    std::sort(m_statistics.begin(), m_statistics.end(), [](const TDspProfiler::Statistics& a, const TDspProfiler::Statistics& b) {
+        return a.worst > b.worst;
+    });
+
+    QHash<const void*, QString> names = collect_object_names();
+
+    // Time available to process one buffer, in nanoseconds
+    qreal cycleBudget = 0;
+    uint sampleRate = audiodevice().get_sample_rate();
+    if (sampleRate) {
+        cycleBudget = qreal(audiodevice().get_buffer_size()) * 1000000000.0 / sampleRate;
+    }
+
+    m_tree->clear();
+
+    for (const auto& statistics : m_statistics) {
+        QString name;
+        if (statistics.category == TDspProfiler::MIXER) {
+            name = QString(static_cast<const char*>(statistics.object));
+        } else if (statistics.category == TDspProfiler::CYCLE) {
+            name = tr("Audio Cycle");
+        } else {
+            name = names.value(statistics.object, tr("(deleted)"));
+        }
+
+        auto item = new QTreeWidgetItem(m_tree);
+        item->setText(NAME_COLUMN, name);
+        item->setText(TYPE_COLUMN, TDspProfiler::category_name(statistics.category));
+        item->setText(CALLS_COLUMN, QString::number(statistics.count));
+        item->setText(AVERAGE_COLUMN, QString::number(to_microseconds(statistics.total / qMax(qint64(1), statistics.count)), 'f', 1));
+        item->setText(MEDIAN_COLUMN, QString::number(to_microseconds(statistics.median), 'f', 1));
+        item->setText(PERCENTILE99_COLUMN, QString::number(to_microseconds(statistics.percentile99), 'f', 1));
+        item->setText(WORST_COLUMN, QString::number(to_microseconds(statistics.worst), 'f', 1));
+        if (cycleBudget > 0) {
+            item->setText(BUDGET_COLUMN, QString::number(qreal(statistics.worst) * 100.0 / cycleBudget, 'f', 1));
+        }
+
+        for (int column = CALLS_COLUMN; column < COLUMN_COUNT; ++column) {
+            item->setTextAlignment(column, Qt::AlignRight | Qt::AlignVCenter);
+        }
+    }
+}
+
+void TDspProfilerWidget::save_to_file()
+{
+    Project* project = pm().get_project();
+    QString dir = project ? project->get_root_dir() : QDir::homePath();
+
+    QString fileName = QFileDialog::getSaveFileName(this, tr("Save DSP Load Statistics"), dir, tr("CSV File (*.csv)"));
+
+    if (fileName.isEmpty()) {
+        return;
+    }
+
+    QFile file(fileName);
+
+    if (!file.open(QIODevice::WriteOnly | QIODevice::Text)) {
+        PWARN(QString("TDspProfilerWidget: Could not open %1 for writing").arg(fileName));
+        return;
+    }
+
+    QTextStream out(&file);
+
+    QStringList header;
+    for (int column = 0; column < COLUMN_COUNT; ++column) {
+        header << m_tree->headerItem()->text(column);
+    }
+    out << header.join(",") << "\n";
+
+    for (int i = 0; i < m_tree->topLevelItemCount(); ++i) {
+        QTreeWidgetItem* item = m_tree->topLevelItem(i);
+        QStringList fields;
+        for (int column = 0; column < COLUMN_COUNT; ++column) {
+            QString text = item->text(column);
+            text.replace("\"", "\"\"");
+            fields << "\"" + text + "\"";
+        }
+        out << fields.join(",") << "\n";
+    }
+}
+
+QHash<const void*, QString> TDspProfilerWidget::collect_object_names()
+{
+    QHash<const void*, QString> names;
+
+    Project* project = pm().get_project();
+    if (!project) {
+        return names;
+    }
+
+    collect_session_object_names(project, names);
+
+    for (auto sheet : project->get_sheets()) {
+        collect_session_object_names(sheet, names);
+
+        for (auto track : sheet->get_audio_tracks()) {
+            for (auto clip : track->get_audioclips()) {
+                QString clipName = track->get_name() + " / " + clip->get_name();
+                names.insert(clip, clipName);
+                if (clip->get_fade_in()) {
+                    names.insert(clip->get_fade_in(), clipName + " / " + tr("Fade In"));
+                }
+                if (clip->get_fade_out()) {
+                    names.insert(clip->get_fade_out(), clipName + " / " + tr("Fade Out"));
+                }
+            }
+        }
+    }
+
+    return names;
+}
+
+void TDspProfilerWidget::collect_session_object_names(TSession* session, QHash<const void*, QString>& names)
+{
+    QList<TAudioProcessingNode*> nodes;
+
+    for (auto track : session->get_bus_tracks()) {
+        nodes.append(track);
+    }
+    if (session->get_master_out_bus_track()) {
+        nodes.append(session->get_master_out_bus_track());
+    }
+    if (auto sheet = qobject_cast<Sheet*>(session)) {
+        for (auto track : sheet->get_audio_tracks()) {
+            nodes.append(track);
+        }
+    }
+
+    for (auto node : nodes) {
+        names.insert(node, node->get_name());
+
+        PluginChain* chain = node->get_plugin_chain();
+        if (!chain) {
+            continue;
+        }
+
+        for (auto plugin : chain->get_plugins()) {
+            QString pluginName = node->get_name() + " / " + plugin->get_name();
+            names.insert(plugin, pluginName);
+            for (auto port : plugin->get_control_ports()) {
+                if (port->get_curve()) {
+                    names.insert(port->get_curve(), pluginName + " / " + port->get_description());
+                }
+            }
+        }
+    }
+}
+
+//eof
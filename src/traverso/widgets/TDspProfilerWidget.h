@@ -0,0 +1,63 @@
+/*
+Copyright (C) 2024 Remon Sijrier
+
+This file is part of Traverso
+
+Traverso is free software; you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation; either version 2 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program; if not, write to the Free Software
+Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA.
+
+*/
+
+#ifndef TDSPPROFILERWIDGET_H
+#define TDSPPROFILERWIDGET_H
+
+#include <QWidget>
+#include <QHash>
+#include <QTimer>
+
+#include "TDspProfiler.h"
+
+class TSession;
+class QPushButton;
+class QTreeWidget;
+
+class TDspProfilerWidget : public QWidget
+{
+    Q_OBJECT
+
+public:
+    TDspProfilerWidget(QWidget* parent);
+    ~TDspProfilerWidget();
+
+private:
+    QPushButton*    m_enableButton;
+    QPushButton*    m_resetButton;
+    QPushButton*    m_saveButton;
+    QTreeWidget*    m_tree;
+    QTimer          m_updateTimer;
+    QList<TDspProfiler::Statistics> m_statistics;
+
+    QHash<const void*, QString> collect_object_names();
+    void collect_session_object_names(TSession* session, QHash<const void*, QString>& names);
+
+private slots:
+    void set_profiling_enabled(bool enabled);
+    void reset();
+    void save_to_file();
+    void update_statistics();
+};
+
+#endif
+
+//eof